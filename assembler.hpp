@@ -3,8 +3,10 @@
 #include "printer.hpp"
 #include <cstdint>
 #include <vector>
+#include <string>
 #include <algorithm>
 #include <fstream>
+#include <filesystem>
 
 enum Register: std::uint8_t {
 	EAX,
@@ -37,9 +39,31 @@ constexpr Ptr PTR(Register r, std::uint32_t offset = 0) {
 class Assembler {
 	using Addr = std::uint32_t;
 	static constexpr Addr VADDR = 0x10000;
+	// the writable segment is not part of the file and is filled with zeros
+	static constexpr Addr DATA_VADDR = 0x8000000;
 	static constexpr Addr ELF_HEADER_SIZE = 52;
 	static constexpr Addr PROGRAM_HEADER_SIZE = 32;
 	std::vector<char> data;
+	std::uint32_t data_size = 0;
+public:
+	class Jump {
+		std::size_t position;
+	public:
+		constexpr Jump(std::size_t position): position(position) {}
+		void set_target(Assembler& assembler, std::size_t target) const {
+			assembler.write<std::uint32_t>(position, target - (position + 4));
+		}
+	};
+	// an absolute address in the code that is set once its target is known
+	class Address {
+		std::size_t position;
+	public:
+		constexpr Address(std::size_t position): position(position) {}
+		void set_target(Assembler& assembler, std::size_t target) const {
+			assembler.write<Addr>(position, VADDR + target);
+		}
+	};
+private:
 	template <class T> void write(T t) {
 		for (std::size_t i = 0; i < sizeof(T); ++i) {
 			data.push_back(t & 0xFF);
@@ -92,15 +116,13 @@ class Assembler {
 			write<std::uint32_t>(offset);
 		}
 	}
+	Jump jump_0F(std::uint8_t opcode) {
+		opcode_0F(opcode);
+		const std::size_t position = data.size();
+		write<std::uint32_t>(0);
+		return Jump(position);
+	}
 public:
-	class Jump {
-		std::size_t position;
-	public:
-		constexpr Jump(std::size_t position): position(position) {}
-		void set_target(Assembler& assembler, std::size_t target) const {
-			assembler.write<std::uint32_t>(position, target - (position + 4));
-		}
-	};
 	void write_elf_header() {
 		write<std::uint8_t>(0x7f);
 		write<std::uint8_t>('E');
@@ -118,13 +140,13 @@ public:
 		write<std::uint16_t>(2); // ET_EXEC
 		write<std::uint16_t>(3); // EM_386
 		write<std::uint32_t>(1);
-		write<Addr>(VADDR + ELF_HEADER_SIZE + PROGRAM_HEADER_SIZE); // entry point
+		write<Addr>(VADDR + ELF_HEADER_SIZE + 2 * PROGRAM_HEADER_SIZE); // entry point
 		write<Addr>(ELF_HEADER_SIZE); // program header position
 		write<Addr>(0); // section header position
 		write<std::uint32_t>(0); // flags
 		write<std::uint16_t>(ELF_HEADER_SIZE); // ELF header size
 		write<std::uint16_t>(PROGRAM_HEADER_SIZE); // program header size
-		write<std::uint16_t>(1); // number of program headers
+		write<std::uint16_t>(2); // number of program headers
 		write<std::uint16_t>(0); // section header size
 		write<std::uint16_t>(0); // number of section headers
 		write<std::uint16_t>(0);
@@ -139,18 +161,45 @@ public:
 		write<std::uint32_t>(5); // flags: PF_R|PF_X
 		write<std::uint32_t>(0); // align
 	}
+	void write_data_program_header() {
+		write<std::uint32_t>(1); // PT_LOAD
+		write<Addr>(0); // offset
+		write<Addr>(DATA_VADDR); // vaddr
+		write<Addr>(0); // paddr
+		write<std::uint32_t>(0); // filesz
+		write<std::uint32_t>(0); // memsz, will be set later
+		write<std::uint32_t>(6); // flags: PF_R|PF_W
+		write<std::uint32_t>(0x1000); // align
+	}
 	void write_headers() {
 		write_elf_header();
 		write_program_header();
+		write_data_program_header();
 	}
 	std::size_t get_position() const {
 		return data.size();
 	}
+	// reserves zeroed memory in the writable segment and returns its address
+	Addr reserve(std::uint32_t size) {
+		const Addr address = DATA_VADDR + data_size;
+		data_size += (size + 3) / 4 * 4;
+		return address;
+	}
+	// appends bytes that are not instructions, like string literals
+	void write_bytes(const std::string& bytes) {
+		data.insert(data.end(), bytes.begin(), bytes.end());
+	}
 	void write_file(const char* path) {
 		write<std::uint32_t>(68, data.size()); // filesz
 		write<std::uint32_t>(72, data.size()); // memsz
-		std::ofstream file(path);
-		file.write(data.data(), data.size());
+		write<std::uint32_t>(104, data_size); // memsz of the writable segment
+		{
+			std::ofstream file(path, std::ios::binary);
+			file.write(data.data(), data.size());
+		}
+		// the file is an executable
+		using std::filesystem::perms;
+		std::filesystem::permissions(path, perms::owner_exec | perms::group_exec | perms::others_exec, std::filesystem::perm_options::add);
 	}
 	void MOV(Register dst, Register src) {
 		opcode(0x8B);
@@ -173,10 +222,27 @@ public:
 		operand(0, dst);
 		write<std::uint32_t>(imm);
 	}
+	// dst = the address of a position in the code
+	Address MOV_ADDRESS(Register dst) {
+		opcode(0xB8 | dst);
+		const std::size_t position = data.size();
+		write<Addr>(0);
+		return Address(position);
+	}
+	// stores the low byte of src
+	void MOV8(Ptr dst, Register src) {
+		opcode(0x88);
+		operand(src, dst);
+	}
 	void MOVZX(Register dst, Register src) {
 		opcode_0F(0xB6);
 		operand(dst, src);
 	}
+	// loads a byte
+	void MOVZX(Register dst, Ptr src) {
+		opcode_0F(0xB6);
+		operand(dst, src);
+	}
 	void LEA(Register dst, Ptr src) {
 		opcode(0x8D);
 		operand(dst, src);
@@ -190,10 +256,63 @@ public:
 		operand(0, dst);
 		write<std::uint32_t>(value);
 	}
+	void ADD(Register dst, Ptr src) {
+		opcode(0x03);
+		operand(dst, src);
+	}
 	void SUB(Register dst, Register src) {
 		opcode(0x2B);
 		operand(dst, src);
 	}
+	void SUB(Register dst, std::uint32_t value) {
+		opcode(0x81);
+		operand(0x5, dst);
+		write<std::uint32_t>(value);
+	}
+	void SUB(Register dst, Ptr src) {
+		opcode(0x2B);
+		operand(dst, src);
+	}
+	void AND(Register dst, std::uint32_t value) {
+		opcode(0x81);
+		operand(0x4, dst);
+		write<std::uint32_t>(value);
+	}
+	void OR(Register dst, Register src) {
+		opcode(0x0B);
+		operand(dst, src);
+	}
+	void OR(Register dst, std::uint32_t value) {
+		opcode(0x81);
+		operand(0x1, dst);
+		write<std::uint32_t>(value);
+	}
+	void SHL(Register dst, std::uint8_t count) {
+		opcode(0xC1);
+		operand(0x4, dst);
+		write<std::uint8_t>(count);
+	}
+	// dst = dst << CL
+	void SHL(Register dst) {
+		opcode(0xD3);
+		operand(0x4, dst);
+	}
+	void SHR(Register dst, std::uint8_t count) {
+		opcode(0xC1);
+		operand(0x5, dst);
+		write<std::uint8_t>(count);
+	}
+	// dst = the index of the highest set bit of src
+	void BSR(Register dst, Register src) {
+		opcode_0F(0xBD);
+		operand(dst, src);
+	}
+	// dst = src * value
+	void IMUL(Register dst, Register src, std::uint32_t value) {
+		opcode(0x69);
+		operand(dst, src);
+		write<std::uint32_t>(value);
+	}
 	// EDX:EAX = EAX * r
 	void IMUL(Register r) {
 		opcode(0xF7);
@@ -216,6 +335,10 @@ public:
 		opcode(0x68);
 		write<std::uint32_t>(value);
 	}
+	void PUSH(Ptr p) {
+		opcode(0xFF);
+		operand(0x6, p);
+	}
 	void POP(Register r) {
 		opcode(0x58 | r);
 	}
@@ -228,6 +351,10 @@ public:
 		operand(0x7, r);
 		write<std::uint32_t>(value);
 	}
+	void CMP(Register r, Ptr p) {
+		opcode(0x3B);
+		operand(r, p);
+	}
 	void SETE(Register r) {
 		opcode_0F(0x94);
 		operand(0, r);
@@ -259,16 +386,35 @@ public:
 		return Jump(position);
 	}
 	Jump JE() {
-		opcode_0F(0x84);
-		const std::size_t position = data.size();
-		write<std::uint32_t>(0);
-		return Jump(position);
+		return jump_0F(0x84);
 	}
 	Jump JNE() {
-		opcode_0F(0x85);
-		const std::size_t position = data.size();
-		write<std::uint32_t>(0);
-		return Jump(position);
+		return jump_0F(0x85);
+	}
+	Jump JL() {
+		return jump_0F(0x8C);
+	}
+	Jump JLE() {
+		return jump_0F(0x8E);
+	}
+	Jump JG() {
+		return jump_0F(0x8F);
+	}
+	Jump JGE() {
+		return jump_0F(0x8D);
+	}
+	// unsigned comparisons
+	Jump JB() {
+		return jump_0F(0x82);
+	}
+	Jump JBE() {
+		return jump_0F(0x86);
+	}
+	Jump JA() {
+		return jump_0F(0x87);
+	}
+	Jump JAE() {
+		return jump_0F(0x83);
 	}
 	Jump CALL() {
 		opcode(0xE8);
@@ -283,6 +429,18 @@ public:
 		opcode(0xCD);
 		write<std::uint8_t>(x);
 	}
+	// copies ECX bytes from ESI to EDI
+	void REP_MOVSB() {
+		opcode(0xF3);
+		opcode(0xA4);
+	}
+	// the direction of REP_MOVSB
+	void STD() {
+		opcode(0xFD);
+	}
+	void CLD() {
+		opcode(0xFC);
+	}
 	template <class T> void comment(const T&) {}
 };
 
@@ -326,10 +484,18 @@ public:
 	public:
 		void set_target(TextAssembler&, std::size_t) const {}
 	};
+	class Address {
+	public:
+		void set_target(TextAssembler&, std::size_t) const {}
+	};
 	void write_headers() {}
 	std::size_t get_position() const {
 		return 0;
 	}
+	std::uint32_t reserve(std::uint32_t) {
+		return 0;
+	}
+	void write_bytes(const std::string&) {}
 	void write_file(const char*) {}
 	void MOV(Register dst, Register src) {
 		printer.println(format("  MOV %, %", print_register(dst), print_register(src)));
@@ -346,9 +512,19 @@ public:
 	void MOV(Ptr dst, std::uint32_t imm) {
 		printer.println(format("  MOV %, %", print_ptr(dst), print_number(imm)));
 	}
+	Address MOV_ADDRESS(Register dst) {
+		printer.println(format("  MOV %, ADDRESS", print_register(dst)));
+		return Address();
+	}
+	void MOV8(Ptr dst, Register src) {
+		printer.println(format("  MOV BYTE %, %", print_ptr(dst), print_register(src)));
+	}
 	void MOVZX(Register dst, Register src) {
 		printer.println(format("  MOVZX %, %", print_register(dst), print_register(src)));
 	}
+	void MOVZX(Register dst, Ptr src) {
+		printer.println(format("  MOVZX %, BYTE %", print_register(dst), print_ptr(src)));
+	}
 	void LEA(Register dst, Ptr src) {
 		printer.println(format("  LEA %, %", print_register(dst), print_ptr(src)));
 	}
@@ -358,9 +534,42 @@ public:
 	void ADD(Register dst, std::uint32_t value) {
 		printer.println(format("  ADD %, %", print_register(dst), print_number(value)));
 	}
+	void ADD(Register dst, Ptr src) {
+		printer.println(format("  ADD %, %", print_register(dst), print_ptr(src)));
+	}
 	void SUB(Register dst, Register src) {
 		printer.println(format("  SUB %, %", print_register(dst), print_register(src)));
 	}
+	void SUB(Register dst, std::uint32_t value) {
+		printer.println(format("  SUB %, %", print_register(dst), print_number(value)));
+	}
+	void SUB(Register dst, Ptr src) {
+		printer.println(format("  SUB %, %", print_register(dst), print_ptr(src)));
+	}
+	void AND(Register dst, std::uint32_t value) {
+		printer.println(format("  AND %, %", print_register(dst), print_number(value)));
+	}
+	void OR(Register dst, Register src) {
+		printer.println(format("  OR %, %", print_register(dst), print_register(src)));
+	}
+	void OR(Register dst, std::uint32_t value) {
+		printer.println(format("  OR %, %", print_register(dst), print_number(value)));
+	}
+	void SHL(Register dst, std::uint8_t count) {
+		printer.println(format("  SHL %, %", print_register(dst), print_number(count)));
+	}
+	void SHL(Register dst) {
+		printer.println(format("  SHL %, CL", print_register(dst)));
+	}
+	void SHR(Register dst, std::uint8_t count) {
+		printer.println(format("  SHR %, %", print_register(dst), print_number(count)));
+	}
+	void BSR(Register dst, Register src) {
+		printer.println(format("  BSR %, %", print_register(dst), print_register(src)));
+	}
+	void IMUL(Register dst, Register src, std::uint32_t value) {
+		printer.println(format("  IMUL %, %, %", print_register(dst), print_register(src), print_number(value)));
+	}
 	// EDX:EAX = EAX * r
 	void IMUL(Register r) {
 		printer.println(format("  IMUL %", print_register(r)));
@@ -380,6 +589,9 @@ public:
 	void PUSH(std::uint32_t value) {
 		printer.println(format("  PUSH %", print_number(value)));
 	}
+	void PUSH(Ptr p) {
+		printer.println(format("  PUSH %", print_ptr(p)));
+	}
 	void POP(Register r) {
 		printer.println(format("  POP %", print_register(r)));
 	}
@@ -389,6 +601,9 @@ public:
 	void CMP(Register r, std::uint32_t value) {
 		printer.println(format("  CMP %, %", print_register(r), print_number(value)));
 	}
+	void CMP(Register r, Ptr p) {
+		printer.println(format("  CMP %, %", print_register(r), print_ptr(p)));
+	}
 	void SETE(Register r) {
 		printer.println(format("  SETE %", print_register(r)));
 	}
@@ -419,6 +634,38 @@ public:
 		printer.println("  JNE");
 		return Jump();
 	}
+	Jump JL() {
+		printer.println("  JL");
+		return Jump();
+	}
+	Jump JLE() {
+		printer.println("  JLE");
+		return Jump();
+	}
+	Jump JG() {
+		printer.println("  JG");
+		return Jump();
+	}
+	Jump JGE() {
+		printer.println("  JGE");
+		return Jump();
+	}
+	Jump JB() {
+		printer.println("  JB");
+		return Jump();
+	}
+	Jump JBE() {
+		printer.println("  JBE");
+		return Jump();
+	}
+	Jump JA() {
+		printer.println("  JA");
+		return Jump();
+	}
+	Jump JAE() {
+		printer.println("  JAE");
+		return Jump();
+	}
 	Jump CALL() {
 		printer.println("  CALL");
 		return Jump();
@@ -429,6 +676,15 @@ public:
 	void INT(std::uint8_t x) {
 		printer.println(format("  INT %", print_number(x)));
 	}
+	void REP_MOVSB() {
+		printer.println("  REP MOVSB");
+	}
+	void STD() {
+		printer.println("  STD");
+	}
+	void CLD() {
+		printer.println("  CLD");
+	}
 	template <class T> void comment(const T& t) {
 		printer.println(format("  ; %", t));
 	}
@@ -0,0 +1,388 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <fstream>
+
+// LEB128 encoded integers and length prefixed vectors
+class WasmWriter {
+public:
+	static void write_byte(std::vector<char>& data, std::uint8_t byte) {
+		data.push_back(byte);
+	}
+	static void write_unsigned(std::vector<char>& data, std::uint32_t value) {
+		do {
+			std::uint8_t byte = value & 0x7F;
+			value >>= 7;
+			if (value != 0) {
+				byte |= 0x80;
+			}
+			data.push_back(byte);
+		} while (value != 0);
+	}
+	static void write_signed(std::vector<char>& data, std::int32_t value) {
+		while (true) {
+			const std::uint8_t byte = value & 0x7F;
+			value >>= 7;
+			if ((value == 0 && (byte & 0x40) == 0) || (value == -1 && (byte & 0x40) != 0)) {
+				data.push_back(byte);
+				return;
+			}
+			data.push_back(byte | 0x80);
+		}
+	}
+	static void write_bytes(std::vector<char>& data, const std::vector<char>& bytes) {
+		write_unsigned(data, bytes.size());
+		data.insert(data.end(), bytes.begin(), bytes.end());
+	}
+	static void write_name(std::vector<char>& data, const std::string& name) {
+		write_unsigned(data, name.size());
+		data.insert(data.end(), name.begin(), name.end());
+	}
+};
+
+// the instructions of a single function body, all values are i32
+class WasmAssembler {
+	std::vector<char> data;
+	void opcode(std::uint8_t opcode) {
+		WasmWriter::write_byte(data, opcode);
+	}
+	void memory_argument(std::uint32_t alignment, std::uint32_t offset) {
+		WasmWriter::write_unsigned(data, alignment);
+		WasmWriter::write_unsigned(data, offset);
+	}
+public:
+	const std::vector<char>& get_data() const {
+		return data;
+	}
+	void UNREACHABLE() {
+		opcode(0x00);
+	}
+	void BLOCK() {
+		opcode(0x02);
+		opcode(0x40);
+	}
+	void LOOP() {
+		opcode(0x03);
+		opcode(0x40);
+	}
+	void IF() {
+		opcode(0x04);
+		opcode(0x40);
+	}
+	void ELSE() {
+		opcode(0x05);
+	}
+	void END() {
+		opcode(0x0B);
+	}
+	void BR(std::uint32_t depth) {
+		opcode(0x0C);
+		WasmWriter::write_unsigned(data, depth);
+	}
+	void BR_IF(std::uint32_t depth) {
+		opcode(0x0D);
+		WasmWriter::write_unsigned(data, depth);
+	}
+	void BR_TABLE(const std::vector<std::uint32_t>& depths, std::uint32_t default_depth) {
+		opcode(0x0E);
+		WasmWriter::write_unsigned(data, depths.size());
+		for (std::uint32_t depth: depths) {
+			WasmWriter::write_unsigned(data, depth);
+		}
+		WasmWriter::write_unsigned(data, default_depth);
+	}
+	void RETURN() {
+		opcode(0x0F);
+	}
+	void CALL(std::uint32_t function) {
+		opcode(0x10);
+		WasmWriter::write_unsigned(data, function);
+	}
+	void DROP() {
+		opcode(0x1A);
+	}
+	void SELECT() {
+		opcode(0x1B);
+	}
+	void LOCAL_GET(std::uint32_t local) {
+		opcode(0x20);
+		WasmWriter::write_unsigned(data, local);
+	}
+	void LOCAL_SET(std::uint32_t local) {
+		opcode(0x21);
+		WasmWriter::write_unsigned(data, local);
+	}
+	void LOCAL_TEE(std::uint32_t local) {
+		opcode(0x22);
+		WasmWriter::write_unsigned(data, local);
+	}
+	void GLOBAL_GET(std::uint32_t global) {
+		opcode(0x23);
+		WasmWriter::write_unsigned(data, global);
+	}
+	void GLOBAL_SET(std::uint32_t global) {
+		opcode(0x24);
+		WasmWriter::write_unsigned(data, global);
+	}
+	void I32_LOAD(std::uint32_t offset = 0) {
+		opcode(0x28);
+		memory_argument(2, offset);
+	}
+	void I32_LOAD8_U(std::uint32_t offset = 0) {
+		opcode(0x2D);
+		memory_argument(0, offset);
+	}
+	void I32_STORE(std::uint32_t offset = 0) {
+		opcode(0x36);
+		memory_argument(2, offset);
+	}
+	void I32_STORE8(std::uint32_t offset = 0) {
+		opcode(0x3A);
+		memory_argument(0, offset);
+	}
+	void MEMORY_SIZE() {
+		opcode(0x3F);
+		opcode(0x00);
+	}
+	void MEMORY_GROW() {
+		opcode(0x40);
+		opcode(0x00);
+	}
+	void I32_CONST(std::int32_t value) {
+		opcode(0x41);
+		WasmWriter::write_signed(data, value);
+	}
+	void I32_EQZ() {
+		opcode(0x45);
+	}
+	void I32_EQ() {
+		opcode(0x46);
+	}
+	void I32_NE() {
+		opcode(0x47);
+	}
+	void I32_LT_S() {
+		opcode(0x48);
+	}
+	void I32_LT_U() {
+		opcode(0x49);
+	}
+	void I32_GT_S() {
+		opcode(0x4A);
+	}
+	void I32_GT_U() {
+		opcode(0x4B);
+	}
+	void I32_LE_S() {
+		opcode(0x4C);
+	}
+	void I32_LE_U() {
+		opcode(0x4D);
+	}
+	void I32_GE_S() {
+		opcode(0x4E);
+	}
+	void I32_GE_U() {
+		opcode(0x4F);
+	}
+	void I32_ADD() {
+		opcode(0x6A);
+	}
+	void I32_SUB() {
+		opcode(0x6B);
+	}
+	void I32_MUL() {
+		opcode(0x6C);
+	}
+	void I32_DIV_S() {
+		opcode(0x6D);
+	}
+	void I32_REM_S() {
+		opcode(0x6F);
+	}
+	void I32_AND() {
+		opcode(0x71);
+	}
+	void I32_OR() {
+		opcode(0x72);
+	}
+	void I32_SHL() {
+		opcode(0x74);
+	}
+	void I32_SHR_U() {
+		opcode(0x76);
+	}
+	// copies between overlapping ranges like memmove
+	void MEMORY_COPY() {
+		opcode(0xFC);
+		WasmWriter::write_unsigned(data, 10);
+		opcode(0x00);
+		opcode(0x00);
+	}
+};
+
+// a module with a single memory, mutable i32 globals and functions that take and return i32 values
+class WasmModule {
+	struct FunctionType {
+		std::uint32_t parameters;
+		std::uint32_t results;
+	};
+	struct Import {
+		std::string module;
+		std::string name;
+		std::uint32_t type;
+	};
+	struct Function {
+		std::uint32_t type;
+		std::uint32_t locals = 0;
+		std::vector<char> code;
+	};
+	struct Export {
+		std::string name;
+		std::uint8_t kind;
+		std::uint32_t index;
+	};
+	struct DataSegment {
+		std::uint32_t offset;
+		std::string bytes;
+	};
+	std::vector<FunctionType> types;
+	std::vector<Import> imports;
+	std::vector<Function> functions;
+	std::vector<std::int32_t> globals;
+	std::vector<Export> exports;
+	std::vector<DataSegment> data_segments;
+	std::uint32_t memory_pages = 1;
+	static void write_section(std::vector<char>& data, std::uint8_t id, const std::vector<char>& section) {
+		WasmWriter::write_byte(data, id);
+		WasmWriter::write_bytes(data, section);
+	}
+public:
+	static constexpr std::uint8_t EXPORT_FUNCTION = 0x00;
+	static constexpr std::uint8_t EXPORT_MEMORY = 0x02;
+	static constexpr std::uint32_t PAGE_SIZE = 0x10000;
+	std::uint32_t add_type(std::uint32_t parameters, std::uint32_t results) {
+		for (std::size_t i = 0; i < types.size(); ++i) {
+			if (types[i].parameters == parameters && types[i].results == results) {
+				return i;
+			}
+		}
+		types.push_back({parameters, results});
+		return types.size() - 1;
+	}
+	// imports have to be added before any function is declared
+	std::uint32_t add_import(const std::string& module, const std::string& name, std::uint32_t parameters, std::uint32_t results) {
+		imports.push_back({module, name, add_type(parameters, results)});
+		return imports.size() - 1;
+	}
+	// reserves the index of a function so that it can be called before it is defined
+	std::uint32_t declare_function(std::uint32_t parameters, std::uint32_t results) {
+		functions.emplace_back();
+		functions.back().type = add_type(parameters, results);
+		return imports.size() + functions.size() - 1;
+	}
+	void define_function(std::uint32_t index, std::uint32_t locals, const WasmAssembler& assembler) {
+		Function& function = functions[index - imports.size()];
+		function.locals = locals;
+		function.code = assembler.get_data();
+	}
+	std::uint32_t add_global(std::int32_t value) {
+		globals.push_back(value);
+		return globals.size() - 1;
+	}
+	void add_export(const std::string& name, std::uint8_t kind, std::uint32_t index) {
+		exports.push_back({name, kind, index});
+	}
+	void add_data(std::uint32_t offset, const std::string& bytes) {
+		data_segments.push_back({offset, bytes});
+	}
+	void set_memory_size(std::uint32_t size) {
+		memory_pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+	}
+	void write_file(const char* path) const {
+		std::vector<char> data = {'\0', 'a', 's', 'm', 0x01, 0x00, 0x00, 0x00};
+		std::vector<char> section;
+		WasmWriter::write_unsigned(section, types.size());
+		for (const FunctionType& type: types) {
+			WasmWriter::write_byte(section, 0x60);
+			WasmWriter::write_unsigned(section, type.parameters);
+			for (std::uint32_t i = 0; i < type.parameters; ++i) {
+				WasmWriter::write_byte(section, 0x7F);
+			}
+			WasmWriter::write_unsigned(section, type.results);
+			for (std::uint32_t i = 0; i < type.results; ++i) {
+				WasmWriter::write_byte(section, 0x7F);
+			}
+		}
+		write_section(data, 1, section);
+		section.clear();
+		WasmWriter::write_unsigned(section, imports.size());
+		for (const Import& import: imports) {
+			WasmWriter::write_name(section, import.module);
+			WasmWriter::write_name(section, import.name);
+			WasmWriter::write_byte(section, 0x00);
+			WasmWriter::write_unsigned(section, import.type);
+		}
+		write_section(data, 2, section);
+		section.clear();
+		WasmWriter::write_unsigned(section, functions.size());
+		for (const Function& function: functions) {
+			WasmWriter::write_unsigned(section, function.type);
+		}
+		write_section(data, 3, section);
+		section.clear();
+		WasmWriter::write_unsigned(section, 1);
+		WasmWriter::write_byte(section, 0x00);
+		WasmWriter::write_unsigned(section, memory_pages);
+		write_section(data, 5, section);
+		section.clear();
+		WasmWriter::write_unsigned(section, globals.size());
+		for (std::int32_t value: globals) {
+			WasmWriter::write_byte(section, 0x7F);
+			WasmWriter::write_byte(section, 0x01);
+			WasmWriter::write_byte(section, 0x41);
+			WasmWriter::write_signed(section, value);
+			WasmWriter::write_byte(section, 0x0B);
+		}
+		write_section(data, 6, section);
+		section.clear();
+		WasmWriter::write_unsigned(section, exports.size());
+		for (const Export& export_: exports) {
+			WasmWriter::write_name(section, export_.name);
+			WasmWriter::write_byte(section, export_.kind);
+			WasmWriter::write_unsigned(section, export_.index);
+		}
+		write_section(data, 7, section);
+		section.clear();
+		WasmWriter::write_unsigned(section, functions.size());
+		for (const Function& function: functions) {
+			std::vector<char> body;
+			if (function.locals > 0) {
+				WasmWriter::write_unsigned(body, 1);
+				WasmWriter::write_unsigned(body, function.locals);
+				WasmWriter::write_byte(body, 0x7F);
+			}
+			else {
+				WasmWriter::write_unsigned(body, 0);
+			}
+			body.insert(body.end(), function.code.begin(), function.code.end());
+			WasmWriter::write_byte(body, 0x0B);
+			WasmWriter::write_bytes(section, body);
+		}
+		write_section(data, 10, section);
+		section.clear();
+		WasmWriter::write_unsigned(section, data_segments.size());
+		for (const DataSegment& segment: data_segments) {
+			WasmWriter::write_byte(section, 0x00);
+			WasmWriter::write_byte(section, 0x41);
+			WasmWriter::write_signed(section, segment.offset);
+			WasmWriter::write_byte(section, 0x0B);
+			WasmWriter::write_name(section, segment.bytes);
+		}
+		write_section(data, 11, section);
+		std::ofstream file(path, std::ios::binary);
+		file.write(data.data(), data.size());
+	}
+};
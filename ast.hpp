@@ -3,10 +3,147 @@
 #include "printer.hpp"
 #include <cstdint>
 #include <vector>
-#include <set>
 #include <memory>
+#include <utility>
+#include <new>
+#include <type_traits>
+#include <algorithm>
 
 class Function;
+class Program;
+
+// a flat table indexed by the dense indices of expressions or functions
+template <class K, class V> class IndexTable {
+	std::vector<V> values;
+	std::size_t offset = 0;
+public:
+	using Iterator = typename std::vector<V>::const_iterator;
+	typename std::vector<V>::reference operator [](const K* key) {
+		const std::size_t index = key->get_index();
+		if (values.empty()) {
+			offset = index;
+		}
+		else if (index < offset) {
+			// grow towards lower indices geometrically as well
+			const std::size_t growth = std::max(offset - index, values.size());
+			const std::size_t new_offset = offset > growth ? offset - growth : 0;
+			values.insert(values.begin(), offset - new_offset, V());
+			offset = new_offset;
+		}
+		if (index - offset >= values.size()) {
+			values.resize(index - offset + 1);
+		}
+		return values[index - offset];
+	}
+	V get(const K* key) const {
+		const std::size_t index = key->get_index();
+		if (index < offset || index - offset >= values.size()) {
+			return V();
+		}
+		return values[index - offset];
+	}
+	Iterator begin() const {
+		return values.begin();
+	}
+	Iterator end() const {
+		return values.end();
+	}
+};
+
+class Arena {
+	static constexpr std::size_t CHUNK_SIZE = 64 * 1024;
+	struct Chunk {
+		Chunk* next;
+	};
+	struct Finalizer {
+		void (*finalize)(void*);
+		void* object;
+		Finalizer* next;
+	};
+	Chunk* chunks = nullptr;
+	char* position = nullptr;
+	char* end = nullptr;
+	Finalizer* finalizers = nullptr;
+	static constexpr std::uintptr_t align(std::uintptr_t address, std::size_t alignment) {
+		return (address + alignment - 1) & ~static_cast<std::uintptr_t>(alignment - 1);
+	}
+	void* allocate(std::size_t size, std::size_t alignment) {
+		std::uintptr_t address = align(reinterpret_cast<std::uintptr_t>(position), alignment);
+		if (position == nullptr || address + size > reinterpret_cast<std::uintptr_t>(end)) {
+			const std::size_t header_size = align(sizeof(Chunk), alignof(std::max_align_t));
+			const std::size_t chunk_size = std::max(CHUNK_SIZE, header_size + size + alignment);
+			Chunk* chunk = static_cast<Chunk*>(::operator new(chunk_size));
+			chunk->next = chunks;
+			chunks = chunk;
+			position = reinterpret_cast<char*>(chunk) + header_size;
+			end = reinterpret_cast<char*>(chunk) + chunk_size;
+			address = align(reinterpret_cast<std::uintptr_t>(position), alignment);
+		}
+		position = reinterpret_cast<char*>(address + size);
+		return reinterpret_cast<void*>(address);
+	}
+	void release() {
+		// run the destructors in reverse order of construction, then drop all chunks at once
+		while (finalizers) {
+			Finalizer* next = finalizers->next;
+			finalizers->finalize(finalizers->object);
+			finalizers = next;
+		}
+		while (chunks) {
+			Chunk* next = chunks->next;
+			::operator delete(chunks);
+			chunks = next;
+		}
+		position = nullptr;
+		end = nullptr;
+	}
+public:
+	Arena() = default;
+	Arena(const Arena&) = delete;
+	Arena(Arena&& arena): chunks(std::exchange(arena.chunks, nullptr)), position(std::exchange(arena.position, nullptr)), end(std::exchange(arena.end, nullptr)), finalizers(std::exchange(arena.finalizers, nullptr)) {}
+	~Arena() {
+		release();
+	}
+	Arena& operator =(const Arena&) = delete;
+	Arena& operator =(Arena&& arena) {
+		std::swap(chunks, arena.chunks);
+		std::swap(position, arena.position);
+		std::swap(end, arena.end);
+		std::swap(finalizers, arena.finalizers);
+		return *this;
+	}
+	template <class T, class... A> T* create(A&&... arguments) {
+		T* object = new (allocate(sizeof(T), alignof(T))) T(std::forward<A>(arguments)...);
+		if constexpr (!std::is_trivially_destructible_v<T>) {
+			Finalizer* finalizer = new (allocate(sizeof(Finalizer), alignof(Finalizer))) Finalizer();
+			finalizer->finalize = [](void* object) {
+				static_cast<T*>(object)->~T();
+			};
+			finalizer->object = object;
+			finalizer->next = finalizers;
+			finalizers = finalizer;
+		}
+		return object;
+	}
+};
+
+inline std::size_t hash_combine(std::size_t seed, std::size_t value) {
+	std::uint64_t hash = value;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+	return seed ^ static_cast<std::size_t>(hash + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+}
+
+inline std::size_t hash_pointer(const void* pointer) {
+	return hash_combine(0, reinterpret_cast<std::uintptr_t>(pointer));
+}
+
+template <class T> std::size_t hash_combine(std::size_t seed, const std::vector<T*>& pointers) {
+	for (const T* pointer: pointers) {
+		seed = hash_combine(seed, reinterpret_cast<std::uintptr_t>(pointer));
+	}
+	return hash_combine(seed, pointers.size());
+}
 
 enum class TypeId {
 	INT,
@@ -18,6 +155,8 @@ enum class TypeId {
 	ARRAY,
 	STRING,
 	STRING_ITERATOR,
+	STRING_BUILDER,
+	SLICE,
 	VOID,
 	REFERENCE,
 	TYPE
@@ -51,8 +190,11 @@ public:
 	TypeId get_id() const override {
 		return TypeId::CLOSURE;
 	}
-	bool operator <(const ClosureType& rhs) const {
-		return std::make_pair(function, std::ref(environment_types)) < std::make_pair(rhs.function, std::ref(rhs.environment_types));
+	bool operator ==(const ClosureType& rhs) const {
+		return function == rhs.function && environment_types == rhs.environment_types;
+	}
+	std::size_t get_hash() const {
+		return hash_combine(hash_pointer(function), environment_types);
 	}
 	void add_environment_type(const Type* type) {
 		environment_types.push_back(type);
@@ -137,8 +279,11 @@ public:
 	TypeId get_id() const override {
 		return TypeId::TUPLE;
 	}
-	bool operator <(const TupleType& rhs) const {
-		return element_types < rhs.element_types;
+	bool operator ==(const TupleType& rhs) const {
+		return element_types == rhs.element_types;
+	}
+	std::size_t get_hash() const {
+		return hash_combine(0, element_types);
 	}
 	void add_element_type(const Type* type) {
 		element_types.push_back(type);
@@ -155,8 +300,11 @@ public:
 	TypeId get_id() const override {
 		return TypeId::ARRAY;
 	}
-	bool operator <(const ArrayType& rhs) const {
-		return element_type < rhs.element_type;
+	bool operator ==(const ArrayType& rhs) const {
+		return element_type == rhs.element_type;
+	}
+	std::size_t get_hash() const {
+		return hash_pointer(element_type);
 	}
 	const Type* get_element_type() const {
 		return element_type;
@@ -177,6 +325,32 @@ public:
 	}
 };
 
+class StringBuilderType: public Type {
+public:
+	TypeId get_id() const override {
+		return TypeId::STRING_BUILDER;
+	}
+};
+
+// a view of a range of an array or a string
+class SliceType: public Type {
+	const Type* array_type;
+public:
+	SliceType(const Type* array_type): array_type(array_type) {}
+	TypeId get_id() const override {
+		return TypeId::SLICE;
+	}
+	bool operator ==(const SliceType& rhs) const {
+		return array_type == rhs.array_type;
+	}
+	std::size_t get_hash() const {
+		return hash_pointer(array_type);
+	}
+	const Type* get_array_type() const {
+		return array_type;
+	}
+};
+
 class VoidType: public Type {
 public:
 	TypeId get_id() const override {
@@ -191,8 +365,11 @@ public:
 	TypeId get_id() const override {
 		return TypeId::REFERENCE;
 	}
-	bool operator <(const ReferenceType& rhs) const {
-		return type < rhs.type;
+	bool operator ==(const ReferenceType& rhs) const {
+		return type == rhs.type;
+	}
+	std::size_t get_hash() const {
+		return hash_pointer(type);
 	}
 	const Type* get_type() const {
 		return type;
@@ -206,77 +383,101 @@ public:
 	TypeId get_id() const override {
 		return TypeId::TYPE;
 	}
-	bool operator <(const TypeType& rhs) const {
-		return type < rhs.type;
+	bool operator ==(const TypeType& rhs) const {
+		return type == rhs.type;
+	}
+	std::size_t get_hash() const {
+		return hash_pointer(type);
 	}
 	const Type* get_type() const {
 		return type;
 	}
 };
 
-template <class T> class TypePointer {
-	T* pointer;
-public:
-	TypePointer(T* pointer = nullptr): pointer(pointer) {}
-	TypePointer(const TypePointer&) = delete;
-	TypePointer(TypePointer&& type_pointer): pointer(std::exchange(type_pointer.pointer, nullptr)) {}
-	~TypePointer() {
-		if (pointer) {
-			delete pointer;
+// an open addressing hash set of interned types with cached hashes
+template <class T> class TypeSet {
+	struct Entry {
+		std::size_t hash;
+		T* type = nullptr;
+	};
+	std::vector<Entry> entries;
+	std::size_t size = 0;
+	void grow() {
+		std::vector<Entry> old_entries(std::max<std::size_t>(entries.size() * 2, 16));
+		std::swap(entries, old_entries);
+		const std::size_t mask = entries.size() - 1;
+		for (const Entry& entry: old_entries) {
+			if (entry.type) {
+				std::size_t i = entry.hash & mask;
+				while (entries[i].type) {
+					i = (i + 1) & mask;
+				}
+				entries[i] = entry;
+			}
 		}
 	}
-	TypePointer& operator =(const TypePointer&) = delete;
-	TypePointer& operator =(TypePointer&& type_pointer) {
-		std::swap(pointer, type_pointer.pointer);
-		return *this;
-	}
-	operator T*() const {
-		return pointer;
-	}
-};
-
-template <class T> class TypeCompare {
 public:
-	bool operator ()(const T* type1, const T* type2) const {
-		return *type1 < *type2;
+	T* get_or_insert(Arena& arena, const T* type) {
+		if ((size + 1) * 4 > entries.size() * 3) {
+			grow();
+		}
+		const std::size_t hash = type->get_hash();
+		const std::size_t mask = entries.size() - 1;
+		std::size_t i = hash & mask;
+		while (entries[i].type) {
+			if (entries[i].hash == hash && *entries[i].type == *type) {
+				return entries[i].type;
+			}
+			i = (i + 1) & mask;
+		}
+		entries[i].hash = hash;
+		entries[i].type = arena.create<T>(*type);
+		++size;
+		return entries[i].type;
+	}
+	std::size_t get_size() const {
+		return size;
 	}
-	using is_transparent = std::true_type;
 };
 
 class TypeInterner {
-	template <class T> using TypeSet = std::set<TypePointer<T>, TypeCompare<T>>;
-	template <class T> using TypeVector = std::vector<TypePointer<T>>;
-	static inline TypePointer<IntType> int_type;
-	static inline TypePointer<CharType> char_type;
+	// all types are allocated from a dedicated arena that lives until the end of the program
+	static inline Arena arena;
+	static inline IntType* int_type = nullptr;
+	static inline CharType* char_type = nullptr;
 	static inline TypeSet<ClosureType> closure_types;
-	static inline TypeVector<StructType> struct_types;
-	static inline TypeVector<EnumType> enum_types;
 	static inline TypeSet<TupleType> tuple_types;
 	static inline TypeSet<ArrayType> array_types;
-	static inline TypePointer<StringType> string_type;
-	static inline TypePointer<StringIteratorType> string_iterator_type;
-	static inline TypePointer<VoidType> void_type;
+	static inline StringType* string_type = nullptr;
+	static inline StringIteratorType* string_iterator_type = nullptr;
+	static inline StringBuilderType* string_builder_type = nullptr;
+	static inline TypeSet<SliceType> slice_types;
+	static inline VoidType* void_type = nullptr;
 	static inline TypeSet<ReferenceType> reference_types;
 	static inline TypeSet<TypeType> type_types;
-	template <class T> static T* get_or_set(TypePointer<T>& type) {
+	// the number of distinct types, reported with --time-passes
+	static inline std::size_t type_count = 0;
+	template <class T> static T* get_or_set(T*& type) {
 		if (type == nullptr) {
-			type = new T();
+			type = arena.create<T>();
+			++type_count;
 		}
 		return type;
 	}
 	template <class T> static T* get_or_insert(TypeSet<T>& types, const T* type) {
-		auto iterator = types.find(type);
-		if (iterator == types.end()) {
-			iterator = types.emplace(new T(*type)).first;
-		}
-		return *iterator;
+		const std::size_t size = types.get_size();
+		T* result = types.get_or_insert(arena, type);
+		type_count += types.get_size() - size;
+		return result;
 	}
-	template <class T> static T* create(TypeVector<T>& types) {
-		T* type = new T();
-		types.push_back(type);
-		return type;
+	template <class T> static T* create() {
+		++type_count;
+		return arena.create<T>();
 	}
 public:
+	static std::size_t get_type_count() {
+		return type_count;
+	}
 	static const Type* get_int_type() {
 		return get_or_set(int_type);
 	}
@@ -287,10 +488,10 @@ public:
 		return get_or_insert(closure_types, closure_type);
 	}
 	static StructType* create_struct_type() {
-		return create(struct_types);
+		return create<StructType>();
 	}
 	static EnumType* create_enum_type() {
-		return create(enum_types);
+		return create<EnumType>();
 	}
 	static const Type* intern(const TupleType* tuple_type) {
 		return get_or_insert(tuple_types, tuple_type);
@@ -305,6 +506,13 @@ public:
 	static const Type* get_string_iterator_type() {
 		return get_or_set(string_iterator_type);
 	}
+	static const Type* get_string_builder_type() {
+		return get_or_set(string_builder_type);
+	}
+	static const Type* get_slice_type(const Type* array_type) {
+		SliceType slice_type(array_type);
+		return get_or_insert(slice_types, &slice_type);
+	}
 	static const Type* get_void_type() {
 		return get_or_set(void_type);
 	}
@@ -441,7 +649,8 @@ public:
 
 class Expression {
 	const Type* type;
-	std::size_t position;
+	std::size_t position = 0;
+	std::size_t index = 0;
 public:
 	const Expression* next_expression = nullptr;
 	Expression(const Type* type = nullptr): type(type) {}
@@ -462,6 +671,12 @@ public:
 	std::size_t get_position() const {
 		return position;
 	}
+	void set_index(std::size_t index) {
+		this->index = index;
+	}
+	std::size_t get_index() const {
+		return index;
+	}
 };
 
 template <class T> T visit(Visitor<T>& visitor, const Expression* expression) {
@@ -586,14 +801,6 @@ public:
 	Block() = default;
 	Block(const Block&) = delete;
 	Block(Block&& block): first(std::exchange(block.first, nullptr)), last(std::exchange(block.last, nullptr)) {}
-	~Block() {
-		const Expression* expression = first;
-		while (expression) {
-			const Expression* next = expression->next_expression;
-			delete expression;
-			expression = next;
-		}
-	}
 	Block& operator =(const Block&) = delete;
 	Block& operator =(Block&& block) {
 		std::swap(first, block.first);
@@ -679,9 +886,7 @@ public:
 	const Expression* get_right() const {
 		return right;
 	}
-	template <BinaryOperation operation> static Expression* create(const Expression* left, const Expression* right) {
-		return new BinaryExpression(operation, left, right);
-	}
+	template <BinaryOperation operation> static Expression* create(Program* program, const Expression* left, const Expression* right);
 };
 
 class ArrayLiteral: public Expression {
@@ -858,10 +1063,14 @@ public:
 
 class Function {
 	std::string path;
+	// the position of the func keyword and the name of named functions
+	std::size_t position = 0;
+	std::string name;
 	Block block;
 	std::size_t arguments;
 	std::vector<const Type*> argument_types;
 	const Type* return_type;
+	std::size_t index = 0;
 public:
 	const Function* next_function = nullptr;
 	Function(const Type* return_type = nullptr): arguments(0), return_type(return_type) {}
@@ -893,6 +1102,30 @@ public:
 	const char* get_path() const {
 		return path.empty() ? nullptr : path.c_str();
 	}
+	void set_position(std::size_t position) {
+		this->position = position;
+	}
+	std::size_t get_position() const {
+		return position;
+	}
+	void set_name(const std::string& name) {
+		this->name = name;
+	}
+	const std::string& get_name() const {
+		return name;
+	}
+	// copies the source location from the function this function was created from
+	void set_source(const Function* function) {
+		path = function->path;
+		position = function->position;
+		name = function->name;
+	}
+	void set_index(std::size_t index) {
+		this->index = index;
+	}
+	std::size_t get_index() const {
+		return index;
+	}
 };
 
 class Closure: public Expression {
@@ -1015,6 +1248,8 @@ public:
 class Intrinsic: public Expression {
 	const char* name;
 	std::vector<const Expression*> arguments;
+	// the function that parallelMap and parallelReduce call for the elements
+	const Function* function = nullptr;
 public:
 	Intrinsic(const char* name, const Type* type = nullptr): Expression(type), name(name) {}
 	void accept(Visitor<void>& visitor) const override {
@@ -1032,6 +1267,12 @@ public:
 	const std::vector<const Expression*>& get_arguments() const {
 		return arguments;
 	}
+	void set_function(const Function* function) {
+		this->function = function;
+	}
+	const Function* get_function() const {
+		return function;
+	}
 };
 
 class VoidLiteral: public Expression {
@@ -1056,9 +1297,7 @@ public:
 	const Expression* get_right() const {
 		return right;
 	}
-	static Expression* create(const Expression* left, const Expression* right) {
-		return new Bind(left, right);
-	}
+	static Expression* create(Program* program, const Expression* left, const Expression* right);
 };
 
 class TypeLiteral: public Expression {
@@ -1161,27 +1400,44 @@ public:
 	}
 };
 
+// a program owns all of its functions and expressions through its arena
+// and numbers them densely in the order of their creation
 class Program {
+	Arena arena;
 	const Function* first = nullptr;
 	Function* last = nullptr;
+	std::size_t expressions = 0;
+	std::size_t functions = 0;
 public:
 	Program() = default;
 	Program(const Program&) = delete;
-	Program(Program&& program): first(std::exchange(program.first, nullptr)), last(std::exchange(program.last, nullptr)) {}
-	~Program() {
-		const Function* function = first;
-		while (function) {
-			const Function* next = function->next_function;
-			delete function;
-			function = next;
-		}
-	}
+	Program(Program&& program): arena(std::move(program.arena)), first(std::exchange(program.first, nullptr)), last(std::exchange(program.last, nullptr)), expressions(std::exchange(program.expressions, 0)), functions(std::exchange(program.functions, 0)) {}
 	Program& operator =(const Program&) = delete;
 	Program& operator =(Program&& program) {
+		std::swap(arena, program.arena);
 		std::swap(first, program.first);
 		std::swap(last, program.last);
+		std::swap(expressions, program.expressions);
+		std::swap(functions, program.functions);
 		return *this;
 	}
+	template <class T, class... A> T* create(A&&... arguments) {
+		T* expression = arena.create<T>(std::forward<A>(arguments)...);
+		expression->set_index(expressions++);
+		return expression;
+	}
+	template <class... A> Function* create_function(A&&... arguments) {
+		Function* function = arena.create<Function>(std::forward<A>(arguments)...);
+		function->set_index(functions++);
+		add_function(function);
+		return function;
+	}
+	std::size_t get_expressions() const {
+		return expressions;
+	}
+	std::size_t get_functions() const {
+		return functions;
+	}
 	void add_function(Function* function) {
 		if (first == nullptr) {
 			first = function;
@@ -1217,6 +1473,14 @@ public:
 	}
 };
 
+template <BinaryOperation operation> Expression* BinaryExpression::create(Program* program, const Expression* left, const Expression* right) {
+	return program->create<BinaryExpression>(operation, left, right);
+}
+
+inline Expression* Bind::create(Program* program, const Expression* left, const Expression* right) {
+	return program->create<Bind>(left, right);
+}
+
 class GetInt: public Visitor<const IntLiteral*> {
 public:
 	const IntLiteral* visit_int_literal(const IntLiteral& int_literal) override {
@@ -1311,6 +1575,15 @@ public:
 		case TypeId::STRING_ITERATOR:
 			p.print("StringIterator");
 			break;
+		case TypeId::STRING_BUILDER:
+			p.print("StringBuilder");
+			break;
+		case TypeId::SLICE:
+			{
+				const Type* array_type = static_cast<const SliceType*>(type)->get_array_type();
+				p.print(format("Slice(%)", PrintType(array_type)));
+				break;
+			}
 		case TypeId::VOID:
 			p.print("Void");
 			break;
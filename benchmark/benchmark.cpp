@@ -0,0 +1,513 @@
+#include "../printer.hpp"
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+// generates scaled workloads, compiles them with moebc for the C and JavaScript backends and runs the results
+// usage: moebius-benchmark <moebc> <source directory> <output directory> [scale]
+
+class Workload {
+public:
+	std::string name;
+	std::string source;
+	// additional files next to the source
+	std::vector<std::pair<std::string, std::string>> modules;
+	// the size is read from standard input so that the work is not evaluated at compile time
+	std::size_t size;
+};
+
+class Workloads {
+	static constexpr const char* prelude = R"(let std = @import("StandardLibrary.moeb")
+let Array = std.Array
+let Tuple = std.Tuple
+let length = std.length
+let get = std.get
+let set = std.set
+let push = std.push
+let toString = std.toString
+let putStrLn = std.putStrLn
+let print = std.print
+let readAll = std.readAll
+
+func parseInt(it, n): Int => {
+	let (next, found, codepoint) = @stringIteratorGetNext(it)
+	return if (found) if (codepoint >= 48) if (codepoint <= 57) parseInt(next, n * 10 + codepoint - 48) else n else n else n
+}
+let n = parseInt(@stringIterator(readAll()), 0)
+)";
+public:
+	// sorts an array of pseudo random numbers in place
+	static Workload quicksort(std::size_t scale) {
+		Workload workload;
+		workload.name = "quicksort";
+		workload.size = 20000 * scale;
+		workload.source = std::string(prelude) + R"(
+func swap(a, i, j) => {
+	let tmp = a.get(i)
+	let a = a.set(i, a.get(j))
+	return a.set(j, tmp)
+}
+
+func quicksort(a: Array(Int), lo: Int, hi: Int): Array(Int) =>
+	if (lo >= hi)
+		a
+	else {
+		func partition(a, lo, hi) => {
+			let pivot = a.get(hi - 1)
+			func loop(a, i, j): Tuple((Array(Int), Int)) =>
+				if (j < hi - 1)
+					if (a.get(j) <= pivot) loop(a.swap(i, j), i + 1, j + 1)
+					else loop(a, i, j + 1)
+				else
+					(a, i)
+			let (a, i) = loop(a, lo, lo)
+			let a = a.swap(i, hi - 1)
+			return (a, i)
+		}
+		let (a, p) = partition(a, lo, hi)
+		let a = quicksort(a, lo, p)
+		return quicksort(a, p + 1, hi)
+	}
+
+func random(seed) => (seed * 75 + 74) % 65537
+
+func fill(a, seed): Array(Int) =>
+	if (a.length() < n) fill(a.push(random(seed)), random(seed)) else a
+
+func checksum(a, i, sum): Int =>
+	if (i < a.length()) checksum(a, i + 1, (sum * 31 + a.get(i)) % 1000003) else sum
+
+let a = fill([42], 42)
+let a = quicksort(a, 0, a.length())
+return print(checksum(a, 0, 0))
+)";
+		return workload;
+	}
+	// builds a long string by pushing small strings
+	static Workload strings(std::size_t scale) {
+		Workload workload;
+		workload.name = "strings";
+		workload.size = 20000 * scale;
+		workload.source = std::string(prelude) + R"(
+func build(i, s): String =>
+	if (i < n) build(i + 1, s.push(toString(i)).push(", ")) else s
+
+return putStrLn(build(0, "["))
+)";
+		return workload;
+	}
+	// writes numbers into a string builder and parses them again through string slices
+	static Workload parsing(std::size_t scale) {
+		Workload workload;
+		workload.name = "parsing";
+		workload.size = 20000 * scale;
+		workload.source = std::string(prelude) + R"(
+let Slice = std.Slice
+func write(i, builder): StringBuilder =>
+	if (i < n) write(i + 1, builder.push(toString(i)).push(" ")) else builder
+
+func parseNumber(s, n): Tuple((Slice(String), Int)) => {
+	let (rest, found, codepoint) = @sliceGetNext(@slice(s))
+	return if (found) if (codepoint >= 48) if (codepoint <= 57) parseNumber(rest, n * 10 + codepoint - 48) else (rest, n) else (rest, n) else (rest, n)
+}
+func sum(s, total): Int =>
+	if (length(s) > 0) {
+		let (s, n) = parseNumber(s, 0)
+		return sum(s, total + n)
+	} else total
+
+let text = @stringBuilderToString(write(0, @stringBuilder()))
+return print(sum(@slice(text), 0))
+)";
+		return workload;
+	}
+	// maps an expensive function over an array and sums the results with the parallel intrinsics
+	static Workload parallel(std::size_t scale) {
+		Workload workload;
+		workload.name = "parallel";
+		workload.size = 20000 * scale;
+		workload.source = std::string(prelude) + R"(
+func range(a, i): Array(Int) =>
+	if (i < n) range(a.push(i), i + 1) else a
+
+func steps(x, count): Int =>
+	if (x <= 1) count else if (x % 2 == 0) steps(x / 2, count + 1) else steps(3 * x + 1, count + 1)
+
+let counts = std.parallelMap(range([1], 2), func(x) => steps(x, 0))
+return print(std.parallelReduce(counts, 0, func(a, b) => a + b))
+)";
+		return workload;
+	}
+	// builds and walks recursive enums
+	// the C backend only supports recursion through a reference to the enum itself, so the trees are chains
+	static Workload trees(std::size_t scale) {
+		Workload workload;
+		workload.name = "trees";
+		workload.size = 200 * scale;
+		workload.source = std::string(prelude) + R"(
+enum Tree {
+	Leaf: Int,
+	Node: @referenceType(Tree)
+}
+
+func build(depth, seed): Tree =>
+	if (depth == 0) Tree.Leaf(seed) else Tree.Node(@reference(build(depth - 1, seed + 1)))
+
+func height(tree): Int => switch (tree) {
+	Leaf: Leaf,
+	Node: 1 + height(Node)
+}
+
+func rounds(i, total): Int =>
+	if (i < n) rounds(i + 1, (total + height(build(1000, i))) % 1000003) else total
+
+return print(rounds(0, 0))
+)";
+		return workload;
+	}
+	// a pipeline of higher-order functions whose closures capture arrays and numbers
+	static Workload closures(std::size_t scale) {
+		Workload workload;
+		workload.name = "closures";
+		workload.size = 100000 * scale;
+		workload.source = std::string(prelude) + R"(
+func range(i, a): Array(Int) => if (i < n) range(i + 1, a.push(i)) else a
+func map(a, i, result, f): Array(Int) => if (i < a.length()) map(a, i + 1, result.push(f(a.get(i))), f) else result
+func fold(a, i, acc, f): Int => if (i < a.length()) fold(a, i + 1, f(acc, a.get(i)), f) else acc
+// the closure argument is called from an inner function
+func foldLoop(a, init, f) => {
+	func loop(i, acc): Int => if (i < a.length()) loop(i + 1, f(acc, a.get(i))) else acc
+	return loop(0, init)
+}
+
+let weights = [3, 5, 7]
+let offset = n % 100
+let a = range(1, [0])
+let a = map(a, 0, [0], func(x) => x * weights.get(x % 3) + offset)
+let sum = fold(a, 0, 0, func(acc, x) => (acc + x) % 1000003)
+return print(foldLoop(a, sum, func(acc, x) => (acc * 31 + x + offset) % 1000003))
+)";
+		return workload;
+	}
+	// a chain of modules where every module imports the next two
+	static Workload imports(std::size_t scale) {
+		Workload workload;
+		workload.name = "imports";
+		workload.size = 1000;
+		const std::size_t modules = 200 * scale;
+		for (std::size_t i = 0; i < modules; ++i) {
+			const std::string name = "Module" + std::to_string(i) + ".moeb";
+			std::string source;
+			if (i + 1 < modules) {
+				const std::string next = "Module" + std::to_string(i + 1) + ".moeb";
+				const std::string other = "Module" + std::to_string(std::min(i + 2, modules - 1)) + ".moeb";
+				source += "let next = @import(\"" + next + "\")\n";
+				source += "let other = @import(\"" + other + "\")\n";
+				source += "let nextF = next.f\n";
+				source += "let otherG = other.g\n";
+				source += "func f(x) => nextF(x + " + std::to_string(i) + ") % 1000003\n";
+				source += "func g(x) => (otherG(x) + " + std::to_string(i) + ") % 1000003\n";
+			}
+			else {
+				source += "func f(x) => x\n";
+				source += "func g(x) => x\n";
+			}
+			source += "return {\n\tf,\n\tg,\n}\n";
+			workload.modules.emplace_back(name, source);
+		}
+		workload.source = std::string(prelude) + R"(
+let module = @import("Module0.moeb")
+let f = module.f
+let g = module.g
+return print(f(n)) >> print(g(n))
+)";
+		return workload;
+	}
+};
+
+class Measurement {
+public:
+	bool success = false;
+	std::uint64_t microseconds = 0;
+	std::size_t peak_kilobytes = 0;
+};
+
+// a phase reported by moebc --time-passes
+class Phase {
+public:
+	std::string name;
+	std::uint64_t microseconds;
+};
+
+class Result {
+public:
+	std::string workload;
+	const char* backend;
+	Measurement compilation;
+	std::vector<Phase> phases;
+	Measurement run;
+	// only counted for the C backend
+	bool has_allocations = false;
+	std::uint64_t allocations = 0;
+	std::uint64_t bytes = 0;
+	bool output_matches = true;
+};
+
+class Benchmark {
+	std::string moebc;
+	std::filesystem::path source_directory;
+	std::filesystem::path output_directory;
+	bool has_node = false;
+	std::vector<Result> results;
+	static std::string read_file(const std::filesystem::path& path) {
+		SourceFile file(path.c_str());
+		return std::string(file.begin(), file.end());
+	}
+	static void write_file(const std::filesystem::path& path, const std::string& content) {
+		std::ofstream file(path);
+		file << content;
+	}
+	// runs a command with its standard streams redirected to files and measures its time and peak memory
+	static Measurement run(const std::vector<std::string>& arguments, const std::filesystem::path& input_path, const std::filesystem::path& output_path, const std::filesystem::path& log_path) {
+		Measurement measurement;
+		const auto start = std::chrono::steady_clock::now();
+		const pid_t pid = fork();
+		if (pid == -1) {
+			return measurement;
+		}
+		if (pid == 0) {
+			const int input = open(input_path.c_str(), O_RDONLY);
+			const int output = open(output_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			const int log = open(log_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			if (input == -1 || output == -1 || log == -1) {
+				_exit(127);
+			}
+			dup2(input, STDIN_FILENO);
+			dup2(output, STDOUT_FILENO);
+			dup2(log, STDERR_FILENO);
+			std::vector<char*> argv;
+			for (const std::string& argument: arguments) {
+				argv.push_back(const_cast<char*>(argument.c_str()));
+			}
+			argv.push_back(nullptr);
+			execvp(argv[0], argv.data());
+			_exit(127);
+		}
+		int status;
+		struct rusage usage;
+		if (wait4(pid, &status, 0, &usage) == -1) {
+			return measurement;
+		}
+		measurement.microseconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+		measurement.peak_kilobytes = usage.ru_maxrss;
+		measurement.success = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+		return measurement;
+	}
+	static std::vector<Phase> read_phases(const std::filesystem::path& path) {
+		std::vector<Phase> phases;
+		const std::string json = read_file(path);
+		const std::string name_key = "{\"name\": \"";
+		const std::string microseconds_key = "\"microseconds\": ";
+		for (std::size_t position = json.find(name_key); position != std::string::npos; position = json.find(name_key, position)) {
+			position += name_key.size();
+			const std::size_t name_end = json.find('"', position);
+			const std::size_t microseconds = json.find(microseconds_key, name_end);
+			if (name_end == std::string::npos || microseconds == std::string::npos) {
+				break;
+			}
+			phases.push_back({json.substr(position, name_end - position), std::strtoull(json.c_str() + microseconds + microseconds_key.size(), nullptr, 10)});
+		}
+		return phases;
+	}
+	// sums the type table of the report written by an executable compiled with -profile
+	static void read_allocations(const std::filesystem::path& path, Result& result) {
+		const std::string report = read_file(path);
+		std::size_t position = report.find("type allocations bytes name\n");
+		if (position == std::string::npos) {
+			return;
+		}
+		position = report.find('\n', position) + 1;
+		while (position < report.size()) {
+			const std::size_t line_end = report.find('\n', position);
+			char* end;
+			const std::uint64_t allocations = std::strtoull(report.c_str() + report.find(' ', position), &end, 10);
+			const std::uint64_t bytes = std::strtoull(end, nullptr, 10);
+			result.allocations += allocations;
+			result.bytes += bytes;
+			if (line_end == std::string::npos) {
+				break;
+			}
+			position = line_end + 1;
+		}
+		result.has_allocations = true;
+	}
+	void measure(const Workload& workload, const std::filesystem::path& directory, const char* backend) {
+		const std::filesystem::path source_path = directory / (workload.name + ".moeb");
+		const std::filesystem::path input_path = directory / "input";
+		const std::filesystem::path null_path = "/dev/null";
+		const bool is_c = StringView(backend) == "c";
+		const std::string prefix = (directory / backend).string();
+		const std::filesystem::path phases_path = prefix + ".phases.json";
+		Result result;
+		result.workload = workload.name;
+		result.backend = backend;
+		std::vector<std::string> compile_arguments = {moebc, "--time-passes=" + phases_path.string()};
+		if (!is_c) {
+			compile_arguments.push_back("-js");
+		}
+		compile_arguments.push_back(source_path.string());
+		result.compilation = run(compile_arguments, null_path, null_path, prefix + ".compile.log");
+		if (result.compilation.success) {
+			result.phases = read_phases(phases_path);
+			if (is_c) {
+				result.run = run({source_path.string() + ".exe"}, input_path, prefix + ".out", prefix + ".log");
+				// a second build with -profile counts the allocations without disturbing the timing of the first
+				if (run({moebc, "-profile", source_path.string()}, null_path, null_path, prefix + ".profile.log").success) {
+					if (run({source_path.string() + ".exe"}, input_path, null_path, null_path).success) {
+						read_allocations(source_path.string() + ".profile", result);
+					}
+				}
+			}
+			else {
+				result.run = run({"node", (source_directory / "benchmark" / "run_html.js").string(), source_path.string() + ".html"}, input_path, prefix + ".out", prefix + ".log");
+				result.output_matches = read_file(prefix + ".out") == read_file((directory / "c").string() + ".out");
+			}
+		}
+		results.push_back(result);
+	}
+	static auto print_milliseconds(std::uint64_t microseconds) {
+		return print_functor([microseconds](auto& printer) {
+			printer.print(std::to_string(microseconds / 1000) + "." + std::to_string(microseconds / 100 % 10));
+		});
+	}
+	static auto print_column(const std::string& s, std::size_t width) {
+		return print_functor([s, width](auto& printer) {
+			printer.print(s);
+			for (std::size_t i = s.size(); i < width; ++i) {
+				printer.print(' ');
+			}
+		});
+	}
+	static std::string to_string(const Measurement& measurement, std::uint64_t value) {
+		return measurement.success ? std::to_string(value) : "failed";
+	}
+	void print_table(const Printer& printer) const {
+		printer.print(print_column("workload", 12));
+		printer.print(print_column("backend", 9));
+		printer.print(print_column("compile ms", 12));
+		printer.print(print_column("run ms", 10));
+		printer.print(print_column("peak rss kb", 13));
+		printer.print(print_column("allocations", 13));
+		printer.print(print_column("bytes", 14));
+		printer.print("output\n");
+		for (const Result& result: results) {
+			printer.print(print_column(result.workload, 12));
+			printer.print(print_column(result.backend, 9));
+			printer.print(print_column(to_string(result.compilation, result.compilation.microseconds / 1000), 12));
+			printer.print(print_column(to_string(result.run, result.run.microseconds / 1000), 10));
+			printer.print(print_column(to_string(result.run, result.run.peak_kilobytes), 13));
+			printer.print(print_column(result.has_allocations ? std::to_string(result.allocations) : "-", 13));
+			printer.print(print_column(result.has_allocations ? std::to_string(result.bytes) : "-", 14));
+			printer.print(result.output_matches ? StringView("ok\n") : StringView("differs\n"));
+			// the phases of the compilation in the order in which they ran
+			printer.print("  ");
+			for (const Phase& phase: result.phases) {
+				printer.print(format(" %=%", phase.name, print_milliseconds(phase.microseconds)));
+			}
+			printer.print('\n');
+		}
+	}
+	static StringView print_bool(bool value) {
+		return value ? StringView("true") : StringView("false");
+	}
+	static void print_measurement(const Printer& printer, const Measurement& measurement) {
+		printer.print(format("{\"success\": %, \"microseconds\": %, \"peak_rss_kilobytes\": %}", print_bool(measurement.success), std::to_string(measurement.microseconds), std::to_string(measurement.peak_kilobytes)));
+	}
+	void print_json(const Printer& printer) const {
+		printer.print("[");
+		for (std::size_t i = 0; i < results.size(); ++i) {
+			const Result& result = results[i];
+			printer.print(i > 0 ? StringView(",\n") : StringView("\n"));
+			printer.print(format("\t{\"workload\": \"%\", \"backend\": \"%\", \"compile\": ", result.workload, result.backend));
+			print_measurement(printer, result.compilation);
+			printer.print(", \"phases\": [");
+			for (std::size_t j = 0; j < result.phases.size(); ++j) {
+				if (j > 0) {
+					printer.print(", ");
+				}
+				printer.print(format("{\"name\": \"%\", \"microseconds\": %}", result.phases[j].name, std::to_string(result.phases[j].microseconds)));
+			}
+			printer.print("], \"run\": ");
+			print_measurement(printer, result.run);
+			if (result.has_allocations) {
+				printer.print(format(", \"allocations\": %, \"bytes\": %", std::to_string(result.allocations), std::to_string(result.bytes)));
+			}
+			printer.print(format(", \"output_matches\": %}", print_bool(result.output_matches)));
+		}
+		printer.print("\n]\n");
+	}
+public:
+	Benchmark(const char* moebc, const char* source_directory, const char* output_directory): moebc(std::filesystem::absolute(moebc).string()), source_directory(std::filesystem::absolute(source_directory)), output_directory(std::filesystem::absolute(output_directory)) {
+		const std::filesystem::path null_path = "/dev/null";
+		has_node = run({"node", "--version"}, null_path, null_path, null_path).success;
+	}
+	void add(const Workload& workload) {
+		const std::filesystem::path directory = output_directory / workload.name;
+		std::filesystem::create_directories(directory);
+		std::filesystem::copy_file(source_directory / "examples" / "StandardLibrary.moeb", directory / "StandardLibrary.moeb", std::filesystem::copy_options::overwrite_existing);
+		write_file(directory / (workload.name + ".moeb"), workload.source);
+		for (const auto& module: workload.modules) {
+			write_file(directory / module.first, module.second);
+		}
+		write_file(directory / "input", std::to_string(workload.size) + "\n");
+		Printer status_printer(std::cerr);
+		status_printer.print(format("running %\n", workload.name));
+		measure(workload, directory, "c");
+		if (has_node) {
+			measure(workload, directory, "js");
+		}
+	}
+	void report() const {
+		print_table(Printer(std::cout));
+		const std::filesystem::path json_path = output_directory / "results.json";
+		std::ofstream file(json_path);
+		print_json(Printer(file));
+		std::cout << json_path.string() << '\n';
+		if (!has_node) {
+			std::cout << "node was not found, the JavaScript backend was skipped\n";
+		}
+	}
+	bool succeeded() const {
+		for (const Result& result: results) {
+			if (!result.compilation.success || !result.run.success || !result.output_matches) {
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
+int main(int argc, char** argv) {
+	if (argc < 4) {
+		print_error(Printer(std::cerr), "usage: moebius-benchmark <moebc> <source directory> <output directory> [scale]");
+		return EXIT_FAILURE;
+	}
+	const std::size_t scale = argc > 4 ? std::max<std::size_t>(std::strtoul(argv[4], nullptr, 10), 1) : 1;
+	Benchmark benchmark(argv[1], argv[2], argv[3]);
+	benchmark.add(Workloads::quicksort(scale));
+	benchmark.add(Workloads::strings(scale));
+	benchmark.add(Workloads::parsing(scale));
+	benchmark.add(Workloads::parallel(scale));
+	benchmark.add(Workloads::trees(scale));
+	benchmark.add(Workloads::closures(scale));
+	benchmark.add(Workloads::imports(scale));
+	benchmark.report();
+	return benchmark.succeeded() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,22 @@
+// runs a page generated by moebc -js in node with standard input and output
+const fs = require('fs');
+const html = fs.readFileSync(process.argv[2], 'utf8');
+const script = html.match(/<script>([\s\S]*)<\/script>/)[1];
+let output = '';
+const append = (node) => {
+	if (node.text !== undefined) output += node.text;
+};
+global.stdin = fs.readFileSync(0, 'utf8');
+global.window = {
+	addEventListener: (event, listener) => {
+		global.main = listener;
+	},
+};
+global.document = {
+	body: { appendChild: append },
+	createElement: (tag) => ({ appendChild: append }),
+	createTextNode: (text) => ({ text }),
+};
+(0, eval)(script);
+global.main();
+process.stdout.write(output);
@@ -0,0 +1,889 @@
+#pragma once
+
+#include "parser.hpp"
+#include "statistics.hpp"
+#include <cstdint>
+#include <string>
+#include <filesystem>
+#include <random>
+
+// a persistent cache of parsed files keyed by the hash of their content
+class ParseCache {
+	static constexpr std::uint64_t version = 4;
+	enum class Kind: std::uint8_t {
+		RETURN,
+		INT_LITERAL,
+		BINARY_EXPRESSION,
+		ARRAY_LITERAL,
+		STRING_LITERAL,
+		IF,
+		TUPLE_LITERAL,
+		TUPLE_ACCESS,
+		STRUCT_LITERAL,
+		STRUCT_ACCESS,
+		ENUM_LITERAL,
+		SWITCH,
+		CASE_VARIABLE,
+		CLOSURE,
+		CLOSURE_ACCESS,
+		ARGUMENT,
+		CLOSURE_CALL,
+		METHOD_CALL,
+		FUNCTION_CALL,
+		INTRINSIC,
+		VOID_LITERAL,
+		BIND,
+		TYPE_LITERAL,
+		STRUCT_TYPE_DECLARATION,
+		STRUCT_TYPE_DEFINITION,
+		ENUM_TYPE_DECLARATION,
+		ENUM_TYPE_DEFINITION,
+		TYPE_ASSERT,
+		RETURN_TYPE
+	};
+	// only the types the parser creates can be serialized
+	enum class TypeKind: std::uint8_t {
+		NONE,
+		INT,
+		CHAR,
+		STRING,
+		STRING_ITERATOR,
+		STRING_BUILDER,
+		VOID,
+		TYPE
+	};
+	static std::uint64_t hash(const char* begin, const char* end) {
+		std::uint64_t hash = 0xcbf29ce484222325;
+		for (const char* c = begin; c < end; ++c) {
+			hash = (hash ^ static_cast<unsigned char>(*c)) * 0x100000001b3;
+		}
+		return hash;
+	}
+	class Writer {
+		std::string data;
+	public:
+		bool failed = false;
+		void write_number(std::uint64_t n) {
+			while (n >= 0x80) {
+				data.push_back(static_cast<char>((n & 0x7F) | 0x80));
+				n >>= 7;
+			}
+			data.push_back(static_cast<char>(n));
+		}
+		void write_string(const std::string& s) {
+			write_number(s.size());
+			data.append(s);
+		}
+		void write_type(const Type* type) {
+			if (type == nullptr) {
+				write_number(static_cast<std::uint64_t>(TypeKind::NONE));
+				return;
+			}
+			switch (type->get_id()) {
+			case TypeId::INT:
+				write_number(static_cast<std::uint64_t>(TypeKind::INT));
+				return;
+			case TypeId::CHAR:
+				write_number(static_cast<std::uint64_t>(TypeKind::CHAR));
+				return;
+			case TypeId::STRING:
+				write_number(static_cast<std::uint64_t>(TypeKind::STRING));
+				return;
+			case TypeId::STRING_ITERATOR:
+				write_number(static_cast<std::uint64_t>(TypeKind::STRING_ITERATOR));
+				return;
+			case TypeId::STRING_BUILDER:
+				write_number(static_cast<std::uint64_t>(TypeKind::STRING_BUILDER));
+				return;
+			case TypeId::VOID:
+				write_number(static_cast<std::uint64_t>(TypeKind::VOID));
+				return;
+			case TypeId::TYPE:
+				write_number(static_cast<std::uint64_t>(TypeKind::TYPE));
+				write_type(static_cast<const TypeType*>(type)->get_type());
+				return;
+			default:
+				failed = true;
+				return;
+			}
+		}
+		const std::string& get_data() const {
+			return data;
+		}
+	};
+	class Reader {
+		const char* position;
+		const char* end;
+	public:
+		bool failed = false;
+		Reader(const char* position, const char* end): position(position), end(end) {}
+		const char* get_position() const {
+			return position;
+		}
+		std::uint64_t read_number() {
+			std::uint64_t n = 0;
+			for (unsigned int shift = 0; shift < 64; shift += 7) {
+				if (position == end) {
+					failed = true;
+					return 0;
+				}
+				const unsigned char c = *position++;
+				n |= static_cast<std::uint64_t>(c & 0x7F) << shift;
+				if ((c & 0x80) == 0) {
+					return n;
+				}
+			}
+			failed = true;
+			return 0;
+		}
+		std::string read_string() {
+			const std::uint64_t size = read_number();
+			if (size > static_cast<std::uint64_t>(end - position)) {
+				failed = true;
+				return std::string();
+			}
+			std::string s(position, size);
+			position += size;
+			return s;
+		}
+		const Type* read_type() {
+			switch (static_cast<TypeKind>(read_number())) {
+			case TypeKind::NONE:
+				return nullptr;
+			case TypeKind::INT:
+				return TypeInterner::get_int_type();
+			case TypeKind::CHAR:
+				return TypeInterner::get_char_type();
+			case TypeKind::STRING:
+				return TypeInterner::get_string_type();
+			case TypeKind::STRING_ITERATOR:
+				return TypeInterner::get_string_iterator_type();
+			case TypeKind::STRING_BUILDER:
+				return TypeInterner::get_string_builder_type();
+			case TypeKind::VOID:
+				return TypeInterner::get_void_type();
+			case TypeKind::TYPE:
+				if (const Type* type = read_type()) {
+					return TypeInterner::get_type_type(type);
+				}
+				failed = true;
+				return nullptr;
+			default:
+				failed = true;
+				return nullptr;
+			}
+		}
+		bool at_end() const {
+			return position == end;
+		}
+	};
+
+	// collects the functions and expressions of a parsed file in the order of their creation
+	class Collector: public Visitor<void> {
+		std::vector<const Function*>& functions;
+		std::vector<const Expression*>& expressions;
+		IndexTable<Function, bool> visited;
+		void add_function(const Function* function) {
+			if (function && !visited[function]) {
+				visited[function] = true;
+				functions.push_back(function);
+			}
+		}
+		void add_block(const Block& block) {
+			for (const Expression* expression: block) {
+				expressions.push_back(expression);
+				visit(*this, expression);
+			}
+		}
+	public:
+		Collector(std::vector<const Function*>& functions, std::vector<const Expression*>& expressions): functions(functions), expressions(expressions) {}
+		void visit_if(const If& if_) override {
+			add_block(if_.get_then_block());
+			add_block(if_.get_else_block());
+		}
+		void visit_switch(const Switch& switch_) override {
+			for (const auto& case_: switch_.get_cases()) {
+				add_block(case_.second);
+			}
+		}
+		void visit_closure(const Closure& closure) override {
+			add_function(closure.get_function());
+		}
+		void visit_function_call(const FunctionCall& call) override {
+			add_function(call.get_function());
+		}
+		static void collect(const Function* main_function, std::vector<const Function*>& functions, std::vector<const Expression*>& expressions) {
+			Collector collector(functions, expressions);
+			collector.add_function(main_function);
+			for (std::size_t i = 0; i < functions.size(); ++i) {
+				collector.add_block(functions[i]->get_block());
+			}
+			auto by_index = [](auto* lhs, auto* rhs) {
+				return lhs->get_index() < rhs->get_index();
+			};
+			std::sort(functions.begin(), functions.end(), by_index);
+			std::sort(expressions.begin(), expressions.end(), by_index);
+		}
+	};
+
+	// writes the constructor arguments of an expression, which were created before it
+	class RecordWriter: public Visitor<void> {
+		Writer& writer;
+		const IndexTable<Function, std::size_t>& function_ids;
+		const IndexTable<Expression, std::size_t>& expression_ids;
+		std::size_t current_id;
+		void write_kind(Kind kind) {
+			writer.write_number(static_cast<std::uint64_t>(kind));
+		}
+		void write_expression(const Expression* expression) {
+			const std::size_t id = expression ? expression_ids.get(expression) : 0;
+			if (expression && (id == 0 || id >= current_id)) {
+				writer.failed = true;
+			}
+			writer.write_number(id);
+		}
+		void write_function(const Function* function) {
+			const std::size_t id = function ? function_ids.get(function) : 0;
+			if (function && id == 0) {
+				writer.failed = true;
+			}
+			writer.write_number(id);
+		}
+	public:
+		RecordWriter(Writer& writer, const IndexTable<Function, std::size_t>& function_ids, const IndexTable<Expression, std::size_t>& expression_ids, std::size_t current_id): writer(writer), function_ids(function_ids), expression_ids(expression_ids), current_id(current_id) {}
+		void visit_return(const Return& return_) override {
+			write_kind(Kind::RETURN);
+			write_expression(return_.get_expression());
+		}
+		void visit_int_literal(const IntLiteral& int_literal) override {
+			write_kind(Kind::INT_LITERAL);
+			writer.write_number(static_cast<std::uint32_t>(int_literal.get_value()));
+		}
+		void visit_binary_expression(const BinaryExpression& binary_expression) override {
+			write_kind(Kind::BINARY_EXPRESSION);
+			writer.write_number(static_cast<std::uint64_t>(binary_expression.get_operation()));
+			write_expression(binary_expression.get_left());
+			write_expression(binary_expression.get_right());
+		}
+		void visit_array_literal(const ArrayLiteral& array_literal) override {
+			write_kind(Kind::ARRAY_LITERAL);
+		}
+		void visit_string_literal(const StringLiteral& string_literal) override {
+			write_kind(Kind::STRING_LITERAL);
+			writer.write_string(string_literal.get_value());
+		}
+		void visit_if(const If& if_) override {
+			write_kind(Kind::IF);
+			write_expression(if_.get_condition());
+		}
+		void visit_tuple_literal(const TupleLiteral& tuple_literal) override {
+			write_kind(Kind::TUPLE_LITERAL);
+		}
+		void visit_tuple_access(const TupleAccess& tuple_access) override {
+			write_kind(Kind::TUPLE_ACCESS);
+			write_expression(tuple_access.get_tuple());
+			writer.write_number(tuple_access.get_index());
+		}
+		void visit_struct_literal(const StructLiteral& struct_literal) override {
+			write_kind(Kind::STRUCT_LITERAL);
+			write_expression(struct_literal.get_type_expression());
+		}
+		void visit_struct_access(const StructAccess& struct_access) override {
+			write_kind(Kind::STRUCT_ACCESS);
+			write_expression(struct_access.get_struct());
+			writer.write_string(struct_access.get_field_name());
+		}
+		void visit_enum_literal(const EnumLiteral& enum_literal) override {
+			write_kind(Kind::ENUM_LITERAL);
+			write_expression(enum_literal.get_expression());
+			writer.write_number(enum_literal.get_index());
+		}
+		void visit_switch(const Switch& switch_) override {
+			write_kind(Kind::SWITCH);
+			write_expression(switch_.get_enum());
+		}
+		void visit_case_variable(const CaseVariable& case_variable) override {
+			write_kind(Kind::CASE_VARIABLE);
+		}
+		void visit_closure(const Closure& closure) override {
+			write_kind(Kind::CLOSURE);
+			write_function(closure.get_function());
+		}
+		void visit_closure_access(const ClosureAccess& closure_access) override {
+			write_kind(Kind::CLOSURE_ACCESS);
+			write_expression(closure_access.get_closure());
+			writer.write_number(closure_access.get_index());
+		}
+		void visit_argument(const Argument& argument) override {
+			write_kind(Kind::ARGUMENT);
+			writer.write_number(argument.get_index());
+		}
+		void visit_closure_call(const ClosureCall& closure_call) override {
+			write_kind(Kind::CLOSURE_CALL);
+			write_expression(closure_call.get_closure());
+		}
+		void visit_method_call(const MethodCall& method_call) override {
+			write_kind(Kind::METHOD_CALL);
+			write_expression(method_call.get_object());
+			writer.write_string(method_call.get_method_name());
+			write_expression(method_call.get_method());
+		}
+		void visit_function_call(const FunctionCall& call) override {
+			write_kind(Kind::FUNCTION_CALL);
+			write_function(call.get_function());
+		}
+		void visit_intrinsic(const Intrinsic& intrinsic) override {
+			write_kind(Kind::INTRINSIC);
+			writer.write_string(intrinsic.get_name());
+		}
+		void visit_void_literal(const VoidLiteral& void_literal) override {
+			write_kind(Kind::VOID_LITERAL);
+		}
+		void visit_bind(const Bind& bind) override {
+			write_kind(Kind::BIND);
+			write_expression(bind.get_left());
+			write_expression(bind.get_right());
+		}
+		void visit_type_literal(const TypeLiteral& type_literal) override {
+			write_kind(Kind::TYPE_LITERAL);
+			writer.write_type(static_cast<const TypeType*>(type_literal.get_type())->get_type());
+		}
+		void visit_struct_type_declaration(const StructTypeDeclaration& struct_type_declaration) override {
+			write_kind(Kind::STRUCT_TYPE_DECLARATION);
+			if (struct_type_declaration.get_struct_type()) {
+				writer.failed = true;
+			}
+		}
+		void visit_struct_type_definition(const StructTypeDefinition& struct_type_definition) override {
+			write_kind(Kind::STRUCT_TYPE_DEFINITION);
+			write_expression(struct_type_definition.get_declaration());
+		}
+		void visit_enum_type_declaration(const EnumTypeDeclaration& enum_type_declaration) override {
+			write_kind(Kind::ENUM_TYPE_DECLARATION);
+			if (enum_type_declaration.get_enum_type()) {
+				writer.failed = true;
+			}
+		}
+		void visit_enum_type_definition(const EnumTypeDefinition& enum_type_definition) override {
+			write_kind(Kind::ENUM_TYPE_DEFINITION);
+			write_expression(enum_type_definition.get_declaration());
+		}
+		void visit_type_assert(const TypeAssert& type_assert) override {
+			write_kind(Kind::TYPE_ASSERT);
+			write_expression(type_assert.get_expression());
+			write_expression(type_assert.get_type());
+		}
+		void visit_return_type(const ReturnType& return_type) override {
+			write_kind(Kind::RETURN_TYPE);
+			write_expression(return_type.get_type());
+		}
+		static void write(Writer& writer, const IndexTable<Function, std::size_t>& function_ids, const IndexTable<Expression, std::size_t>& expression_ids, const Expression* expression) {
+			RecordWriter record_writer(writer, function_ids, expression_ids, expression_ids.get(expression));
+			visit(record_writer, expression);
+			writer.write_number(expression->get_position());
+			writer.write_type(expression->get_type());
+		}
+	};
+
+	// writes everything that is added to an expression after its creation
+	class ContentWriter: public Visitor<void> {
+		Writer& writer;
+		const IndexTable<Expression, std::size_t>& expression_ids;
+		void write_expressions(const std::vector<const Expression*>& expressions) {
+			writer.write_number(expressions.size());
+			for (const Expression* expression: expressions) {
+				const std::size_t id = expression_ids.get(expression);
+				if (id == 0) {
+					writer.failed = true;
+				}
+				writer.write_number(id);
+			}
+		}
+		void write_fields(const std::vector<std::pair<std::string, const Expression*>>& fields) {
+			writer.write_number(fields.size());
+			for (const auto& field: fields) {
+				writer.write_string(field.first);
+				const std::size_t id = expression_ids.get(field.second);
+				if (id == 0) {
+					writer.failed = true;
+				}
+				writer.write_number(id);
+			}
+		}
+	public:
+		ContentWriter(Writer& writer, const IndexTable<Expression, std::size_t>& expression_ids): writer(writer), expression_ids(expression_ids) {}
+		void write_block(const Block& block) {
+			std::vector<const Expression*> expressions;
+			for (const Expression* expression: block) {
+				expressions.push_back(expression);
+			}
+			write_expressions(expressions);
+		}
+		void visit_array_literal(const ArrayLiteral& array_literal) override {
+			write_expressions(array_literal.get_elements());
+		}
+		void visit_if(const If& if_) override {
+			write_block(if_.get_then_block());
+			write_block(if_.get_else_block());
+		}
+		void visit_tuple_literal(const TupleLiteral& tuple_literal) override {
+			write_expressions(tuple_literal.get_elements());
+		}
+		void visit_struct_literal(const StructLiteral& struct_literal) override {
+			write_fields(struct_literal.get_fields());
+		}
+		void visit_switch(const Switch& switch_) override {
+			writer.write_number(switch_.get_cases().size());
+			for (const auto& case_: switch_.get_cases()) {
+				writer.write_string(case_.first);
+				write_block(case_.second);
+			}
+		}
+		void visit_closure(const Closure& closure) override {
+			write_expressions(closure.get_environment_expressions());
+		}
+		void visit_closure_call(const ClosureCall& closure_call) override {
+			write_expressions(closure_call.get_arguments());
+		}
+		void visit_method_call(const MethodCall& method_call) override {
+			write_expressions(method_call.get_arguments());
+		}
+		void visit_function_call(const FunctionCall& call) override {
+			write_expressions(call.get_arguments());
+		}
+		void visit_intrinsic(const Intrinsic& intrinsic) override {
+			write_expressions(intrinsic.get_arguments());
+		}
+		void visit_struct_type_definition(const StructTypeDefinition& struct_type_definition) override {
+			write_fields(struct_type_definition.get_fields());
+		}
+		void visit_enum_type_definition(const EnumTypeDefinition& enum_type_definition) override {
+			write_fields(enum_type_definition.get_cases());
+		}
+	};
+
+	class Deserializer {
+		Reader& reader;
+		Program* program;
+		const char* path;
+		std::vector<Function*> functions;
+		std::vector<Expression*> expressions;
+		std::vector<Kind> kinds;
+		Function* read_function() {
+			const std::uint64_t id = reader.read_number();
+			if (id == 0 || id > functions.size()) {
+				reader.failed = true;
+				return nullptr;
+			}
+			return functions[id - 1];
+		}
+		Expression* read_expression(bool nullable = false) {
+			const std::uint64_t id = reader.read_number();
+			if (id == 0 && nullable) {
+				return nullptr;
+			}
+			if (id == 0 || id > expressions.size()) {
+				reader.failed = true;
+				return nullptr;
+			}
+			return expressions[id - 1];
+		}
+		Expression* read_expression(Kind kind) {
+			const std::uint64_t id = reader.read_number();
+			if (id == 0 || id > expressions.size() || kinds[id - 1] != kind) {
+				reader.failed = true;
+				return nullptr;
+			}
+			return expressions[id - 1];
+		}
+		static const char* look_up_intrinsic(const std::string& name) {
+			for (const char* intrinsic: intrinsics) {
+				if (StringView(intrinsic) == StringView(name.c_str())) {
+					return intrinsic;
+				}
+			}
+			return nullptr;
+		}
+		Expression* read_record(Kind kind) {
+			switch (kind) {
+			case Kind::RETURN:
+				return program->create<Return>(read_expression());
+			case Kind::INT_LITERAL:
+				return program->create<IntLiteral>(static_cast<std::int32_t>(reader.read_number()));
+			case Kind::BINARY_EXPRESSION:
+				{
+					const BinaryOperation operation = static_cast<BinaryOperation>(reader.read_number());
+					const Expression* left = read_expression();
+					const Expression* right = read_expression();
+					return program->create<BinaryExpression>(operation, left, right);
+				}
+			case Kind::ARRAY_LITERAL:
+				return program->create<ArrayLiteral>();
+			case Kind::STRING_LITERAL:
+				return program->create<StringLiteral>(reader.read_string());
+			case Kind::IF:
+				return program->create<If>(read_expression());
+			case Kind::TUPLE_LITERAL:
+				return program->create<TupleLiteral>();
+			case Kind::TUPLE_ACCESS:
+				{
+					const Expression* tuple = read_expression();
+					const std::size_t index = reader.read_number();
+					return program->create<TupleAccess>(tuple, index);
+				}
+			case Kind::STRUCT_LITERAL:
+				if (const Expression* type_expression = read_expression(true)) {
+					return program->create<StructLiteral>(type_expression);
+				}
+				return program->create<StructLiteral>();
+			case Kind::STRUCT_ACCESS:
+				{
+					const Expression* struct_ = read_expression();
+					const std::string field_name = reader.read_string();
+					return program->create<StructAccess>(struct_, field_name);
+				}
+			case Kind::ENUM_LITERAL:
+				{
+					const Expression* expression = read_expression();
+					const std::size_t index = reader.read_number();
+					return program->create<EnumLiteral>(expression, index);
+				}
+			case Kind::SWITCH:
+				return program->create<Switch>(read_expression());
+			case Kind::CASE_VARIABLE:
+				return program->create<CaseVariable>();
+			case Kind::CLOSURE:
+				return program->create<Closure>(read_function());
+			case Kind::CLOSURE_ACCESS:
+				{
+					const Expression* closure = read_expression();
+					const std::size_t index = reader.read_number();
+					return program->create<ClosureAccess>(closure, index);
+				}
+			case Kind::ARGUMENT:
+				return program->create<Argument>(reader.read_number());
+			case Kind::CLOSURE_CALL:
+				return program->create<ClosureCall>(read_expression());
+			case Kind::METHOD_CALL:
+				{
+					const Expression* object = read_expression();
+					const std::string method_name = reader.read_string();
+					const Expression* method = read_expression(true);
+					return program->create<MethodCall>(object, StringView(method_name.c_str()), method);
+				}
+			case Kind::FUNCTION_CALL:
+				{
+					FunctionCall* call = program->create<FunctionCall>();
+					call->set_function(read_function());
+					return call;
+				}
+			case Kind::INTRINSIC:
+				if (const char* name = look_up_intrinsic(reader.read_string())) {
+					return program->create<Intrinsic>(name);
+				}
+				reader.failed = true;
+				return nullptr;
+			case Kind::VOID_LITERAL:
+				return program->create<VoidLiteral>();
+			case Kind::BIND:
+				{
+					const Expression* left = read_expression();
+					const Expression* right = read_expression();
+					return program->create<Bind>(left, right);
+				}
+			case Kind::TYPE_LITERAL:
+				if (const Type* type = reader.read_type()) {
+					return program->create<TypeLiteral>(type);
+				}
+				reader.failed = true;
+				return nullptr;
+			case Kind::STRUCT_TYPE_DECLARATION:
+				return program->create<StructTypeDeclaration>();
+			case Kind::STRUCT_TYPE_DEFINITION:
+				if (Expression* declaration = read_expression(Kind::STRUCT_TYPE_DECLARATION)) {
+					return program->create<StructTypeDefinition>(static_cast<const StructTypeDeclaration*>(declaration));
+				}
+				return nullptr;
+			case Kind::ENUM_TYPE_DECLARATION:
+				return program->create<EnumTypeDeclaration>();
+			case Kind::ENUM_TYPE_DEFINITION:
+				if (Expression* declaration = read_expression(Kind::ENUM_TYPE_DECLARATION)) {
+					return program->create<EnumTypeDefinition>(static_cast<const EnumTypeDeclaration*>(declaration));
+				}
+				return nullptr;
+			case Kind::TYPE_ASSERT:
+				{
+					const Expression* expression = read_expression();
+					const Expression* type = read_expression();
+					return program->create<TypeAssert>(expression, type);
+				}
+			case Kind::RETURN_TYPE:
+				return program->create<ReturnType>(read_expression());
+			default:
+				reader.failed = true;
+				return nullptr;
+			}
+		}
+		template <class F> void read_expressions(F f) {
+			const std::uint64_t size = reader.read_number();
+			for (std::uint64_t i = 0; i < size && !reader.failed; ++i) {
+				if (Expression* expression = read_expression()) {
+					f(expression);
+				}
+			}
+		}
+		template <class F> void read_fields(F f) {
+			const std::uint64_t size = reader.read_number();
+			for (std::uint64_t i = 0; i < size && !reader.failed; ++i) {
+				const std::string name = reader.read_string();
+				if (Expression* expression = read_expression()) {
+					f(StringView(name.c_str()), expression);
+				}
+			}
+		}
+		void read_block(Block* block) {
+			read_expressions([&](Expression* expression) {
+				block->add_expression(expression);
+			});
+		}
+		void read_contents(Kind kind, Expression* expression) {
+			switch (kind) {
+			case Kind::ARRAY_LITERAL:
+				read_expressions([&](Expression* element) {
+					static_cast<ArrayLiteral*>(expression)->add_element(element);
+				});
+				return;
+			case Kind::IF:
+				read_block(static_cast<If*>(expression)->get_then_block());
+				read_block(static_cast<If*>(expression)->get_else_block());
+				return;
+			case Kind::TUPLE_LITERAL:
+				read_expressions([&](Expression* element) {
+					static_cast<TupleLiteral*>(expression)->add_element(element);
+				});
+				return;
+			case Kind::STRUCT_LITERAL:
+				read_fields([&](const StringView& name, Expression* field) {
+					static_cast<StructLiteral*>(expression)->add_field(name, field);
+				});
+				return;
+			case Kind::SWITCH:
+				{
+					const std::uint64_t size = reader.read_number();
+					for (std::uint64_t i = 0; i < size && !reader.failed; ++i) {
+						const std::string name = reader.read_string();
+						read_block(static_cast<Switch*>(expression)->add_case(name));
+					}
+					return;
+				}
+			case Kind::CLOSURE:
+				read_expressions([&](Expression* environment_expression) {
+					static_cast<Closure*>(expression)->add_environment_expression(environment_expression);
+				});
+				return;
+			case Kind::CLOSURE_CALL:
+				read_expressions([&](Expression* argument) {
+					static_cast<ClosureCall*>(expression)->add_argument(argument);
+				});
+				return;
+			case Kind::METHOD_CALL:
+				read_expressions([&](Expression* argument) {
+					static_cast<MethodCall*>(expression)->add_argument(argument);
+				});
+				return;
+			case Kind::FUNCTION_CALL:
+				read_expressions([&](Expression* argument) {
+					static_cast<FunctionCall*>(expression)->add_argument(argument);
+				});
+				return;
+			case Kind::INTRINSIC:
+				read_expressions([&](Expression* argument) {
+					static_cast<Intrinsic*>(expression)->add_argument(argument);
+				});
+				return;
+			case Kind::STRUCT_TYPE_DEFINITION:
+				read_fields([&](const StringView& name, Expression* field) {
+					static_cast<StructTypeDefinition*>(expression)->add_field(name, field);
+				});
+				return;
+			case Kind::ENUM_TYPE_DEFINITION:
+				read_fields([&](const StringView& name, Expression* case_) {
+					static_cast<EnumTypeDefinition*>(expression)->add_case(name, case_);
+				});
+				return;
+			default:
+				return;
+			}
+		}
+	public:
+		Deserializer(Reader& reader, Program* program, const char* path): reader(reader), program(program), path(path) {}
+		const Function* read() {
+			const std::uint64_t function_count = reader.read_number();
+			for (std::uint64_t i = 0; i < function_count && !reader.failed; ++i) {
+				Function* function = program->create_function();
+				function->set_path(path);
+				const std::uint64_t arguments = reader.read_number();
+				for (std::uint64_t j = 0; j < arguments; ++j) {
+					function->add_argument();
+				}
+				function->set_position(reader.read_number());
+				function->set_name(reader.read_string());
+				functions.push_back(function);
+			}
+			const std::uint64_t expression_count = reader.read_number();
+			for (std::uint64_t i = 0; i < expression_count && !reader.failed; ++i) {
+				const Kind kind = static_cast<Kind>(reader.read_number());
+				Expression* expression = read_record(kind);
+				if (expression == nullptr) {
+					reader.failed = true;
+					break;
+				}
+				expression->set_position(reader.read_number());
+				const Type* type = reader.read_type();
+				if (expression->get_type() != type) {
+					expression->set_type(type);
+				}
+				expressions.push_back(expression);
+				kinds.push_back(kind);
+			}
+			for (std::size_t i = 0; i < functions.size() && !reader.failed; ++i) {
+				read_block(functions[i]->get_block());
+			}
+			for (std::size_t i = 0; i < expressions.size() && !reader.failed; ++i) {
+				read_contents(kinds[i], expressions[i]);
+			}
+			if (reader.failed || !reader.at_end() || functions.empty()) {
+				return nullptr;
+			}
+			return functions[0];
+		}
+	};
+
+	static std::string serialize(const Function* main_function) {
+		std::vector<const Function*> functions;
+		std::vector<const Expression*> expressions;
+		Collector::collect(main_function, functions, expressions);
+		IndexTable<Function, std::size_t> function_ids;
+		IndexTable<Expression, std::size_t> expression_ids;
+		for (std::size_t i = 0; i < functions.size(); ++i) {
+			function_ids[functions[i]] = i + 1;
+		}
+		for (std::size_t i = 0; i < expressions.size(); ++i) {
+			expression_ids[expressions[i]] = i + 1;
+		}
+		Writer writer;
+		writer.write_number(functions.size());
+		for (const Function* function: functions) {
+			writer.write_number(function->get_arguments());
+			writer.write_number(function->get_position());
+			writer.write_string(function->get_name());
+		}
+		writer.write_number(expressions.size());
+		for (const Expression* expression: expressions) {
+			RecordWriter::write(writer, function_ids, expression_ids, expression);
+		}
+		ContentWriter content_writer(writer, expression_ids);
+		for (const Function* function: functions) {
+			content_writer.write_block(function->get_block());
+		}
+		for (const Expression* expression: expressions) {
+			visit(content_writer, expression);
+		}
+		if (writer.failed || functions.empty() || functions[0] != main_function) {
+			return std::string();
+		}
+		return writer.get_data();
+	}
+	static std::string get_header(std::uint64_t content_hash, std::size_t content_size) {
+		Writer writer;
+		writer.write_number(version);
+		writer.write_number(content_hash);
+		writer.write_number(content_size);
+		return writer.get_data();
+	}
+	static void append_hex(std::string& s, std::uint64_t n) {
+		for (int shift = 60; shift >= 0; shift -= 4) {
+			s.push_back("0123456789abcdef"[n >> shift & 0xF]);
+		}
+	}
+	static std::filesystem::path get_cache_path(std::uint64_t content_hash) {
+		std::string file_name;
+		append_hex(file_name, content_hash);
+		return std::filesystem::path(directory) / (file_name + ".ast");
+	}
+	// unique to this process and call
+	static std::string get_temporary_suffix() {
+		static const std::uint64_t process = (static_cast<std::uint64_t>(std::random_device()()) << 32) ^ std::random_device()();
+		static std::uint64_t counter = 0;
+		std::string suffix = ".";
+		append_hex(suffix, process);
+		append_hex(suffix, counter++);
+		return suffix + ".tmp";
+	}
+	static const Function* load(const std::filesystem::path& cache_path, const std::string& header, Program* program, const char* path) {
+		const std::string cache_path_string = cache_path.string();
+		SourceFile cache_file(cache_path_string.c_str());
+		if (static_cast<std::size_t>(cache_file.end() - cache_file.begin()) < header.size() || std::string(cache_file.begin(), header.size()) != header) {
+			return nullptr;
+		}
+		// the payload is preceded by its size and hash so that a damaged file is rejected before it is decoded
+		Reader reader(cache_file.begin() + header.size(), cache_file.end());
+		const std::uint64_t payload_size = reader.read_number();
+		const std::uint64_t payload_hash = reader.read_number();
+		const char* payload = reader.get_position();
+		if (reader.failed || payload_size != static_cast<std::uint64_t>(cache_file.end() - payload) || payload_hash != hash(payload, cache_file.end())) {
+			return nullptr;
+		}
+		Deserializer deserializer(reader, program, path);
+		return deserializer.read();
+	}
+	static void store(const std::filesystem::path& cache_path, const std::string& header, const Function* main_function) {
+		const std::string data = serialize(main_function);
+		if (data.empty()) {
+			return;
+		}
+		std::error_code error_code;
+		std::filesystem::create_directories(directory, error_code);
+		Writer payload_writer;
+		payload_writer.write_number(data.size());
+		payload_writer.write_number(hash(data.data(), data.data() + data.size()));
+		// every compiler writes its own temporary file and renames it into place so that concurrent compilers never see a partial file
+		std::filesystem::path temporary_path = cache_path;
+		temporary_path += get_temporary_suffix();
+		{
+			std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+			file << header << payload_writer.get_data() << data;
+			if (!file) {
+				file.close();
+				std::filesystem::remove(temporary_path, error_code);
+				return;
+			}
+		}
+		std::filesystem::rename(temporary_path, cache_path, error_code);
+		if (error_code) {
+			std::filesystem::remove(temporary_path, error_code);
+		}
+	}
+public:
+	// the directory of the cache, the cache is disabled if it is null
+	static inline const char* directory = nullptr;
+	static const Function* parse_program(const char* path, Program* program) {
+		SourceFile file(path);
+		if (directory == nullptr) {
+			MoebiusParser parser(&file, program);
+			return parser.parse_program();
+		}
+		const std::uint64_t content_hash = hash(file.begin(), file.end());
+		const std::string header = get_header(content_hash, file.end() - file.begin());
+		const std::filesystem::path cache_path = get_cache_path(content_hash);
+		if (const Function* main_function = load(cache_path, header, program, path)) {
+			Statistics::parse_cache_hits += 1;
+			return main_function;
+		}
+		Statistics::parse_cache_misses += 1;
+		MoebiusParser parser(&file, program);
+		const Function* main_function = parser.parse_program();
+		store(cache_path, header, main_function);
+		return main_function;
+	}
+};
@@ -1,7 +1,13 @@
 #pragma once
 
 #include "ast.hpp"
+#include "options.hpp"
+#include "statistics.hpp"
 #include <sstream>
+#include <thread>
+#include <atomic>
+#include <filesystem>
+#include <string>
 
 class CodegenC: public Visitor<Variable> {
 	class Type {
@@ -45,14 +51,81 @@ class CodegenC: public Visitor<Variable> {
 		return c >= 'a' && c <= 'z' || c >= 'A' && c <= 'Z' || c >= '0' && c <= '9' || c == ' ' || c == '-' || c == '.' || c == ',' || c == ':' || c == ';' || c == '!' || c == '?';
 	}
 	static const ::Type* get_element_type(const ::Type* type) {
-		if (type->get_id() == TypeId::STRING) {
+		if (type->get_id() == TypeId::STRING || type->get_id() == TypeId::STRING_BUILDER) {
 			return TypeInterner::get_char_type();
 		}
 		return static_cast<const ArrayType*>(type)->get_element_type();
 	}
+	static const ::Type* get_array_type(const ::Type* slice_type) {
+		return static_cast<const SliceType*>(slice_type)->get_array_type();
+	}
 	static bool is_managed(const ::Type* type) {
 		const TypeId type_id = type->get_id();
-		return type_id == TypeId::STRUCT || type_id == TypeId::ENUM || type_id == TypeId::TUPLE || type_id == TypeId::ARRAY || type_id == TypeId::STRING || type_id == TypeId::STRING_ITERATOR || type_id == TypeId::REFERENCE;
+		return type_id == TypeId::STRUCT || type_id == TypeId::ENUM || type_id == TypeId::TUPLE || type_id == TypeId::ARRAY || type_id == TypeId::STRING || type_id == TypeId::STRING_ITERATOR || type_id == TypeId::STRING_BUILDER || type_id == TypeId::SLICE || type_id == TypeId::REFERENCE;
+	}
+	enum class EnumLayout {
+		// a tag followed by a union of the case values
+		TAGGED,
+		// no case carries a value, the enum is just its tag
+		TAG_ONLY,
+		// one empty case and one reference case, the empty case is the null pointer
+		NULLABLE_REFERENCE
+	};
+	static EnumLayout get_enum_layout(const EnumType* type) {
+		const auto& cases = type->get_cases();
+		if (cases.size() == 2) {
+			const ::Type* void_type = TypeInterner::get_void_type();
+			if (cases[0].second == void_type && cases[1].second->get_id() == TypeId::REFERENCE) {
+				return EnumLayout::NULLABLE_REFERENCE;
+			}
+			if (cases[1].second == void_type && cases[0].second->get_id() == TypeId::REFERENCE) {
+				return EnumLayout::NULLABLE_REFERENCE;
+			}
+		}
+		for (const auto& case_: cases) {
+			if (case_.second != TypeInterner::get_void_type()) {
+				return EnumLayout::TAGGED;
+			}
+		}
+		return EnumLayout::TAG_ONLY;
+	}
+	static StringView get_tag_type(const EnumType* type) {
+		const std::size_t size = type->get_cases().size();
+		if (size <= 0x100) {
+			return "uint8_t";
+		}
+		if (size <= 0x10000) {
+			return "uint16_t";
+		}
+		return "uint32_t";
+	}
+	static std::size_t get_void_case(const EnumType* type) {
+		return type->get_cases()[0].second == TypeInterner::get_void_type() ? 0 : 1;
+	}
+	template <class T> static auto print_enum_tag(const EnumType* type, const T& enum_) {
+		return print_functor([type, &enum_](auto& printer) {
+			switch (get_enum_layout(type)) {
+			case EnumLayout::TAGGED:
+				printer.print(format("%.tag", enum_));
+				break;
+			case EnumLayout::TAG_ONLY:
+				printer.print(enum_);
+				break;
+			case EnumLayout::NULLABLE_REFERENCE:
+				printer.print(format("(% == NULL ? % : %)", enum_, print_number(get_void_case(type)), print_number(1 - get_void_case(type))));
+				break;
+			}
+		});
+	}
+	template <class T> static auto print_enum_value(const EnumType* type, const T& enum_, std::size_t index) {
+		return print_functor([type, &enum_, index](auto& printer) {
+			if (get_enum_layout(type) == EnumLayout::NULLABLE_REFERENCE) {
+				printer.print(enum_);
+			}
+			else {
+				printer.print(format("%.value.v%", enum_, print_number(index)));
+			}
+		});
 	}
 	struct TypeTableEntry {
 		std::size_t index;
@@ -60,24 +133,228 @@ class CodegenC: public Visitor<Variable> {
 		bool is_defined = false;
 		bool functions_generated = false;
 	};
+	struct FunctionTableEntry {
+		std::size_t index;
+		bool has_index = false;
+		// the source location, only looked up for -profile and -line-directives
+		std::size_t line = 0;
+		std::size_t column = 0;
+	};
 	class FunctionTable {
-		std::map<const Function*, std::size_t> functions;
+		IndexTable<Function, FunctionTableEntry> functions;
+		std::size_t next_function_index = 0;
 		std::map<const ::Type*, TypeTableEntry> types;
 		std::size_t next_type_index = 0;
 		IndentPrinter& type_declaration_printer;
 		IndentPrinter& function_declaration_printer;
 		IndentPrinter& type_function_printer;
+		const CodegenOptions& options;
+		const EscapeAnalysis& escape_analysis;
+		const ParallelAnalysis& parallel_analysis;
+		std::map<std::string, LineTable> line_tables;
+		// the bodies of the parallel loops, one for every function and kind of loop
+		std::map<std::pair<const Function*, bool>, std::size_t> parallel_bodies;
+		// once frozen, the table is only read and can be shared between threads
+		// so the serial TypeDeclaration pass has to declare every type, function, and parallel loop body that is generated afterwards
+		bool frozen = false;
+		// something was not declared before the table was frozen, which is a bug in TypeDeclaration
+		// this can happen on a worker thread, so the compiler aborts instead of exiting
+		[[noreturn]] static void undeclared(const char* what) {
+			print_error(Printer(std::cerr), format("internal error: % used after the function table was frozen without being declared", what));
+			std::abort();
+		}
 	public:
-		FunctionTable(IndentPrinter& type_declaration_printer, IndentPrinter& function_declaration_printer, IndentPrinter& type_function_printer): type_declaration_printer(type_declaration_printer), function_declaration_printer(function_declaration_printer), type_function_printer(type_function_printer) {}
+		FunctionTable(IndentPrinter& type_declaration_printer, IndentPrinter& function_declaration_printer, IndentPrinter& type_function_printer, const CodegenOptions& options, const EscapeAnalysis& escape_analysis, const ParallelAnalysis& parallel_analysis): type_declaration_printer(type_declaration_printer), function_declaration_printer(function_declaration_printer), type_function_printer(type_function_printer), options(options), escape_analysis(escape_analysis), parallel_analysis(parallel_analysis) {}
+		bool is_reference_counted() const {
+			return options.reference_counting;
+		}
+		bool is_stack_allocated(const Expression* expression) const {
+			return escape_analysis.is_stack_allocated(expression);
+		}
+		// whether the calls of a parallel loop can run on several threads
+		// input, output, and the runtime profile are not synchronized and neither are reference counts
+		bool is_parallel(const Function* function) const {
+			if (options.runtime_profile || parallel_analysis.has_input_output(function)) {
+				return false;
+			}
+			if (options.reference_counting) {
+				for (const ::Type* type: function->get_argument_types()) {
+					if (is_managed(type)) {
+						return false;
+					}
+				}
+			}
+			return true;
+		}
+		// the allocator functions of the generated code
+		StringView get_malloc() const {
+			return options.pool_allocation ? "pool_alloc" : "malloc";
+		}
+		StringView get_realloc() const {
+			return options.pool_allocation ? "pool_realloc" : "realloc";
+		}
+		StringView get_free() const {
+			return options.pool_allocation ? "pool_free" : "free";
+		}
+		bool is_profiled() const {
+			return options.runtime_profile;
+		}
+		bool has_line_directives() const {
+			return options.line_directives;
+		}
+		// counts an allocation of size bytes for the given type in the runtime profile
+		template <class T> void print_allocation(IndentPrinter& printer, const ::Type* type, const T& size) const {
+			if (options.runtime_profile) {
+				printer.println(format("profile_allocation(%, %);", print_number(types.find(type)->second.index), size));
+			}
+		}
+		void freeze() {
+			frozen = true;
+		}
 		std::size_t look_up(const Function* function) {
-			auto iterator = functions.find(function);
-			if (iterator != functions.end()) {
+			if (frozen) {
+				if (!functions.get(function).has_index) {
+					undeclared("a function");
+				}
+				return functions.get(function).index;
+			}
+			if (!functions[function].has_index) {
+				functions[function].index = next_function_index++;
+				functions[function].has_index = true;
+				if ((options.runtime_profile || options.line_directives) && function->get_path()) {
+					const LineTable& line_table = line_tables.try_emplace(function->get_path(), function->get_path()).first->second;
+					functions[function].line = line_table.get_line(function->get_position());
+					functions[function].column = line_table.get_column(function->get_position());
+				}
+			}
+			return functions[function].index;
+		}
+		// the context and the body of a parallel loop that calls function for a range of elements
+		// a map stores the results in elements, a reduce combines blocks of PARALLEL_BLOCK elements starting from initial
+		std::size_t get_parallel_body(const Function* function, bool reduce) {
+			auto iterator = parallel_bodies.find(std::make_pair(function, reduce));
+			if (frozen) {
+				if (iterator == parallel_bodies.end()) {
+					undeclared("a parallel loop body");
+				}
+				return iterator->second;
+			}
+			if (iterator != parallel_bodies.end()) {
 				return iterator->second;
 			}
-			const std::size_t index = functions.size();
-			functions[function] = index;
+			const std::size_t index = parallel_bodies.size();
+			parallel_bodies[std::make_pair(function, reduce)] = index;
+			const std::vector<const ::Type*>& argument_types = function->get_argument_types();
+			const std::size_t environment = argument_types.size() - (reduce ? 2 : 1);
+			const ::Type* element_type = argument_types.back();
+			const Type source_type = get_type(element_type);
+			const Type result_type = get_type(function->get_return_type());
+			const Type number_type = get_type(TypeInterner::get_int_type());
+			const std::size_t function_index = look_up(function);
+			IndentPrinter& printer = type_function_printer;
+			printer.println_increasing("typedef struct {");
+			printer.println(format("%* source;", source_type));
+			printer.println(format("% length;", number_type));
+			for (std::size_t i = 0; i < environment; ++i) {
+				if (argument_types[i] != TypeInterner::get_void_type()) {
+					printer.println(format("% %;", get_type(argument_types[i]), Variable(i)));
+				}
+			}
+			if (reduce) {
+				printer.println(format("% initial;", result_type));
+			}
+			printer.println(format("%* elements;", result_type));
+			printer.println_decreasing(format("} p%_context;", print_number(index)));
+			// every call gets its own copies of the environment and the element
+			auto print_copy = [&](const ::Type* type, const auto& value) {
+				return print_functor([this, type, &value](auto& printer) {
+					if (is_managed(type)) {
+						printer.print(format("%_copy(%)", get_type(type), value));
+					}
+					else {
+						printer.print(value);
+					}
+				});
+			};
+			auto print_call = [&](const auto& accumulator, const auto& element) {
+				return print_functor([&](auto& printer) {
+					printer.print(format("f%(", print_number(function_index)));
+					bool is_first_argument = true;
+					for (std::size_t i = 0; i < environment; ++i) {
+						if (argument_types[i] != TypeInterner::get_void_type()) {
+							if (is_first_argument) is_first_argument = false;
+							else printer.print(", ");
+							printer.print(print_copy(argument_types[i], format("context->%", Variable(i))));
+						}
+					}
+					if (reduce) {
+						if (!is_first_argument) printer.print(", ");
+						printer.print(accumulator);
+						is_first_argument = false;
+					}
+					if (!is_first_argument) printer.print(", ");
+					printer.print(print_copy(element_type, element));
+					printer.print(")");
+				});
+			};
+			printer.println_increasing(format("static void p%_body(void* data, size_t start, size_t end) {", print_number(index)));
+			printer.println(format("p%_context* context = data;", print_number(index)));
+			if (reduce) {
+				printer.println_increasing("for (size_t block = start; block < end; ++block) {");
+				printer.println("size_t i = block * PARALLEL_BLOCK;");
+				printer.println("size_t block_end = i + PARALLEL_BLOCK < context->length ? i + PARALLEL_BLOCK : context->length;");
+				printer.println(format("% accumulator = %;", result_type, print_copy(function->get_return_type(), "context->initial")));
+				printer.println_increasing("for (; i < block_end; ++i) {");
+				printer.println(format("accumulator = %;", print_call("accumulator", "context->source[i]")));
+				printer.println_decreasing("}");
+				printer.println("context->elements[block] = accumulator;");
+				printer.println_decreasing("}");
+			}
+			else {
+				printer.println_increasing("for (size_t i = start; i < end; ++i) {");
+				printer.println(format("context->elements[i] = %;", print_call("", "context->source[i]")));
+				printer.println_decreasing("}");
+			}
+			printer.println_decreasing("}");
 			return index;
 		}
+		// combines the result so far with the partial result of block i of a parallel reduce on the calling thread
+		auto print_parallel_combine(const Function* function, Variable result) {
+			return print_functor([this, function, result](auto& printer) {
+				const std::vector<const ::Type*>& argument_types = function->get_argument_types();
+				printer.print(format("f%(", print_number(look_up(function))));
+				for (std::size_t i = 0; i + 2 < argument_types.size(); ++i) {
+					if (argument_types[i] != TypeInterner::get_void_type()) {
+						if (is_managed(argument_types[i])) {
+							printer.print(format("%_copy(%_context.%), ", get_type(argument_types[i]), result, Variable(i)));
+						}
+						else {
+							printer.print(format("%_context.%, ", result, Variable(i)));
+						}
+					}
+				}
+				printer.print(format("%, %_context.elements[i])", result, result));
+			});
+		}
+		std::size_t get_line(const Function* function) const {
+			return functions.get(function).line;
+		}
+		std::size_t get_column(const Function* function) const {
+			return functions.get(function).column;
+		}
+		std::size_t get_function_count() const {
+			return next_function_index;
+		}
+		// the types indexed by the numbers of their C names
+		std::vector<const ::Type*> get_types() const {
+			std::vector<const ::Type*> result(next_type_index, nullptr);
+			for (const auto& entry: types) {
+				if (entry.second.is_declared) {
+					result[entry.second.index] = entry.first;
+				}
+			}
+			return result;
+		}
 		std::size_t declare_type(const ::Type* type) {
 			if (types[type].is_declared) {
 				return types[type].index;
@@ -120,14 +397,28 @@ class CodegenC: public Visitor<Variable> {
 				}
 			case TypeId::ENUM:
 				{
-					const Type number_type = declare_type(TypeInterner::get_int_type());
-					const std::vector<std::pair<std::string, const ::Type*>>& cases = static_cast<const EnumType*>(type)->get_cases();
+					const EnumType* enum_type = static_cast<const EnumType*>(type);
+					const std::vector<std::pair<std::string, const ::Type*>>& cases = enum_type->get_cases();
 					for (const auto& case_: cases) {
 						declare_type(case_.second);
 					}
 					const std::size_t index = next_type_index++;
+					const EnumLayout layout = get_enum_layout(enum_type);
+					if (layout == EnumLayout::TAG_ONLY) {
+						type_declaration_printer.println(format("typedef % %;", get_tag_type(enum_type), Type(index)));
+						types[type].index = index;
+						types[type].is_declared = true;
+						return index;
+					}
+					if (layout == EnumLayout::NULLABLE_REFERENCE) {
+						const Type reference_type = declare_type(cases[1 - get_void_case(enum_type)].second);
+						type_declaration_printer.println(format("typedef % %;", reference_type, Type(index)));
+						types[type].index = index;
+						types[type].is_declared = true;
+						return index;
+					}
 					type_declaration_printer.println_increasing("typedef struct {");
-					type_declaration_printer.println(format("% tag;", number_type));
+					type_declaration_printer.println(format("% tag;", get_tag_type(enum_type)));
 					type_declaration_printer.println_increasing("union {");
 					for (std::size_t i = 0; i < cases.size(); ++i) {
 						if (cases[i].second != TypeInterner::get_void_type()) {
@@ -167,6 +458,9 @@ class CodegenC: public Visitor<Variable> {
 					const Type number_type = declare_type(TypeInterner::get_int_type());
 					const std::size_t index = next_type_index++;
 					type_declaration_printer.println_increasing(format("typedef struct % {", Type(index)));
+					if (options.reference_counting) {
+						type_declaration_printer.println(format("% refcount;", number_type));
+					}
 					type_declaration_printer.println(format("% length;", number_type));
 					type_declaration_printer.println(format("% capacity;", number_type));
 					type_declaration_printer.println(format("% elements[];", element_type));
@@ -186,6 +480,29 @@ class CodegenC: public Visitor<Variable> {
 					types[type].is_declared = true;
 					return index;
 				}
+			case TypeId::STRING_BUILDER:
+				{
+					// a string builder is a string that is only ever grown in place
+					const std::size_t index = declare_type(TypeInterner::get_string_type());
+					types[type].index = index;
+					types[type].is_declared = true;
+					return index;
+				}
+			case TypeId::SLICE:
+				{
+					// the array, the start, and the end of the range
+					const Type array_type = declare_type(get_array_type(type));
+					const Type number_type = declare_type(TypeInterner::get_int_type());
+					const std::size_t index = next_type_index++;
+					type_declaration_printer.println_increasing("typedef struct {");
+					type_declaration_printer.println(format("% v0;", array_type));
+					type_declaration_printer.println(format("% v1;", number_type));
+					type_declaration_printer.println(format("% v2;", number_type));
+					type_declaration_printer.println_decreasing(format("} %;", Type(index)));
+					types[type].index = index;
+					types[type].is_declared = true;
+					return index;
+				}
 			case TypeId::VOID:
 				{
 					const std::size_t index = next_type_index++;
@@ -256,6 +573,12 @@ class CodegenC: public Visitor<Variable> {
 					generate_string_iterator_functions(type);
 					return;
 				}
+			case TypeId::STRING_BUILDER:
+				generate_functions(TypeInterner::get_string_type());
+				return;
+			case TypeId::SLICE:
+				generate_slice_functions(type);
+				return;
 			case TypeId::REFERENCE:
 				generate_reference_functions(type);
 				return;
@@ -264,6 +587,13 @@ class CodegenC: public Visitor<Variable> {
 			}
 		}
 		Type get_type(const ::Type* type) {
+			if (frozen) {
+				auto iterator = types.find(type);
+				if (iterator == types.end() || !iterator->second.is_declared) {
+					undeclared("a type");
+				}
+				return iterator->second.index;
+			}
 			const std::size_t index = define_type(type);
 			generate_functions(type);
 			return index;
@@ -303,49 +633,68 @@ class CodegenC: public Visitor<Variable> {
 			printer.println_decreasing("}");
 		}
 		void generate_enum_functions(const ::Type* type) {
+			const EnumType* enum_type_ = static_cast<const EnumType*>(type);
 			const Type enum_type = get_type(type);
-			const auto& cases = static_cast<const EnumType*>(type)->get_cases();
+			const auto& cases = enum_type_->get_cases();
 			const Type void_type = get_type(TypeInterner::get_void_type());
 			for (const auto& case_: cases) {
 				get_type(case_.second);
 			}
+			const EnumLayout layout = get_enum_layout(enum_type_);
 			IndentPrinter& printer = type_function_printer;
 
 			// enum_copy
 			function_declaration_printer.println(format("static % %_copy(%);", enum_type, enum_type, enum_type));
 			printer.println_increasing(format("static % %_copy(% enum_) {", enum_type, enum_type, enum_type));
-			printer.println(format("% new_enum;", enum_type));
-			printer.println("new_enum.tag = enum_.tag;");
-			printer.println_increasing("switch (enum_.tag) {");
-			for (std::size_t i = 0; i < cases.size(); ++i) {
-				printer.println_increasing(format("case %: {", print_number(i)));
-				if (is_managed(cases[i].second)) {
-					printer.println(format("new_enum.value.v% = %_copy(enum_.value.v%);", print_number(i), get_type(cases[i].second), print_number(i)));
-				}
-				else if (cases[i].second != TypeInterner::get_void_type()) {
-					printer.println(format("new_enum.value.v% = enum_.value.v%;", print_number(i), print_number(i)));
+			if (layout == EnumLayout::TAG_ONLY) {
+				printer.println("return enum_;");
+			}
+			else if (layout == EnumLayout::NULLABLE_REFERENCE) {
+				const Type reference_type = get_type(cases[1 - get_void_case(enum_type_)].second);
+				printer.println(format("return enum_ == NULL ? NULL : %_copy(enum_);", reference_type));
+			}
+			else {
+				printer.println(format("% new_enum;", enum_type));
+				printer.println("new_enum.tag = enum_.tag;");
+				printer.println_increasing("switch (enum_.tag) {");
+				for (std::size_t i = 0; i < cases.size(); ++i) {
+					printer.println_increasing(format("case %: {", print_number(i)));
+					if (is_managed(cases[i].second)) {
+						printer.println(format("new_enum.value.v% = %_copy(enum_.value.v%);", print_number(i), get_type(cases[i].second), print_number(i)));
+					}
+					else if (cases[i].second != TypeInterner::get_void_type()) {
+						printer.println(format("new_enum.value.v% = enum_.value.v%;", print_number(i), print_number(i)));
+					}
+					printer.println("break;");
+					printer.println_decreasing("}");
 				}
-				printer.println("break;");
 				printer.println_decreasing("}");
+				printer.println("return new_enum;");
 			}
 			printer.println_decreasing("}");
-			printer.println("return new_enum;");
-			printer.println_decreasing("}");
 
 			// enum_free
 			function_declaration_printer.println(format("static % %_free(%);", void_type, enum_type, enum_type));
 			printer.println_increasing(format("static % %_free(% enum_) {", void_type, enum_type, enum_type));
-			printer.println_increasing("switch (enum_.tag) {");
-			for (std::size_t i = 0; i < cases.size(); ++i) {
-				printer.println_increasing(format("case %: {", print_number(i)));
-				if (is_managed(cases[i].second)) {
-					printer.println(format("%_free(enum_.value.v%);", get_type(cases[i].second), print_number(i)));
+			if (layout == EnumLayout::NULLABLE_REFERENCE) {
+				const Type reference_type = get_type(cases[1 - get_void_case(enum_type_)].second);
+				printer.println_increasing("if (enum_ != NULL) {");
+				printer.println(format("%_free(enum_);", reference_type));
+				printer.println_decreasing("}");
+			}
+			else if (layout == EnumLayout::TAGGED) {
+				printer.println_increasing("switch (enum_.tag) {");
+				for (std::size_t i = 0; i < cases.size(); ++i) {
+					printer.println_increasing(format("case %: {", print_number(i)));
+					if (is_managed(cases[i].second)) {
+						printer.println(format("%_free(enum_.value.v%);", get_type(cases[i].second), print_number(i)));
+					}
+					printer.println("break;");
+					printer.println_decreasing("}");
 				}
-				printer.println("break;");
 				printer.println_decreasing("}");
 			}
 			printer.println_decreasing("}");
-			printer.println_decreasing("}");
 		}
 		void generate_tuple_functions(const ::Type* type) {
 			const Type tuple_type = get_type(type);
@@ -388,16 +737,20 @@ class CodegenC: public Visitor<Variable> {
 			// array_new
 			printer.println_increasing(format("static % %_new(%* elements, % length) {", array_type, array_type, element_type, number_type));
 			if (null_terminated) {
-				printer.println(format("% array = malloc(sizeof(struct %) + (length + 1) * sizeof(%));", array_type, array_type, element_type));
+				printer.println(format("% array = %(sizeof(struct %) + (length + 1) * sizeof(%));", array_type, get_malloc(), array_type, element_type));
+				print_allocation(printer, type, format("sizeof(struct %) + (length + 1) * sizeof(%)", array_type, element_type));
 			}
 			else {
-				printer.println(format("% array = malloc(sizeof(struct %) + length * sizeof(%));", array_type, array_type, element_type));
+				printer.println(format("% array = %(sizeof(struct %) + length * sizeof(%));", array_type, get_malloc(), array_type, element_type));
+				print_allocation(printer, type, format("sizeof(struct %) + length * sizeof(%)", array_type, element_type));
+			}
+			if (options.reference_counting) {
+				printer.println("array->refcount = 1;");
 			}
 			printer.println("array->length = length;");
 			printer.println("array->capacity = length;");
-			printer.println_increasing(format("for (% i = 0; i < length; i++) {", number_type));
-			printer.println("array->elements[i] = elements[i];");
-			printer.println_decreasing("}");
+			// the elements are moved into the array, so even managed elements can be copied bytewise
+			printer.println(format("if (length > 0) memcpy(array->elements, elements, length * sizeof(%));", element_type));
 			if (null_terminated) {
 				printer.println("array->elements[length] = 0;");
 			}
@@ -406,23 +759,38 @@ class CodegenC: public Visitor<Variable> {
 
 			// array_copy
 			function_declaration_printer.println(format("static % %_copy(%);", array_type, array_type, array_type));
-			printer.println_increasing(format("static % %_copy(% array) {", array_type, array_type, array_type));
+			if (options.reference_counting) {
+				// copies only share the array, array_clone creates a deep copy
+				printer.println_increasing(format("static % %_copy(% array) {", array_type, array_type, array_type));
+				printer.println("array->refcount += 1;");
+				printer.println("return array;");
+				printer.println_decreasing("}");
+				printer.println_increasing(format("static % %_clone(% array) {", array_type, array_type, array_type));
+			}
+			else {
+				printer.println_increasing(format("static % %_copy(% array) {", array_type, array_type, array_type));
+			}
 			if (null_terminated) {
-				printer.println(format("% new_array = malloc(sizeof(struct %) + (array->length + 1) * sizeof(%));", array_type, array_type, element_type));
+				printer.println(format("% new_array = %(sizeof(struct %) + (array->length + 1) * sizeof(%));", array_type, get_malloc(), array_type, element_type));
+				print_allocation(printer, type, format("sizeof(struct %) + (array->length + 1) * sizeof(%)", array_type, element_type));
 			}
 			else {
-				printer.println(format("% new_array = malloc(sizeof(struct %) + array->length * sizeof(%));", array_type, array_type, element_type));
+				printer.println(format("% new_array = %(sizeof(struct %) + array->length * sizeof(%));", array_type, get_malloc(), array_type, element_type));
+				print_allocation(printer, type, format("sizeof(struct %) + array->length * sizeof(%)", array_type, element_type));
+			}
+			if (options.reference_counting) {
+				printer.println("new_array->refcount = 1;");
 			}
 			printer.println("new_array->length = array->length;");
 			printer.println("new_array->capacity = array->length;");
-			printer.println_increasing(format("for (% i = 0; i < array->length; i++) {", number_type));
 			if (is_managed(get_element_type(type))) {
+				printer.println_increasing(format("for (% i = 0; i < array->length; i++) {", number_type));
 				printer.println(format("new_array->elements[i] = %_copy(array->elements[i]);", element_type));
+				printer.println_decreasing("}");
 			}
 			else {
-				printer.println("new_array->elements[i] = array->elements[i];");
+				printer.println(format("memcpy(new_array->elements, array->elements, array->length * sizeof(%));", element_type));
 			}
-			printer.println_decreasing("}");
 			if (null_terminated) {
 				printer.println("new_array->elements[array->length] = 0;");
 			}
@@ -432,72 +800,125 @@ class CodegenC: public Visitor<Variable> {
 			// array_free
 			function_declaration_printer.println(format("static % %_free(%);", void_type, array_type, array_type));
 			printer.println_increasing(format("static % %_free(% array) {", void_type, array_type, array_type));
+			if (options.reference_counting) {
+				printer.println("if (--array->refcount > 0) return;");
+			}
 			if (is_managed(get_element_type(type))) {
 				printer.println_increasing(format("for (% i = 0; i < array->length; i++) {", number_type));
 				printer.println(format("%_free(array->elements[i]);", element_type));
 				printer.println_decreasing("}");
 			}
-			printer.println("free(array);");
+			printer.println(format("%(array);", get_free()));
 			printer.println_decreasing("}");
 
 			// array_splice
 			printer.println_increasing(format("static % %_splice(% array, % index, % remove, %* insert_elements, % insert_length) {", array_type, array_type, array_type, number_type, number_type, element_type, number_type));
+			if (options.reference_counting) {
+				printer.println_increasing("if (array->refcount > 1) {");
+				printer.println("array->refcount -= 1;");
+				printer.println(format("array = %_clone(array);", array_type));
+				printer.println_decreasing("}");
+			}
 			if (is_managed(get_element_type(type))) {
 				printer.println_increasing(format("for (% i = 0; i < remove; i++) {", number_type));
 				printer.println(format("%_free(array->elements[index + i]);", element_type));
 				printer.println_decreasing("}");
 			}
 			printer.println(format("% new_length = array->length - remove + insert_length;", number_type));
+			// the array has a single owner, so it can grow in place
 			printer.println_increasing("if (new_length > array->capacity) {");
 			printer.println(format("% new_capacity = array->capacity * 2;", number_type));
 			printer.println("if (new_capacity < new_length) new_capacity = new_length;");
 			if (null_terminated) {
-				printer.println(format("% new_array = malloc(sizeof(struct %) + (new_capacity + 1) * sizeof(%));", array_type, array_type, element_type));
+				printer.println(format("array = %(array, sizeof(struct %) + (new_capacity + 1) * sizeof(%));", get_realloc(), array_type, element_type));
+				print_allocation(printer, type, format("sizeof(struct %) + (new_capacity + 1) * sizeof(%)", array_type, element_type));
 			}
 			else {
-				printer.println(format("% new_array = malloc(sizeof(struct %) + new_capacity * sizeof(%));", array_type, array_type, element_type));
+				printer.println(format("array = %(array, sizeof(struct %) + new_capacity * sizeof(%));", get_realloc(), array_type, element_type));
+				print_allocation(printer, type, format("sizeof(struct %) + new_capacity * sizeof(%)", array_type, element_type));
 			}
-			printer.println("new_array->length = new_length;");
-			printer.println("new_array->capacity = new_capacity;");
-			printer.println_increasing(format("for (% i = 0; i < index; i++) {", number_type));
-			printer.println("new_array->elements[i] = array->elements[i];");
+			printer.println("array->capacity = new_capacity;");
 			printer.println_decreasing("}");
-			printer.println_increasing(format("for (% i = 0; i < insert_length; i++) {", number_type));
-			printer.println("new_array->elements[index + i] = insert_elements[i];");
+			// the remaining and the inserted elements are moved, so they can be copied bytewise
+			printer.println_increasing("if (remove != insert_length) {");
+			printer.println(format("memmove(array->elements + index + insert_length, array->elements + index + remove, (array->length - index - remove) * sizeof(%));", element_type));
+			if (null_terminated) {
+				printer.println("array->elements[new_length] = 0;");
+			}
 			printer.println_decreasing("}");
-			printer.println_increasing(format("for (% i = index + remove; i < array->length; i++) {", number_type));
-			printer.println("new_array->elements[i - remove + insert_length] = array->elements[i];");
+			printer.println(format("if (insert_length > 0) memcpy(array->elements + index, insert_elements, insert_length * sizeof(%));", element_type));
+			printer.println("array->length = new_length;");
+			printer.println("return array;");
 			printer.println_decreasing("}");
+
+			// array_splice_copy
+			// splices an array that is still used elsewhere into a new array
+			printer.println_increasing(format("static % %_splice_copy(% array, % index, % remove, %* insert_elements, % insert_length) {", array_type, array_type, array_type, number_type, number_type, element_type, number_type));
+			printer.println(format("% new_length = array->length - remove + insert_length;", number_type));
+			if (null_terminated) {
+				printer.println(format("% new_array = %(sizeof(struct %) + (new_length + 1) * sizeof(%));", array_type, get_malloc(), array_type, element_type));
+				print_allocation(printer, type, format("sizeof(struct %) + (new_length + 1) * sizeof(%)", array_type, element_type));
+			}
+			else {
+				printer.println(format("% new_array = %(sizeof(struct %) + new_length * sizeof(%));", array_type, get_malloc(), array_type, element_type));
+				print_allocation(printer, type, format("sizeof(struct %) + new_length * sizeof(%)", array_type, element_type));
+			}
+			if (options.reference_counting) {
+				printer.println("new_array->refcount = 1;");
+			}
+			printer.println("new_array->length = new_length;");
+			printer.println("new_array->capacity = new_length;");
+			if (is_managed(get_element_type(type))) {
+				printer.println_increasing(format("for (% i = 0; i < index; i++) {", number_type));
+				printer.println(format("new_array->elements[i] = %_copy(array->elements[i]);", element_type));
+				printer.println_decreasing("}");
+			}
+			else {
+				printer.println(format("memcpy(new_array->elements, array->elements, index * sizeof(%));", element_type));
+			}
+			printer.println(format("if (insert_length > 0) memcpy(new_array->elements + index, insert_elements, insert_length * sizeof(%));", element_type));
+			if (is_managed(get_element_type(type))) {
+				printer.println_increasing(format("for (% i = index + remove; i < array->length; i++) {", number_type));
+				printer.println(format("new_array->elements[i - remove + insert_length] = %_copy(array->elements[i]);", element_type));
+				printer.println_decreasing("}");
+			}
+			else {
+				printer.println(format("memcpy(new_array->elements + index + insert_length, array->elements + index + remove, (array->length - index - remove) * sizeof(%));", element_type));
+			}
 			if (null_terminated) {
 				printer.println("new_array->elements[new_length] = 0;");
 			}
-			printer.println("free(array);");
 			printer.println("return new_array;");
 			printer.println_decreasing("}");
-			printer.println_increasing("else {");
-			printer.println_increasing("if (remove > insert_length) {");
-			printer.println_increasing(format("for (% i = index + remove; i < array->length; i++) {", number_type));
-			printer.println("array->elements[i - remove + insert_length] = array->elements[i];");
-			printer.println_decreasing("}");
-			if (null_terminated) {
-				printer.println("array->elements[new_length] = 0;");
+
+			// array_consume
+			if (options.reference_counting) {
+				// releases an array whose elements have been moved elsewhere
+				printer.println_increasing(format("static % %_consume(% array) {", void_type, array_type, array_type));
+				printer.println_increasing("if (--array->refcount == 0) {");
+				printer.println(format("%(array);", get_free()));
+				printer.println("return;");
+				printer.println_decreasing("}");
+				if (is_managed(get_element_type(type))) {
+					printer.println_increasing(format("for (% i = 0; i < array->length; i++) {", number_type));
+					printer.println(format("%_copy(array->elements[i]);", element_type));
+					printer.println_decreasing("}");
+				}
+				printer.println_decreasing("}");
 			}
-			printer.println_decreasing("}");
-			printer.println_increasing("else if (insert_length > remove) {");
+
+			// string_read_all
 			if (null_terminated) {
-				printer.println("array->elements[new_length] = 0;");
+				printer.println_increasing(format("static % %_read_all(void) {", array_type, array_type));
+				printer.println(format("% string = %_new(NULL, 0);", array_type, array_type));
+				printer.println(format("%* bytes;", element_type));
+				printer.println("size_t length;");
+				printer.println_increasing("while ((length = io_read(&bytes)) > 0) {");
+				printer.println(format("string = %_splice(string, string->length, 0, bytes, length);", array_type));
+				printer.println_decreasing("}");
+				printer.println("return string;");
+				printer.println_decreasing("}");
 			}
-			printer.println_increasing(format("for (% i = array->length - 1; i >= index + remove; i--) {", number_type));
-			printer.println("array->elements[i - remove + insert_length] = array->elements[i];");
-			printer.println_decreasing("}");
-			printer.println_decreasing("}");
-			printer.println_increasing(format("for (% i = 0; i < insert_length; i++) {", number_type));
-			printer.println("array->elements[index + i] = insert_elements[i];");
-			printer.println_decreasing("}");
-			printer.println("array->length = new_length;");
-			printer.println("return array;");
-			printer.println_decreasing("}");
-			printer.println_decreasing("}");
 
 			// from_codepoint
 			if (get_element_type(type) == TypeInterner::get_char_type()) {
@@ -527,38 +948,22 @@ class CodegenC: public Visitor<Variable> {
 				printer.println_decreasing("}");
 			}
 		}
-		void generate_string_iterator_functions(const ::Type* type) {
-			const Type string_iterator_type = get_type(type);
-			const Type number_type = get_type(TypeInterner::get_int_type());
-			const Type char_type = get_type(TypeInterner::get_char_type());
-			IndentPrinter& printer = type_function_printer;
-
-			// string_iterator_get_next
-			TupleType iteration_result_type_tuple;
-			iteration_result_type_tuple.add_element_type(type);
-			iteration_result_type_tuple.add_element_type(TypeInterner::get_int_type());
-			iteration_result_type_tuple.add_element_type(TypeInterner::get_int_type());
-			const Type iteration_result_type = get_type(TypeInterner::intern(&iteration_result_type_tuple));
-			function_declaration_printer.println(format("static % string_iterator_get_next(%);", iteration_result_type, string_iterator_type));
-			printer.println_increasing(format("static % string_iterator_get_next(% string_iterator) {", iteration_result_type, string_iterator_type));
-			printer.println(format("%* s = string_iterator.v0->elements + string_iterator.v1;", char_type));
-			printer.println(format("% size = string_iterator.v0->length - string_iterator.v1;", number_type));
-			printer.println(format("% result;", iteration_result_type));
-			printer.println("result.v0.v0 = string_iterator.v0;");
+		// decodes the code point at s and advances the position of value, which has been copied into result.v0
+		void print_get_next(IndentPrinter& printer, const char* value) {
 			printer.println_increasing("if (size >= 1 && (s[0] & 0x80) == 0x00) {");
-			printer.println("result.v0.v1 = string_iterator.v1 + 1;");
+			printer.println(format("result.v0.v1 = %.v1 + 1;", value));
 			printer.println("result.v1 = 1;");
 			printer.println("result.v2 = s[0];");
 			printer.println_decreasing("}");
 			printer.println_increasing("else if (size >= 2 && (s[0] & 0xE0) == 0xC0) {");
-			printer.println("result.v0.v1 = string_iterator.v1 + 2;");
+			printer.println(format("result.v0.v1 = %.v1 + 2;", value));
 			printer.println("result.v1 = 1;");
 			printer.println("result.v2 = 0;");
 			printer.println("result.v2 |= (s[0] & 0x1F) << 6;");
 			printer.println("result.v2 |= (s[1] & 0x3F);");
 			printer.println_decreasing("}");
 			printer.println_increasing("else if (size >= 3 && (s[0] & 0xF0) == 0xE0) {");
-			printer.println("result.v0.v1 = string_iterator.v1 + 3;");
+			printer.println(format("result.v0.v1 = %.v1 + 3;", value));
 			printer.println("result.v1 = 1;");
 			printer.println("result.v2 = 0;");
 			printer.println("result.v2 |= (s[0] & 0x0F) << 12;");
@@ -566,7 +971,7 @@ class CodegenC: public Visitor<Variable> {
 			printer.println("result.v2 |= (s[2] & 0x3F);");
 			printer.println_decreasing("}");
 			printer.println_increasing("else if (size >= 4 && (s[0] & 0xF8) == 0xF0) {");
-			printer.println("result.v0.v1 = string_iterator.v1 + 4;");
+			printer.println(format("result.v0.v1 = %.v1 + 4;", value));
 			printer.println("result.v1 = 1;");
 			printer.println("result.v2 = 0;");
 			printer.println("result.v2 |= (s[0] & 0x07) << 18;");
@@ -575,12 +980,138 @@ class CodegenC: public Visitor<Variable> {
 			printer.println("result.v2 |= (s[3] & 0x3F);");
 			printer.println_decreasing("}");
 			printer.println_increasing("else {");
-			printer.println("result.v0.v1 = string_iterator.v1;");
+			printer.println(format("result.v0.v1 = %.v1;", value));
 			printer.println("result.v1 = 0;");
 			printer.println_decreasing("}");
+		}
+		void generate_string_iterator_functions(const ::Type* type) {
+			const Type string_iterator_type = get_type(type);
+			const Type number_type = get_type(TypeInterner::get_int_type());
+			const Type char_type = get_type(TypeInterner::get_char_type());
+			IndentPrinter& printer = type_function_printer;
+
+			// string_iterator_get_next
+			TupleType iteration_result_type_tuple;
+			iteration_result_type_tuple.add_element_type(type);
+			iteration_result_type_tuple.add_element_type(TypeInterner::get_int_type());
+			iteration_result_type_tuple.add_element_type(TypeInterner::get_int_type());
+			const Type iteration_result_type = get_type(TypeInterner::intern(&iteration_result_type_tuple));
+			function_declaration_printer.println(format("static % string_iterator_get_next(%);", iteration_result_type, string_iterator_type));
+			printer.println_increasing(format("static % string_iterator_get_next(% string_iterator) {", iteration_result_type, string_iterator_type));
+			printer.println(format("%* s = string_iterator.v0->elements + string_iterator.v1;", char_type));
+			printer.println(format("% size = string_iterator.v0->length - string_iterator.v1;", number_type));
+			printer.println(format("% result;", iteration_result_type));
+			printer.println("result.v0 = string_iterator;");
+			print_get_next(printer, "string_iterator");
 			printer.println("return result;");
 			printer.println_decreasing("}");
 		}
+		void generate_slice_functions(const ::Type* type) {
+			const ::Type* sliced_type = get_array_type(type);
+			const bool null_terminated = sliced_type->get_id() == TypeId::STRING;
+			const Type slice_type = get_type(type);
+			const Type array_type = get_type(sliced_type);
+			const Type element_type = get_type(get_element_type(sliced_type));
+			const Type number_type = get_type(TypeInterner::get_int_type());
+			const Type void_type = get_type(TypeInterner::get_void_type());
+			IndentPrinter& printer = type_function_printer;
+
+			// slice_copy_range
+			// copies only the elements in the range of the slice into a new array
+			printer.println_increasing(format("static % %_copy_range(% slice) {", array_type, slice_type, slice_type));
+			printer.println(format("% length = slice.v2 - slice.v1;", number_type));
+			if (null_terminated) {
+				printer.println(format("% array = %(sizeof(struct %) + (length + 1) * sizeof(%));", array_type, get_malloc(), array_type, element_type));
+				print_allocation(printer, sliced_type, format("sizeof(struct %) + (length + 1) * sizeof(%)", array_type, element_type));
+			}
+			else {
+				printer.println(format("% array = %(sizeof(struct %) + length * sizeof(%));", array_type, get_malloc(), array_type, element_type));
+				print_allocation(printer, sliced_type, format("sizeof(struct %) + length * sizeof(%)", array_type, element_type));
+			}
+			if (options.reference_counting) {
+				printer.println("array->refcount = 1;");
+			}
+			printer.println("array->length = length;");
+			printer.println("array->capacity = length;");
+			if (is_managed(get_element_type(sliced_type))) {
+				printer.println_increasing(format("for (% i = 0; i < length; i++) {", number_type));
+				printer.println(format("array->elements[i] = %_copy(slice.v0->elements[slice.v1 + i]);", element_type));
+				printer.println_decreasing("}");
+			}
+			else {
+				printer.println(format("memcpy(array->elements, slice.v0->elements + slice.v1, length * sizeof(%));", element_type));
+			}
+			if (null_terminated) {
+				printer.println("array->elements[length] = 0;");
+			}
+			printer.println("return array;");
+			printer.println_decreasing("}");
+
+			// slice_copy
+			function_declaration_printer.println(format("static % %_copy(%);", slice_type, slice_type, slice_type));
+			printer.println_increasing(format("static % %_copy(% slice) {", slice_type, slice_type, slice_type));
+			if (options.reference_counting) {
+				// copies share the array
+				printer.println(format("slice.v0 = %_copy(slice.v0);", array_type));
+			}
+			else {
+				printer.println(format("slice.v0 = %_copy_range(slice);", slice_type));
+				printer.println("slice.v2 -= slice.v1;");
+				printer.println("slice.v1 = 0;");
+			}
+			printer.println("return slice;");
+			printer.println_decreasing("}");
+
+			// slice_free
+			function_declaration_printer.println(format("static % %_free(%);", void_type, slice_type, slice_type));
+			printer.println_increasing(format("static % %_free(% slice) {", void_type, slice_type, slice_type));
+			printer.println(format("%_free(slice.v0);", array_type));
+			printer.println_decreasing("}");
+
+			// slice_to_array
+			// the slice owns its array, so the range can be moved to the front of it
+			printer.println_increasing(format("static % %_to_array(% slice) {", array_type, slice_type, slice_type));
+			printer.println(format("% array = slice.v0;", array_type));
+			printer.println_increasing("if (slice.v1 == 0 && slice.v2 == array->length) {");
+			printer.println("return array;");
+			printer.println_decreasing("}");
+			if (options.reference_counting) {
+				printer.println_increasing("if (array->refcount > 1) {");
+				printer.println("array->refcount -= 1;");
+				printer.println(format("return %_copy_range(slice);", slice_type));
+				printer.println_decreasing("}");
+			}
+			if (is_managed(get_element_type(sliced_type))) {
+				printer.println_increasing(format("for (% i = 0; i < array->length; i++) {", number_type));
+				printer.println(format("if (i < slice.v1 || i >= slice.v2) %_free(array->elements[i]);", element_type));
+				printer.println_decreasing("}");
+			}
+			printer.println(format("memmove(array->elements, array->elements + slice.v1, (slice.v2 - slice.v1) * sizeof(%));", element_type));
+			printer.println("array->length = slice.v2 - slice.v1;");
+			if (null_terminated) {
+				printer.println("array->elements[array->length] = 0;");
+			}
+			printer.println("return array;");
+			printer.println_decreasing("}");
+
+			// slice_get_next
+			if (null_terminated) {
+				TupleType iteration_result_type_tuple;
+				iteration_result_type_tuple.add_element_type(type);
+				iteration_result_type_tuple.add_element_type(TypeInterner::get_int_type());
+				iteration_result_type_tuple.add_element_type(TypeInterner::get_int_type());
+				const Type iteration_result_type = get_type(TypeInterner::intern(&iteration_result_type_tuple));
+				function_declaration_printer.println(format("static % %_get_next(%);", iteration_result_type, slice_type, slice_type));
+				printer.println_increasing(format("static % %_get_next(% slice) {", iteration_result_type, slice_type, slice_type));
+				printer.println(format("%* s = slice.v0->elements + slice.v1;", element_type));
+				printer.println(format("% size = slice.v2 - slice.v1;", number_type));
+				printer.println(format("% result;", iteration_result_type));
+				printer.println("result.v0 = slice;");
+				print_get_next(printer, "slice");
+				printer.println("return result;");
+				printer.println_decreasing("}");
+			}
+		}
 		void generate_reference_functions(const ::Type* type) {
 			const Type reference_type = get_type(type);
 			const Type value_type = get_type(static_cast<const ReferenceType*>(type)->get_type());
@@ -588,9 +1119,11 @@ class CodegenC: public Visitor<Variable> {
 			IndentPrinter& printer = type_function_printer;
 
 			// reference_copy
+			// references are not reference counted, even with -rc a copy allocates a new node and copies the value
 			function_declaration_printer.println(format("static % %_copy(%);", reference_type, reference_type, reference_type));
 			printer.println_increasing(format("static % %_copy(% reference) {", reference_type, reference_type, reference_type));
-			printer.println(format("% new_reference = malloc(sizeof(struct %));", reference_type, reference_type));
+			printer.println(format("% new_reference = %(sizeof(struct %));", reference_type, get_malloc(), reference_type));
+			print_allocation(printer, type, format("sizeof(struct %)", reference_type));
 			printer.println(format("new_reference->value = %_copy(reference->value);", value_type));
 			printer.println("return new_reference;");
 			printer.println_decreasing("}");
@@ -599,24 +1132,89 @@ class CodegenC: public Visitor<Variable> {
 			function_declaration_printer.println(format("static % %_free(%);", void_type, reference_type, reference_type));
 			printer.println_increasing(format("static % %_free(% reference) {", void_type, reference_type, reference_type));
 			printer.println(format("%_free(reference->value);", value_type));
-			printer.println("free(reference);");
+			printer.println(format("%(reference);", get_free()));
 			printer.println_decreasing("}");
 		}
 	};
-	FunctionTable& function_table;
-	IndentPrinter& printer;
-	using ExpressionTable = std::map<const Expression*, Variable>;
-	ExpressionTable& expression_table;
-	std::size_t variable;
-	Variable case_variable;
-	Variable result;
-	const TailCallData& tail_call_data;
-	Variable next_variable() {
-		return Variable(variable++);
-	}
-	CodegenC(FunctionTable& function_table, IndentPrinter& printer, ExpressionTable& expression_table, std::size_t variable, Variable case_variable, Variable result, const TailCallData& tail_call_data): function_table(function_table), printer(printer), expression_table(expression_table), variable(variable), case_variable(case_variable), result(result), tail_call_data(tail_call_data) {}
-	static void evaluate(FunctionTable& function_table, IndentPrinter& printer, ExpressionTable& expression_table, std::size_t variable, Variable case_variable, Variable result, const TailCallData& tail_call_data, const Block& block) {
-		CodegenC codegen(function_table, printer, expression_table, variable, case_variable, result, tail_call_data);
+	// declares the types of all expressions in a block ahead of code generation
+	// the number of counters used by the profileCounter intrinsics of a program
+	class ProfileCounters: public Visitor<void> {
+		class GetIndex: public Visitor<std::size_t> {
+		public:
+			std::size_t visit_int_literal(const IntLiteral& int_literal) override {
+				return int_literal.get_value();
+			}
+		};
+		std::size_t counters = 0;
+		void evaluate(const Block& block) {
+			for (const Expression* expression: block) {
+				visit(*this, expression);
+			}
+		}
+	public:
+		static std::size_t evaluate(const Program& program) {
+			ProfileCounters profile_counters;
+			for (const Function* function: program) {
+				profile_counters.evaluate(function->get_block());
+			}
+			return profile_counters.counters;
+		}
+		void visit_if(const If& if_) override {
+			evaluate(if_.get_then_block());
+			evaluate(if_.get_else_block());
+		}
+		void visit_switch(const Switch& switch_) override {
+			for (const auto& case_: switch_.get_cases()) {
+				evaluate(case_.second);
+			}
+		}
+		void visit_intrinsic(const Intrinsic& intrinsic) override {
+			if (intrinsic.name_equals("profileCounter")) {
+				GetIndex get_index;
+				counters = std::max(counters, visit(get_index, intrinsic.get_arguments()[0]) + 1);
+			}
+		}
+	};
+	class TypeDeclaration: public Visitor<void> {
+		FunctionTable& function_table;
+	public:
+		TypeDeclaration(FunctionTable& function_table): function_table(function_table) {}
+		static void evaluate(FunctionTable& function_table, const Block& block) {
+			TypeDeclaration type_declaration(function_table);
+			for (const Expression* expression: block) {
+				function_table.get_type(expression->get_type());
+				visit(type_declaration, expression);
+			}
+		}
+		void visit_if(const If& if_) override {
+			evaluate(function_table, if_.get_then_block());
+			evaluate(function_table, if_.get_else_block());
+		}
+		void visit_switch(const Switch& switch_) override {
+			for (const auto& case_: switch_.get_cases()) {
+				evaluate(function_table, case_.second);
+			}
+		}
+		void visit_intrinsic(const Intrinsic& intrinsic) override {
+			if (intrinsic.get_function()) {
+				function_table.get_parallel_body(intrinsic.get_function(), intrinsic.name_equals("parallelReduce"));
+			}
+		}
+	};
+	FunctionTable& function_table;
+	IndentPrinter& printer;
+	using ExpressionTable = IndexTable<Expression, Variable>;
+	ExpressionTable& expression_table;
+	std::size_t variable;
+	Variable case_variable;
+	Variable result;
+	const TailCallData& tail_call_data;
+	Variable next_variable() {
+		return Variable(variable++);
+	}
+	CodegenC(FunctionTable& function_table, IndentPrinter& printer, ExpressionTable& expression_table, std::size_t variable, Variable case_variable, Variable result, const TailCallData& tail_call_data): function_table(function_table), printer(printer), expression_table(expression_table), variable(variable), case_variable(case_variable), result(result), tail_call_data(tail_call_data) {}
+	static void evaluate(FunctionTable& function_table, IndentPrinter& printer, ExpressionTable& expression_table, std::size_t variable, Variable case_variable, Variable result, const TailCallData& tail_call_data, const Block& block) {
+		CodegenC codegen(function_table, printer, expression_table, variable, case_variable, result, tail_call_data);
 		for (const Expression* expression: block) {
 			expression_table[expression] = visit(codegen, expression);
 		}
@@ -650,11 +1248,28 @@ public:
 		printer.println(format("% % = % % %;", type, result, left, print_operator(binary_expression.get_operation()), right));
 		return result;
 	}
+	// declares storage for an array in the current stack frame
+	void print_stack_array(const Type& type, const Type& element_type, const Variable& array, std::size_t capacity, std::size_t length) {
+		printer.println(format("_Alignas(struct %) char %_storage[sizeof(struct %) + % * sizeof(%)];", type, array, type, print_number(capacity), element_type));
+		printer.println(format("% % = (%)%_storage;", type, array, type, array));
+		if (function_table.is_reference_counted()) {
+			printer.println(format("%->refcount = 1;", array));
+		}
+		printer.println(format("%->length = %;", array, print_number(length)));
+		printer.println(format("%->capacity = %;", array, print_number(length)));
+	}
 	Variable visit_array_literal(const ArrayLiteral& array_literal) override {
 		const Variable result = next_variable();
 		const Type type = function_table.get_type(array_literal.get_type());
 		const Type element_type = function_table.get_type(get_element_type(array_literal.get_type()));
 		const std::size_t size = array_literal.get_elements().size();
+		if (function_table.is_stack_allocated(&array_literal)) {
+			print_stack_array(type, element_type, result, size, size);
+			for (std::size_t i = 0; i < size; ++i) {
+				printer.println(format("%->elements[%] = %;", result, print_number(i), expression_table[array_literal.get_elements()[i]]));
+			}
+			return result;
+		}
 		printer.println(print_functor([&](auto& printer) {
 			printer.print(format("% % = %_new((%[]){", type, result, type, element_type));
 			for (std::size_t i = 0; i < size; ++i) {
@@ -665,24 +1280,34 @@ public:
 		}));
 		return result;
 	}
-	Variable visit_string_literal(const StringLiteral& string_literal) override {
-		const Variable result = next_variable();
-		const Type type = function_table.get_type(string_literal.get_type());
-		printer.println(print_functor([&](auto& printer) {
-			std::size_t size = 0;
-			printer.print(format("% % = %_new(\"", type, result, type));
-			for (std::int32_t codepoint: code_points(string_literal.get_value())) {
+	static auto print_string_literal(const std::string& value) {
+		return print_functor([&value](auto& printer) {
+			printer.print('"');
+			for (std::int32_t codepoint: code_points(value)) {
 				if (is_printable_character(codepoint)) {
 					printer.print(static_cast<char>(codepoint));
-					++size;
 				}
 				else for (char c: from_codepoint(codepoint)) {
 					printer.print(format("\\%", print_octal(static_cast<unsigned char>(c), 3)));
-					++size;
 				}
 			}
-			printer.print(format("\", %);", print_number(size)));
-		}));
+			printer.print('"');
+		});
+	}
+	Variable visit_string_literal(const StringLiteral& string_literal) override {
+		const Variable result = next_variable();
+		const Type type = function_table.get_type(string_literal.get_type());
+		std::size_t size = 0;
+		for (std::int32_t codepoint: code_points(string_literal.get_value())) {
+			size += is_printable_character(codepoint) ? 1 : from_codepoint(codepoint).size();
+		}
+		if (function_table.is_stack_allocated(&string_literal)) {
+			const Type element_type = function_table.get_type(get_element_type(string_literal.get_type()));
+			print_stack_array(type, element_type, result, size + 1, size);
+			printer.println(format("memcpy(%->elements, %, %);", result, print_string_literal(string_literal.get_value()), print_number(size + 1)));
+			return result;
+		}
+		printer.println(format("% % = %_new(%, %);", type, result, type, print_string_literal(string_literal.get_value()), print_number(size)));
 		return result;
 	}
 	Variable visit_if(const If& if_) override {
@@ -752,10 +1377,25 @@ public:
 		const std::size_t index = enum_literal.get_index();
 		const Variable result = next_variable();
 		const Type result_type = function_table.get_type(enum_literal.get_type());
-		printer.println(format("% %;", result_type, result));
-		printer.println(format("%.tag = %;", result, print_number(index)));
-		if (enum_literal.get_expression()->get_type() != TypeInterner::get_void_type()) {
-			printer.println(format("%.value.v% = %;", result, print_number(index), expression));
+		switch (get_enum_layout(static_cast<const EnumType*>(enum_literal.get_type()))) {
+		case EnumLayout::TAGGED:
+			printer.println(format("% %;", result_type, result));
+			printer.println(format("%.tag = %;", result, print_number(index)));
+			if (enum_literal.get_expression()->get_type() != TypeInterner::get_void_type()) {
+				printer.println(format("%.value.v% = %;", result, print_number(index), expression));
+			}
+			break;
+		case EnumLayout::TAG_ONLY:
+			printer.println(format("% % = %;", result_type, result, print_number(index)));
+			break;
+		case EnumLayout::NULLABLE_REFERENCE:
+			if (enum_literal.get_expression()->get_type() != TypeInterner::get_void_type()) {
+				printer.println(format("% % = %;", result_type, result, expression));
+			}
+			else {
+				printer.println(format("% % = NULL;", result_type, result));
+			}
+			break;
 		}
 		return result;
 	}
@@ -779,26 +1419,27 @@ public:
 			const Type result_type = function_table.get_type(switch_.get_type());
 			printer.println(format("% %;", result_type, result));
 		}
+		const EnumType* enum_type = get_enum_type(switch_.get_enum());
 		if (switch_.get_enum()->get_type_id() == TypeId::REFERENCE) {
-			printer.println_increasing(format("switch (%->value.tag) {", enum_));
+			printer.println_increasing(format("switch (%) {", print_enum_tag(enum_type, format("%->value", enum_))));
 		}
 		else {
-			printer.println_increasing(format("switch (%.tag) {", enum_));
+			printer.println_increasing(format("switch (%) {", print_enum_tag(enum_type, enum_)));
 		}
 		for (std::size_t i = 0; i < switch_.get_cases().size(); ++i) {
 			const Block& case_block = switch_.get_cases()[i].second;
-			const ::Type* case_type = get_enum_type(switch_.get_enum())->get_cases()[i].second;
+			const ::Type* case_type = enum_type->get_cases()[i].second;
 			printer.println_increasing(format("case %: {", print_number(i)));
 			if (case_type != TypeInterner::get_void_type()) {
 				if (switch_.get_enum()->get_type_id() == TypeId::REFERENCE) {
-					printer.println(format("% % = %->value.value.v%;", function_table.get_type(case_type), case_variable, enum_, print_number(i)));
+					printer.println(format("% % = %;", function_table.get_type(case_type), case_variable, print_enum_value(enum_type, format("%->value", enum_), i)));
 				}
 				else {
-					printer.println(format("% % = %.value.v%;", function_table.get_type(case_type), case_variable, enum_, print_number(i)));
+					printer.println(format("% % = %;", function_table.get_type(case_type), case_variable, print_enum_value(enum_type, enum_, i)));
 				}
 			}
-			if (switch_.get_enum()->get_type_id() == TypeId::REFERENCE) {
-				printer.println(format("free(%);", enum_));
+			if (switch_.get_enum()->get_type_id() == TypeId::REFERENCE && !function_table.is_stack_allocated(switch_.get_enum())) {
+				printer.println(format("%(%);", function_table.get_free(), enum_));
 			}
 			evaluate(case_variable, result, case_block);
 			printer.println("break;");
@@ -816,11 +1457,30 @@ public:
 	Variable visit_function_call(const FunctionCall& call) override {
 		const std::size_t new_index = function_table.look_up(call.get_function());
 		const Variable result = next_variable();
-		if (tail_call_data.is_tail_call(&call)) {
+		if (tail_call_data.is_group_tail_call(&call)) {
 			for (std::size_t i = 0; i < call.get_arguments().size(); ++i) {
 				if (call.get_arguments()[i]->get_type() != TypeInterner::get_void_type()) {
 					const Variable argument = expression_table[call.get_arguments()[i]];
-					printer.println(format("% = %;", Variable(i), argument));
+					printer.println(format("arguments.f%.% = %;", print_number(new_index), Variable(i), argument));
+				}
+			}
+			printer.println(format("state = %;", print_number(new_index)));
+			printer.println("continue;");
+		}
+		else if (tail_call_data.is_tail_call(&call)) {
+			// stage the arguments so that no argument is overwritten before it is read
+			const std::size_t first_temporary = variable;
+			for (std::size_t i = 0; i < call.get_arguments().size(); ++i) {
+				if (call.get_arguments()[i]->get_type() != TypeInterner::get_void_type()) {
+					const Type argument_type = function_table.get_type(call.get_arguments()[i]->get_type());
+					const Variable argument = expression_table[call.get_arguments()[i]];
+					printer.println(format("% % = %;", argument_type, Variable(first_temporary + i), argument));
+				}
+				next_variable();
+			}
+			for (std::size_t i = 0; i < call.get_arguments().size(); ++i) {
+				if (call.get_arguments()[i]->get_type() != TypeInterner::get_void_type()) {
+					printer.println(format("% = %;", Variable(i), Variable(first_temporary + i)));
 				}
 			}
 			printer.println("continue;");
@@ -843,32 +1503,60 @@ public:
 		}));
 		return result;
 	}
+	// releases an array after its elements have been spliced into another array
+	void print_consume(const Type& type, const Variable& array) {
+		if (function_table.is_reference_counted()) {
+			printer.println(format("%_consume(%);", type, array));
+		}
+		else {
+			printer.println(format("%(%);", function_table.get_free(), array));
+		}
+	}
 	Variable visit_intrinsic(const Intrinsic& intrinsic) override {
 		const Variable result = next_variable();
 		if (intrinsic.name_equals("putChar")) {
 			const Variable argument = expression_table[intrinsic.get_arguments()[0]];
-			printer.println(format("fputc(%, stdout);", argument));
+			printer.println(format("io_put_char(%);", argument));
 		}
 		else if (intrinsic.name_equals("putStr")) {
 			const Variable argument = expression_table[intrinsic.get_arguments()[0]];
-			printer.println(format("fputs(%->elements, stdout);", argument));
+			printer.println(format("io_put_bytes(%->elements, %->length);", argument, argument));
 		}
 		else if (intrinsic.name_equals("getChar")) {
 			const Type type = function_table.get_type(intrinsic.get_type());
-			printer.println(format("% % = getchar();", type, result));
+			printer.println(format("% % = io_get_char();", type, result));
+		}
+		else if (intrinsic.name_equals("readAll")) {
+			const Type type = function_table.get_type(intrinsic.get_type());
+			printer.println(format("% % = %_read_all();", type, result, type));
+		}
+		else if (intrinsic.name_equals("writeAll")) {
+			const Variable argument = expression_table[intrinsic.get_arguments()[0]];
+			printer.println(format("io_write_all(%->elements, %->length);", argument, argument));
 		}
 		else if (intrinsic.name_equals("arrayGet")) {
 			const Variable array = expression_table[intrinsic.get_arguments()[0]];
 			const Variable index = expression_table[intrinsic.get_arguments()[1]];
 			const Type type = function_table.get_type(intrinsic.get_type());
-			printer.println(format("% % = %->elements[%];", type, result, array, index));
+			if (intrinsic.get_arguments()[0]->get_type_id() == TypeId::SLICE) {
+				printer.println(format("% % = %.v0->elements[%.v1 + %];", type, result, array, array, index));
+			}
+			else {
+				printer.println(format("% % = %->elements[%];", type, result, array, index));
+			}
 		}
 		else if (intrinsic.name_equals("arrayLength")) {
 			const Variable array = expression_table[intrinsic.get_arguments()[0]];
 			const Type type = function_table.get_type(intrinsic.get_type());
-			printer.println(format("% % = %->length;", type, result, array));
+			if (intrinsic.get_arguments()[0]->get_type_id() == TypeId::SLICE) {
+				printer.println(format("% % = %.v2 - %.v1;", type, result, array, array));
+			}
+			else {
+				printer.println(format("% % = %->length;", type, result, array));
+			}
 		}
-		else if (intrinsic.name_equals("arraySplice")) {
+		else if (intrinsic.name_equals("arraySplice") || intrinsic.name_equals("arraySpliceCopy")) {
+			const StringView splice = intrinsic.name_equals("arraySplice") ? "splice" : "splice_copy";
 			const Type type = function_table.get_type(intrinsic.get_type());
 			const Type element_type = function_table.get_type(get_element_type(intrinsic.get_type()));
 			const Variable array = expression_table[intrinsic.get_arguments()[0]];
@@ -876,13 +1564,13 @@ public:
 			const Variable remove = expression_table[intrinsic.get_arguments()[2]];
 			if (intrinsic.get_arguments().size() == 4 && intrinsic.get_arguments()[3]->get_type() == intrinsic.get_type()) {
 				const Variable insert = expression_table[intrinsic.get_arguments()[3]];
-				printer.println(format("% % = %_splice(%, %, %, %->elements, %->length);", type, result, type, array, index, remove, insert, insert));
-				printer.println(format("free(%);", insert));
+				printer.println(format("% % = %_%(%, %, %, %->elements, %->length);", type, result, type, splice, array, index, remove, insert, insert));
+				print_consume(type, insert);
 			}
 			else {
 				const std::size_t insert = intrinsic.get_arguments().size() - 3;
 				printer.println(print_functor([&](auto& printer) {
-					printer.print(format("% % = %_splice(%, %, %, (%[]){", type, result, type, array, index, remove, element_type));
+					printer.print(format("% % = %_%(%, %, %, (%[]){", type, result, type, splice, array, index, remove, element_type));
 					for (std::size_t i = 0; i < insert; ++i) {
 						if (i > 0) printer.print(", ");
 						printer.print(expression_table[intrinsic.get_arguments()[i + 3]]);
@@ -891,22 +1579,23 @@ public:
 				}));
 			}
 		}
-		else if (intrinsic.name_equals("stringPush")) {
+		else if (intrinsic.name_equals("stringPush") || intrinsic.name_equals("stringPushCopy") || intrinsic.name_equals("stringBuilderPush")) {
+			const StringView splice = intrinsic.name_equals("stringPushCopy") ? "splice_copy" : "splice";
 			const Type type = function_table.get_type(intrinsic.get_type());
 			const Type element_type = function_table.get_type(get_element_type(intrinsic.get_type()));
 			const Type number_type = function_table.get_type(TypeInterner::get_int_type());
 			const Variable string = expression_table[intrinsic.get_arguments()[0]];
 			const Variable argument = expression_table[intrinsic.get_arguments()[1]];
-			if (intrinsic.get_arguments()[1]->get_type() == intrinsic.get_type()) {
-				printer.println(format("% % = %_splice(%, %->length, 0, %->elements, %->length);", type, result, type, string, string, argument, argument));
-				printer.println(format("free(%);", argument));
+			if (intrinsic.get_arguments()[1]->get_type_id() == TypeId::STRING) {
+				printer.println(format("% % = %_%(%, %->length, 0, %->elements, %->length);", type, result, type, splice, string, string, argument, argument));
+				print_consume(type, argument);
 			}
 			else {
 				const Variable elements = next_variable();
 				const Variable length = next_variable();
 				printer.println(format("% %[4];", element_type, elements));
 				printer.println(format("% % = from_codepoint(%, %);", number_type, length, argument, elements));
-				printer.println(format("% % = %_splice(%, %->length, 0, %, %);", type, result, type, string, string, elements, length));
+				printer.println(format("% % = %_%(%, %->length, 0, %, %);", type, result, type, splice, string, string, elements, length));
 			}
 		}
 		else if (intrinsic.name_equals("stringIterator")) {
@@ -921,21 +1610,157 @@ public:
 			const Type type = function_table.get_type(intrinsic.get_type());
 			printer.println(format("% % = string_iterator_get_next(%);", type, result, iterator));
 		}
+		else if (intrinsic.name_equals("stringBuilder")) {
+			const Type type = function_table.get_type(intrinsic.get_type());
+			printer.println(format("% % = %_new(NULL, 0);", type, result, type));
+		}
+		else if (intrinsic.name_equals("stringBuilderToString")) {
+			const Variable builder = expression_table[intrinsic.get_arguments()[0]];
+			const Type type = function_table.get_type(intrinsic.get_type());
+			printer.println(format("% % = %;", type, result, builder));
+		}
+		else if (intrinsic.name_equals("slice") || intrinsic.name_equals("sliceCopy")) {
+			const Expression* argument = intrinsic.get_arguments()[0];
+			const Variable array = expression_table[argument];
+			const Type type = function_table.get_type(intrinsic.get_type());
+			// sliceCopy borrows its array and copies the view
+			const Variable view = intrinsic.name_equals("slice") ? result : next_variable();
+			printer.println(format("% %;", type, view));
+			if (argument->get_type_id() == TypeId::SLICE) {
+				printer.println(format("%.v0 = %.v0;", view, array));
+				if (intrinsic.get_arguments().size() == 3) {
+					const Variable start = expression_table[intrinsic.get_arguments()[1]];
+					const Variable end = expression_table[intrinsic.get_arguments()[2]];
+					printer.println(format("%.v1 = %.v1 + %;", view, array, start));
+					printer.println(format("%.v2 = %.v1 + %;", view, array, end));
+				}
+				else {
+					printer.println(format("%.v1 = %.v1;", view, array));
+					printer.println(format("%.v2 = %.v2;", view, array));
+				}
+			}
+			else {
+				printer.println(format("%.v0 = %;", view, array));
+				if (intrinsic.get_arguments().size() == 3) {
+					const Variable start = expression_table[intrinsic.get_arguments()[1]];
+					const Variable end = expression_table[intrinsic.get_arguments()[2]];
+					printer.println(format("%.v1 = %;", view, start));
+					printer.println(format("%.v2 = %;", view, end));
+				}
+				else {
+					printer.println(format("%.v1 = 0;", view));
+					printer.println(format("%.v2 = %->length;", view, array));
+				}
+			}
+			if (intrinsic.name_equals("sliceCopy")) {
+				printer.println(format("% % = %_copy(%);", type, result, type, view));
+			}
+		}
+		else if (intrinsic.name_equals("sliceGetNext")) {
+			const Expression* argument = intrinsic.get_arguments()[0];
+			const Variable slice = expression_table[argument];
+			const Type slice_type = function_table.get_type(argument->get_type());
+			const Type type = function_table.get_type(intrinsic.get_type());
+			printer.println(format("% % = %_get_next(%);", type, result, slice_type, slice));
+		}
+		else if (intrinsic.name_equals("sliceToArray")) {
+			const Expression* argument = intrinsic.get_arguments()[0];
+			const Variable slice = expression_table[argument];
+			const Type slice_type = function_table.get_type(argument->get_type());
+			const Type type = function_table.get_type(intrinsic.get_type());
+			printer.println(format("% % = %_to_array(%);", type, result, slice_type, slice));
+		}
+		else if (intrinsic.name_equals("parallelMap") || intrinsic.name_equals("parallelReduce")) {
+			const bool reduce = intrinsic.name_equals("parallelReduce");
+			const Function* function = intrinsic.get_function();
+			const std::size_t body = function_table.get_parallel_body(function, reduce);
+			const Variable array = expression_table[intrinsic.get_arguments()[0]];
+			const std::size_t first_argument = reduce ? 2 : 1;
+			const Type type = function_table.get_type(intrinsic.get_type());
+			const Type element_type = function_table.get_type(reduce ? intrinsic.get_type() : get_element_type(intrinsic.get_type()));
+			printer.println(format("p%_context %_context;", print_number(body), result));
+			printer.println(format("%_context.source = %->elements;", result, array));
+			printer.println(format("%_context.length = %->length;", result, array));
+			for (std::size_t i = first_argument; i < intrinsic.get_arguments().size(); ++i) {
+				if (intrinsic.get_arguments()[i]->get_type() != TypeInterner::get_void_type()) {
+					printer.println(format("%_context.% = %;", result, Variable(i - first_argument), expression_table[intrinsic.get_arguments()[i]]));
+				}
+			}
+			if (reduce) {
+				printer.println(format("%_context.initial = %;", result, expression_table[intrinsic.get_arguments()[1]]));
+				printer.println(format("size_t %_length = (%_context.length + PARALLEL_BLOCK - 1) / PARALLEL_BLOCK;", result, result));
+			}
+			else {
+				printer.println(format("size_t %_length = %_context.length;", result, result));
+			}
+			printer.println(format("%_context.elements = malloc(%_length * sizeof(%));", result, result, element_type));
+			if (function_table.is_parallel(function)) {
+				printer.println(format("parallel_for(%_length, p%_body, &%_context);", result, print_number(body), result));
+			}
+			else {
+				printer.println(format("p%_body(&%_context, 0, %_length);", print_number(body), result, result));
+			}
+			if (reduce) {
+				// the partial results of the blocks are combined in order
+				printer.println(format("% %;", type, result));
+				printer.println_increasing(format("if (%_length == 0) {", result));
+				if (is_managed(intrinsic.get_type())) {
+					printer.println(format("% = %_copy(%_context.initial);", result, type, result));
+				}
+				else {
+					printer.println(format("% = %_context.initial;", result, result));
+				}
+				printer.println_decreasing("}");
+				printer.println_increasing("else {");
+				printer.println(format("% = %_context.elements[0];", result, result));
+				printer.println_increasing(format("for (size_t i = 1; i < %_length; ++i) {", result));
+				printer.println(format("% = %;", result, function_table.print_parallel_combine(function, result)));
+				printer.println_decreasing("}");
+				printer.println_decreasing("}");
+			}
+			else {
+				printer.println(format("% % = %_new(%_context.elements, %_length);", type, result, type, result, result));
+			}
+			printer.println(format("free(%_context.elements);", result));
+		}
 		else if (intrinsic.name_equals("reference")) {
 			const Variable value = expression_table[intrinsic.get_arguments()[0]];
 			const Type type = function_table.get_type(intrinsic.get_type());
-			printer.println(format("% % = malloc(sizeof(struct %));", type, result, type));
+			if (function_table.is_stack_allocated(&intrinsic)) {
+				printer.println(format("struct % %_storage;", type, result));
+				printer.println(format("% % = &%_storage;", type, result, result));
+			}
+			else {
+				printer.println(format("% % = %(sizeof(struct %));", type, result, function_table.get_malloc(), type));
+				function_table.print_allocation(printer, intrinsic.get_type(), format("sizeof(struct %)", type));
+			}
 			printer.println(format("%->value = %;", result, value));
 		}
+		else if (intrinsic.name_equals("profileCounter")) {
+			const Variable index = expression_table[intrinsic.get_arguments()[0]];
+			printer.println(format("profile_counters[%] += 1;", index));
+		}
 		else if (intrinsic.name_equals("copy")) {
 			const Variable array = expression_table[intrinsic.get_arguments()[0]];
 			const Type type = function_table.get_type(intrinsic.get_type());
 			printer.println(format("% % = %_copy(%);", type, result, type, array));
 		}
 		else if (intrinsic.name_equals("free")) {
-			const Variable array = expression_table[intrinsic.get_arguments()[0]];
-			const Type type = function_table.get_type(intrinsic.get_arguments()[0]->get_type());
-			printer.println(format("%_free(%);", type, array));
+			const Expression* argument = intrinsic.get_arguments()[0];
+			const Variable array = expression_table[argument];
+			const Type type = function_table.get_type(argument->get_type());
+			if (function_table.is_stack_allocated(argument)) {
+				// only the value of a reference in the stack frame needs to be freed
+				if (argument->get_type_id() == TypeId::REFERENCE) {
+					const ::Type* value_type = static_cast<const ReferenceType*>(argument->get_type())->get_type();
+					if (is_managed(value_type)) {
+						printer.println(format("%_free(%->value);", function_table.get_type(value_type), array));
+					}
+				}
+			}
+			else {
+				printer.println(format("%_free(%);", type, array));
+			}
 		}
 		else {
 			printer.println(print_functor([&](auto& printer) {
@@ -960,80 +1785,726 @@ public:
 	}
 	Variable visit_return(const Return& return_) override {
 		const Expression* expression = return_.get_expression();
-		if (expression->get_type() != TypeInterner::get_void_type() && !tail_call_data.is_tail_call(expression)) {
+		if (expression->get_type() != TypeInterner::get_void_type() && !tail_call_data.is_tail_call(expression) && !tail_call_data.is_group_tail_call(expression)) {
 			printer.println(format("% = %;", result, expression_table[expression]));
 		}
 		return next_variable();
 	}
-	static void codegen(const Program& program, const char* source_path, const TailCallData& tail_call_data) {
+	// buffered input and output on top of read and write
+	static void print_runtime_declarations(IndentPrinter& printer, StringView linkage) {
+		printer.println(format("%void io_flush(void);", linkage));
+		printer.println(format("%void io_put_char(char c);", linkage));
+		printer.println(format("%void io_put_bytes(const char* bytes, size_t length);", linkage));
+		printer.println(format("%void io_write_all(const char* bytes, size_t length);", linkage));
+		printer.println(format("%int32_t io_get_char(void);", linkage));
+		printer.println(format("%size_t io_read(char** bytes);", linkage));
+	}
+	// one counter per function before inlining, written to the profile when the program exits
+	static void print_profile_declarations(IndentPrinter& printer, StringView linkage, std::size_t counters) {
+		printer.println(format("%uint64_t profile_counters[%];", linkage.empty() ? "extern " : linkage, print_number(counters)));
+		printer.println(format("%void profile_write(void);", linkage));
+	}
+	static void print_profile(IndentPrinter& printer, StringView linkage, std::size_t counters, const std::string& path) {
+		printer.println(format("%uint64_t profile_counters[%];", linkage, print_number(counters)));
+		printer.println_increasing(format("%void profile_write(void) {", linkage));
+		printer.println(format("FILE* file = fopen(%, \"w\");", print_string_literal(path)));
+		printer.println("if (file == NULL) return;");
+		printer.println_increasing(format("for (size_t i = 0; i < %; ++i) {", print_number(counters)));
+		printer.println("if (profile_counters[i] > 0) fprintf(file, \"%zu %llu\\n\", i, (unsigned long long)profile_counters[i]);");
+		printer.println_decreasing("}");
+		printer.println("fclose(file);");
+		printer.println_decreasing("}");
+	}
+	// calls, cycles and allocations counted by -profile
+	// the clock is the time stamp counter on x86 and a monotonic clock in nanoseconds elsewhere
+	static void print_runtime_profile_declarations(IndentPrinter& printer, StringView linkage) {
+		printer.println("#if defined(_MSC_VER)");
+		printer.println("#include <intrin.h>");
+		printer.println("#define profile_clock() __rdtsc()");
+		printer.println("#elif defined(__x86_64__) || defined(__i386__)");
+		printer.println("#include <x86intrin.h>");
+		printer.println("#define profile_clock() __rdtsc()");
+		printer.println("#else");
+		printer.println("#include <time.h>");
+		printer.println_increasing("static inline uint64_t profile_clock(void) {");
+		printer.println("struct timespec time;");
+		printer.println("clock_gettime(CLOCK_MONOTONIC, &time);");
+		printer.println("return (uint64_t)time.tv_sec * 1000000000 + time.tv_nsec;");
+		printer.println_decreasing("}");
+		printer.println("#endif");
+		printer.println(format("%void profile_function(size_t function, uint64_t start);", linkage));
+		printer.println(format("%void profile_allocation(size_t type, size_t bytes);", linkage));
+		printer.println(format("%void profile_report(void);", linkage));
+	}
+	// the tables are printed after the functions have been generated since only then the number of types is known
+	static void print_runtime_profile(const Program& program, FunctionTable& function_table, IndentPrinter& printer, StringView linkage, const std::string& path) {
+		const std::size_t functions = std::max<std::size_t>(function_table.get_function_count(), 1);
+		const std::vector<const ::Type*> types = function_table.get_types();
+		std::vector<std::string> function_locations(functions, "?");
+		for (const Function* function: program) {
+			std::ostringstream location;
+			Printer location_printer(location);
+			if (function->get_path()) {
+				location_printer.print(format("%:%:%", function->get_path(), print_number(function_table.get_line(function)), print_number(function_table.get_column(function))));
+			}
+			else {
+				location_printer.print("?");
+			}
+			location_printer.print(' ');
+			location_printer.print(function->get_name().empty() ? "(anonymous)" : function->get_name().c_str());
+			function_locations[function_table.look_up(function)] = location.str();
+		}
+		printer.println(format("static uint64_t profile_function_calls[%];", print_number(functions)));
+		printer.println(format("static uint64_t profile_function_cycles[%];", print_number(functions)));
+		printer.println(format("static uint64_t profile_type_allocations[%];", print_number(std::max<std::size_t>(types.size(), 1))));
+		printer.println(format("static uint64_t profile_type_bytes[%];", print_number(std::max<std::size_t>(types.size(), 1))));
+		printer.println_increasing(format("static const char* profile_function_names[%] = {", print_number(functions)));
+		for (const std::string& location: function_locations) {
+			printer.println(format("%,", print_string_literal(location)));
+		}
+		printer.println_decreasing("};");
+		printer.println_increasing(format("static const char* profile_type_names[%] = {", print_number(std::max<std::size_t>(types.size(), 1))));
+		for (const ::Type* type: types) {
+			std::ostringstream name;
+			if (type) {
+				Printer(name).print(print_type(type));
+			}
+			printer.println(format("%,", print_string_literal(name.str())));
+		}
+		if (types.empty()) {
+			printer.println("\"\",");
+		}
+		printer.println_decreasing("};");
+		printer.println_increasing(format("%void profile_function(size_t function, uint64_t start) {", linkage));
+		printer.println("profile_function_calls[function] += 1;");
+		printer.println("profile_function_cycles[function] += profile_clock() - start;");
+		printer.println_decreasing("}");
+		printer.println_increasing(format("%void profile_allocation(size_t type, size_t bytes) {", linkage));
+		printer.println("profile_type_allocations[type] += 1;");
+		printer.println("profile_type_bytes[type] += bytes;");
+		printer.println_decreasing("}");
+		// the cycles of a function include the cycles of the functions it calls
+		printer.println_increasing(format("%void profile_report(void) {", linkage));
+		printer.println(format("FILE* file = fopen(%, \"w\");", print_string_literal(path)));
+		printer.println("if (file == NULL) return;");
+		printer.println("fprintf(file, \"function calls cycles location name\\n\");");
+		printer.println_increasing(format("for (size_t i = 0; i < %; ++i) {", print_number(functions)));
+		printer.println("if (profile_function_calls[i] > 0) fprintf(file, \"f%zu %llu %llu %s\\n\", i, (unsigned long long)profile_function_calls[i], (unsigned long long)profile_function_cycles[i], profile_function_names[i]);");
+		printer.println_decreasing("}");
+		printer.println("fprintf(file, \"type allocations bytes name\\n\");");
+		printer.println_increasing(format("for (size_t i = 0; i < %; ++i) {", print_number(types.size())));
+		printer.println("if (profile_type_allocations[i] > 0) fprintf(file, \"t%zu %llu %llu %s\\n\", i, (unsigned long long)profile_type_allocations[i], (unsigned long long)profile_type_bytes[i], profile_type_names[i]);");
+		printer.println_decreasing("}");
+		printer.println("fclose(file);");
+		printer.println_decreasing("}");
+	}
+	// size class allocator, blocks up to 256 bytes are kept in per-thread free lists for each multiple of 16 bytes
+	// every block is preceded by its size class, 0 marks blocks that come directly from malloc
+	static void print_pool_declarations(IndentPrinter& printer, StringView linkage) {
+		printer.println(format("%void* pool_alloc(size_t size);", linkage));
+		printer.println(format("%void* pool_realloc(void* pointer, size_t size);", linkage));
+		printer.println(format("%void pool_free(void* pointer);", linkage));
+	}
+	static void print_pool(IndentPrinter& printer, StringView linkage) {
+		printer.println("#define POOL_SIZE_CLASSES 16");
+		printer.println("#define POOL_CHUNK_SIZE (1 << 16)");
+		printer.println("static _Thread_local void* pool_free_lists[POOL_SIZE_CLASSES];");
+		printer.println("static _Thread_local char* pool_chunk = NULL;");
+		printer.println("static _Thread_local size_t pool_chunk_remaining = 0;");
+		printer.println_increasing(format("%void* pool_alloc(size_t size) {", linkage));
+		printer.println("size_t size_class = size == 0 ? 1 : (size + 15) / 16;");
+		printer.println_increasing("if (size_class > POOL_SIZE_CLASSES) {");
+		printer.println("size_t* block = malloc(sizeof(size_t) + size);");
+		printer.println("block[0] = 0;");
+		printer.println("return block + 1;");
+		printer.println_decreasing("}");
+		printer.println("void* pointer = pool_free_lists[size_class - 1];");
+		printer.println_increasing("if (pointer != NULL) {");
+		printer.println("pool_free_lists[size_class - 1] = *(void**)pointer;");
+		printer.println("return pointer;");
+		printer.println_decreasing("}");
+		printer.println("size_t block_size = sizeof(size_t) + size_class * 16;");
+		printer.println_increasing("if (pool_chunk_remaining < block_size) {");
+		printer.println("pool_chunk = malloc(POOL_CHUNK_SIZE);");
+		printer.println("pool_chunk_remaining = POOL_CHUNK_SIZE;");
+		printer.println_decreasing("}");
+		printer.println("size_t* block = (size_t*)pool_chunk;");
+		printer.println("pool_chunk += block_size;");
+		printer.println("pool_chunk_remaining -= block_size;");
+		printer.println("block[0] = size_class;");
+		printer.println("return block + 1;");
+		printer.println_decreasing("}");
+		printer.println_increasing(format("%void* pool_realloc(void* pointer, size_t size) {", linkage));
+		printer.println("size_t* block = (size_t*)pointer - 1;");
+		printer.println_increasing("if (block[0] == 0 && size > POOL_SIZE_CLASSES * 16) {");
+		printer.println("block = realloc(block, sizeof(size_t) + size);");
+		printer.println("return block + 1;");
+		printer.println_decreasing("}");
+		printer.println("if (block[0] != 0 && size <= block[0] * 16) return pointer;");
+		printer.println("void* new_pointer = pool_alloc(size);");
+		printer.println("memcpy(new_pointer, pointer, block[0] != 0 ? block[0] * 16 : size);");
+		printer.println("pool_free(pointer);");
+		printer.println("return new_pointer;");
+		printer.println_decreasing("}");
+		printer.println_increasing(format("%void pool_free(void* pointer) {", linkage));
+		printer.println("size_t* block = (size_t*)pointer - 1;");
+		printer.println_increasing("if (block[0] == 0) {");
+		printer.println("free(block);");
+		printer.println("return;");
+		printer.println_decreasing("}");
+		printer.println("*(void**)pointer = pool_free_lists[block[0] - 1];");
+		printer.println("pool_free_lists[block[0] - 1] = pointer;");
+		printer.println_decreasing("}");
+	}
+	// a pool of worker threads that is started on first use, every thread owns a range of the loop and takes items from its front
+	// a thread that runs out of items steals the back half of the range of another thread, loops inside a loop run sequentially
+	static void print_parallel_declarations(IndentPrinter& printer, StringView linkage) {
+		printer.println("#ifndef _WIN32");
+		printer.println("#include <pthread.h>");
+		printer.println("#endif");
+		printer.println("#define PARALLEL_BLOCK 1024");
+		printer.println(format("%void parallel_for(size_t length, void (*body)(void*, size_t, size_t), void* context);", linkage));
+	}
+	static void print_parallel(IndentPrinter& printer, StringView linkage) {
+		printer.println("#ifdef _WIN32");
+		printer.println_increasing(format("%void parallel_for(size_t length, void (*body)(void*, size_t, size_t), void* context) {", linkage));
+		printer.println("body(context, 0, length);");
+		printer.println_decreasing("}");
+		printer.println("#else");
+		printer.println("#define PARALLEL_MAX_WORKERS 64");
+		printer.println_increasing("typedef struct {");
+		printer.println("pthread_mutex_t mutex;");
+		printer.println("size_t start;");
+		printer.println("size_t end;");
+		printer.println_decreasing("} parallel_range;");
+		printer.println("static parallel_range parallel_ranges[PARALLEL_MAX_WORKERS];");
+		printer.println("static pthread_mutex_t parallel_mutex = PTHREAD_MUTEX_INITIALIZER;");
+		printer.println("static pthread_cond_t parallel_wake = PTHREAD_COND_INITIALIZER;");
+		printer.println("static pthread_cond_t parallel_done = PTHREAD_COND_INITIALIZER;");
+		printer.println("static size_t parallel_workers = 0;");
+		printer.println("static size_t parallel_job = 0;");
+		printer.println("static size_t parallel_active = 0;");
+		printer.println("static size_t parallel_grain = 1;");
+		printer.println("static void (*parallel_body)(void*, size_t, size_t);");
+		printer.println("static void* parallel_context;");
+		printer.println("static _Thread_local int parallel_nested = 0;");
+		printer.println_increasing("static void parallel_work(size_t worker) {");
+		printer.println("parallel_range* own = &parallel_ranges[worker];");
+		printer.println_increasing("while (1) {");
+		printer.println("pthread_mutex_lock(&own->mutex);");
+		printer.println("size_t start = own->start;");
+		printer.println("size_t end = own->end - start > parallel_grain ? start + parallel_grain : own->end;");
+		printer.println("own->start = end;");
+		printer.println("pthread_mutex_unlock(&own->mutex);");
+		printer.println_increasing("if (start < end) {");
+		printer.println("parallel_body(parallel_context, start, end);");
+		printer.println("continue;");
+		printer.println_decreasing("}");
+		printer.println("int stolen = 0;");
+		printer.println_increasing("for (size_t i = 1; i < parallel_workers && !stolen; ++i) {");
+		printer.println("parallel_range* victim = &parallel_ranges[(worker + i) % parallel_workers];");
+		printer.println("pthread_mutex_lock(&victim->mutex);");
+		printer.println_increasing("if (victim->start < victim->end) {");
+		printer.println("start = victim->end - (victim->end - victim->start + 1) / 2;");
+		printer.println("end = victim->end;");
+		printer.println("victim->end = start;");
+		printer.println("stolen = 1;");
+		printer.println_decreasing("}");
+		printer.println("pthread_mutex_unlock(&victim->mutex);");
+		printer.println_decreasing("}");
+		printer.println("if (!stolen) return;");
+		printer.println("pthread_mutex_lock(&own->mutex);");
+		printer.println("own->start = start;");
+		printer.println("own->end = end;");
+		printer.println("pthread_mutex_unlock(&own->mutex);");
+		printer.println_decreasing("}");
+		printer.println_decreasing("}");
+		printer.println_increasing("static void* parallel_worker(void* argument) {");
+		printer.println("size_t worker = (size_t)argument;");
+		printer.println("size_t job = 0;");
+		printer.println("parallel_nested = 1;");
+		printer.println("pthread_mutex_lock(&parallel_mutex);");
+		printer.println_increasing("while (1) {");
+		printer.println("while (parallel_job == job) pthread_cond_wait(&parallel_wake, &parallel_mutex);");
+		printer.println("job = parallel_job;");
+		printer.println("pthread_mutex_unlock(&parallel_mutex);");
+		printer.println("parallel_work(worker);");
+		printer.println("pthread_mutex_lock(&parallel_mutex);");
+		printer.println("if (--parallel_active == 0) pthread_cond_signal(&parallel_done);");
+		printer.println_decreasing("}");
+		printer.println("return NULL;");
+		printer.println_decreasing("}");
+		// one thread per processor unless MOEBIUS_THREADS is set
+		printer.println_increasing("static void parallel_start(void) {");
+		printer.println("long threads = sysconf(_SC_NPROCESSORS_ONLN);");
+		printer.println("const char* variable = getenv(\"MOEBIUS_THREADS\");");
+		printer.println("if (variable != NULL) threads = atol(variable);");
+		printer.println("if (threads > PARALLEL_MAX_WORKERS) threads = PARALLEL_MAX_WORKERS;");
+		printer.println("for (size_t i = 0; i < PARALLEL_MAX_WORKERS; ++i) pthread_mutex_init(&parallel_ranges[i].mutex, NULL);");
+		printer.println("parallel_workers = 1;");
+		printer.println_increasing("for (long i = 1; i < threads; ++i) {");
+		printer.println("pthread_t thread;");
+		printer.println("if (pthread_create(&thread, NULL, parallel_worker, (void*)parallel_workers) != 0) break;");
+		printer.println("pthread_detach(thread);");
+		printer.println("parallel_workers += 1;");
+		printer.println_decreasing("}");
+		printer.println_decreasing("}");
+		printer.println_increasing(format("%void parallel_for(size_t length, void (*body)(void*, size_t, size_t), void* context) {", linkage));
+		printer.println_increasing("if (parallel_nested || length < 2) {");
+		printer.println("body(context, 0, length);");
+		printer.println("return;");
+		printer.println_decreasing("}");
+		printer.println("pthread_mutex_lock(&parallel_mutex);");
+		printer.println("if (parallel_workers == 0) parallel_start();");
+		printer.println_increasing("if (parallel_workers == 1) {");
+		printer.println("pthread_mutex_unlock(&parallel_mutex);");
+		printer.println("body(context, 0, length);");
+		printer.println("return;");
+		printer.println_decreasing("}");
+		printer.println("parallel_body = body;");
+		printer.println("parallel_context = context;");
+		printer.println("parallel_grain = length / (parallel_workers * 16) + 1;");
+		printer.println_increasing("for (size_t i = 0; i < parallel_workers; ++i) {");
+		printer.println("parallel_ranges[i].start = length * i / parallel_workers;");
+		printer.println("parallel_ranges[i].end = length * (i + 1) / parallel_workers;");
+		printer.println_decreasing("}");
+		printer.println("parallel_active = parallel_workers - 1;");
+		printer.println("parallel_job += 1;");
+		printer.println("pthread_cond_broadcast(&parallel_wake);");
+		printer.println("pthread_mutex_unlock(&parallel_mutex);");
+		printer.println("parallel_nested = 1;");
+		printer.println("parallel_work(0);");
+		printer.println("parallel_nested = 0;");
+		printer.println("pthread_mutex_lock(&parallel_mutex);");
+		printer.println("while (parallel_active > 0) pthread_cond_wait(&parallel_done, &parallel_mutex);");
+		printer.println("pthread_mutex_unlock(&parallel_mutex);");
+		printer.println_decreasing("}");
+		printer.println("#endif");
+	}
+	static void print_runtime(IndentPrinter& printer, StringView linkage) {
+		printer.println("static char io_output_buffer[1 << 16];");
+		printer.println("static size_t io_output_length = 0;");
+		printer.println("static char io_input_buffer[1 << 16];");
+		printer.println("static size_t io_input_position = 0;");
+		printer.println("static size_t io_input_length = 0;");
+		printer.println_increasing("static void io_write(const char* bytes, size_t length) {");
+		printer.println_increasing("while (length > 0) {");
+		printer.println("long result = write(1, bytes, length);");
+		printer.println("if (result < 0 && errno == EINTR) continue;");
+		printer.println("if (result <= 0) return;");
+		printer.println("bytes += result;");
+		printer.println("length -= result;");
+		printer.println_decreasing("}");
+		printer.println_decreasing("}");
+		printer.println_increasing(format("%void io_flush(void) {", linkage));
+		printer.println("io_write(io_output_buffer, io_output_length);");
+		printer.println("io_output_length = 0;");
+		printer.println_decreasing("}");
+		printer.println_increasing(format("%void io_put_char(char c) {", linkage));
+		printer.println("if (io_output_length == sizeof(io_output_buffer)) io_flush();");
+		printer.println("io_output_buffer[io_output_length++] = c;");
+		printer.println_decreasing("}");
+		printer.println_increasing(format("%void io_put_bytes(const char* bytes, size_t length) {", linkage));
+		printer.println_increasing("if (length > sizeof(io_output_buffer) - io_output_length) {");
+		printer.println("io_flush();");
+		printer.println_increasing("if (length > sizeof(io_output_buffer)) {");
+		printer.println("io_write(bytes, length);");
+		printer.println("return;");
+		printer.println_decreasing("}");
+		printer.println_decreasing("}");
+		printer.println("memcpy(io_output_buffer + io_output_length, bytes, length);");
+		printer.println("io_output_length += length;");
+		printer.println_decreasing("}");
+		printer.println_increasing(format("%void io_write_all(const char* bytes, size_t length) {", linkage));
+		printer.println("io_flush();");
+		printer.println("io_write(bytes, length);");
+		printer.println_decreasing("}");
+		printer.println_increasing("static size_t io_fill(void) {");
+		// flush pending output so that prompts are visible before blocking on input
+		printer.println("io_flush();");
+		printer.println("long result;");
+		printer.println("do result = read(0, io_input_buffer, sizeof(io_input_buffer)); while (result < 0 && errno == EINTR);");
+		printer.println("io_input_position = 0;");
+		printer.println("io_input_length = result > 0 ? result : 0;");
+		printer.println("return io_input_length;");
+		printer.println_decreasing("}");
+		printer.println_increasing(format("%int32_t io_get_char(void) {", linkage));
+		printer.println("if (io_input_position == io_input_length && io_fill() == 0) return -1;");
+		printer.println("return (unsigned char)io_input_buffer[io_input_position++];");
+		printer.println_decreasing("}");
+		printer.println_increasing(format("%size_t io_read(char** bytes) {", linkage));
+		printer.println("if (io_input_position == io_input_length && io_fill() == 0) return 0;");
+		printer.println("*bytes = io_input_buffer + io_input_position;");
+		printer.println("size_t length = io_input_length - io_input_position;");
+		printer.println("io_input_position = io_input_length;");
+		printer.println("return length;");
+		printer.println_decreasing("}");
+	}
+	static void declare_function(FunctionTable& function_table, IndentPrinter& function_declaration_printer, const TailCallData& tail_call_data, const Function* function, StringView linkage = "static ") {
+		const Type return_type = function_table.get_type(function->get_return_type());
+		const std::size_t index = function_table.look_up(function);
+		const std::size_t arguments = function->get_argument_types().size();
+		function_declaration_printer.println(print_functor([&](auto& printer) {
+			printer.print(linkage);
+			printer.print(format("% f%(", return_type, print_number(index)));
+			bool is_first_argument = true;
+			for (std::size_t i = 0; i < arguments; ++i) {
+				if (function->get_argument_types()[i] != TypeInterner::get_void_type()) {
+					if (is_first_argument) is_first_argument = false;
+					else printer.print(", ");
+					const Type argument_type = function_table.get_type(function->get_argument_types()[i]);
+					printer.print(format("% %", argument_type, Variable(i)));
+				}
+			}
+			printer.print(");");
+		}));
+		if (tail_call_data.has_group(function) && tail_call_data.groups[tail_call_data.get_group(function)].front() == function) {
+			declare_group(function_table, function_declaration_printer, tail_call_data, tail_call_data.get_group(function), linkage);
+		}
+	}
+	static bool has_arguments(const Function* function) {
+		for (const ::Type* argument_type: function->get_argument_types()) {
+			if (argument_type != TypeInterner::get_void_type()) {
+				return true;
+			}
+		}
+		return false;
+	}
+	// the arguments of every function of the group share a union
+	static void declare_group(FunctionTable& function_table, IndentPrinter& function_declaration_printer, const TailCallData& tail_call_data, std::size_t group, StringView linkage) {
+		const std::vector<const Function*>& functions = tail_call_data.groups[group];
+		function_declaration_printer.println_increasing("typedef union {");
+		bool is_empty = true;
+		for (const Function* function: functions) {
+			if (!has_arguments(function)) {
+				continue;
+			}
+			is_empty = false;
+			function_declaration_printer.println_increasing("struct {");
+			for (std::size_t i = 0; i < function->get_argument_types().size(); ++i) {
+				if (function->get_argument_types()[i] != TypeInterner::get_void_type()) {
+					const Type argument_type = function_table.get_type(function->get_argument_types()[i]);
+					function_declaration_printer.println(format("% %;", argument_type, Variable(i)));
+				}
+			}
+			function_declaration_printer.println_decreasing(format("} f%;", print_number(function_table.look_up(function))));
+		}
+		if (is_empty) {
+			function_declaration_printer.println("char none;");
+		}
+		function_declaration_printer.println_decreasing(format("} d%_arguments;", print_number(group)));
+		const Type return_type = function_table.get_type(functions.front()->get_return_type());
+		function_declaration_printer.println(print_functor([&](auto& printer) {
+			printer.print(linkage);
+			printer.print(format("% d%(size_t state, d%_arguments arguments);", return_type, print_number(group), print_number(group)));
+		}));
+	}
+	// a loop that switches between the bodies of the functions of the group
+	static void generate_group(FunctionTable& function_table, IndentPrinter& printer, const TailCallData& tail_call_data, std::size_t group, StringView linkage) {
+		const std::vector<const Function*>& functions = tail_call_data.groups[group];
+		const ::Type* return_type = functions.front()->get_return_type();
+		printer.println_increasing(print_functor([&](auto& printer) {
+			printer.print(linkage);
+			printer.print(format("% d%(size_t state, d%_arguments arguments) {", function_table.get_type(return_type), print_number(group), print_number(group)));
+		}));
+		printer.println_increasing("while (1) {");
+		printer.println_increasing("switch (state) {");
+		for (const Function* function: functions) {
+			const std::size_t index = function_table.look_up(function);
+			const std::size_t arguments = function->get_argument_types().size();
+			printer.println_increasing(format("case %: {", print_number(index)));
+			for (std::size_t i = 0; i < arguments; ++i) {
+				if (function->get_argument_types()[i] != TypeInterner::get_void_type()) {
+					const Type argument_type = function_table.get_type(function->get_argument_types()[i]);
+					printer.println(format("% % = arguments.f%.%;", argument_type, Variable(i), print_number(index), Variable(i)));
+				}
+			}
+			const Variable result = Variable(arguments);
+			if (return_type->get_id() != TypeId::VOID) {
+				printer.println(format("% %;", function_table.get_type(return_type), result));
+			}
+			CodegenC::evaluate(function_table, printer, arguments + 1, result, tail_call_data, function->get_block());
+			if (return_type->get_id() != TypeId::VOID) {
+				printer.println(format("return %;", result));
+			}
+			else {
+				printer.println("return;");
+			}
+			printer.println_decreasing("}");
+		}
+		printer.println_decreasing("}");
+		printer.println_decreasing("}");
+		printer.println_decreasing("}");
+	}
+	static void generate_function(FunctionTable& function_table, IndentPrinter& printer, const TailCallData& tail_call_data, const Function* function, StringView linkage = "static ") {
+		const Type return_type = function_table.get_type(function->get_return_type());
+		const std::size_t index = function_table.look_up(function);
+		const std::size_t arguments = function->get_argument_types().size();
+		if (function_table.has_line_directives() && function->get_path()) {
+			printer.println(format("#line % %", print_number(function_table.get_line(function)), print_string_literal(function->get_path())));
+		}
+		printer.println_increasing(print_functor([&](auto& printer) {
+			printer.print(linkage);
+			printer.print(format("% f%(", return_type, print_number(index)));
+			bool is_first_argument = true;
+			for (std::size_t i = 0; i < arguments; ++i) {
+				if (function->get_argument_types()[i] != TypeInterner::get_void_type()) {
+					if (is_first_argument) is_first_argument = false;
+					else printer.print(", ");
+					const Type argument_type = function_table.get_type(function->get_argument_types()[i]);
+					printer.print(format("% %", argument_type, Variable(i)));
+				}
+			}
+			printer.print(") {");
+		}));
+		if (function_table.is_profiled()) {
+			printer.println("uint64_t profile_start = profile_clock();");
+		}
+		if (tail_call_data.has_group(function)) {
+			// enter the loop of the group
+			const std::size_t group = tail_call_data.get_group(function);
+			printer.println(format("d%_arguments arguments;", print_number(group)));
+			for (std::size_t i = 0; i < arguments; ++i) {
+				if (function->get_argument_types()[i] != TypeInterner::get_void_type()) {
+					printer.println(format("arguments.f%.% = %;", print_number(index), Variable(i), Variable(i)));
+				}
+			}
+			if (function_table.is_profiled() && function->get_return_type()->get_id() != TypeId::VOID) {
+				printer.println(format("% result = d%(%, arguments);", return_type, print_number(group), print_number(index)));
+				printer.println(format("profile_function(%, profile_start);", print_number(index)));
+				printer.println("return result;");
+			}
+			else if (function->get_return_type()->get_id() != TypeId::VOID) {
+				printer.println(format("return d%(%, arguments);", print_number(group), print_number(index)));
+			}
+			else {
+				printer.println(format("d%(%, arguments);", print_number(group), print_number(index)));
+				if (function_table.is_profiled()) {
+					printer.println(format("profile_function(%, profile_start);", print_number(index)));
+				}
+			}
+			printer.println_decreasing("}");
+			if (tail_call_data.groups[group].front() == function) {
+				generate_group(function_table, printer, tail_call_data, group, linkage);
+			}
+			return;
+		}
+		if (tail_call_data.has_tail_call(function)) {
+			printer.println_increasing("while (1) {");
+		}
+		const Variable result = Variable(arguments);
+		if (function->get_return_type()->get_id() != TypeId::VOID) {
+			const Type result_type = function_table.get_type(function->get_return_type());
+			printer.println(format("% %;", result_type, result));
+		}
+		CodegenC::evaluate(function_table, printer, arguments + 1, result, tail_call_data, function->get_block());
+		if (function_table.is_profiled()) {
+			printer.println(format("profile_function(%, profile_start);", print_number(index)));
+		}
+		if (function->get_return_type()->get_id() != TypeId::VOID) {
+			printer.println(format("return %;", result));
+		}
+		else {
+			printer.println("return;");
+		}
+		if (tail_call_data.has_tail_call(function)) {
+			printer.println_decreasing("}");
+		}
+		printer.println_decreasing("}");
+	}
+	static void generate_functions(const Program& program, FunctionTable& function_table, IndentPrinter& function_declaration_printer, std::vector<std::string>& bodies, const TailCallData& tail_call_data, const CodegenOptions& options) {
+		const StringView linkage = options.shards > 1 ? "" : "static ";
+		std::vector<const Function*> program_functions;
+		for (const Function* function: program) {
+			program_functions.push_back(function);
+		}
+		// declare every type and function serially so that the function table can be shared
+		for (const Function* function: program_functions) {
+			declare_function(function_table, function_declaration_printer, tail_call_data, function, linkage);
+			TypeDeclaration::evaluate(function_table, function->get_block());
+		}
+		function_table.freeze();
+		bodies.resize(program_functions.size());
+		std::atomic<std::size_t> next_function(0);
+		auto worker = [&]() {
+			for (std::size_t i = next_function++; i < program_functions.size(); i = next_function++) {
+				std::ostringstream body;
+				IndentPrinter printer(body);
+				generate_function(function_table, printer, tail_call_data, program_functions[i], linkage);
+				bodies[i] = body.str();
+			}
+		};
+		std::vector<std::thread> threads;
+		for (unsigned int i = 1; i < options.jobs; ++i) {
+			threads.emplace_back(worker);
+		}
+		worker();
+		for (std::thread& thread: threads) {
+			thread.join();
+		}
+	}
+	static bool run_commands(const std::vector<std::string>& commands) {
+		std::vector<int> results(commands.size());
+		std::vector<std::thread> threads;
+		for (std::size_t i = 0; i < commands.size(); ++i) {
+			threads.emplace_back([&, i]() {
+				results[i] = std::system(commands[i].c_str());
+			});
+		}
+		for (std::thread& thread: threads) {
+			thread.join();
+		}
+		return std::all_of(results.begin(), results.end(), [](int result) {
+			return result == 0;
+		});
+	}
+	static void print_generated(const Printer& status_printer, const std::string& path) {
+		status_printer.print(bold(path));
+		status_printer.print(bold(green(" successfully generated")));
+		status_printer.print('\n');
+	}
+	static void codegen(const Program& program, const char* source_path, const TailCallData& tail_call_data, const CodegenOptions& requested_options) {
+		const ParallelAnalysis parallel_analysis(program);
+		const bool parallel = !parallel_analysis.get_parallel_functions().empty();
+		CodegenOptions options = requested_options;
+		if (parallel) {
+			// the workers allocate from their own free lists
+			options.pool_allocation = true;
+		}
 		std::ostringstream type_declarations;
 		std::ostringstream function_declarations;
 		std::ostringstream type_functions;
 		std::ostringstream functions;
+		std::ostringstream runtime_profile;
 		IndentPrinter type_declaration_printer(type_declarations);
 		IndentPrinter function_declaration_printer(function_declarations);
 		IndentPrinter type_function_printer(type_functions);
 		IndentPrinter printer(functions);
-		FunctionTable function_table(type_declaration_printer, function_declaration_printer, type_function_printer);
+		const EscapeAnalysis escape_analysis(program);
+		FunctionTable function_table(type_declaration_printer, function_declaration_printer, type_function_printer, options, escape_analysis, parallel_analysis);
 		type_declaration_printer.println("#include <stdlib.h>");
 		type_declaration_printer.println("#include <stdint.h>");
 		type_declaration_printer.println("#include <stdio.h>");
+		type_declaration_printer.println("#include <string.h>");
+		type_declaration_printer.println("#include <errno.h>");
+		type_declaration_printer.println("#ifdef _WIN32");
+		type_declaration_printer.println("#include <io.h>");
+		type_declaration_printer.println("#else");
+		type_declaration_printer.println("#include <unistd.h>");
+		type_declaration_printer.println("#endif");
+		const StringView runtime_linkage = options.shards > 1 ? "" : "static ";
+		print_runtime_declarations(type_declaration_printer, runtime_linkage);
+		if (options.pool_allocation) {
+			print_pool_declarations(type_declaration_printer, runtime_linkage);
+		}
+		if (parallel) {
+			print_parallel_declarations(type_declaration_printer, runtime_linkage);
+		}
+		print_runtime(printer, runtime_linkage);
+		if (options.pool_allocation) {
+			print_pool(printer, runtime_linkage);
+		}
+		if (parallel) {
+			print_parallel(printer, runtime_linkage);
+		}
+		if (options.profile_path) {
+			// at least one counter since C does not allow empty arrays
+			const std::size_t counters = std::max<std::size_t>(ProfileCounters::evaluate(program), 1);
+			print_profile_declarations(type_declaration_printer, runtime_linkage, counters);
+			print_profile(printer, runtime_linkage, counters, options.profile_path);
+		}
+		if (options.runtime_profile) {
+			print_runtime_profile_declarations(type_declaration_printer, runtime_linkage);
+		}
 		{
 			printer.println_increasing("int main(int argc, char **argv) {");
 			const std::size_t index = function_table.look_up(program.get_main_function());
 			printer.println(format("f%();", print_number(index)));
+			printer.println("io_flush();");
+			if (options.profile_path) {
+				printer.println("profile_write();");
+			}
+			if (options.runtime_profile) {
+				printer.println("profile_report();");
+			}
 			printer.println("return 0;");
 			printer.println_decreasing("}");
 		}
-		for (const Function* function: program) {
-			const Type return_type = function_table.get_type(function->get_return_type());
-			const std::size_t index = function_table.look_up(function);
-			const std::size_t arguments = function->get_argument_types().size();
-			function_declaration_printer.println(print_functor([&](auto& printer) {
-				printer.print(format("static % f%(", return_type, print_number(index)));
-				bool is_first_argument = true;
-				for (std::size_t i = 0; i < arguments; ++i) {
-					if (function->get_argument_types()[i] != TypeInterner::get_void_type()) {
-						if (is_first_argument) is_first_argument = false;
-						else printer.print(", ");
-						const Type argument_type = function_table.get_type(function->get_argument_types()[i]);
-						printer.print(format("% %", argument_type, Variable(i)));
+		Printer status_printer(std::cerr);
+		std::string executable_path = std::string(source_path) + ".exe";
+		const char* c_compiler = getenv("CC", "cc");
+		std::string compiler_arguments = getenv("CFLAGS", "");
+		if (parallel) {
+			compiler_arguments += " -pthread";
+		}
+		if (options.shards > 1) {
+			// a shared header followed by shards of roughly equal size that are compiled in parallel
+			std::vector<std::string> bodies;
+			generate_functions(program, function_table, function_declaration_printer, bodies, tail_call_data, options);
+			if (options.runtime_profile) {
+				IndentPrinter runtime_profile_printer(runtime_profile);
+				print_runtime_profile(program, function_table, runtime_profile_printer, runtime_linkage, std::string(source_path) + ".profile");
+			}
+			std::string header_path = std::string(source_path) + ".h";
+			{
+				std::ofstream file(header_path);
+				file << type_declarations.str();
+				file << function_declarations.str();
+				file << type_functions.str();
+			}
+			print_generated(status_printer, header_path);
+			std::size_t total_size = functions.tellp();
+			for (const std::string& body: bodies) {
+				total_size += body.size();
+			}
+			const std::string include = "#include \"" + std::filesystem::path(header_path).filename().string() + "\"\n";
+			std::vector<std::string> compile_commands;
+			std::string link_command = std::string(c_compiler) + " " + compiler_arguments + " -o " + executable_path;
+			std::size_t size = 0;
+			std::size_t body = 0;
+			for (unsigned int shard = 0; shard < options.shards; ++shard) {
+				std::string c_path = std::string(source_path) + "." + std::to_string(shard) + ".c";
+				std::string object_path = std::string(source_path) + "." + std::to_string(shard) + ".o";
+				{
+					std::ofstream file(c_path);
+					file << include;
+					if (shard == 0) {
+						file << runtime_profile.str();
+						file << functions.str();
+						size += functions.str().size();
 					}
-				}
-				printer.print(");");
-			}));
-			printer.println_increasing(print_functor([&](auto& printer) {
-				printer.print(format("static % f%(", return_type, print_number(index)));
-				bool is_first_argument = true;
-				for (std::size_t i = 0; i < arguments; ++i) {
-					if (function->get_argument_types()[i] != TypeInterner::get_void_type()) {
-						if (is_first_argument) is_first_argument = false;
-						else printer.print(", ");
-						const Type argument_type = function_table.get_type(function->get_argument_types()[i]);
-						printer.print(format("% %", argument_type, Variable(i)));
+					const std::size_t shard_end = total_size * (shard + 1) / options.shards;
+					for (; body < bodies.size() && (size < shard_end || shard + 1 == options.shards); ++body) {
+						file << bodies[body];
+						size += bodies[body].size();
 					}
 				}
-				printer.print(") {");
-			}));
-			if (tail_call_data.has_tail_call(function)) {
-				printer.println_increasing("while (1) {");
-			}
-			const Variable result = Variable(arguments);
-			if (function->get_return_type()->get_id() != TypeId::VOID) {
-				const Type result_type = function_table.get_type(function->get_return_type());
-				printer.println(format("% %;", result_type, result));
-			}
-			CodegenC::evaluate(function_table, printer, arguments + 1, result, tail_call_data, function->get_block());
-			if (function->get_return_type()->get_id() != TypeId::VOID) {
-				printer.println(format("return %;", result));
+				print_generated(status_printer, c_path);
+				compile_commands.push_back(std::string(c_compiler) + " " + compiler_arguments + " -c -o " + object_path + " " + c_path);
+				link_command += " " + object_path;
 			}
-			else {
-				printer.println("return;");
+			const bool success = Statistics::time("cc", [&]() {
+				return run_commands(compile_commands) && std::system(link_command.c_str()) == 0;
+			});
+			if (success) {
+				print_generated(status_printer, executable_path);
 			}
-			if (tail_call_data.has_tail_call(function)) {
-				printer.println_decreasing("}");
+			return;
+		}
+		if (options.jobs > 1) {
+			std::vector<std::string> bodies;
+			generate_functions(program, function_table, function_declaration_printer, bodies, tail_call_data, options);
+			for (const std::string& body: bodies) {
+				functions << body;
 			}
-			printer.println_decreasing("}");
+		}
+		else for (const Function* function: program) {
+			declare_function(function_table, function_declaration_printer, tail_call_data, function);
+			generate_function(function_table, printer, tail_call_data, function);
+		}
+		if (options.runtime_profile) {
+			IndentPrinter runtime_profile_printer(runtime_profile);
+			print_runtime_profile(program, function_table, runtime_profile_printer, runtime_linkage, std::string(source_path) + ".profile");
 		}
 		std::string c_path = std::string(source_path) + ".c";
 		{
@@ -1041,20 +2512,17 @@ public:
 			file << type_declarations.str();
 			file << function_declarations.str();
 			file << type_functions.str();
+			// before the functions so that their #line directives do not apply to it
+			file << runtime_profile.str();
 			file << functions.str();
 		}
-		Printer status_printer(std::cerr);
-		status_printer.print(bold(c_path));
-		status_printer.print(bold(green(" successfully generated")));
-		status_printer.print('\n');
-		std::string executable_path = std::string(source_path) + ".exe";
-		const char* c_compiler = getenv("CC", "cc");
-		const char* compiler_arguments = getenv("CFLAGS", "");
+		print_generated(status_printer, c_path);
 		std::string command = std::string(c_compiler) + " " + compiler_arguments + " -o " + executable_path + " " + c_path;
-		if (std::system(command.c_str()) == 0) {
-			status_printer.print(bold(executable_path));
-			status_printer.print(bold(green(" successfully generated")));
-			status_printer.print('\n');
+		const int result = Statistics::time("cc", [&]() {
+			return std::system(command.c_str());
+		});
+		if (result == 0) {
+			print_generated(status_printer, executable_path);
 		}
 	}
 };
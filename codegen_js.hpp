@@ -1,6 +1,9 @@
 #pragma once
 
 #include "ast.hpp"
+#include "options.hpp"
+#include <map>
+#include <set>
 
 class CodegenJS: public Visitor<Variable> {
 	static StringView print_operator(BinaryOperation operation) {
@@ -34,22 +37,111 @@ class CodegenJS: public Visitor<Variable> {
 	static constexpr bool is_printable_character(std::int32_t c) {
 		return c >= 'a' && c <= 'z' || c >= 'A' && c <= 'Z' || c >= '0' && c <= '9' || c == ' ' || c == '-' || c == '.' || c == ',' || c == ':' || c == ';' || c == '!' || c == '?';
 	}
+	struct FunctionTableEntry {
+		std::size_t index;
+		bool has_index = false;
+	};
+	// references are represented by the values they point to
+	static const ::Type* get_value_type(const ::Type* type) {
+		while (type->get_id() == TypeId::REFERENCE) {
+			type = static_cast<const ReferenceType*>(type)->get_type();
+		}
+		return type;
+	}
+	static const ::Type* get_array_type(const ::Type* slice_type) {
+		return static_cast<const SliceType*>(slice_type)->get_array_type();
+	}
+	static bool is_int_array(const ::Type* type) {
+		return type->get_id() == TypeId::ARRAY && static_cast<const ArrayType*>(type)->get_element_type() == TypeInterner::get_int_type();
+	}
 	class FunctionTable {
-		std::map<const Function*, std::size_t> functions;
+		IndexTable<Function, FunctionTableEntry> functions;
+		std::size_t next_function_index = 0;
+		std::map<const ::Type*, bool> contained_arrays;
+		std::map<const ::Type*, std::size_t> copy_functions;
+		std::vector<const ::Type*> copy_function_queue;
+		static bool contains_array(const ::Type* type, std::set<const ::Type*>& visited) {
+			type = get_value_type(type);
+			if (!visited.insert(type).second) {
+				return false;
+			}
+			switch (type->get_id()) {
+			case TypeId::ARRAY:
+			case TypeId::STRING_BUILDER:
+				return true;
+			case TypeId::STRUCT:
+				for (const auto& field: static_cast<const StructType*>(type)->get_fields()) {
+					if (contains_array(field.second, visited)) {
+						return true;
+					}
+				}
+				return false;
+			case TypeId::ENUM:
+				for (const auto& case_: static_cast<const EnumType*>(type)->get_cases()) {
+					if (contains_array(case_.second, visited)) {
+						return true;
+					}
+				}
+				return false;
+			case TypeId::TUPLE:
+				for (const ::Type* element_type: static_cast<const TupleType*>(type)->get_element_types()) {
+					if (contains_array(element_type, visited)) {
+						return true;
+					}
+				}
+				return false;
+			default:
+				return false;
+			}
+		}
 	public:
 		std::size_t look_up(const Function* function) {
-			auto iterator = functions.find(function);
-			if (iterator != functions.end()) {
-				return iterator->second;
+			if (!functions[function].has_index) {
+				functions[function].index = next_function_index++;
+				functions[function].has_index = true;
+			}
+			return functions[function].index;
+		}
+		// arrays are modified in place, so only values that contain arrays need to be copied
+		// slices are never modified and can share their array
+		bool needs_copy(const ::Type* type) {
+			type = get_value_type(type);
+			auto iterator = contained_arrays.find(type);
+			if (iterator == contained_arrays.end()) {
+				std::set<const ::Type*> visited;
+				iterator = contained_arrays.emplace(type, contains_array(type, visited)).first;
+			}
+			return iterator->second;
+		}
+		std::size_t look_up_copy(const ::Type* type) {
+			type = get_value_type(type);
+			auto iterator = copy_functions.find(type);
+			if (iterator == copy_functions.end()) {
+				iterator = copy_functions.emplace(type, copy_functions.size()).first;
+				copy_function_queue.push_back(type);
+			}
+			return iterator->second;
+		}
+		const ::Type* get_next_copy_function() {
+			if (copy_function_queue.empty()) {
+				return nullptr;
+			}
+			const ::Type* type = copy_function_queue.back();
+			copy_function_queue.pop_back();
+			return type;
+		}
+		template <class P, class T> void print_copy(P& printer, const ::Type* type, const T& value) {
+			if (needs_copy(type)) {
+				printer.print(format("c%(%)", print_number(look_up_copy(type)), value));
+			}
+			else {
+				printer.print(value);
 			}
-			const std::size_t index = functions.size();
-			functions[function] = index;
-			return index;
 		}
 	};
 	FunctionTable& function_table;
 	IndentPrinter& printer;
-	using ExpressionTable = std::map<const Expression*, Variable>;
+	using ExpressionTable = IndexTable<Expression, Variable>;
 	ExpressionTable& expression_table;
 	std::size_t variable;
 	Variable case_variable;
@@ -78,25 +170,44 @@ class CodegenJS: public Visitor<Variable> {
 public:
 	Variable visit_int_literal(const IntLiteral& int_literal) override {
 		const Variable result = next_variable();
-		printer.println(format("const % = %;", result, print_number(int_literal.get_value())));
+		const std::int32_t value = int_literal.get_value();
+		if (value < 0) {
+			printer.println(format("const % = -%;", result, print_number(0u - static_cast<unsigned int>(value))));
+		}
+		else {
+			printer.println(format("const % = %;", result, print_number(value)));
+		}
 		return result;
 	}
 	Variable visit_binary_expression(const BinaryExpression& binary_expression) override {
 		const Variable left = expression_table[binary_expression.get_left()];
 		const Variable right = expression_table[binary_expression.get_right()];
 		const Variable result = next_variable();
-		printer.println(format("const % = (% % %) | 0;", result, left, print_operator(binary_expression.get_operation()), right));
+		if (binary_expression.get_operation() == BinaryOperation::MUL) {
+			// a product of two 32-bit numbers does not always fit into a double
+			printer.println(format("const % = Math.imul(%, %);", result, left, right));
+		}
+		else {
+			printer.println(format("const % = (% % %) | 0;", result, left, print_operator(binary_expression.get_operation()), right));
+		}
 		return result;
 	}
 	Variable visit_array_literal(const ArrayLiteral& array_literal) override {
 		const Variable result = next_variable();
+		const bool int_array = is_int_array(array_literal.get_type());
 		printer.println(print_functor([&](auto& printer) {
-			printer.print(format("const % = [", result));
+			printer.print(format("const % = ", result));
+			printer.print(int_array ? "new IntArray(Int32Array.of(" : "[");
 			for (std::size_t i = 0; i < array_literal.get_elements().size(); ++i) {
 				if (i > 0) printer.print(", ");
 				printer.print(expression_table[array_literal.get_elements()[i]]);
 			}
-			printer.print("];");
+			if (int_array) {
+				printer.print(format("), %);", print_number(array_literal.get_elements().size())));
+			}
+			else {
+				printer.print("];");
+			}
 		}));
 		return result;
 	}
@@ -181,9 +292,13 @@ public:
 		const Variable result = next_variable();
 		printer.println_increasing(format("const % = {", result));
 		printer.println(format("tag: %,", print_number(index)));
+		// every case has a value so that all enums of a type share a shape
 		if (enum_literal.get_expression()->get_type() != TypeInterner::get_void_type()) {
 			printer.println(format("value: %,", expression));
 		}
+		else {
+			printer.println("value: undefined,");
+		}
 		printer.println_decreasing("};");
 		return result;
 	}
@@ -218,11 +333,29 @@ public:
 	Variable visit_function_call(const FunctionCall& call) override {
 		const std::size_t new_index = function_table.look_up(call.get_function());
 		const Variable result = next_variable();
-		if (tail_call_data.is_tail_call(&call)) {
+		if (tail_call_data.is_group_tail_call(&call)) {
+			for (std::size_t i = 0; i < call.get_arguments().size(); ++i) {
+				if (call.get_arguments()[i]->get_type() != TypeInterner::get_void_type()) {
+					const Variable argument = expression_table[call.get_arguments()[i]];
+					printer.println(format("a% = %;", print_number(i), argument));
+				}
+			}
+			printer.println(format("state = %;", print_number(new_index)));
+			printer.println("continue;");
+		}
+		else if (tail_call_data.is_tail_call(&call)) {
+			// stage the arguments so that no argument is overwritten before it is read
+			const std::size_t first_temporary = variable;
 			for (std::size_t i = 0; i < call.get_arguments().size(); ++i) {
 				if (call.get_arguments()[i]->get_type() != TypeInterner::get_void_type()) {
 					const Variable argument = expression_table[call.get_arguments()[i]];
-					printer.println(format("% = %;", Variable(i), argument));
+					printer.println(format("const % = %;", Variable(first_temporary + i), argument));
+				}
+				next_variable();
+			}
+			for (std::size_t i = 0; i < call.get_arguments().size(); ++i) {
+				if (call.get_arguments()[i]->get_type() != TypeInterner::get_void_type()) {
+					printer.println(format("% = %;", Variable(i), Variable(first_temporary + i)));
 				}
 			}
 			printer.println("continue;");
@@ -248,48 +381,110 @@ public:
 		const Variable result = next_variable();
 		if (intrinsic.name_equals("putChar")) {
 			const Variable argument = expression_table[intrinsic.get_arguments()[0]];
-			printer.println(format("putChar(String.fromCodePoint(%));", argument));
+			printer.println(format("stdoutBuffer += String.fromCodePoint(%);", argument));
 			printer.println(format("const % = null;", result));
 		}
-		else if (intrinsic.name_equals("putStr")) {
+		else if (intrinsic.name_equals("putStr") || intrinsic.name_equals("writeAll")) {
 			const Variable argument = expression_table[intrinsic.get_arguments()[0]];
-			printer.println(format("putStr(%);", argument));
+			printer.println(format("stdoutBuffer += %;", argument));
 			printer.println(format("const % = null;", result));
 		}
 		else if (intrinsic.name_equals("getChar")) {
-			// TODO
+			printer.println(format("const % = stdinGetChar();", result));
+		}
+		else if (intrinsic.name_equals("readAll")) {
+			printer.println(format("const % = stdinReadAll();", result));
 		}
 		else if (intrinsic.name_equals("arrayGet")) {
 			const Variable array = expression_table[intrinsic.get_arguments()[0]];
 			const Variable index = expression_table[intrinsic.get_arguments()[1]];
-			printer.println(format("const % = %[%];", result, array, index));
+			const ::Type* array_type = intrinsic.get_arguments()[0]->get_type();
+			if (array_type->get_id() == TypeId::SLICE) {
+				if (is_int_array(get_array_type(array_type))) {
+					printer.println(format("const % = %[0].data[%[1] + %];", result, array, array, index));
+				}
+				else {
+					printer.println(format("const % = %[0][%[1] + %];", result, array, array, index));
+				}
+			}
+			else if (is_int_array(array_type)) {
+				printer.println(format("const % = %.data[%];", result, array, index));
+			}
+			else {
+				printer.println(format("const % = %[%];", result, array, index));
+			}
 		}
 		else if (intrinsic.name_equals("arrayLength")) {
 			const Variable array = expression_table[intrinsic.get_arguments()[0]];
-			printer.println(format("const % = %.length;", result, array));
+			if (intrinsic.get_arguments()[0]->get_type_id() == TypeId::SLICE) {
+				printer.println(format("const % = %[2] - %[1];", result, array, array));
+			}
+			else {
+				printer.println(format("const % = %.length;", result, array));
+			}
 		}
-		else if (intrinsic.name_equals("arraySplice")) {
+		else if (intrinsic.name_equals("arraySplice") || intrinsic.name_equals("arraySpliceCopy")) {
 			const Variable array = expression_table[intrinsic.get_arguments()[0]];
 			const Variable index = expression_table[intrinsic.get_arguments()[1]];
 			const Variable remove = expression_table[intrinsic.get_arguments()[2]];
-			printer.println(format("const % = %.slice();", result, array));
+			// arraySplice consumes its array and modifies it in place
+			if (intrinsic.name_equals("arraySpliceCopy")) {
+				printer.println(print_functor([&](auto& printer) {
+					printer.print(format("const % = ", result));
+					function_table.print_copy(printer, intrinsic.get_type(), array);
+					printer.print(";");
+				}));
+			}
+			else {
+				printer.println(format("const % = %;", result, array));
+			}
+			const bool int_array = is_int_array(intrinsic.get_type());
 			if (intrinsic.get_arguments().size() == 4 && intrinsic.get_arguments()[3]->get_type() == intrinsic.get_type()) {
 				const Variable insert = expression_table[intrinsic.get_arguments()[3]];
-				printer.println(format("%.splice(%, %, ...%);", result, index, remove, insert));
+				if (int_array) {
+					printer.println(format("intArraySplice(%, %, %, %.length);", result, index, remove, insert));
+					printer.println(format("%.data.set(%.data.subarray(0, %.length), %);", result, insert, insert, index));
+				}
+				else {
+					printer.println(format("arraySplice(%, %, %, %);", result, index, remove, insert));
+				}
 			}
 			else {
 				const std::size_t insert = intrinsic.get_arguments().size() - 3;
-				printer.println(print_functor([&](auto& printer) {
-					printer.print(format("%.splice(%, %", result, index, remove));
+				if (int_array) {
+					printer.println(format("intArraySplice(%, %, %, %);", result, index, remove, print_number(insert)));
 					for (std::size_t i = 0; i < insert; ++i) {
-						printer.print(", ");
-						printer.print(expression_table[intrinsic.get_arguments()[i + 3]]);
+						const Variable element = expression_table[intrinsic.get_arguments()[i + 3]];
+						printer.println(format("%.data[% + %] = %;", result, index, print_number(i), element));
 					}
-					printer.print(");");
-				}));
+				}
+				else {
+					if (insert > 0) {
+						// appending is by far the most common splice
+						printer.println(print_functor([&](auto& printer) {
+							printer.print(format("if (% === 0 && % === %.length) %.push(", remove, index, result, result));
+							for (std::size_t i = 0; i < insert; ++i) {
+								if (i > 0) printer.print(", ");
+								printer.print(expression_table[intrinsic.get_arguments()[i + 3]]);
+							}
+							printer.print(");");
+						}));
+						printer.println(print_functor([&](auto& printer) {
+							printer.print(format("else %.splice(%, %", result, index, remove));
+							for (std::size_t i = 0; i < insert; ++i) {
+								printer.print(", ");
+								printer.print(expression_table[intrinsic.get_arguments()[i + 3]]);
+							}
+							printer.print(");");
+						}));
+					}
+					else {
+						printer.println(format("%.splice(%, %);", result, index, remove));
+					}
+				}
 			}
 		}
-		else if (intrinsic.name_equals("stringPush")) {
+		else if (intrinsic.name_equals("stringPush") || intrinsic.name_equals("stringPushCopy")) {
 			const Variable string = expression_table[intrinsic.get_arguments()[0]];
 			const Variable argument = expression_table[intrinsic.get_arguments()[1]];
 			if (intrinsic.get_arguments()[1]->get_type() == intrinsic.get_type()) {
@@ -301,24 +496,172 @@ public:
 		}
 		else if (intrinsic.name_equals("stringIterator")) {
 			const Variable string = expression_table[intrinsic.get_arguments()[0]];
-			printer.println(format("const % = %[Symbol.iterator]();", result, string));
+			// an iterator is the string and the position of the next code unit
+			printer.println(format("const % = [%, 0];", result, string));
 		}
 		else if (intrinsic.name_equals("stringIteratorGetNext")) {
 			const Variable iterator = expression_table[intrinsic.get_arguments()[0]];
-			const Variable iterator_result = next_variable();
-			printer.println(format("const % = %.next();", iterator_result, iterator));
-			printer.println(format("const % = [%, !%.done, %.value?.codePointAt(0)];", result, iterator, iterator_result, iterator_result));
+			const Variable codepoint = next_variable();
+			printer.println(format("const % = %[0].codePointAt(%[1]);", codepoint, iterator, iterator));
+			printer.println(format("const % = % === undefined ? [%, 0, 0] : [[%[0], %[1] + (% > 0xFFFF ? 2 : 1)], 1, %];", result, codepoint, iterator, iterator, iterator, codepoint, codepoint));
+		}
+		else if (intrinsic.name_equals("stringBuilder")) {
+			// a string builder collects the pushed strings and joins them once
+			printer.println(format("const % = [];", result));
+		}
+		else if (intrinsic.name_equals("stringBuilderPush")) {
+			const Variable builder = expression_table[intrinsic.get_arguments()[0]];
+			const Variable argument = expression_table[intrinsic.get_arguments()[1]];
+			if (intrinsic.get_arguments()[1]->get_type_id() == TypeId::STRING) {
+				printer.println(format("%.push(%);", builder, argument));
+			}
+			else {
+				printer.println(format("%.push(String.fromCodePoint(%));", builder, argument));
+			}
+			printer.println(format("const % = %;", result, builder));
+		}
+		else if (intrinsic.name_equals("stringBuilderToString")) {
+			const Variable builder = expression_table[intrinsic.get_arguments()[0]];
+			printer.println(format("const % = %.join('');", result, builder));
+		}
+		else if (intrinsic.name_equals("slice") || intrinsic.name_equals("sliceCopy")) {
+			// a slice is the array, the start, and the end of the range
+			const Expression* argument = intrinsic.get_arguments()[0];
+			const Variable array = expression_table[argument];
+			const Variable view = next_variable();
+			if (argument->get_type_id() == TypeId::SLICE) {
+				if (intrinsic.get_arguments().size() == 3) {
+					const Variable start = expression_table[intrinsic.get_arguments()[1]];
+					const Variable end = expression_table[intrinsic.get_arguments()[2]];
+					printer.println(format("const % = [%[0], %[1] + %, %[1] + %];", view, array, array, start, array, end));
+				}
+				else {
+					printer.println(format("const % = %;", view, array));
+				}
+			}
+			else {
+				if (intrinsic.get_arguments().size() == 3) {
+					const Variable start = expression_table[intrinsic.get_arguments()[1]];
+					const Variable end = expression_table[intrinsic.get_arguments()[2]];
+					printer.println(format("const % = [%, %, %];", view, array, start, end));
+				}
+				else {
+					printer.println(format("const % = [%, 0, %.length];", view, array, array));
+				}
+			}
+			// an array that is still used might be modified later, so only its range is copied
+			if (intrinsic.name_equals("sliceCopy") && argument->get_type_id() == TypeId::ARRAY) {
+				printer.println(print_functor([&](auto& printer) {
+					printer.print(format("const % = [", result));
+					print_slice_to_array(printer, intrinsic.get_type(), view);
+					printer.print(format(", 0, %[2] - %[1]];", view, view));
+				}));
+			}
+			else {
+				printer.println(format("const % = %;", result, view));
+			}
+		}
+		else if (intrinsic.name_equals("sliceGetNext")) {
+			const Variable slice = expression_table[intrinsic.get_arguments()[0]];
+			const Variable codepoint = next_variable();
+			printer.println(format("const % = %[1] < %[2] ? %[0].codePointAt(%[1]) : undefined;", codepoint, slice, slice, slice, slice));
+			printer.println(format("const % = % === undefined ? [%, 0, 0] : [[%[0], %[1] + (% > 0xFFFF ? 2 : 1), %[2]], 1, %];", result, codepoint, slice, slice, slice, codepoint, slice, codepoint));
+		}
+		else if (intrinsic.name_equals("sliceToArray")) {
+			const Variable slice = expression_table[intrinsic.get_arguments()[0]];
+			printer.println(print_functor([&](auto& printer) {
+				printer.print(format("const % = ", result));
+				print_slice_to_array(printer, intrinsic.get_arguments()[0]->get_type(), slice);
+				printer.print(";");
+			}));
+		}
+		else if (intrinsic.name_equals("parallelMap") || intrinsic.name_equals("parallelReduce")) {
+			// JavaScript runs the calls sequentially
+			const bool reduce = intrinsic.name_equals("parallelReduce");
+			const Variable array = expression_table[intrinsic.get_arguments()[0]];
+			const bool int_array = is_int_array(intrinsic.get_arguments()[0]->get_type());
+			const ::Type* element_type = static_cast<const ArrayType*>(intrinsic.get_arguments()[0]->get_type())->get_element_type();
+			auto print_call = [&](auto& printer) {
+				printer.print(format("f%(", print_number(function_table.look_up(intrinsic.get_function()))));
+				for (std::size_t i = reduce ? 2 : 1; i < intrinsic.get_arguments().size(); ++i) {
+					const Expression* argument = intrinsic.get_arguments()[i];
+					if (argument->get_type() != TypeInterner::get_void_type()) {
+						function_table.print_copy(printer, argument->get_type(), expression_table[argument]);
+						printer.print(", ");
+					}
+				}
+				if (reduce) {
+					printer.print(format("%, ", result));
+				}
+				if (int_array) {
+					printer.print(format("%.data[i]", array));
+				}
+				else {
+					function_table.print_copy(printer, element_type, format("%[i]", array));
+				}
+				printer.print(")");
+			};
+			if (reduce) {
+				printer.println(print_functor([&](auto& printer) {
+					printer.print(format("let % = ", result));
+					function_table.print_copy(printer, intrinsic.get_type(), expression_table[intrinsic.get_arguments()[1]]);
+					printer.print(";");
+				}));
+				printer.println_increasing(format("for (let i = 0; i < %.length; ++i) {", array));
+				printer.println(print_functor([&](auto& printer) {
+					printer.print(format("% = ", result));
+					print_call(printer);
+					printer.print(";");
+				}));
+			}
+			else {
+				const bool int_result = is_int_array(intrinsic.get_type());
+				if (int_result) {
+					printer.println(format("const % = new IntArray(new Int32Array(%.length), %.length);", result, array, array));
+				}
+				else {
+					printer.println(format("const % = new Array(%.length);", result, array));
+				}
+				printer.println_increasing(format("for (let i = 0; i < %.length; ++i) {", array));
+				printer.println(print_functor([&](auto& printer) {
+					printer.print(format(int_result ? "%.data[i] = " : "%[i] = ", result));
+					print_call(printer);
+					printer.print(";");
+				}));
+			}
+			printer.println_decreasing("}");
 		}
 		else if (intrinsic.name_equals("reference")) {
 			const Variable value = expression_table[intrinsic.get_arguments()[0]];
 			printer.println(format("const % = %;", result, value));
 		}
 		else if (intrinsic.name_equals("copy")) {
-			const Variable array = expression_table[intrinsic.get_arguments()[0]];
-			printer.println(format("const % = %;", result, array));
+			const Variable value = expression_table[intrinsic.get_arguments()[0]];
+			printer.println(print_functor([&](auto& printer) {
+				printer.print(format("const % = ", result));
+				function_table.print_copy(printer, intrinsic.get_type(), value);
+				printer.print(";");
+			}));
 		}
 		return result;
 	}
+	// copies the range of a slice into a new array, since slices share their array
+	template <class P> void print_slice_to_array(P& printer, const ::Type* slice_type, const Variable& slice) {
+		const ::Type* array_type = get_array_type(slice_type);
+		if (array_type->get_id() == TypeId::STRING) {
+			printer.print(format("%[0].slice(%[1], %[2])", slice, slice, slice));
+		}
+		else if (is_int_array(array_type)) {
+			printer.print(format("new IntArray(%[0].data.slice(%[1], %[2]), %[2] - %[1])", slice, slice, slice, slice, slice));
+		}
+		else {
+			const ::Type* element_type = static_cast<const ArrayType*>(array_type)->get_element_type();
+			printer.print(format("%[0].slice(%[1], %[2])", slice, slice, slice));
+			if (function_table.needs_copy(element_type)) {
+				printer.print(format(".map(c%)", print_number(function_table.look_up_copy(element_type))));
+			}
+		}
+	}
 	Variable visit_bind(const Bind& bind) override {
 		const Variable right = expression_table[bind.get_right()];
 		const Variable result = next_variable();
@@ -329,12 +672,132 @@ public:
 	}
 	Variable visit_return(const Return& return_) override {
 		const Expression* expression = return_.get_expression();
-		if (expression->get_type() != TypeInterner::get_void_type() && !tail_call_data.is_tail_call(expression)) {
+		if (expression->get_type() != TypeInterner::get_void_type() && !tail_call_data.is_tail_call(expression) && !tail_call_data.is_group_tail_call(expression)) {
 			printer.println(format("% = %;", result, expression_table[expression]));
 		}
 		return next_variable();
 	}
-	static void codegen(const Program& program, const char* source_path, const TailCallData& tail_call_data) {
+	// a loop that switches between the bodies of the functions of the group
+	static void generate_group(FunctionTable& function_table, IndentPrinter& printer, const TailCallData& tail_call_data, std::size_t group) {
+		const std::vector<const Function*>& functions = tail_call_data.groups[group];
+		std::size_t max_arguments = 0;
+		for (const Function* function: functions) {
+			max_arguments = std::max(max_arguments, function->get_argument_types().size());
+		}
+		printer.println_increasing(print_functor([&](auto& printer) {
+			printer.print(format("function d%(state", print_number(group)));
+			for (std::size_t i = 0; i < max_arguments; ++i) {
+				printer.print(format(", a%", print_number(i)));
+			}
+			printer.print(") {");
+		}));
+		printer.println_increasing("while (true) {");
+		printer.println_increasing("switch (state) {");
+		for (const Function* function: functions) {
+			const std::size_t index = function_table.look_up(function);
+			const std::size_t arguments = function->get_argument_types().size();
+			printer.println_increasing(format("case %: {", print_number(index)));
+			for (std::size_t i = 0; i < arguments; ++i) {
+				if (function->get_argument_types()[i] != TypeInterner::get_void_type()) {
+					printer.println(format("const v% = a%;", print_number(i), print_number(i)));
+				}
+			}
+			const Variable result = Variable(arguments);
+			if (function->get_return_type()->get_id() != TypeId::VOID) {
+				printer.println(format("let %;", result));
+			}
+			CodegenJS::evaluate(function_table, printer, arguments + 1, result, tail_call_data, function->get_block());
+			if (function->get_return_type()->get_id() != TypeId::VOID) {
+				printer.println(format("return %;", result));
+			}
+			else {
+				printer.println("return;");
+			}
+			printer.println_decreasing("}");
+		}
+		printer.println_decreasing("}");
+		printer.println_decreasing("}");
+		printer.println_decreasing("}");
+	}
+	// a deep copy of the arrays in a value, everything else is immutable and shared
+	static void generate_copy_function(FunctionTable& function_table, IndentPrinter& printer, const ::Type* type) {
+		const std::size_t index = function_table.look_up_copy(type);
+		printer.println_increasing(format("function c%(value) {", print_number(index)));
+		switch (type->get_id()) {
+		case TypeId::ARRAY:
+		{
+			const ::Type* element_type = static_cast<const ArrayType*>(type)->get_element_type();
+			if (is_int_array(type)) {
+				printer.println("return new IntArray(value.data.slice(0, value.length), value.length);");
+			}
+			else if (function_table.needs_copy(element_type)) {
+				printer.println(format("return value.map(c%);", print_number(function_table.look_up_copy(element_type))));
+			}
+			else {
+				printer.println("return value.slice();");
+			}
+			break;
+		}
+		case TypeId::STRING_BUILDER:
+			printer.println("return value.slice();");
+			break;
+		case TypeId::TUPLE:
+		{
+			const std::vector<const ::Type*>& element_types = static_cast<const TupleType*>(type)->get_element_types();
+			printer.println(print_functor([&](auto& printer) {
+				printer.print("return [");
+				for (std::size_t i = 0; i < element_types.size(); ++i) {
+					if (i > 0) printer.print(", ");
+					if (element_types[i] != TypeInterner::get_void_type()) {
+						function_table.print_copy(printer, element_types[i], format("value[%]", print_number(i)));
+					}
+					else {
+						printer.print("undefined");
+					}
+				}
+				printer.print("];");
+			}));
+			break;
+		}
+		case TypeId::STRUCT:
+		{
+			printer.println_increasing("return {");
+			for (const auto& field: static_cast<const StructType*>(type)->get_fields()) {
+				if (field.second != TypeInterner::get_void_type()) {
+					printer.println(print_functor([&](auto& printer) {
+						printer.print(format("%: ", field.first));
+						function_table.print_copy(printer, field.second, format("value.%", field.first));
+						printer.print(",");
+					}));
+				}
+			}
+			printer.println_decreasing("};");
+			break;
+		}
+		case TypeId::ENUM:
+		{
+			const auto& cases = static_cast<const EnumType*>(type)->get_cases();
+			printer.println_increasing("switch (value.tag) {");
+			for (std::size_t i = 0; i < cases.size(); ++i) {
+				if (function_table.needs_copy(cases[i].second)) {
+					printer.println(print_functor([&](auto& printer) {
+						printer.print(format("case %: return {tag: %, value: ", print_number(i), print_number(i)));
+						function_table.print_copy(printer, cases[i].second, "value.value");
+						printer.print("};");
+					}));
+				}
+			}
+			printer.println("default: return value;");
+			printer.println_decreasing("}");
+			break;
+		}
+		default:
+			printer.println("return value;");
+			break;
+		}
+		printer.println_decreasing("}");
+	}
+	static void codegen(const Program& program, const char* source_path, const TailCallData& tail_call_data, const CodegenOptions& options) {
 		FunctionTable function_table;
 		std::string path = std::string(source_path) + ".html";
 		std::ofstream file(path);
@@ -343,6 +806,7 @@ public:
 		printer.println("window.addEventListener('load', main);");
 		{
 			printer.println_increasing("function main() {");
+			printer.println("document.body.appendChild(stdout);");
 			const std::size_t index = function_table.look_up(program.get_main_function());
 			printer.println(format("f%();", print_number(index)));
 			printer.println("flushStdout();");
@@ -363,6 +827,30 @@ public:
 				}
 				printer.print(") {");
 			}));
+			if (tail_call_data.has_group(function)) {
+				// enter the loop of the group
+				const std::size_t group = tail_call_data.get_group(function);
+				printer.println(print_functor([&](auto& printer) {
+					if (function->get_return_type()->get_id() != TypeId::VOID) {
+						printer.print("return ");
+					}
+					printer.print(format("d%(%", print_number(group), print_number(index)));
+					for (std::size_t i = 0; i < arguments; ++i) {
+						if (function->get_argument_types()[i] != TypeInterner::get_void_type()) {
+							printer.print(format(", v%", print_number(i)));
+						}
+						else {
+							printer.print(", undefined");
+						}
+					}
+					printer.print(");");
+				}));
+				printer.println_decreasing("}");
+				if (tail_call_data.groups[group].front() == function) {
+					generate_group(function_table, printer, tail_call_data, group);
+				}
+				continue;
+			}
 			if (tail_call_data.has_tail_call(function)) {
 				printer.println_increasing("while (true) {");
 			}
@@ -382,29 +870,74 @@ public:
 			}
 			printer.println_decreasing("}");
 		}
-		printer.println("let stdoutBuffer = '';");
+		while (const ::Type* type = function_table.get_next_copy_function()) {
+			generate_copy_function(function_table, printer, type);
+		}
+		// arrays of numbers are backed by typed arrays with a capacity and grow geometrically
 		{
-			printer.println_increasing("function flushStdout() {");
-			printer.println("document.body.appendChild(document.createTextNode(stdoutBuffer));");
-			printer.println("stdoutBuffer = '';");
+			printer.println_increasing("class IntArray {");
+			printer.println_increasing("constructor(data, length) {");
+			printer.println("this.data = data;");
+			printer.println("this.length = length;");
+			printer.println_decreasing("}");
 			printer.println_decreasing("}");
 		}
 		{
-			printer.println_increasing("function putChar(c) {");
-			printer.println_increasing("if (c === '\\n') {");
-			printer.println("flushStdout();");
-			printer.println("document.body.appendChild(document.createElement('br'));");
+			// replaces remove elements at index with room for insert elements
+			printer.println_increasing("function intArraySplice(array, index, remove, insert) {");
+			printer.println("const length = array.length - remove + insert;");
+			printer.println_increasing("if (length > array.data.length) {");
+			printer.println("const data = new Int32Array(Math.max(length, array.data.length * 2));");
+			printer.println("data.set(array.data.subarray(0, index));");
+			printer.println("data.set(array.data.subarray(index + remove, array.length), index + insert);");
+			printer.println("array.data = data;");
 			printer.println_decreasing("}");
-			printer.println_increasing("else {");
-			printer.println("stdoutBuffer = stdoutBuffer + c;");
+			printer.println_increasing("else if (remove !== insert) {");
+			printer.println("array.data.copyWithin(index + insert, index + remove, array.length);");
 			printer.println_decreasing("}");
+			printer.println("array.length = length;");
 			printer.println_decreasing("}");
 		}
 		{
-			printer.println_increasing("function putStr(s) {");
-			printer.println_increasing("for (const c of s) {");
-			printer.println("putChar(c);");
+			// replaces remove elements at index with the elements of insert without spreading them into arguments
+			printer.println_increasing("function arraySplice(array, index, remove, insert) {");
+			printer.println("const tail = array.splice(index + remove);");
+			printer.println("array.length = index;");
+			printer.println("for (const element of insert) array.push(element);");
+			printer.println("for (const element of tail) array.push(element);");
 			printer.println_decreasing("}");
+		}
+		// a web page has no standard input, a runner outside of the browser can provide it as a global string
+		// getChar and readAll share a cursor into its UTF-8 bytes like the buffered input of the other backends
+		printer.println("let stdinBytes = null;");
+		printer.println("let stdinPosition = 0;");
+		{
+			printer.println_increasing("function stdinGetBytes() {");
+			printer.println("if (stdinBytes === null) stdinBytes = new TextEncoder().encode(typeof stdin === 'string' ? stdin : '');");
+			printer.println("return stdinBytes;");
+			printer.println_decreasing("}");
+		}
+		{
+			printer.println_increasing("function stdinGetChar() {");
+			printer.println("const bytes = stdinGetBytes();");
+			printer.println("return stdinPosition < bytes.length ? bytes[stdinPosition++] : -1;");
+			printer.println_decreasing("}");
+		}
+		{
+			printer.println_increasing("function stdinReadAll() {");
+			printer.println("const bytes = stdinGetBytes();");
+			printer.println("const position = stdinPosition;");
+			printer.println("stdinPosition = bytes.length;");
+			printer.println("return new TextDecoder().decode(bytes.subarray(position));");
+			printer.println_decreasing("}");
+		}
+		// output is collected in a string and appended to the page in large batches
+		printer.println("const stdout = document.createElement('pre');");
+		printer.println("let stdoutBuffer = '';");
+		{
+			printer.println_increasing("function flushStdout() {");
+			printer.println("stdout.appendChild(document.createTextNode(stdoutBuffer));");
+			printer.println("stdoutBuffer = '';");
 			printer.println_decreasing("}");
 		}
 		printer.println("</script></head><body></body></html>");
@@ -0,0 +1,1434 @@
+#pragma once
+
+#include "ast.hpp"
+#include "options.hpp"
+#include "assembler_wasm.hpp"
+#include <map>
+#include <algorithm>
+
+// every value is an i32, aggregates are pointers to blocks on the heap
+// tuples and structs hold one word per field, enums a tag and a value, string iterators a string and a position
+// arrays and strings hold their length and capacity followed by words or bytes
+// references are represented by the values they point to and string builders by strings
+class CodegenWasm: public Visitor<std::uint32_t> {
+	// the byte written by putChar
+	static constexpr std::int32_t SCRATCH = 8;
+	// the heads of the free lists, one for every power of two
+	static constexpr std::int32_t FREE_LISTS = 16;
+	static constexpr std::int32_t SIZE_CLASSES = 32;
+	// string literals
+	static constexpr std::int32_t DATA = FREE_LISTS + SIZE_CLASSES * 4;
+	// length and capacity
+	static constexpr std::uint32_t ARRAY_HEADER = 8;
+	static constexpr std::uint32_t HEAP_TOP = 0;
+	static const ::Type* get_value_type(const ::Type* type) {
+		while (type->get_id() == TypeId::REFERENCE) {
+			type = static_cast<const ReferenceType*>(type)->get_type();
+		}
+		if (type->get_id() == TypeId::STRING_BUILDER) {
+			return TypeInterner::get_string_type();
+		}
+		return type;
+	}
+	[[noreturn]] static void unsupported(const char* feature) {
+		print_error(Printer(std::cerr), format("the WebAssembly codegen does not support %", feature));
+		std::exit(EXIT_FAILURE);
+	}
+	static bool is_managed(const ::Type* type) {
+		const TypeId type_id = get_value_type(type)->get_id();
+		return type_id == TypeId::STRUCT || type_id == TypeId::ENUM || type_id == TypeId::TUPLE || type_id == TypeId::ARRAY || type_id == TypeId::STRING || type_id == TypeId::STRING_ITERATOR;
+	}
+	static const ::Type* get_element_type(const ::Type* type) {
+		type = get_value_type(type);
+		if (type->get_id() == TypeId::STRING) {
+			return TypeInterner::get_char_type();
+		}
+		return static_cast<const ArrayType*>(type)->get_element_type();
+	}
+	// the binary logarithm of the element size
+	static std::int32_t get_element_shift(const ::Type* type) {
+		return get_value_type(type)->get_id() == TypeId::STRING ? 0 : 2;
+	}
+	static std::uint32_t get_field_offset(const ::Type* type, const std::string& field_name) {
+		return static_cast<const StructType*>(get_value_type(type))->get_index(field_name) * 4;
+	}
+	static std::vector<const ::Type*> get_field_types(const ::Type* type) {
+		std::vector<const ::Type*> field_types;
+		if (type->get_id() == TypeId::TUPLE) {
+			field_types = static_cast<const TupleType*>(type)->get_element_types();
+		}
+		else if (type->get_id() == TypeId::STRUCT) {
+			for (const auto& field: static_cast<const StructType*>(type)->get_fields()) {
+				field_types.push_back(field.second);
+			}
+		}
+		return field_types;
+	}
+	enum class TypeFunction {
+		COPY,
+		FREE,
+		// frees a range of the elements of an array
+		FREE_ELEMENTS
+	};
+	class FunctionTable {
+		WasmModule& module;
+		IndexTable<Function, std::uint32_t> functions;
+		std::vector<std::uint32_t> groups;
+		std::map<std::pair<TypeFunction, const ::Type*>, std::uint32_t> type_functions;
+		std::vector<std::pair<TypeFunction, const ::Type*>> type_function_queue;
+		std::map<std::string, std::int32_t> strings;
+		std::string data;
+	public:
+		// imported from the environment
+		const std::uint32_t write;
+		const std::uint32_t get_char;
+		// the runtime
+		const std::uint32_t malloc;
+		const std::uint32_t free;
+		const std::uint32_t array_new;
+		const std::uint32_t array_resize;
+		const std::uint32_t string_push_codepoint;
+		const std::uint32_t string_iterator_get_next;
+		const std::uint32_t read_all;
+		FunctionTable(WasmModule& module):
+			module(module),
+			write(module.add_import("env", "write", 2, 0)),
+			get_char(module.add_import("env", "getChar", 0, 1)),
+			malloc(module.declare_function(1, 1)),
+			free(module.declare_function(1, 0)),
+			array_new(module.declare_function(2, 1)),
+			array_resize(module.declare_function(5, 1)),
+			string_push_codepoint(module.declare_function(2, 1)),
+			string_iterator_get_next(module.declare_function(1, 1)),
+			read_all(module.declare_function(0, 1))
+		{}
+		void declare(const Function* function) {
+			functions[function] = module.declare_function(function->get_argument_types().size(), 1);
+		}
+		std::uint32_t look_up(const Function* function) const {
+			return functions.get(function);
+		}
+		std::uint32_t declare_group(std::uint32_t arguments) {
+			groups.push_back(module.declare_function(1 + arguments, 1));
+			return groups.back();
+		}
+		std::uint32_t look_up_group(std::size_t group) const {
+			return groups[group];
+		}
+		std::uint32_t look_up(TypeFunction type_function, const ::Type* type) {
+			const auto key = std::make_pair(type_function, get_value_type(type));
+			auto iterator = type_functions.find(key);
+			if (iterator == type_functions.end()) {
+				const std::uint32_t parameters = type_function == TypeFunction::FREE_ELEMENTS ? 3 : 1;
+				const std::uint32_t results = type_function == TypeFunction::COPY ? 1 : 0;
+				iterator = type_functions.emplace(key, module.declare_function(parameters, results)).first;
+				type_function_queue.push_back(key);
+			}
+			return iterator->second;
+		}
+		bool get_next_type_function(std::pair<TypeFunction, const ::Type*>& type_function) {
+			if (type_function_queue.empty()) {
+				return false;
+			}
+			type_function = type_function_queue.back();
+			type_function_queue.pop_back();
+			return true;
+		}
+		std::int32_t look_up(const std::string& string) {
+			auto iterator = strings.find(string);
+			if (iterator == strings.end()) {
+				iterator = strings.emplace(string, DATA + data.size()).first;
+				data.append(string);
+			}
+			return iterator->second;
+		}
+		const std::string& get_data() const {
+			return data;
+		}
+		// copies the value on the stack
+		void copy(WasmAssembler& assembler, const ::Type* type) {
+			if (is_managed(type)) {
+				assembler.CALL(look_up(TypeFunction::COPY, type));
+			}
+		}
+		// frees the value on the stack
+		void free_value(WasmAssembler& assembler, const ::Type* type) {
+			if (is_managed(type)) {
+				assembler.CALL(look_up(TypeFunction::FREE, type));
+			}
+			else {
+				assembler.DROP();
+			}
+		}
+	};
+	// the state of the function that is being generated
+	class FunctionContext {
+	public:
+		WasmAssembler assembler;
+		std::uint32_t locals;
+		std::uint32_t depth = 0;
+		// the loop that is continued by tail calls
+		std::uint32_t loop = 0;
+		// the local of the first argument
+		std::uint32_t arguments = 0;
+		// the local that selects the function of a group
+		std::uint32_t state = 0;
+		FunctionContext(std::uint32_t parameters): locals(parameters) {}
+		std::uint32_t next_local() {
+			return locals++;
+		}
+		std::uint32_t enter() {
+			return ++depth;
+		}
+		void leave() {
+			--depth;
+		}
+		// the relative depth of a branch to the given label
+		std::uint32_t get_branch_depth(std::uint32_t label) const {
+			return depth - label;
+		}
+	};
+	FunctionTable& function_table;
+	FunctionContext& context;
+	WasmAssembler& assembler;
+	using ExpressionTable = IndexTable<Expression, std::uint32_t>;
+	ExpressionTable& expression_table;
+	std::uint32_t case_variable;
+	std::uint32_t result;
+	const TailCallData& tail_call_data;
+	std::uint32_t next_local() {
+		return context.next_local();
+	}
+	// pushes the address of the element at the index in the local onto the stack, the offset of the elements has to be added
+	void element_address(std::uint32_t array, std::uint32_t index, std::int32_t shift) {
+		assembler.LOCAL_GET(array);
+		assembler.LOCAL_GET(index);
+		if (shift > 0) {
+			assembler.I32_CONST(shift);
+			assembler.I32_SHL();
+		}
+		assembler.I32_ADD();
+	}
+	CodegenWasm(FunctionTable& function_table, FunctionContext& context, ExpressionTable& expression_table, std::uint32_t case_variable, std::uint32_t result, const TailCallData& tail_call_data): function_table(function_table), context(context), assembler(context.assembler), expression_table(expression_table), case_variable(case_variable), result(result), tail_call_data(tail_call_data) {}
+	static void evaluate(FunctionTable& function_table, FunctionContext& context, ExpressionTable& expression_table, std::uint32_t case_variable, std::uint32_t result, const TailCallData& tail_call_data, const Block& block) {
+		CodegenWasm codegen(function_table, context, expression_table, case_variable, result, tail_call_data);
+		for (const Expression* expression: block) {
+			expression_table[expression] = visit(codegen, expression);
+		}
+	}
+	static void evaluate(FunctionTable& function_table, FunctionContext& context, std::uint32_t result, const TailCallData& tail_call_data, const Block& block) {
+		ExpressionTable expression_table;
+		evaluate(function_table, context, expression_table, 0, result, tail_call_data, block);
+	}
+	void evaluate(std::uint32_t case_variable, std::uint32_t result, const Block& block) {
+		evaluate(function_table, context, expression_table, case_variable, result, tail_call_data, block);
+	}
+public:
+	std::uint32_t visit_int_literal(const IntLiteral& int_literal) override {
+		const std::uint32_t result = next_local();
+		assembler.I32_CONST(int_literal.get_value());
+		assembler.LOCAL_SET(result);
+		return result;
+	}
+	std::uint32_t visit_binary_expression(const BinaryExpression& binary_expression) override {
+		const std::uint32_t left = expression_table[binary_expression.get_left()];
+		const std::uint32_t right = expression_table[binary_expression.get_right()];
+		const std::uint32_t result = next_local();
+		assembler.LOCAL_GET(left);
+		assembler.LOCAL_GET(right);
+		switch (binary_expression.get_operation()) {
+		case BinaryOperation::ADD:
+			assembler.I32_ADD();
+			break;
+		case BinaryOperation::SUB:
+			assembler.I32_SUB();
+			break;
+		case BinaryOperation::MUL:
+			assembler.I32_MUL();
+			break;
+		case BinaryOperation::DIV:
+			assembler.I32_DIV_S();
+			break;
+		case BinaryOperation::REM:
+			assembler.I32_REM_S();
+			break;
+		case BinaryOperation::EQ:
+			assembler.I32_EQ();
+			break;
+		case BinaryOperation::NE:
+			assembler.I32_NE();
+			break;
+		case BinaryOperation::LT:
+			assembler.I32_LT_S();
+			break;
+		case BinaryOperation::LE:
+			assembler.I32_LE_S();
+			break;
+		case BinaryOperation::GT:
+			assembler.I32_GT_S();
+			break;
+		case BinaryOperation::GE:
+			assembler.I32_GE_S();
+			break;
+		default:
+			break;
+		}
+		assembler.LOCAL_SET(result);
+		return result;
+	}
+	std::uint32_t visit_array_literal(const ArrayLiteral& array_literal) override {
+		const std::uint32_t result = next_local();
+		const std::vector<const Expression*>& elements = array_literal.get_elements();
+		assembler.I32_CONST(elements.size());
+		assembler.I32_CONST(2);
+		assembler.CALL(function_table.array_new);
+		assembler.LOCAL_SET(result);
+		for (std::size_t i = 0; i < elements.size(); ++i) {
+			if (elements[i]->get_type() != TypeInterner::get_void_type()) {
+				assembler.LOCAL_GET(result);
+				assembler.LOCAL_GET(expression_table[elements[i]]);
+				assembler.I32_STORE(ARRAY_HEADER + i * 4);
+			}
+		}
+		return result;
+	}
+	std::uint32_t visit_string_literal(const StringLiteral& string_literal) override {
+		const std::uint32_t result = next_local();
+		const std::string& value = string_literal.get_value();
+		assembler.I32_CONST(value.size());
+		assembler.I32_CONST(0);
+		assembler.CALL(function_table.array_new);
+		assembler.LOCAL_SET(result);
+		if (!value.empty()) {
+			assembler.LOCAL_GET(result);
+			assembler.I32_CONST(ARRAY_HEADER);
+			assembler.I32_ADD();
+			assembler.I32_CONST(function_table.look_up(value));
+			assembler.I32_CONST(value.size());
+			assembler.MEMORY_COPY();
+		}
+		return result;
+	}
+	std::uint32_t visit_if(const If& if_) override {
+		const std::uint32_t condition = expression_table[if_.get_condition()];
+		const std::uint32_t result = next_local();
+		assembler.LOCAL_GET(condition);
+		assembler.IF();
+		context.enter();
+		evaluate(case_variable, result, if_.get_then_block());
+		assembler.ELSE();
+		evaluate(case_variable, result, if_.get_else_block());
+		assembler.END();
+		context.leave();
+		return result;
+	}
+	std::uint32_t visit_tuple_literal(const TupleLiteral& tuple_literal) override {
+		const std::uint32_t result = next_local();
+		const std::vector<const Expression*>& elements = tuple_literal.get_elements();
+		assembler.I32_CONST(elements.size() * 4);
+		assembler.CALL(function_table.malloc);
+		assembler.LOCAL_SET(result);
+		for (std::size_t i = 0; i < elements.size(); ++i) {
+			if (elements[i]->get_type() != TypeInterner::get_void_type()) {
+				assembler.LOCAL_GET(result);
+				assembler.LOCAL_GET(expression_table[elements[i]]);
+				assembler.I32_STORE(i * 4);
+			}
+		}
+		return result;
+	}
+	std::uint32_t visit_tuple_access(const TupleAccess& tuple_access) override {
+		const std::uint32_t tuple = expression_table[tuple_access.get_tuple()];
+		const std::uint32_t result = next_local();
+		if (tuple_access.get_type() != TypeInterner::get_void_type()) {
+			assembler.LOCAL_GET(tuple);
+			assembler.I32_LOAD(tuple_access.get_index() * 4);
+			assembler.LOCAL_SET(result);
+		}
+		return result;
+	}
+	std::uint32_t visit_struct_literal(const StructLiteral& struct_literal) override {
+		const std::uint32_t result = next_local();
+		assembler.I32_CONST(static_cast<const StructType*>(struct_literal.get_type())->get_fields().size() * 4);
+		assembler.CALL(function_table.malloc);
+		assembler.LOCAL_SET(result);
+		for (const auto& field: struct_literal.get_fields()) {
+			if (field.second->get_type() != TypeInterner::get_void_type()) {
+				assembler.LOCAL_GET(result);
+				assembler.LOCAL_GET(expression_table[field.second]);
+				assembler.I32_STORE(get_field_offset(struct_literal.get_type(), field.first));
+			}
+		}
+		return result;
+	}
+	std::uint32_t visit_struct_access(const StructAccess& struct_access) override {
+		const std::uint32_t struct_ = expression_table[struct_access.get_struct()];
+		const std::uint32_t result = next_local();
+		if (struct_access.get_type() != TypeInterner::get_void_type()) {
+			assembler.LOCAL_GET(struct_);
+			assembler.I32_LOAD(get_field_offset(struct_access.get_struct()->get_type(), struct_access.get_field_name()));
+			assembler.LOCAL_SET(result);
+		}
+		return result;
+	}
+	std::uint32_t visit_enum_literal(const EnumLiteral& enum_literal) override {
+		const std::uint32_t result = next_local();
+		assembler.I32_CONST(8);
+		assembler.CALL(function_table.malloc);
+		assembler.LOCAL_SET(result);
+		assembler.LOCAL_GET(result);
+		assembler.I32_CONST(enum_literal.get_index());
+		assembler.I32_STORE(0);
+		if (enum_literal.get_expression()->get_type() != TypeInterner::get_void_type()) {
+			assembler.LOCAL_GET(result);
+			assembler.LOCAL_GET(expression_table[enum_literal.get_expression()]);
+			assembler.I32_STORE(4);
+		}
+		return result;
+	}
+	std::uint32_t visit_switch(const Switch& switch_) override {
+		const std::uint32_t enum_ = expression_table[switch_.get_enum()];
+		const std::uint32_t result = next_local();
+		const std::uint32_t tag = next_local();
+		const std::uint32_t case_variable = next_local();
+		// the value moves into the case variable and the block of the enum is no longer needed
+		assembler.LOCAL_GET(enum_);
+		assembler.I32_LOAD(0);
+		assembler.LOCAL_SET(tag);
+		assembler.LOCAL_GET(enum_);
+		assembler.I32_LOAD(4);
+		assembler.LOCAL_SET(case_variable);
+		assembler.LOCAL_GET(enum_);
+		assembler.CALL(function_table.free);
+		const std::size_t cases = switch_.get_cases().size();
+		assembler.BLOCK();
+		const std::uint32_t end = context.enter();
+		for (std::size_t i = 0; i < cases; ++i) {
+			assembler.BLOCK();
+			context.enter();
+		}
+		std::vector<std::uint32_t> depths;
+		for (std::size_t i = 0; i < cases; ++i) {
+			depths.push_back(i);
+		}
+		assembler.LOCAL_GET(tag);
+		assembler.BR_TABLE(depths, cases > 0 ? cases - 1 : 0);
+		for (std::size_t i = 0; i < cases; ++i) {
+			assembler.END();
+			context.leave();
+			evaluate(case_variable, result, switch_.get_cases()[i].second);
+			assembler.BR(context.get_branch_depth(end));
+		}
+		assembler.END();
+		context.leave();
+		return result;
+	}
+	std::uint32_t visit_case_variable(const CaseVariable&) override {
+		return case_variable;
+	}
+	std::uint32_t visit_argument(const Argument& argument) override {
+		return context.arguments + argument.get_index();
+	}
+	std::uint32_t visit_function_call(const FunctionCall& call) override {
+		const std::uint32_t result = next_local();
+		const std::vector<const Expression*>& arguments = call.get_arguments();
+		// all arguments are pushed before any of them is overwritten
+		for (const Expression* argument: arguments) {
+			assembler.LOCAL_GET(expression_table[argument]);
+		}
+		if (tail_call_data.is_group_tail_call(&call) || tail_call_data.is_tail_call(&call)) {
+			for (std::size_t i = arguments.size(); i > 0; --i) {
+				assembler.LOCAL_SET(context.arguments + i - 1);
+			}
+			if (tail_call_data.is_group_tail_call(&call)) {
+				const std::vector<const Function*>& functions = tail_call_data.groups[tail_call_data.get_group(call.get_function())];
+				const std::size_t position = std::find(functions.begin(), functions.end(), call.get_function()) - functions.begin();
+				assembler.I32_CONST(position);
+				assembler.LOCAL_SET(context.state);
+			}
+			assembler.BR(context.get_branch_depth(context.loop));
+		}
+		else {
+			assembler.CALL(function_table.look_up(call.get_function()));
+			assembler.LOCAL_SET(result);
+		}
+		return result;
+	}
+	std::uint32_t visit_intrinsic(const Intrinsic& intrinsic) override {
+		const std::uint32_t result = next_local();
+		if (intrinsic.name_equals("putChar")) {
+			const std::uint32_t argument = expression_table[intrinsic.get_arguments()[0]];
+			assembler.I32_CONST(SCRATCH);
+			assembler.LOCAL_GET(argument);
+			assembler.I32_STORE8();
+			assembler.I32_CONST(SCRATCH);
+			assembler.I32_CONST(1);
+			assembler.CALL(function_table.write);
+		}
+		else if (intrinsic.name_equals("putStr") || intrinsic.name_equals("writeAll")) {
+			const std::uint32_t argument = expression_table[intrinsic.get_arguments()[0]];
+			assembler.LOCAL_GET(argument);
+			assembler.I32_CONST(ARRAY_HEADER);
+			assembler.I32_ADD();
+			assembler.LOCAL_GET(argument);
+			assembler.I32_LOAD(0);
+			assembler.CALL(function_table.write);
+		}
+		else if (intrinsic.name_equals("getChar")) {
+			assembler.CALL(function_table.get_char);
+			assembler.LOCAL_SET(result);
+		}
+		else if (intrinsic.name_equals("readAll")) {
+			assembler.CALL(function_table.read_all);
+			assembler.LOCAL_SET(result);
+		}
+		else if (intrinsic.name_equals("arrayGet")) {
+			const Expression* array = intrinsic.get_arguments()[0];
+			const std::uint32_t index = expression_table[intrinsic.get_arguments()[1]];
+			element_address(expression_table[array], index, get_element_shift(array->get_type()));
+			if (get_element_shift(array->get_type()) == 0) {
+				assembler.I32_LOAD8_U(ARRAY_HEADER);
+			}
+			else {
+				assembler.I32_LOAD(ARRAY_HEADER);
+			}
+			assembler.LOCAL_SET(result);
+		}
+		else if (intrinsic.name_equals("arrayLength")) {
+			const std::uint32_t array = expression_table[intrinsic.get_arguments()[0]];
+			assembler.LOCAL_GET(array);
+			assembler.I32_LOAD(0);
+			assembler.LOCAL_SET(result);
+		}
+		else if (intrinsic.name_equals("arraySplice") || intrinsic.name_equals("arraySpliceCopy")) {
+			const ::Type* type = intrinsic.get_type();
+			const ::Type* element_type = get_element_type(type);
+			const std::int32_t shift = get_element_shift(type);
+			const std::uint32_t array = expression_table[intrinsic.get_arguments()[0]];
+			const std::uint32_t index = expression_table[intrinsic.get_arguments()[1]];
+			const std::uint32_t remove = expression_table[intrinsic.get_arguments()[2]];
+			// arraySpliceCopy borrows its array and splices a copy in place
+			assembler.LOCAL_GET(array);
+			if (intrinsic.name_equals("arraySpliceCopy")) {
+				function_table.copy(assembler, type);
+			}
+			assembler.LOCAL_SET(result);
+			if (is_managed(element_type)) {
+				assembler.LOCAL_GET(result);
+				assembler.LOCAL_GET(index);
+				assembler.LOCAL_GET(remove);
+				assembler.CALL(function_table.look_up(TypeFunction::FREE_ELEMENTS, type));
+			}
+			assembler.LOCAL_GET(result);
+			assembler.LOCAL_GET(index);
+			assembler.LOCAL_GET(remove);
+			if (intrinsic.get_arguments().size() == 4 && intrinsic.get_arguments()[3]->get_type() == type) {
+				// the elements move out of the inserted array
+				const std::uint32_t insert = expression_table[intrinsic.get_arguments()[3]];
+				assembler.LOCAL_GET(insert);
+				assembler.I32_LOAD(0);
+				assembler.I32_CONST(shift);
+				assembler.CALL(function_table.array_resize);
+				assembler.LOCAL_SET(result);
+				element_address(result, index, shift);
+				assembler.I32_CONST(ARRAY_HEADER);
+				assembler.I32_ADD();
+				assembler.LOCAL_GET(insert);
+				assembler.I32_CONST(ARRAY_HEADER);
+				assembler.I32_ADD();
+				assembler.LOCAL_GET(insert);
+				assembler.I32_LOAD(0);
+				assembler.I32_CONST(shift);
+				assembler.I32_SHL();
+				assembler.MEMORY_COPY();
+				assembler.LOCAL_GET(insert);
+				assembler.CALL(function_table.free);
+			}
+			else {
+				const std::size_t insert = intrinsic.get_arguments().size() - 3;
+				assembler.I32_CONST(insert);
+				assembler.I32_CONST(shift);
+				assembler.CALL(function_table.array_resize);
+				assembler.LOCAL_SET(result);
+				for (std::size_t i = 0; i < insert; ++i) {
+					const Expression* element = intrinsic.get_arguments()[i + 3];
+					element_address(result, index, shift);
+					if (element->get_type() != TypeInterner::get_void_type()) {
+						assembler.LOCAL_GET(expression_table[element]);
+					}
+					else {
+						assembler.I32_CONST(0);
+					}
+					if (shift == 0) {
+						assembler.I32_STORE8(ARRAY_HEADER + i);
+					}
+					else {
+						assembler.I32_STORE(ARRAY_HEADER + i * 4);
+					}
+				}
+			}
+		}
+		else if (intrinsic.name_equals("stringPush") || intrinsic.name_equals("stringPushCopy") || intrinsic.name_equals("stringBuilderPush")) {
+			const ::Type* type = intrinsic.get_type();
+			const std::uint32_t string = expression_table[intrinsic.get_arguments()[0]];
+			const std::uint32_t argument = expression_table[intrinsic.get_arguments()[1]];
+			// stringPushCopy borrows its string and pushes onto a copy
+			assembler.LOCAL_GET(string);
+			if (intrinsic.name_equals("stringPushCopy")) {
+				function_table.copy(assembler, type);
+			}
+			assembler.LOCAL_SET(result);
+			if (intrinsic.get_arguments()[1]->get_type_id() == TypeId::STRING) {
+				const std::uint32_t length = next_local();
+				assembler.LOCAL_GET(result);
+				assembler.I32_LOAD(0);
+				assembler.LOCAL_SET(length);
+				assembler.LOCAL_GET(result);
+				assembler.LOCAL_GET(length);
+				assembler.I32_CONST(0);
+				assembler.LOCAL_GET(argument);
+				assembler.I32_LOAD(0);
+				assembler.I32_CONST(0);
+				assembler.CALL(function_table.array_resize);
+				assembler.LOCAL_SET(result);
+				element_address(result, length, 0);
+				assembler.I32_CONST(ARRAY_HEADER);
+				assembler.I32_ADD();
+				assembler.LOCAL_GET(argument);
+				assembler.I32_CONST(ARRAY_HEADER);
+				assembler.I32_ADD();
+				assembler.LOCAL_GET(argument);
+				assembler.I32_LOAD(0);
+				assembler.MEMORY_COPY();
+				assembler.LOCAL_GET(argument);
+				assembler.CALL(function_table.free);
+			}
+			else {
+				assembler.LOCAL_GET(result);
+				assembler.LOCAL_GET(argument);
+				assembler.CALL(function_table.string_push_codepoint);
+				assembler.LOCAL_SET(result);
+			}
+		}
+		else if (intrinsic.name_equals("stringIterator")) {
+			const std::uint32_t string = expression_table[intrinsic.get_arguments()[0]];
+			assembler.I32_CONST(8);
+			assembler.CALL(function_table.malloc);
+			assembler.LOCAL_SET(result);
+			assembler.LOCAL_GET(result);
+			assembler.LOCAL_GET(string);
+			assembler.I32_STORE(0);
+			assembler.LOCAL_GET(result);
+			assembler.I32_CONST(0);
+			assembler.I32_STORE(4);
+		}
+		else if (intrinsic.name_equals("stringIteratorGetNext")) {
+			const std::uint32_t iterator = expression_table[intrinsic.get_arguments()[0]];
+			assembler.LOCAL_GET(iterator);
+			assembler.CALL(function_table.string_iterator_get_next);
+			assembler.LOCAL_SET(result);
+		}
+		else if (intrinsic.name_equals("stringBuilder")) {
+			assembler.I32_CONST(0);
+			assembler.I32_CONST(0);
+			assembler.CALL(function_table.array_new);
+			assembler.LOCAL_SET(result);
+		}
+		else if (intrinsic.name_equals("stringBuilderToString")) {
+			return expression_table[intrinsic.get_arguments()[0]];
+		}
+		else if (intrinsic.name_equals("slice") || intrinsic.name_equals("sliceCopy")) {
+			unsupported("slices");
+		}
+		else if (intrinsic.name_equals("parallelMap") || intrinsic.name_equals("parallelReduce")) {
+			unsupported("parallel intrinsics");
+		}
+		else if (intrinsic.name_equals("reference")) {
+			return expression_table[intrinsic.get_arguments()[0]];
+		}
+		else if (intrinsic.name_equals("copy")) {
+			const std::uint32_t value = expression_table[intrinsic.get_arguments()[0]];
+			assembler.LOCAL_GET(value);
+			function_table.copy(assembler, intrinsic.get_type());
+			assembler.LOCAL_SET(result);
+		}
+		else if (intrinsic.name_equals("free")) {
+			const Expression* argument = intrinsic.get_arguments()[0];
+			assembler.LOCAL_GET(expression_table[argument]);
+			function_table.free_value(assembler, argument->get_type());
+		}
+		return result;
+	}
+	std::uint32_t visit_bind(const Bind& bind) override {
+		return expression_table[bind.get_right()];
+	}
+	std::uint32_t visit_return(const Return& return_) override {
+		const Expression* expression = return_.get_expression();
+		if (expression->get_type() != TypeInterner::get_void_type() && !tail_call_data.is_tail_call(expression) && !tail_call_data.is_group_tail_call(expression)) {
+			assembler.LOCAL_GET(expression_table[expression]);
+			assembler.LOCAL_SET(result);
+		}
+		return next_local();
+	}
+	// a loop that switches between the bodies of the functions of the group
+	static void generate_group(WasmModule& module, FunctionTable& function_table, const TailCallData& tail_call_data, std::size_t group) {
+		const std::vector<const Function*>& functions = tail_call_data.groups[group];
+		std::uint32_t max_arguments = 0;
+		for (const Function* function: functions) {
+			max_arguments = std::max<std::uint32_t>(max_arguments, function->get_argument_types().size());
+		}
+		FunctionContext context(1 + max_arguments);
+		WasmAssembler& assembler = context.assembler;
+		context.arguments = 1;
+		assembler.LOOP();
+		context.loop = context.enter();
+		for (std::size_t i = 0; i < functions.size(); ++i) {
+			assembler.BLOCK();
+			context.enter();
+		}
+		std::vector<std::uint32_t> depths;
+		for (std::size_t i = 0; i < functions.size(); ++i) {
+			depths.push_back(i);
+		}
+		assembler.LOCAL_GET(context.state);
+		assembler.BR_TABLE(depths, functions.size() - 1);
+		for (const Function* function: functions) {
+			assembler.END();
+			context.leave();
+			const std::uint32_t result = context.next_local();
+			CodegenWasm::evaluate(function_table, context, result, tail_call_data, function->get_block());
+			assembler.LOCAL_GET(result);
+			assembler.RETURN();
+		}
+		assembler.END();
+		context.leave();
+		assembler.UNREACHABLE();
+		module.define_function(function_table.look_up_group(group), context.locals - (1 + max_arguments), assembler);
+	}
+	static void generate_function(WasmModule& module, FunctionTable& function_table, const TailCallData& tail_call_data, const Function* function) {
+		const std::uint32_t arguments = function->get_argument_types().size();
+		FunctionContext context(arguments);
+		WasmAssembler& assembler = context.assembler;
+		if (tail_call_data.has_group(function)) {
+			// enter the loop of the group
+			const std::size_t group = tail_call_data.get_group(function);
+			const std::vector<const Function*>& functions = tail_call_data.groups[group];
+			std::uint32_t max_arguments = 0;
+			for (const Function* member: functions) {
+				max_arguments = std::max<std::uint32_t>(max_arguments, member->get_argument_types().size());
+			}
+			assembler.I32_CONST(std::find(functions.begin(), functions.end(), function) - functions.begin());
+			for (std::uint32_t i = 0; i < max_arguments; ++i) {
+				if (i < arguments) {
+					assembler.LOCAL_GET(i);
+				}
+				else {
+					assembler.I32_CONST(0);
+				}
+			}
+			assembler.CALL(function_table.look_up_group(group));
+			module.define_function(function_table.look_up(function), 0, assembler);
+			return;
+		}
+		const std::uint32_t result = context.next_local();
+		if (tail_call_data.has_tail_call(function)) {
+			assembler.LOOP();
+			context.loop = context.enter();
+		}
+		CodegenWasm::evaluate(function_table, context, result, tail_call_data, function->get_block());
+		if (tail_call_data.has_tail_call(function)) {
+			assembler.END();
+			context.leave();
+		}
+		assembler.LOCAL_GET(result);
+		module.define_function(function_table.look_up(function), context.locals - arguments, assembler);
+	}
+	// loops over the indices in [begin, end) of the local index, the body is only entered while begin < end
+	template <class F> static void generate_loop(WasmAssembler& assembler, std::uint32_t index, std::uint32_t end, F&& body) {
+		assembler.BLOCK();
+		assembler.LOOP();
+		assembler.LOCAL_GET(index);
+		assembler.LOCAL_GET(end);
+		assembler.I32_GE_U();
+		assembler.BR_IF(1);
+		body();
+		assembler.LOCAL_GET(index);
+		assembler.I32_CONST(1);
+		assembler.I32_ADD();
+		assembler.LOCAL_SET(index);
+		assembler.BR(0);
+		assembler.END();
+		assembler.END();
+	}
+	static void generate_copy_function(WasmModule& module, FunctionTable& function_table, const ::Type* type, std::uint32_t index) {
+		WasmAssembler assembler;
+		// value, length or tag, copy, index
+		const std::uint32_t value = 0, length = 1, copy = 2, i = 3;
+		switch (type->get_id()) {
+		case TypeId::ARRAY:
+		case TypeId::STRING:
+		{
+			const ::Type* element_type = get_element_type(type);
+			const std::int32_t shift = get_element_shift(type);
+			assembler.LOCAL_GET(value);
+			assembler.I32_LOAD(0);
+			assembler.LOCAL_SET(length);
+			assembler.LOCAL_GET(length);
+			assembler.I32_CONST(shift);
+			assembler.CALL(function_table.array_new);
+			assembler.LOCAL_SET(copy);
+			if (is_managed(element_type)) {
+				assembler.I32_CONST(0);
+				assembler.LOCAL_SET(i);
+				generate_loop(assembler, i, length, [&]() {
+					assembler.LOCAL_GET(copy);
+					assembler.LOCAL_GET(i);
+					assembler.I32_CONST(2);
+					assembler.I32_SHL();
+					assembler.I32_ADD();
+					assembler.LOCAL_GET(value);
+					assembler.LOCAL_GET(i);
+					assembler.I32_CONST(2);
+					assembler.I32_SHL();
+					assembler.I32_ADD();
+					assembler.I32_LOAD(ARRAY_HEADER);
+					function_table.copy(assembler, element_type);
+					assembler.I32_STORE(ARRAY_HEADER);
+				});
+			}
+			else {
+				assembler.LOCAL_GET(copy);
+				assembler.I32_CONST(ARRAY_HEADER);
+				assembler.I32_ADD();
+				assembler.LOCAL_GET(value);
+				assembler.I32_CONST(ARRAY_HEADER);
+				assembler.I32_ADD();
+				assembler.LOCAL_GET(length);
+				assembler.I32_CONST(shift);
+				assembler.I32_SHL();
+				assembler.MEMORY_COPY();
+			}
+			break;
+		}
+		case TypeId::STRING_ITERATOR:
+			assembler.I32_CONST(8);
+			assembler.CALL(function_table.malloc);
+			assembler.LOCAL_SET(copy);
+			assembler.LOCAL_GET(copy);
+			assembler.LOCAL_GET(value);
+			assembler.I32_LOAD(0);
+			function_table.copy(assembler, TypeInterner::get_string_type());
+			assembler.I32_STORE(0);
+			assembler.LOCAL_GET(copy);
+			assembler.LOCAL_GET(value);
+			assembler.I32_LOAD(4);
+			assembler.I32_STORE(4);
+			break;
+		case TypeId::TUPLE:
+		case TypeId::STRUCT:
+		{
+			const std::vector<const ::Type*> field_types = get_field_types(type);
+			assembler.I32_CONST(field_types.size() * 4);
+			assembler.CALL(function_table.malloc);
+			assembler.LOCAL_SET(copy);
+			for (std::size_t field = 0; field < field_types.size(); ++field) {
+				if (field_types[field] != TypeInterner::get_void_type()) {
+					assembler.LOCAL_GET(copy);
+					assembler.LOCAL_GET(value);
+					assembler.I32_LOAD(field * 4);
+					function_table.copy(assembler, field_types[field]);
+					assembler.I32_STORE(field * 4);
+				}
+			}
+			break;
+		}
+		case TypeId::ENUM:
+		{
+			const auto& cases = static_cast<const EnumType*>(type)->get_cases();
+			assembler.I32_CONST(8);
+			assembler.CALL(function_table.malloc);
+			assembler.LOCAL_SET(copy);
+			assembler.LOCAL_GET(value);
+			assembler.I32_LOAD(0);
+			assembler.LOCAL_SET(length);
+			assembler.LOCAL_GET(copy);
+			assembler.LOCAL_GET(length);
+			assembler.I32_STORE(0);
+			assembler.LOCAL_GET(copy);
+			assembler.LOCAL_GET(value);
+			assembler.I32_LOAD(4);
+			assembler.I32_STORE(4);
+			for (std::size_t case_ = 0; case_ < cases.size(); ++case_) {
+				if (is_managed(cases[case_].second)) {
+					assembler.LOCAL_GET(length);
+					assembler.I32_CONST(case_);
+					assembler.I32_EQ();
+					assembler.IF();
+					assembler.LOCAL_GET(copy);
+					assembler.LOCAL_GET(value);
+					assembler.I32_LOAD(4);
+					function_table.copy(assembler, cases[case_].second);
+					assembler.I32_STORE(4);
+					assembler.END();
+				}
+			}
+			break;
+		}
+		default:
+			assembler.LOCAL_GET(value);
+			assembler.LOCAL_SET(copy);
+			break;
+		}
+		assembler.LOCAL_GET(copy);
+		module.define_function(index, 3, assembler);
+	}
+	static void generate_free_function(WasmModule& module, FunctionTable& function_table, const ::Type* type, std::uint32_t index) {
+		WasmAssembler assembler;
+		const std::uint32_t value = 0;
+		switch (type->get_id()) {
+		case TypeId::ARRAY:
+			if (is_managed(get_element_type(type))) {
+				assembler.LOCAL_GET(value);
+				assembler.I32_CONST(0);
+				assembler.LOCAL_GET(value);
+				assembler.I32_LOAD(0);
+				assembler.CALL(function_table.look_up(TypeFunction::FREE_ELEMENTS, type));
+			}
+			break;
+		case TypeId::STRING_ITERATOR:
+			assembler.LOCAL_GET(value);
+			assembler.I32_LOAD(0);
+			function_table.free_value(assembler, TypeInterner::get_string_type());
+			break;
+		case TypeId::TUPLE:
+		case TypeId::STRUCT:
+		{
+			const std::vector<const ::Type*> field_types = get_field_types(type);
+			for (std::size_t field = 0; field < field_types.size(); ++field) {
+				if (is_managed(field_types[field])) {
+					assembler.LOCAL_GET(value);
+					assembler.I32_LOAD(field * 4);
+					function_table.free_value(assembler, field_types[field]);
+				}
+			}
+			break;
+		}
+		case TypeId::ENUM:
+		{
+			const auto& cases = static_cast<const EnumType*>(type)->get_cases();
+			for (std::size_t case_ = 0; case_ < cases.size(); ++case_) {
+				if (is_managed(cases[case_].second)) {
+					assembler.LOCAL_GET(value);
+					assembler.I32_LOAD(0);
+					assembler.I32_CONST(case_);
+					assembler.I32_EQ();
+					assembler.IF();
+					assembler.LOCAL_GET(value);
+					assembler.I32_LOAD(4);
+					function_table.free_value(assembler, cases[case_].second);
+					assembler.END();
+				}
+			}
+			break;
+		}
+		default:
+			break;
+		}
+		assembler.LOCAL_GET(value);
+		assembler.CALL(function_table.free);
+		module.define_function(index, 0, assembler);
+	}
+	static void generate_free_elements_function(WasmModule& module, FunctionTable& function_table, const ::Type* type, std::uint32_t index) {
+		WasmAssembler assembler;
+		const ::Type* element_type = get_element_type(type);
+		const std::uint32_t array = 0, i = 1, count = 2, end = 3;
+		assembler.LOCAL_GET(i);
+		assembler.LOCAL_GET(count);
+		assembler.I32_ADD();
+		assembler.LOCAL_SET(end);
+		generate_loop(assembler, i, end, [&]() {
+			assembler.LOCAL_GET(array);
+			assembler.LOCAL_GET(i);
+			assembler.I32_CONST(2);
+			assembler.I32_SHL();
+			assembler.I32_ADD();
+			assembler.I32_LOAD(ARRAY_HEADER);
+			function_table.free_value(assembler, element_type);
+		});
+		module.define_function(index, 1, assembler);
+	}
+	// a block of size bytes from the free list of its power of two, the size class is stored in the word before the block
+	static void generate_malloc(WasmModule& module, FunctionTable& function_table) {
+		WasmAssembler assembler;
+		const std::uint32_t size = 0, size_class = 1, block = 2;
+		assembler.I32_CONST(3);
+		assembler.LOCAL_SET(size_class);
+		assembler.BLOCK();
+		assembler.LOOP();
+		assembler.I32_CONST(1);
+		assembler.LOCAL_GET(size_class);
+		assembler.I32_SHL();
+		assembler.LOCAL_GET(size);
+		assembler.I32_CONST(4);
+		assembler.I32_ADD();
+		assembler.I32_GE_U();
+		assembler.BR_IF(1);
+		assembler.LOCAL_GET(size_class);
+		assembler.I32_CONST(1);
+		assembler.I32_ADD();
+		assembler.LOCAL_SET(size_class);
+		assembler.BR(0);
+		assembler.END();
+		assembler.END();
+		assembler.LOCAL_GET(size_class);
+		assembler.I32_CONST(2);
+		assembler.I32_SHL();
+		assembler.I32_LOAD(FREE_LISTS);
+		assembler.LOCAL_TEE(block);
+		assembler.IF();
+		{
+			// pop the free list
+			assembler.LOCAL_GET(size_class);
+			assembler.I32_CONST(2);
+			assembler.I32_SHL();
+			assembler.LOCAL_GET(block);
+			assembler.I32_LOAD(0);
+			assembler.I32_STORE(FREE_LISTS);
+		}
+		assembler.ELSE();
+		{
+			// bump the top of the heap and grow the memory if necessary
+			assembler.GLOBAL_GET(HEAP_TOP);
+			assembler.LOCAL_SET(block);
+			assembler.GLOBAL_GET(HEAP_TOP);
+			assembler.I32_CONST(1);
+			assembler.LOCAL_GET(size_class);
+			assembler.I32_SHL();
+			assembler.I32_ADD();
+			assembler.GLOBAL_SET(HEAP_TOP);
+			assembler.GLOBAL_GET(HEAP_TOP);
+			assembler.MEMORY_SIZE();
+			assembler.I32_CONST(16);
+			assembler.I32_SHL();
+			assembler.I32_GT_U();
+			assembler.IF();
+			assembler.GLOBAL_GET(HEAP_TOP);
+			assembler.I32_CONST(WasmModule::PAGE_SIZE - 1);
+			assembler.I32_ADD();
+			assembler.I32_CONST(16);
+			assembler.I32_SHR_U();
+			assembler.MEMORY_SIZE();
+			assembler.I32_SUB();
+			assembler.MEMORY_GROW();
+			assembler.I32_CONST(-1);
+			assembler.I32_EQ();
+			assembler.IF();
+			assembler.UNREACHABLE();
+			assembler.END();
+			assembler.END();
+		}
+		assembler.END();
+		assembler.LOCAL_GET(block);
+		assembler.LOCAL_GET(size_class);
+		assembler.I32_STORE(0);
+		assembler.LOCAL_GET(block);
+		assembler.I32_CONST(4);
+		assembler.I32_ADD();
+		module.define_function(function_table.malloc, 2, assembler);
+	}
+	static void generate_free(WasmModule& module, FunctionTable& function_table) {
+		WasmAssembler assembler;
+		const std::uint32_t pointer = 0, block = 1, head = 2;
+		assembler.LOCAL_GET(pointer);
+		assembler.I32_CONST(4);
+		assembler.I32_SUB();
+		assembler.LOCAL_TEE(block);
+		assembler.I32_LOAD(0);
+		assembler.I32_CONST(2);
+		assembler.I32_SHL();
+		assembler.LOCAL_SET(head);
+		assembler.LOCAL_GET(block);
+		assembler.LOCAL_GET(head);
+		assembler.I32_LOAD(FREE_LISTS);
+		assembler.I32_STORE(0);
+		assembler.LOCAL_GET(head);
+		assembler.LOCAL_GET(block);
+		assembler.I32_STORE(FREE_LISTS);
+		module.define_function(function_table.free, 2, assembler);
+	}
+	static void generate_array_new(WasmModule& module, FunctionTable& function_table) {
+		WasmAssembler assembler;
+		const std::uint32_t length = 0, shift = 1, array = 2;
+		assembler.LOCAL_GET(length);
+		assembler.LOCAL_GET(shift);
+		assembler.I32_SHL();
+		assembler.I32_CONST(ARRAY_HEADER);
+		assembler.I32_ADD();
+		assembler.CALL(function_table.malloc);
+		assembler.LOCAL_TEE(array);
+		assembler.LOCAL_GET(length);
+		assembler.I32_STORE(0);
+		assembler.LOCAL_GET(array);
+		assembler.LOCAL_GET(length);
+		assembler.I32_STORE(4);
+		assembler.LOCAL_GET(array);
+		module.define_function(function_table.array_new, 1, assembler);
+	}
+	// replaces remove elements at index with room for insert elements and grows the capacity geometrically
+	static void generate_array_resize(WasmModule& module, FunctionTable& function_table) {
+		WasmAssembler assembler;
+		const std::uint32_t array = 0, index = 1, remove = 2, insert = 3, shift = 4, length = 5, new_length = 6, new_array = 7, capacity = 8;
+		assembler.LOCAL_GET(array);
+		assembler.I32_LOAD(0);
+		assembler.LOCAL_TEE(length);
+		assembler.LOCAL_GET(remove);
+		assembler.I32_SUB();
+		assembler.LOCAL_GET(insert);
+		assembler.I32_ADD();
+		assembler.LOCAL_SET(new_length);
+		auto address = [&](std::uint32_t array, std::uint32_t index) {
+			assembler.LOCAL_GET(array);
+			assembler.I32_CONST(ARRAY_HEADER);
+			assembler.I32_ADD();
+			assembler.LOCAL_GET(index);
+			assembler.LOCAL_GET(shift);
+			assembler.I32_SHL();
+			assembler.I32_ADD();
+		};
+		auto copy_tail = [&](std::uint32_t destination) {
+			// the elements after the removed ones
+			assembler.LOCAL_GET(index);
+			assembler.LOCAL_GET(insert);
+			assembler.I32_ADD();
+			assembler.LOCAL_SET(capacity);
+			address(destination, capacity);
+			assembler.LOCAL_GET(index);
+			assembler.LOCAL_GET(remove);
+			assembler.I32_ADD();
+			assembler.LOCAL_SET(capacity);
+			address(array, capacity);
+			assembler.LOCAL_GET(length);
+			assembler.LOCAL_GET(capacity);
+			assembler.I32_SUB();
+			assembler.LOCAL_GET(shift);
+			assembler.I32_SHL();
+			assembler.MEMORY_COPY();
+		};
+		assembler.LOCAL_GET(new_length);
+		assembler.LOCAL_GET(array);
+		assembler.I32_LOAD(4);
+		assembler.I32_GT_U();
+		assembler.IF();
+		{
+			assembler.LOCAL_GET(new_length);
+			assembler.LOCAL_GET(array);
+			assembler.I32_LOAD(4);
+			assembler.I32_CONST(1);
+			assembler.I32_SHL();
+			assembler.LOCAL_TEE(capacity);
+			assembler.LOCAL_GET(new_length);
+			assembler.LOCAL_GET(capacity);
+			assembler.I32_GT_U();
+			assembler.SELECT();
+			assembler.LOCAL_TEE(capacity);
+			assembler.LOCAL_GET(shift);
+			assembler.I32_SHL();
+			assembler.I32_CONST(ARRAY_HEADER);
+			assembler.I32_ADD();
+			assembler.CALL(function_table.malloc);
+			assembler.LOCAL_TEE(new_array);
+			assembler.LOCAL_GET(capacity);
+			assembler.I32_STORE(4);
+			assembler.LOCAL_GET(new_array);
+			assembler.I32_CONST(ARRAY_HEADER);
+			assembler.I32_ADD();
+			assembler.LOCAL_GET(array);
+			assembler.I32_CONST(ARRAY_HEADER);
+			assembler.I32_ADD();
+			assembler.LOCAL_GET(index);
+			assembler.LOCAL_GET(shift);
+			assembler.I32_SHL();
+			assembler.MEMORY_COPY();
+			copy_tail(new_array);
+			assembler.LOCAL_GET(array);
+			assembler.CALL(function_table.free);
+			assembler.LOCAL_GET(new_array);
+			assembler.LOCAL_SET(array);
+		}
+		assembler.ELSE();
+		{
+			copy_tail(array);
+		}
+		assembler.END();
+		assembler.LOCAL_GET(array);
+		assembler.LOCAL_GET(new_length);
+		assembler.I32_STORE(0);
+		assembler.LOCAL_GET(array);
+		module.define_function(function_table.array_resize, 4, assembler);
+	}
+	// appends the UTF-8 encoding of a code point
+	static void generate_string_push_codepoint(WasmModule& module, FunctionTable& function_table) {
+		WasmAssembler assembler;
+		const std::uint32_t string = 0, codepoint = 1, length = 2, bytes = 3, address = 4;
+		assembler.I32_CONST(3);
+		assembler.I32_CONST(4);
+		assembler.LOCAL_GET(codepoint);
+		assembler.I32_CONST(0x10000);
+		assembler.I32_LT_U();
+		assembler.SELECT();
+		assembler.LOCAL_SET(bytes);
+		assembler.I32_CONST(2);
+		assembler.LOCAL_GET(bytes);
+		assembler.LOCAL_GET(codepoint);
+		assembler.I32_CONST(0x800);
+		assembler.I32_LT_U();
+		assembler.SELECT();
+		assembler.LOCAL_SET(bytes);
+		assembler.I32_CONST(1);
+		assembler.LOCAL_GET(bytes);
+		assembler.LOCAL_GET(codepoint);
+		assembler.I32_CONST(0x80);
+		assembler.I32_LT_U();
+		assembler.SELECT();
+		assembler.LOCAL_SET(bytes);
+		assembler.LOCAL_GET(string);
+		assembler.I32_LOAD(0);
+		assembler.LOCAL_SET(length);
+		assembler.LOCAL_GET(string);
+		assembler.LOCAL_GET(length);
+		assembler.I32_CONST(0);
+		assembler.LOCAL_GET(bytes);
+		assembler.I32_CONST(0);
+		assembler.CALL(function_table.array_resize);
+		assembler.LOCAL_TEE(string);
+		assembler.LOCAL_GET(length);
+		assembler.I32_ADD();
+		assembler.LOCAL_SET(address);
+		// the lead byte followed by the continuation bytes from the last to the first
+		auto store_continuation = [&](std::uint32_t position, std::int32_t shift) {
+			assembler.LOCAL_GET(address);
+			assembler.LOCAL_GET(codepoint);
+			if (shift > 0) {
+				assembler.I32_CONST(shift);
+				assembler.I32_SHR_U();
+			}
+			assembler.I32_CONST(0x3F);
+			assembler.I32_AND();
+			assembler.I32_CONST(0x80);
+			assembler.I32_OR();
+			assembler.I32_STORE8(ARRAY_HEADER + position);
+		};
+		auto store_lead = [&](std::int32_t shift, std::int32_t prefix) {
+			assembler.LOCAL_GET(address);
+			assembler.LOCAL_GET(codepoint);
+			if (shift > 0) {
+				assembler.I32_CONST(shift);
+				assembler.I32_SHR_U();
+			}
+			assembler.I32_CONST(prefix);
+			assembler.I32_OR();
+			assembler.I32_STORE8(ARRAY_HEADER);
+		};
+		for (std::int32_t length = 1; length <= 4; ++length) {
+			assembler.LOCAL_GET(bytes);
+			assembler.I32_CONST(length);
+			assembler.I32_EQ();
+			assembler.IF();
+			if (length == 1) {
+				store_lead(0, 0x00);
+			}
+			else {
+				store_lead(6 * (length - 1), length == 2 ? 0xC0 : length == 3 ? 0xE0 : 0xF0);
+				for (std::int32_t position = 1; position < length; ++position) {
+					store_continuation(position, 6 * (length - 1 - position));
+				}
+			}
+			assembler.END();
+		}
+		assembler.LOCAL_GET(string);
+		module.define_function(function_table.string_push_codepoint, 3, assembler);
+	}
+	// decodes the next code point and advances the iterator, the iterator becomes the first element of the result
+	static void generate_string_iterator_get_next(WasmModule& module, FunctionTable& function_table) {
+		WasmAssembler assembler;
+		const std::uint32_t iterator = 0, address = 1, size = 2, first = 3, bytes = 4, codepoint = 5, result = 6;
+		assembler.LOCAL_GET(iterator);
+		assembler.I32_LOAD(0);
+		assembler.LOCAL_GET(iterator);
+		assembler.I32_LOAD(4);
+		assembler.I32_ADD();
+		assembler.LOCAL_SET(address);
+		assembler.LOCAL_GET(iterator);
+		assembler.I32_LOAD(0);
+		assembler.I32_LOAD(0);
+		assembler.LOCAL_GET(iterator);
+		assembler.I32_LOAD(4);
+		assembler.I32_SUB();
+		assembler.LOCAL_TEE(size);
+		assembler.IF();
+		assembler.LOCAL_GET(address);
+		assembler.I32_LOAD8_U(ARRAY_HEADER);
+		assembler.LOCAL_SET(first);
+		assembler.END();
+		struct Encoding {
+			std::int32_t bytes;
+			std::int32_t mask;
+			std::int32_t prefix;
+		};
+		static constexpr Encoding encodings[] = {
+			{1, 0x80, 0x00},
+			{2, 0xE0, 0xC0},
+			{3, 0xF0, 0xE0},
+			{4, 0xF8, 0xF0}
+		};
+		for (const Encoding& encoding: encodings) {
+			if (encoding.bytes > 1) {
+				assembler.ELSE();
+			}
+			assembler.LOCAL_GET(size);
+			assembler.I32_CONST(encoding.bytes);
+			assembler.I32_GE_S();
+			assembler.LOCAL_GET(first);
+			assembler.I32_CONST(encoding.mask);
+			assembler.I32_AND();
+			assembler.I32_CONST(encoding.prefix);
+			assembler.I32_EQ();
+			assembler.I32_AND();
+			assembler.IF();
+			assembler.I32_CONST(encoding.bytes);
+			assembler.LOCAL_SET(bytes);
+			assembler.LOCAL_GET(first);
+			assembler.I32_CONST(~encoding.mask & 0xFF);
+			assembler.I32_AND();
+			assembler.LOCAL_SET(codepoint);
+			for (std::int32_t position = 1; position < encoding.bytes; ++position) {
+				assembler.LOCAL_GET(codepoint);
+				assembler.I32_CONST(6);
+				assembler.I32_SHL();
+				assembler.LOCAL_GET(address);
+				assembler.I32_LOAD8_U(ARRAY_HEADER + position);
+				assembler.I32_CONST(0x3F);
+				assembler.I32_AND();
+				assembler.I32_OR();
+				assembler.LOCAL_SET(codepoint);
+			}
+		}
+		for (std::size_t i = 0; i < sizeof(encodings) / sizeof(Encoding); ++i) {
+			assembler.END();
+		}
+		assembler.LOCAL_GET(iterator);
+		assembler.LOCAL_GET(iterator);
+		assembler.I32_LOAD(4);
+		assembler.LOCAL_GET(bytes);
+		assembler.I32_ADD();
+		assembler.I32_STORE(4);
+		assembler.I32_CONST(12);
+		assembler.CALL(function_table.malloc);
+		assembler.LOCAL_TEE(result);
+		assembler.LOCAL_GET(iterator);
+		assembler.I32_STORE(0);
+		assembler.LOCAL_GET(result);
+		assembler.LOCAL_GET(bytes);
+		assembler.I32_CONST(0);
+		assembler.I32_NE();
+		assembler.I32_STORE(4);
+		assembler.LOCAL_GET(result);
+		assembler.LOCAL_GET(codepoint);
+		assembler.I32_STORE(8);
+		assembler.LOCAL_GET(result);
+		module.define_function(function_table.string_iterator_get_next, 6, assembler);
+	}
+	static void generate_read_all(WasmModule& module, FunctionTable& function_table) {
+		WasmAssembler assembler;
+		const std::uint32_t string = 0, c = 1, length = 2;
+		assembler.I32_CONST(0);
+		assembler.I32_CONST(0);
+		assembler.CALL(function_table.array_new);
+		assembler.LOCAL_SET(string);
+		assembler.BLOCK();
+		assembler.LOOP();
+		assembler.CALL(function_table.get_char);
+		assembler.LOCAL_TEE(c);
+		assembler.I32_CONST(0);
+		assembler.I32_LT_S();
+		assembler.BR_IF(1);
+		assembler.LOCAL_GET(string);
+		assembler.I32_LOAD(0);
+		assembler.LOCAL_SET(length);
+		assembler.LOCAL_GET(string);
+		assembler.LOCAL_GET(length);
+		assembler.I32_CONST(0);
+		assembler.I32_CONST(1);
+		assembler.I32_CONST(0);
+		assembler.CALL(function_table.array_resize);
+		assembler.LOCAL_TEE(string);
+		assembler.LOCAL_GET(length);
+		assembler.I32_ADD();
+		assembler.LOCAL_GET(c);
+		assembler.I32_STORE8(ARRAY_HEADER);
+		assembler.BR(0);
+		assembler.END();
+		assembler.END();
+		assembler.LOCAL_GET(string);
+		module.define_function(function_table.read_all, 3, assembler);
+	}
+	// the module imports write(bytes, length) and getChar() from "env" and exports its memory and main
+	static void codegen(const Program& program, const char* source_path, const TailCallData& tail_call_data, const CodegenOptions& options) {
+		WasmModule module;
+		FunctionTable function_table(module);
+		for (const Function* function: program) {
+			function_table.declare(function);
+		}
+		for (const std::vector<const Function*>& functions: tail_call_data.groups) {
+			std::uint32_t max_arguments = 0;
+			for (const Function* function: functions) {
+				max_arguments = std::max<std::uint32_t>(max_arguments, function->get_argument_types().size());
+			}
+			function_table.declare_group(max_arguments);
+		}
+		generate_malloc(module, function_table);
+		generate_free(module, function_table);
+		generate_array_new(module, function_table);
+		generate_array_resize(module, function_table);
+		generate_string_push_codepoint(module, function_table);
+		generate_string_iterator_get_next(module, function_table);
+		generate_read_all(module, function_table);
+		for (const Function* function: program) {
+			generate_function(module, function_table, tail_call_data, function);
+		}
+		for (std::size_t group = 0; group < tail_call_data.groups.size(); ++group) {
+			generate_group(module, function_table, tail_call_data, group);
+		}
+		std::pair<TypeFunction, const ::Type*> type_function;
+		while (function_table.get_next_type_function(type_function)) {
+			const std::uint32_t index = function_table.look_up(type_function.first, type_function.second);
+			switch (type_function.first) {
+			case TypeFunction::COPY:
+				generate_copy_function(module, function_table, type_function.second, index);
+				break;
+			case TypeFunction::FREE:
+				generate_free_function(module, function_table, type_function.second, index);
+				break;
+			case TypeFunction::FREE_ELEMENTS:
+				generate_free_elements_function(module, function_table, type_function.second, index);
+				break;
+			}
+		}
+		const std::string& data = function_table.get_data();
+		if (!data.empty()) {
+			module.add_data(DATA, data);
+		}
+		// the heap starts at the first aligned address after the string literals
+		const std::int32_t heap_start = (DATA + data.size() + 7) / 8 * 8 + 4;
+		module.add_global(heap_start);
+		module.set_memory_size(heap_start);
+		module.add_export("memory", WasmModule::EXPORT_MEMORY, 0);
+		module.add_export("main", WasmModule::EXPORT_FUNCTION, function_table.look_up(program.get_main_function()));
+		std::string path = std::string(source_path) + ".wasm";
+		module.write_file(path.c_str());
+		Printer status_printer(std::cerr);
+		status_printer.print(bold(path));
+		status_printer.print(bold(green(" successfully generated")));
+		status_printer.print('\n');
+	}
+};
@@ -2,14 +2,260 @@
 
 #include "ast.hpp"
 #include "assembler.hpp"
+#include "options.hpp"
+#include <map>
 
-class CodegenX86: public Visitor<std::uint32_t> {
+// tuples, structs, and enums are stored by value, enums hold a tag followed by the value of their case
+// arrays and strings point to a block on the heap that holds their length and capacity followed by words or bytes
+// references point to a block on the heap that holds their value, string builders are strings
+// string iterators hold a string and a position, slices an array, a start, and an end
+
+// a value is either held in a register or stored in the stack frame relative to EBP
+class Location {
+	Register r;
+	std::uint32_t offset;
+public:
+	constexpr Location(std::uint32_t offset = 0): r(EBP), offset(offset) {}
+	constexpr Location(Register r): r(r), offset(0) {}
+	constexpr bool is_register() const {
+		return r != EBP;
+	}
+	constexpr Register get_register() const {
+		return r;
+	}
+	constexpr std::uint32_t get_offset() const {
+		return offset;
+	}
+	constexpr Ptr get_ptr() const {
+		return PTR(EBP, offset);
+	}
+	constexpr Location operator +(std::uint32_t offset) const {
+		return Location(this->offset + offset);
+	}
+	constexpr bool operator ==(const Location& rhs) const {
+		return r == rhs.r && offset == rhs.offset;
+	}
+};
+
+// linear scan register allocation over the linearized blocks of a function
+// only Int and Char values that are computed by an expression are kept in registers
+class RegisterAllocation: public Visitor<void> {
+public:
+	// the allocatable registers are all callee-saved, EAX, ECX and EDX are scratch registers
+	static constexpr Register registers[] = {EBX, ESI, EDI};
+	// EAX means the expression is not held in a register
+	using RegisterTable = IndexTable<Expression, Register>;
+private:
+	struct Interval {
+		const Expression* expression;
+		std::size_t start;
+		Interval(const Expression* expression, std::size_t start): expression(expression), start(start) {}
+	};
+	std::vector<Interval> intervals;
+	IndexTable<Expression, std::size_t> ends;
+	// expressions that evaluate to the location of another expression
+	IndexTable<Expression, const Expression*> aliases;
+	std::size_t position = 0;
+	// whether the last visited expression computes a new value
+	bool computed;
+	const Expression* get_root(const Expression* expression) const {
+		while (const Expression* alias = aliases.get(expression)) {
+			expression = alias;
+		}
+		return expression;
+	}
+	void use(const Expression* expression) {
+		ends[get_root(expression)] = position;
+	}
+	void alias(const Expression* expression, const Expression* target) {
+		aliases[expression] = target;
+		use(target);
+	}
+	static bool is_scalar(const Expression* expression) {
+		return expression->get_type_id() == TypeId::INT || expression->get_type_id() == TypeId::CHAR;
+	}
+	void evaluate(const Block& block) {
+		for (const Expression* expression: block) {
+			++position;
+			ends[expression] = position;
+			const std::size_t start = position;
+			computed = false;
+			visit(*this, expression);
+			if (computed && is_scalar(expression)) {
+				intervals.emplace_back(expression, start);
+			}
+		}
+	}
+	// the result of an if or switch is written inside its blocks
+	void evaluate_nested(const Expression* expression, const Block& block) {
+		evaluate(block);
+		ends[expression] = std::max(ends[expression], position);
+	}
+public:
+	void visit_int_literal(const IntLiteral& int_literal) override {
+		computed = true;
+	}
+	void visit_binary_expression(const BinaryExpression& binary_expression) override {
+		computed = true;
+		use(binary_expression.get_left());
+		use(binary_expression.get_right());
+	}
+	void visit_array_literal(const ArrayLiteral& array_literal) override {
+		for (const Expression* element: array_literal.get_elements()) {
+			use(element);
+		}
+	}
+	void visit_if(const If& if_) override {
+		use(if_.get_condition());
+		evaluate_nested(&if_, if_.get_then_block());
+		evaluate_nested(&if_, if_.get_else_block());
+		computed = true;
+	}
+	void visit_tuple_literal(const TupleLiteral& tuple_literal) override {
+		if (tuple_literal.get_elements().size() == 1) {
+			alias(&tuple_literal, tuple_literal.get_elements()[0]);
+		}
+		else for (const Expression* element: tuple_literal.get_elements()) {
+			use(element);
+		}
+	}
+	void visit_tuple_access(const TupleAccess& tuple_access) override {
+		alias(&tuple_access, tuple_access.get_tuple());
+	}
+	void visit_struct_literal(const StructLiteral& struct_literal) override {
+		for (const auto& field: struct_literal.get_fields()) {
+			use(field.second);
+		}
+	}
+	void visit_struct_access(const StructAccess& struct_access) override {
+		alias(&struct_access, struct_access.get_struct());
+	}
+	void visit_enum_literal(const EnumLiteral& enum_literal) override {
+		use(enum_literal.get_expression());
+	}
+	void visit_switch(const Switch& switch_) override {
+		use(switch_.get_enum());
+		for (const auto& case_: switch_.get_cases()) {
+			evaluate_nested(&switch_, case_.second);
+		}
+		computed = true;
+	}
+	void visit_function_call(const FunctionCall& call) override {
+		for (const Expression* argument: call.get_arguments()) {
+			use(argument);
+		}
+		computed = true;
+	}
+	void visit_intrinsic(const Intrinsic& intrinsic) override {
+		for (const Expression* argument: intrinsic.get_arguments()) {
+			use(argument);
+		}
+		computed = true;
+	}
+	void visit_bind(const Bind& bind) override {
+		use(bind.get_left());
+		alias(&bind, bind.get_right());
+	}
+	void visit_return(const Return& return_) override {
+		use(return_.get_expression());
+	}
+	static void run(const Function* function, const TailCallData& tail_call_data, RegisterTable& register_table, std::vector<Register>& used_registers) {
+		RegisterAllocation allocation;
+		allocation.evaluate(function->get_block());
+		// intervals are created in the order their expressions are evaluated, sort them by their start
+		std::vector<Interval>& intervals = allocation.intervals;
+		std::stable_sort(intervals.begin(), intervals.end(), [](const Interval& lhs, const Interval& rhs) {
+			return lhs.start < rhs.start;
+		});
+		std::vector<const Interval*> active;
+		std::vector<Register> free_registers(std::rbegin(registers), std::rend(registers));
+		for (const Interval& interval: intervals) {
+			const Expression* expression = interval.expression;
+			if (tail_call_data.is_tail_call(expression)) {
+				continue;
+			}
+			for (auto i = active.begin(); i != active.end();) {
+				if (allocation.ends[(*i)->expression] < interval.start) {
+					free_registers.push_back(register_table[(*i)->expression]);
+					i = active.erase(i);
+				}
+				else {
+					++i;
+				}
+			}
+			const std::size_t end = allocation.ends[expression];
+			if (!free_registers.empty()) {
+				register_table[expression] = free_registers.back();
+				free_registers.pop_back();
+				active.push_back(&interval);
+			}
+			else {
+				// spill the interval that ends last
+				auto spill = std::max_element(active.begin(), active.end(), [&](const Interval* lhs, const Interval* rhs) {
+					return allocation.ends[lhs->expression] < allocation.ends[rhs->expression];
+				});
+				if (allocation.ends[(*spill)->expression] > end) {
+					register_table[expression] = register_table[(*spill)->expression];
+					register_table[(*spill)->expression] = EAX;
+					*spill = &interval;
+				}
+			}
+			const Register r = register_table[expression];
+			if (r != EAX && std::find(used_registers.begin(), used_registers.end(), r) == used_registers.end()) {
+				used_registers.push_back(r);
+			}
+		}
+	}
+};
+
+class CodegenX86: public Visitor<Location> {
 	using A = Assembler;
 	using Jump = typename A::Jump;
+	using Address = typename A::Address;
+	// length and capacity
+	static constexpr std::uint32_t ARRAY_HEADER = 8;
+	// the heads of the free lists, one for every power of two
+	static constexpr std::uint32_t SIZE_CLASSES = 32;
+	// the members of string iterators and slices are laid out from the top like the elements of tuples
+	static constexpr std::uint32_t ITERATOR_STRING = 4;
+	static constexpr std::uint32_t ITERATOR_POSITION = 0;
+	static constexpr std::uint32_t SLICE_ARRAY = 8;
+	static constexpr std::uint32_t SLICE_START = 4;
+	static constexpr std::uint32_t SLICE_END = 0;
+	[[noreturn]] static void unsupported(const char* feature) {
+		print_error(Printer(std::cerr), format("the x86 codegen does not support %", feature));
+		std::exit(EXIT_FAILURE);
+	}
 	static std::uint32_t get_type_size(const Type* type) {
 		switch (type->get_id()) {
 		case TypeId::INT:
+		case TypeId::CHAR:
 			return 4;
+		case TypeId::CLOSURE:
+			{
+				std::uint32_t size = 0;
+				for (const Type* environment_type: static_cast<const ClosureType*>(type)->get_environment_types()) {
+					size += get_type_size(environment_type);
+				}
+				return size;
+			}
+		case TypeId::STRUCT:
+			{
+				std::uint32_t size = 0;
+				for (const auto& field: static_cast<const StructType*>(type)->get_fields()) {
+					size += get_type_size(field.second);
+				}
+				return size;
+			}
+		case TypeId::ENUM:
+			{
+				// the tag is followed by the largest case
+				std::uint32_t size = 0;
+				for (const auto& case_: static_cast<const EnumType*>(type)->get_cases()) {
+					size = std::max(size, get_type_size(case_.second));
+				}
+				return 4 + size;
+			}
 		case TypeId::TUPLE:
 			{
 				std::uint32_t size = 0;
@@ -18,10 +264,104 @@ class CodegenX86: public Visitor<std::uint32_t> {
 				}
 				return size;
 			}
+		case TypeId::ARRAY:
+		case TypeId::STRING:
+		case TypeId::STRING_BUILDER:
+		case TypeId::REFERENCE:
+			return 4;
+		case TypeId::STRING_ITERATOR:
+			return 8;
+		case TypeId::SLICE:
+			return 12;
 		default:
 			return 0;
 		}
 	}
+	// elements are laid out from the top of the value downwards
+	static std::uint32_t get_element_offset(const TupleType* type, std::size_t index) {
+		const std::vector<const Type*>& element_types = type->get_element_types();
+		std::uint32_t offset = get_type_size(type);
+		for (std::size_t i = 0; i <= index; ++i) {
+			offset -= get_type_size(element_types[i]);
+		}
+		return offset;
+	}
+	static std::uint32_t get_field_offset(const StructType* type, std::size_t index) {
+		const auto& fields = type->get_fields();
+		std::uint32_t offset = get_type_size(type);
+		for (std::size_t i = 0; i <= index; ++i) {
+			offset -= get_type_size(fields[i].second);
+		}
+		return offset;
+	}
+	// the elements of a tuple or the fields of a struct with their offsets
+	static std::vector<std::pair<const Type*, std::uint32_t>> get_members(const Type* type) {
+		std::vector<std::pair<const Type*, std::uint32_t>> members;
+		if (type->get_id() == TypeId::TUPLE) {
+			const TupleType* tuple_type = static_cast<const TupleType*>(type);
+			for (std::size_t i = 0; i < tuple_type->get_element_types().size(); ++i) {
+				members.emplace_back(tuple_type->get_element_types()[i], get_element_offset(tuple_type, i));
+			}
+		}
+		else if (type->get_id() == TypeId::STRUCT) {
+			const StructType* struct_type = static_cast<const StructType*>(type);
+			for (std::size_t i = 0; i < struct_type->get_fields().size(); ++i) {
+				members.emplace_back(struct_type->get_fields()[i].second, get_field_offset(struct_type, i));
+			}
+		}
+		return members;
+	}
+	// whether values of the type own memory on the heap, only those need copy and free functions
+	static bool has_heap(const Type* type) {
+		switch (type->get_id()) {
+		case TypeId::ARRAY:
+		case TypeId::STRING:
+		case TypeId::STRING_ITERATOR:
+		case TypeId::STRING_BUILDER:
+		case TypeId::SLICE:
+		case TypeId::REFERENCE:
+			return true;
+		case TypeId::TUPLE:
+		case TypeId::STRUCT:
+			for (const auto& member: get_members(type)) {
+				if (has_heap(member.first)) {
+					return true;
+				}
+			}
+			return false;
+		case TypeId::ENUM:
+			for (const auto& case_: static_cast<const EnumType*>(type)->get_cases()) {
+				if (has_heap(case_.second)) {
+					return true;
+				}
+			}
+			return false;
+		default:
+			return false;
+		}
+	}
+	// the array a slice refers to
+	static const Type* get_array_type(const Type* type) {
+		if (type->get_id() == TypeId::SLICE) {
+			return static_cast<const SliceType*>(type)->get_array_type();
+		}
+		return type;
+	}
+	static const Type* get_element_type(const Type* type) {
+		type = get_array_type(type);
+		if (type->get_id() == TypeId::STRING || type->get_id() == TypeId::STRING_BUILDER) {
+			return TypeInterner::get_char_type();
+		}
+		return static_cast<const ArrayType*>(type)->get_element_type();
+	}
+	// strings hold bytes
+	static std::uint32_t get_element_size(const Type* type) {
+		type = get_array_type(type);
+		if (type->get_id() == TypeId::STRING || type->get_id() == TypeId::STRING_BUILDER) {
+			return 1;
+		}
+		return get_type_size(static_cast<const ArrayType*>(type)->get_element_type());
+	}
 	static std::uint32_t get_input_size(const Function* function) {
 		std::uint32_t input_size = 0;
 		for (const Type* type: function->get_argument_types()) {
@@ -32,122 +372,452 @@ class CodegenX86: public Visitor<std::uint32_t> {
 	static std::uint32_t get_output_size(const Function* function) {
 		return get_type_size(function->get_return_type());
 	}
-	struct DeferredCall {
-		Jump jump;
+	enum class TypeFunction {
+		// copies the value the first argument points to to the second argument
+		COPY,
+		FREE,
+		// frees a range of the elements of an array
+		FREE_ELEMENTS
+	};
+	// the functions of the program, the runtime, and the type functions are routines that are called once their position is known
+	class FunctionTable {
+		std::vector<std::size_t> positions;
+		std::vector<std::pair<Jump, std::size_t>> calls;
+		IndexTable<Function, std::size_t> functions;
+		std::map<std::pair<TypeFunction, const Type*>, std::size_t> type_functions;
+		std::vector<std::pair<TypeFunction, const Type*>> type_function_queue;
+		std::map<std::string, std::size_t> strings;
+		std::string data;
+		std::vector<std::pair<Address, std::size_t>> addresses;
+		std::size_t declare_routine() {
+			positions.push_back(0);
+			return positions.size() - 1;
+		}
+	public:
+		// the runtime
+		const std::size_t malloc;
+		const std::size_t free;
+		const std::size_t memmove;
+		const std::size_t array_new;
+		const std::size_t array_resize;
+		const std::size_t string_push_codepoint;
+		const std::size_t utf8_decode;
+		const std::size_t write;
+		const std::size_t read_all;
+		// the state of the allocator in the writable segment
+		const std::uint32_t heap_top;
+		const std::uint32_t heap_end;
+		const std::uint32_t free_lists;
+		FunctionTable(A& assembler):
+			malloc(declare_routine()),
+			free(declare_routine()),
+			memmove(declare_routine()),
+			array_new(declare_routine()),
+			array_resize(declare_routine()),
+			string_push_codepoint(declare_routine()),
+			utf8_decode(declare_routine()),
+			write(declare_routine()),
+			read_all(declare_routine()),
+			heap_top(assembler.reserve(4)),
+			heap_end(assembler.reserve(4)),
+			free_lists(assembler.reserve(SIZE_CLASSES * 4))
+		{}
+		void declare(const Function* function) {
+			functions[function] = declare_routine();
+		}
+		std::size_t look_up(const Function* function) const {
+			return functions.get(function);
+		}
+		std::size_t look_up(TypeFunction type_function, const Type* type) {
+			if (type->get_id() == TypeId::STRING_BUILDER) {
+				type = TypeInterner::get_string_type();
+			}
+			const auto key = std::make_pair(type_function, type);
+			auto iterator = type_functions.find(key);
+			if (iterator == type_functions.end()) {
+				iterator = type_functions.emplace(key, declare_routine()).first;
+				type_function_queue.push_back(key);
+			}
+			return iterator->second;
+		}
+		bool get_next_type_function(std::pair<TypeFunction, const Type*>& type_function) {
+			if (type_function_queue.empty()) {
+				return false;
+			}
+			type_function = type_function_queue.back();
+			type_function_queue.pop_back();
+			return true;
+		}
+		// the routine starts at the current position
+		void define(A& assembler, std::size_t routine) {
+			positions[routine] = assembler.get_position();
+		}
+		void call(A& assembler, std::size_t routine) {
+			calls.emplace_back(assembler.CALL(), routine);
+		}
+		// dst = the address of a string literal
+		void load_string(A& assembler, Register dst, const std::string& string) {
+			auto iterator = strings.find(string);
+			if (iterator == strings.end()) {
+				iterator = strings.emplace(string, data.size()).first;
+				data.append(string);
+			}
+			addresses.emplace_back(assembler.MOV_ADDRESS(dst), iterator->second);
+		}
+		// resolves the calls and appends the string literals to the code
+		void write_data(A& assembler) {
+			for (const auto& call: calls) {
+				call.first.set_target(assembler, positions[call.second]);
+			}
+			const std::size_t position = assembler.get_position();
+			assembler.write_bytes(data);
+			for (const auto& address: addresses) {
+				address.first.set_target(assembler, position + address.second);
+			}
+		}
+	};
+	// routines take their arguments on the stack and return their result in EAX
+	// like the functions of the program they preserve EBX, ESI, and EDI, which may hold values
+	static constexpr Ptr get_routine_argument(std::uint32_t index) {
+		return PTR(EBP, 8 + 4 * index);
+	}
+	static void enter_routine(A& assembler) {
+		assembler.PUSH(EBP);
+		assembler.MOV(EBP, ESP);
+		assembler.PUSH(EBX);
+		assembler.PUSH(ESI);
+		assembler.PUSH(EDI);
+	}
+	static void leave_routine(A& assembler) {
+		assembler.LEA(ESP, PTR(EBP, 0 - 12));
+		assembler.POP(EDI);
+		assembler.POP(ESI);
+		assembler.POP(EBX);
+		assembler.POP(EBP);
+		assembler.RET();
+	}
+	// the arguments are pushed from the last to the first one before the call
+	static void call_routine(A& assembler, FunctionTable& function_table, std::size_t routine, std::uint32_t arguments) {
+		function_table.call(assembler, routine);
+		assembler.ADD(ESP, 4 * arguments);
+	}
+	// copies size bytes through EAX
+	static void copy_memory(A& assembler, Ptr destination, Ptr source, std::uint32_t size) {
+		for (std::uint32_t i = 0; i < size; i += 4) {
+			assembler.MOV(EAX, PTR(source.get_register(), source.get_offset() + i));
+			assembler.MOV(PTR(destination.get_register(), destination.get_offset() + i), EAX);
+		}
+	}
+	// runs body for the values of index up to end
+	template <class T, class F> static void generate_loop(A& assembler, Register index, T end, F&& body) {
+		const std::size_t loop = assembler.get_position();
+		assembler.CMP(index, end);
+		const Jump jump_end = assembler.JGE();
+		body();
+		assembler.ADD(index, 1);
+		assembler.JMP().set_target(assembler, loop);
+		jump_end.set_target(assembler, assembler.get_position());
+	}
+	using ExpressionTable = IndexTable<Expression, Location>;
+	using RegisterTable = RegisterAllocation::RegisterTable;
+	// the state shared by all blocks of a function
+	struct Context {
+		FunctionTable& function_table;
 		const Function* function;
-		DeferredCall(const Jump& jump, const Function* function): jump(jump), function(function) {}
+		A& assembler;
+		const TailCallData& tail_call_data;
+		RegisterTable register_table;
+		ExpressionTable expression_table;
+		std::uint32_t variable = 0;
+		std::size_t body_position = 0;
+		Context(FunctionTable& function_table, const Function* function, A& assembler, const TailCallData& tail_call_data): function_table(function_table), function(function), assembler(assembler), tail_call_data(tail_call_data) {}
 	};
-	std::vector<DeferredCall>& deferred_calls;
-	const Function* function;
+	Context& context;
+	FunctionTable& function_table;
 	A& assembler;
-	using ExpressionTable = std::map<const Expression*,std::uint32_t>;
 	ExpressionTable& expression_table;
-	std::uint32_t variable = 0;
-	std::uint32_t result;
-	CodegenX86(std::vector<DeferredCall>& deferred_calls, const Function* function, A& assembler, ExpressionTable& expression_table, std::uint32_t result): deferred_calls(deferred_calls), function(function), assembler(assembler), expression_table(expression_table), result(result) {}
-	static void evaluate(std::vector<DeferredCall>& deferred_calls, const Function* function, A& assembler, ExpressionTable& expression_table, std::uint32_t result, const Block& block) {
-		CodegenX86 codegen(deferred_calls, function, assembler, expression_table, result);
+	Location case_variable;
+	Location result;
+	CodegenX86(Context& context, Location case_variable, Location result): context(context), function_table(context.function_table), assembler(context.assembler), expression_table(context.expression_table), case_variable(case_variable), result(result) {}
+	static void evaluate(Context& context, Location case_variable, Location result, const Block& block) {
+		CodegenX86 codegen(context, case_variable, result);
 		for (const Expression* expression: block) {
-			expression_table[expression] = visit(codegen, expression);
+			context.expression_table[expression] = visit(codegen, expression);
 		}
 	}
-	static void evaluate(std::vector<DeferredCall>& deferred_calls, const Function* function, A& assembler, std::uint32_t result, const Block& block) {
-		ExpressionTable expression_table;
-		evaluate(deferred_calls, function, assembler, expression_table, result, block);
+	void evaluate(Location case_variable, Location result, const Block& block) {
+		evaluate(context, case_variable, result, block);
 	}
-	void evaluate(std::uint32_t result, const Block& block) {
-		evaluate(deferred_calls, function, assembler, expression_table, result, block);
+	void evaluate(Location result, const Block& block) {
+		evaluate(context, case_variable, result, block);
 	}
-	std::uint32_t allocate(std::uint32_t size) {
-		variable -= size;
-		return variable;
+	Location allocate(std::uint32_t size) {
+		context.variable -= size;
+		return Location(context.variable);
 	}
-	void memcopy(std::uint32_t destination, std::uint32_t source, std::uint32_t size) {
-		for (std::uint32_t i = 0; i < size; i += 4) {
-			assembler.MOV(EAX, PTR(EBP, source + i));
-			assembler.MOV(PTR(EBP, destination + i), EAX);
+	// the location of a value computed by the given expression
+	Location allocate_result(const Expression* expression) {
+		const Register r = context.register_table.get(expression);
+		if (r != EAX) {
+			return Location(r);
+		}
+		return allocate(get_type_size(expression->get_type()));
+	}
+	void load(Register dst, Location src) {
+		if (src.is_register()) {
+			if (src.get_register() != dst) {
+				assembler.MOV(dst, src.get_register());
+			}
+		}
+		else {
+			assembler.MOV(dst, src.get_ptr());
+		}
+	}
+	void store(Location dst, Register src) {
+		if (dst.is_register()) {
+			if (dst.get_register() != src) {
+				assembler.MOV(dst.get_register(), src);
+			}
+		}
+		else {
+			assembler.MOV(dst.get_ptr(), src);
 		}
 	}
+	void copy(Location destination, Location source, std::uint32_t size) {
+		if (size == 0 || destination == source) {
+			return;
+		}
+		if (destination.is_register()) {
+			load(destination.get_register(), source);
+		}
+		else if (source.is_register()) {
+			store(destination, source.get_register());
+		}
+		else {
+			copy_memory(assembler, destination.get_ptr(), source.get_ptr(), size);
+		}
+	}
+	// copies between a location and the heap through EAX
+	void load(Location destination, Ptr source, std::uint32_t size) {
+		if (destination.is_register()) {
+			assembler.MOV(destination.get_register(), source);
+		}
+		else {
+			copy_memory(assembler, destination.get_ptr(), source, size);
+		}
+	}
+	void store(Ptr destination, Location source, std::uint32_t size) {
+		if (source.is_register()) {
+			assembler.MOV(destination, source.get_register());
+		}
+		else {
+			copy_memory(assembler, destination, source.get_ptr(), size);
+		}
+	}
+	// the arguments of a routine are pushed from the last to the first one once ESP is below all variables
+	void start_call() {
+		assembler.LEA(ESP, PTR(EBP, context.variable));
+	}
+	void push(Location location) {
+		if (location.is_register()) {
+			assembler.PUSH(location.get_register());
+		}
+		else {
+			assembler.PUSH(location.get_ptr());
+		}
+	}
+	void push_address(Location location) {
+		assembler.LEA(EAX, location.get_ptr());
+		assembler.PUSH(EAX);
+	}
+	void call(std::size_t routine) {
+		function_table.call(assembler, routine);
+	}
+	// copies a value together with the memory it owns
+	void copy_value(const Type* type, Location destination, Location source) {
+		if (has_heap(type)) {
+			start_call();
+			push_address(destination);
+			push_address(source);
+			call(function_table.look_up(TypeFunction::COPY, type));
+		}
+		else {
+			copy(destination, source, get_type_size(type));
+		}
+	}
+	void free_value(const Type* type, Location value) {
+		if (has_heap(type)) {
+			start_call();
+			push_address(value);
+			call(function_table.look_up(TypeFunction::FREE, type));
+		}
+	}
+	// ECX = the address of the element with the index in EAX minus ARRAY_HEADER
+	void element_address(Location array, std::uint32_t element_size) {
+		if (element_size != 1) {
+			assembler.IMUL(EAX, EAX, element_size);
+		}
+		load(ECX, array);
+		assembler.ADD(ECX, EAX);
+	}
+	// stores the result of utf8_decode in the found flag and the codepoint of the result of a get_next intrinsic
+	void store_next(Location result, const TupleType* type) {
+		assembler.MOV((result + get_element_offset(type, 2)).get_ptr(), EAX);
+		assembler.CMP(EDX, 0);
+		assembler.SETNE(EAX);
+		assembler.MOVZX(EAX, EAX);
+		assembler.MOV((result + get_element_offset(type, 1)).get_ptr(), EAX);
+	}
+	Location get_argument(std::size_t index) {
+		const Function* function = context.function;
+		const std::vector<const Type*>& argument_types = function->get_argument_types();
+		std::uint32_t location = 8 + std::max(get_input_size(function), get_output_size(function));
+		for (std::size_t i = 0; i <= index; ++i) {
+			location -= get_type_size(argument_types[i]);
+		}
+		return Location(location);
+	}
+	// calls a function whose arguments have just been allocated and returns the location of its result
+	Location call_function(const Function* function) {
+		const std::uint32_t input_size = get_input_size(function);
+		const std::uint32_t output_size = get_output_size(function);
+		if (output_size > input_size) {
+			context.variable -= output_size - input_size;
+		}
+		start_call();
+		call(function_table.look_up(function));
+		if (output_size < input_size) {
+			context.variable += input_size - output_size;
+		}
+		return Location(context.variable);
+	}
+	// system calls use EBX which might hold a value
+	void system_call(std::uint32_t number, std::uint32_t fd, Location buffer) {
+		assembler.LEA(ESP, PTR(EBP, context.variable));
+		assembler.PUSH(EBX);
+		assembler.MOV(EAX, number);
+		assembler.MOV(EBX, fd);
+		assembler.LEA(ECX, buffer.get_ptr());
+		assembler.MOV(EDX, 1);
+		assembler.INT(0x80);
+		assembler.POP(EBX);
+	}
 public:
-	std::uint32_t visit_int_literal(const IntLiteral& int_literal) override {
-		const std::uint32_t result = allocate(4);
-		assembler.MOV(PTR(EBP, result), int_literal.get_value());
+	Location visit_int_literal(const IntLiteral& int_literal) override {
+		const Location result = allocate_result(&int_literal);
+		if (result.is_register()) {
+			assembler.MOV(result.get_register(), int_literal.get_value());
+		}
+		else {
+			assembler.MOV(result.get_ptr(), int_literal.get_value());
+		}
 		return result;
 	}
-	std::uint32_t visit_binary_expression(const BinaryExpression& binary_expression) override {
-		const std::uint32_t left = expression_table[binary_expression.get_left()];
-		const std::uint32_t right = expression_table[binary_expression.get_right()];
-		assembler.MOV(EAX, PTR(EBP, left));
-		assembler.MOV(EBX, PTR(EBP, right));
-		const std::uint32_t result = allocate(4);
+	Location visit_binary_expression(const BinaryExpression& binary_expression) override {
+		load(EAX, expression_table[binary_expression.get_left()]);
+		load(ECX, expression_table[binary_expression.get_right()]);
+		const Location result = allocate_result(&binary_expression);
 		switch (binary_expression.get_operation()) {
 		case BinaryOperation::ADD:
-			assembler.ADD(EAX, EBX);
-			assembler.MOV(PTR(EBP, result), EAX);
+			assembler.ADD(EAX, ECX);
+			store(result, EAX);
 			break;
 		case BinaryOperation::SUB:
-			assembler.SUB(EAX, EBX);
-			assembler.MOV(PTR(EBP, result), EAX);
+			assembler.SUB(EAX, ECX);
+			store(result, EAX);
 			break;
 		case BinaryOperation::MUL:
-			assembler.IMUL(EBX);
-			assembler.MOV(PTR(EBP, result), EAX);
+			assembler.IMUL(ECX);
+			store(result, EAX);
 			break;
 		case BinaryOperation::DIV:
 			assembler.CDQ();
-			assembler.IDIV(EBX);
-			assembler.MOV(PTR(EBP, result), EAX);
+			assembler.IDIV(ECX);
+			store(result, EAX);
 			break;
 		case BinaryOperation::REM:
 			assembler.CDQ();
-			assembler.IDIV(EBX);
-			assembler.MOV(PTR(EBP, result), EDX);
+			assembler.IDIV(ECX);
+			store(result, EDX);
 			break;
 		case BinaryOperation::EQ:
-			assembler.CMP(EAX, EBX);
+			assembler.CMP(EAX, ECX);
 			assembler.SETE(EAX);
 			assembler.MOVZX(EAX, EAX);
-			assembler.MOV(PTR(EBP, result), EAX);
+			store(result, EAX);
 			break;
 		case BinaryOperation::NE:
-			assembler.CMP(EAX, EBX);
+			assembler.CMP(EAX, ECX);
 			assembler.SETNE(EAX);
 			assembler.MOVZX(EAX, EAX);
-			assembler.MOV(PTR(EBP, result), EAX);
+			store(result, EAX);
 			break;
 		case BinaryOperation::LT:
-			assembler.CMP(EAX, EBX);
+			assembler.CMP(EAX, ECX);
 			assembler.SETL(EAX);
 			assembler.MOVZX(EAX, EAX);
-			assembler.MOV(PTR(EBP, result), EAX);
+			store(result, EAX);
 			break;
 		case BinaryOperation::LE:
-			assembler.CMP(EAX, EBX);
+			assembler.CMP(EAX, ECX);
 			assembler.SETLE(EAX);
 			assembler.MOVZX(EAX, EAX);
-			assembler.MOV(PTR(EBP, result), EAX);
+			store(result, EAX);
 			break;
 		case BinaryOperation::GT:
-			assembler.CMP(EAX, EBX);
+			assembler.CMP(EAX, ECX);
 			assembler.SETG(EAX);
 			assembler.MOVZX(EAX, EAX);
-			assembler.MOV(PTR(EBP, result), EAX);
+			store(result, EAX);
 			break;
 		case BinaryOperation::GE:
-			assembler.CMP(EAX, EBX);
+			assembler.CMP(EAX, ECX);
 			assembler.SETGE(EAX);
 			assembler.MOVZX(EAX, EAX);
-			assembler.MOV(PTR(EBP, result), EAX);
+			store(result, EAX);
 			break;
 		}
 		return result;
 	}
-	std::uint32_t visit_if(const If& if_) override {
-		const std::uint32_t condition = expression_table[if_.get_condition()];
-		assembler.MOV(EAX, PTR(EBP, condition));
+	Location visit_array_literal(const ArrayLiteral& array_literal) override {
+		const std::vector<const Expression*>& elements = array_literal.get_elements();
+		const std::uint32_t element_size = get_element_size(array_literal.get_type());
+		const Location result = allocate(4);
+		start_call();
+		assembler.PUSH(element_size);
+		assembler.PUSH(elements.size());
+		call(function_table.array_new);
+		store(result, EAX);
+		assembler.MOV(ECX, EAX);
+		for (std::size_t i = 0; i < elements.size(); ++i) {
+			store(PTR(ECX, ARRAY_HEADER + i * element_size), expression_table[elements[i]], element_size);
+		}
+		return result;
+	}
+	Location visit_string_literal(const StringLiteral& string_literal) override {
+		const std::string& value = string_literal.get_value();
+		const Location result = allocate(4);
+		start_call();
+		assembler.PUSH(1);
+		assembler.PUSH(value.size());
+		call(function_table.array_new);
+		store(result, EAX);
+		if (!value.empty()) {
+			start_call();
+			assembler.PUSH(value.size());
+			function_table.load_string(assembler, EAX, value);
+			assembler.PUSH(EAX);
+			load(EAX, result);
+			assembler.ADD(EAX, ARRAY_HEADER);
+			assembler.PUSH(EAX);
+			call(function_table.memmove);
+		}
+		return result;
+	}
+	Location visit_if(const If& if_) override {
+		load(EAX, expression_table[if_.get_condition()]);
 		assembler.CMP(EAX, 0);
-		const std::uint32_t size = get_type_size(if_.get_type());
-		const std::uint32_t result = allocate(size);
+		const Location result = allocate_result(&if_);
 		const Jump jump_else = assembler.JE();
 		assembler.comment("if");
 		evaluate(result, if_.get_then_block());
@@ -159,7 +829,7 @@ public:
 		jump_end.set_target(assembler, assembler.get_position());
 		return result;
 	}
-	std::uint32_t visit_tuple_literal(const TupleLiteral& tuple_literal) override {
+	Location visit_tuple_literal(const TupleLiteral& tuple_literal) override {
 		const std::vector<const Expression*>& elements = tuple_literal.get_elements();
 		if (elements.size() == 1) {
 			return expression_table[elements[0]];
@@ -167,119 +837,1228 @@ public:
 		else {
 			for (const Expression* element: elements) {
 				const std::uint32_t element_size = get_type_size(element->get_type());
-				const std::uint32_t element_destination = allocate(element_size);
-				memcopy(element_destination, expression_table[element], element_size);
+				const Location element_destination = allocate(element_size);
+				copy(element_destination, expression_table[element], element_size);
 			}
-			return variable;
+			return Location(context.variable);
 		}
 	}
-	std::uint32_t visit_tuple_access(const TupleAccess& tuple_access) override {
-		const std::uint32_t tuple = expression_table[tuple_access.get_tuple()];
-		const std::vector<const Type*>& element_types = static_cast<const TupleType*>(tuple_access.get_tuple()->get_type())->get_element_types();
-		std::uint32_t location = tuple + get_type_size(tuple_access.get_tuple()->get_type());
-		for (std::size_t i = 0; i <= tuple_access.get_index(); ++i) {
-			location -= get_type_size(element_types[i]);
+	Location visit_tuple_access(const TupleAccess& tuple_access) override {
+		const Location tuple = expression_table[tuple_access.get_tuple()];
+		if (tuple.is_register()) {
+			return tuple;
 		}
-		return location;
+		const TupleType* tuple_type = static_cast<const TupleType*>(tuple_access.get_tuple()->get_type());
+		return tuple + get_element_offset(tuple_type, tuple_access.get_index());
 	}
-	std::uint32_t visit_argument(const Argument& argument) override {
-		const std::vector<const Type*>& argument_types = function->get_argument_types();
-		std::uint32_t location = 8 + std::max(get_input_size(function), get_output_size(function));
-		for (std::size_t i = 0; i <= argument.get_index(); ++i) {
-			location -= get_type_size(argument_types[i]);
+	Location visit_struct_literal(const StructLiteral& struct_literal) override {
+		const StructType* struct_type = static_cast<const StructType*>(struct_literal.get_type());
+		const Location result = allocate(get_type_size(struct_type));
+		for (const auto& field: struct_literal.get_fields()) {
+			const std::uint32_t offset = get_field_offset(struct_type, struct_type->get_index(field.first));
+			copy(result + offset, expression_table[field.second], get_type_size(field.second->get_type()));
+		}
+		return result;
+	}
+	Location visit_struct_access(const StructAccess& struct_access) override {
+		const Location struct_ = expression_table[struct_access.get_struct()];
+		if (struct_access.get_struct()->get_type_id() == TypeId::REFERENCE) {
+			// the field is read from the value the reference points to
+			const ReferenceType* reference_type = static_cast<const ReferenceType*>(struct_access.get_struct()->get_type());
+			const StructType* struct_type = static_cast<const StructType*>(reference_type->get_type());
+			const std::uint32_t size = get_type_size(struct_access.get_type());
+			const Location result = allocate(size);
+			load(ECX, struct_);
+			load(result, PTR(ECX, get_field_offset(struct_type, struct_type->get_index(struct_access.get_field_name()))), size);
+			return result;
 		}
-		return location;
+		const StructType* struct_type = static_cast<const StructType*>(struct_access.get_struct()->get_type());
+		return struct_ + get_field_offset(struct_type, struct_type->get_index(struct_access.get_field_name()));
 	}
-	std::uint32_t visit_function_call(const FunctionCall& call) override {
-		const std::uint32_t input_size = get_input_size(call.get_function());
-		const std::uint32_t output_size = get_output_size(call.get_function());
+	Location visit_enum_literal(const EnumLiteral& enum_literal) override {
+		const Location result = allocate(get_type_size(enum_literal.get_type()));
+		assembler.MOV(result.get_ptr(), enum_literal.get_index());
+		const Expression* expression = enum_literal.get_expression();
+		copy(result + 4, expression_table[expression], get_type_size(expression->get_type()));
+		return result;
+	}
+	Location visit_switch(const Switch& switch_) override {
+		Location enum_ = expression_table[switch_.get_enum()];
+		const Location result = allocate_result(&switch_);
+		if (switch_.get_enum()->get_type_id() == TypeId::REFERENCE) {
+			// the value is moved out of the reference, which is freed
+			const Type* enum_type = static_cast<const ReferenceType*>(switch_.get_enum()->get_type())->get_type();
+			const std::uint32_t size = get_type_size(enum_type);
+			const Location value = allocate(size);
+			load(ECX, enum_);
+			load(value, PTR(ECX), size);
+			start_call();
+			push(enum_);
+			call(function_table.free);
+			enum_ = value;
+		}
+		std::vector<Jump> jumps_end;
+		for (std::size_t i = 0; i < switch_.get_cases().size(); ++i) {
+			assembler.comment("case");
+			assembler.MOV(EAX, enum_.get_ptr());
+			assembler.CMP(EAX, i);
+			const Jump jump_next = assembler.JNE();
+			evaluate(enum_ + 4, result, switch_.get_cases()[i].second);
+			jumps_end.push_back(assembler.JMP());
+			jump_next.set_target(assembler, assembler.get_position());
+		}
+		assembler.comment("end");
+		for (const Jump& jump_end: jumps_end) {
+			jump_end.set_target(assembler, assembler.get_position());
+		}
+		return result;
+	}
+	Location visit_case_variable(const CaseVariable& case_variable) override {
+		return this->case_variable;
+	}
+	Location visit_argument(const Argument& argument) override {
+		return get_argument(argument.get_index());
+	}
+	Location visit_function_call(const FunctionCall& call) override {
+		if (context.tail_call_data.is_tail_call(&call)) {
+			// copy the arguments to temporaries first since they may refer to the current arguments
+			std::vector<Location> arguments;
+			for (const Expression* argument: call.get_arguments()) {
+				const std::uint32_t argument_size = get_type_size(argument->get_type());
+				arguments.push_back(allocate(argument_size));
+				copy(arguments.back(), expression_table[argument], argument_size);
+			}
+			for (std::size_t i = 0; i < arguments.size(); ++i) {
+				copy(get_argument(i), arguments[i], get_type_size(call.get_arguments()[i]->get_type()));
+			}
+			assembler.comment("tail call");
+			assembler.JMP().set_target(assembler, context.body_position);
+			return allocate(0);
+		}
 		for (const Expression* argument: call.get_arguments()) {
 			const std::uint32_t argument_size = get_type_size(argument->get_type());
-			const std::uint32_t argument_destination = allocate(argument_size);
-			memcopy(argument_destination, expression_table[argument], argument_size);
+			const Location argument_destination = allocate(argument_size);
+			copy(argument_destination, expression_table[argument], argument_size);
 		}
-		if (output_size > input_size) {
-			variable -= output_size - input_size;
-		}
-		assembler.LEA(ESP, PTR(EBP, variable));
-		Jump jump = assembler.CALL();
-		deferred_calls.emplace_back(jump, call.get_function());
-		if (output_size < input_size) {
-			variable += input_size - output_size;
+		const Location result = call_function(call.get_function());
+		const Register r = context.register_table.get(&call);
+		if (r != EAX) {
+			load(r, result);
+			return Location(r);
 		}
-		return variable;
+		return result;
 	}
-	std::uint32_t visit_intrinsic(const Intrinsic& intrinsic) override {
+	Location visit_intrinsic(const Intrinsic& intrinsic) override {
+		const std::vector<const Expression*>& arguments = intrinsic.get_arguments();
 		if (intrinsic.name_equals("putChar")) {
-			const std::uint32_t argument = expression_table[intrinsic.get_arguments()[0]];
+			Location argument = expression_table[arguments[0]];
+			if (argument.is_register()) {
+				const Location buffer = allocate(4);
+				copy(buffer, argument, 4);
+				argument = buffer;
+			}
 			assembler.comment("putChar");
-			assembler.MOV(EAX, 0x04);
-			assembler.MOV(EBX, 1); // stdout
-			assembler.LEA(ECX, PTR(EBP, argument));
-			assembler.MOV(EDX, 1);
-			assembler.INT(0x80);
-			assembler.POP(EAX);
+			system_call(0x04, 1, argument); // stdout
+			return allocate(0);
+		}
+		else if (intrinsic.name_equals("putStr") || intrinsic.name_equals("writeAll")) {
+			start_call();
+			load(ECX, expression_table[arguments[0]]);
+			assembler.PUSH(PTR(ECX));
+			assembler.LEA(EAX, PTR(ECX, ARRAY_HEADER));
+			assembler.PUSH(EAX);
+			call(function_table.write);
 			return allocate(0);
 		}
 		else if (intrinsic.name_equals("getChar")) {
-			const std::uint32_t result = allocate(4);
+			const Location buffer = allocate(4);
 			assembler.comment("getChar");
-			assembler.MOV(EAX, 0x03);
-			assembler.MOV(EBX, 0); // stdin
-			assembler.LEA(ECX, PTR(EBP, result));
-			assembler.MOV(PTR(ECX), EBX);
-			assembler.MOV(EDX, 1);
-			assembler.INT(0x80);
+			assembler.MOV(buffer.get_ptr(), 0);
+			system_call(0x03, 0, buffer); // stdin
+			// return -1 at the end of the input
+			assembler.CMP(EAX, 1);
+			const Jump jump_end = assembler.JE();
+			assembler.MOV(buffer.get_ptr(), -1);
+			jump_end.set_target(assembler, assembler.get_position());
+			const Register r = context.register_table.get(&intrinsic);
+			if (r != EAX) {
+				load(r, buffer);
+				return Location(r);
+			}
+			return buffer;
+		}
+		else if (intrinsic.name_equals("readAll")) {
+			const Location result = allocate(4);
+			start_call();
+			call(function_table.read_all);
+			store(result, EAX);
 			return result;
 		}
-		else if (intrinsic.name_equals("arrayNew")) {
-			print_error(Printer(std::cerr), "the x86 codegen does not support arrays");
-			std::exit(EXIT_FAILURE);
+		else if (intrinsic.name_equals("arrayGet")) {
+			const Expression* array = arguments[0];
+			const Location location = expression_table[array];
+			const std::uint32_t element_size = get_element_size(array->get_type());
+			const Location result = allocate_result(&intrinsic);
+			load(EAX, expression_table[arguments[1]]);
+			if (array->get_type_id() == TypeId::SLICE) {
+				assembler.ADD(EAX, (location + SLICE_START).get_ptr());
+				element_address(location + SLICE_ARRAY, element_size);
+			}
+			else {
+				element_address(location, element_size);
+			}
+			if (element_size == 1) {
+				assembler.MOVZX(EAX, PTR(ECX, ARRAY_HEADER));
+				store(result, EAX);
+			}
+			else {
+				load(result, PTR(ECX, ARRAY_HEADER), element_size);
+			}
+			return result;
 		}
-		else {
+		else if (intrinsic.name_equals("arrayLength")) {
+			const Expression* array = arguments[0];
+			const Location location = expression_table[array];
+			const Location result = allocate_result(&intrinsic);
+			if (array->get_type_id() == TypeId::SLICE) {
+				assembler.MOV(EAX, (location + SLICE_END).get_ptr());
+				assembler.SUB(EAX, (location + SLICE_START).get_ptr());
+			}
+			else {
+				load(ECX, location);
+				assembler.MOV(EAX, PTR(ECX));
+			}
+			store(result, EAX);
+			return result;
+		}
+		else if (intrinsic.name_equals("arraySplice") || intrinsic.name_equals("arraySpliceCopy")) {
+			// arraySpliceCopy borrows its array and splices a copy
+			const Type* type = intrinsic.get_type();
+			const Type* element_type = get_element_type(type);
+			const std::uint32_t element_size = get_element_size(type);
+			const Location result = allocate(4);
+			if (intrinsic.name_equals("arraySpliceCopy")) {
+				copy_value(type, result, expression_table[arguments[0]]);
+			}
+			else {
+				copy(result, expression_table[arguments[0]], 4);
+			}
+			const Location index = expression_table[arguments[1]];
+			const Location remove = expression_table[arguments[2]];
+			if (has_heap(element_type)) {
+				start_call();
+				push(remove);
+				push(index);
+				push(result);
+				call(function_table.look_up(TypeFunction::FREE_ELEMENTS, type));
+			}
+			if (arguments.size() == 4 && arguments[3]->get_type() == type) {
+				// the elements are moved out of the inserted array, which is freed
+				const Location insert = expression_table[arguments[3]];
+				start_call();
+				assembler.PUSH(element_size);
+				load(ECX, insert);
+				assembler.PUSH(PTR(ECX));
+				push(remove);
+				push(index);
+				push(result);
+				call(function_table.array_resize);
+				store(result, EAX);
+				start_call();
+				load(EDX, insert);
+				assembler.MOV(EAX, PTR(EDX));
+				assembler.IMUL(EAX, EAX, element_size);
+				assembler.PUSH(EAX);
+				assembler.LEA(EAX, PTR(EDX, ARRAY_HEADER));
+				assembler.PUSH(EAX);
+				load(EAX, index);
+				element_address(result, element_size);
+				assembler.LEA(EAX, PTR(ECX, ARRAY_HEADER));
+				assembler.PUSH(EAX);
+				call(function_table.memmove);
+				start_call();
+				push(insert);
+				call(function_table.free);
+			}
+			else {
+				const std::uint32_t insert = arguments.size() - 3;
+				start_call();
+				assembler.PUSH(element_size);
+				assembler.PUSH(insert);
+				push(remove);
+				push(index);
+				push(result);
+				call(function_table.array_resize);
+				store(result, EAX);
+				load(EAX, index);
+				element_address(result, element_size);
+				for (std::uint32_t i = 0; i < insert; ++i) {
+					const Location element = expression_table[arguments[3 + i]];
+					if (element_size == 1) {
+						load(EAX, element);
+						assembler.MOV8(PTR(ECX, ARRAY_HEADER + i), EAX);
+					}
+					else {
+						store(PTR(ECX, ARRAY_HEADER + i * element_size), element, element_size);
+					}
+				}
+			}
+			return result;
+		}
+		else if (intrinsic.name_equals("stringPush") || intrinsic.name_equals("stringPushCopy") || intrinsic.name_equals("stringBuilderPush")) {
+			const Location result = allocate(4);
+			if (intrinsic.name_equals("stringPushCopy")) {
+				copy_value(intrinsic.get_type(), result, expression_table[arguments[0]]);
+			}
+			else {
+				copy(result, expression_table[arguments[0]], 4);
+			}
+			if (arguments[1]->get_type_id() == TypeId::STRING) {
+				// the bytes are appended and the pushed string is freed
+				const Location string = expression_table[arguments[1]];
+				start_call();
+				assembler.PUSH(1);
+				load(ECX, string);
+				assembler.PUSH(PTR(ECX));
+				assembler.PUSH(0);
+				load(ECX, result);
+				assembler.PUSH(PTR(ECX));
+				push(result);
+				call(function_table.array_resize);
+				store(result, EAX);
+				start_call();
+				load(EDX, string);
+				assembler.PUSH(PTR(EDX));
+				assembler.LEA(EAX, PTR(EDX, ARRAY_HEADER));
+				assembler.PUSH(EAX);
+				load(ECX, result);
+				assembler.MOV(EAX, ECX);
+				assembler.ADD(EAX, PTR(ECX));
+				assembler.SUB(EAX, PTR(EDX));
+				assembler.ADD(EAX, ARRAY_HEADER);
+				assembler.PUSH(EAX);
+				call(function_table.memmove);
+				start_call();
+				push(string);
+				call(function_table.free);
+			}
+			else {
+				start_call();
+				push(expression_table[arguments[1]]);
+				push(result);
+				call(function_table.string_push_codepoint);
+				store(result, EAX);
+			}
+			return result;
+		}
+		else if (intrinsic.name_equals("stringIterator")) {
+			const Location result = allocate(8);
+			copy(result + ITERATOR_STRING, expression_table[arguments[0]], 4);
+			assembler.MOV((result + ITERATOR_POSITION).get_ptr(), 0);
+			return result;
+		}
+		else if (intrinsic.name_equals("stringIteratorGetNext")) {
+			const TupleType* type = static_cast<const TupleType*>(intrinsic.get_type());
+			const Location iterator = expression_table[arguments[0]];
+			const Location result = allocate(get_type_size(type));
+			start_call();
+			load(ECX, iterator + ITERATOR_STRING);
+			assembler.MOV(EAX, PTR(ECX));
+			assembler.SUB(EAX, (iterator + ITERATOR_POSITION).get_ptr());
+			assembler.PUSH(EAX);
+			assembler.MOV(EAX, (iterator + ITERATOR_POSITION).get_ptr());
+			assembler.ADD(EAX, ECX);
+			assembler.ADD(EAX, ARRAY_HEADER);
+			assembler.PUSH(EAX);
+			call(function_table.utf8_decode);
+			store_next(result, type);
+			// the iterator advances by the bytes that were decoded
+			const Location next = result + get_element_offset(type, 0);
+			copy(next + ITERATOR_STRING, iterator + ITERATOR_STRING, 4);
+			assembler.MOV(ECX, (iterator + ITERATOR_POSITION).get_ptr());
+			assembler.ADD(ECX, EDX);
+			assembler.MOV((next + ITERATOR_POSITION).get_ptr(), ECX);
+			return result;
+		}
+		else if (intrinsic.name_equals("stringBuilder")) {
+			const Location result = allocate(4);
+			start_call();
+			assembler.PUSH(1);
+			assembler.PUSH(0);
+			call(function_table.array_new);
+			store(result, EAX);
+			return result;
+		}
+		else if (intrinsic.name_equals("stringBuilderToString")) {
+			return expression_table[arguments[0]];
+		}
+		else if (intrinsic.name_equals("slice") || intrinsic.name_equals("sliceCopy")) {
+			// sliceCopy borrows its array and copies the view
+			const Expression* argument = arguments[0];
+			const Location array = expression_table[argument];
+			const Location view = allocate(12);
+			if (argument->get_type_id() == TypeId::SLICE) {
+				copy(view + SLICE_ARRAY, array + SLICE_ARRAY, 4);
+				if (arguments.size() == 3) {
+					load(EAX, expression_table[arguments[1]]);
+					assembler.ADD(EAX, (array + SLICE_START).get_ptr());
+					store(view + SLICE_START, EAX);
+					load(EAX, expression_table[arguments[2]]);
+					assembler.ADD(EAX, (array + SLICE_START).get_ptr());
+					store(view + SLICE_END, EAX);
+				}
+				else {
+					copy(view + SLICE_START, array + SLICE_START, 4);
+					copy(view + SLICE_END, array + SLICE_END, 4);
+				}
+			}
+			else {
+				copy(view + SLICE_ARRAY, array, 4);
+				if (arguments.size() == 3) {
+					copy(view + SLICE_START, expression_table[arguments[1]], 4);
+					copy(view + SLICE_END, expression_table[arguments[2]], 4);
+				}
+				else {
+					assembler.MOV((view + SLICE_START).get_ptr(), 0);
+					load(ECX, array);
+					assembler.MOV(EAX, PTR(ECX));
+					store(view + SLICE_END, EAX);
+				}
+			}
+			if (intrinsic.name_equals("sliceCopy")) {
+				const Location result = allocate(12);
+				copy_value(intrinsic.get_type(), result, view);
+				return result;
+			}
+			return view;
+		}
+		else if (intrinsic.name_equals("sliceGetNext")) {
+			const TupleType* type = static_cast<const TupleType*>(intrinsic.get_type());
+			const Location slice = expression_table[arguments[0]];
+			const Location result = allocate(get_type_size(type));
+			start_call();
+			assembler.MOV(EAX, (slice + SLICE_END).get_ptr());
+			assembler.SUB(EAX, (slice + SLICE_START).get_ptr());
+			assembler.PUSH(EAX);
+			assembler.MOV(EAX, (slice + SLICE_START).get_ptr());
+			assembler.ADD(EAX, (slice + SLICE_ARRAY).get_ptr());
+			assembler.ADD(EAX, ARRAY_HEADER);
+			assembler.PUSH(EAX);
+			call(function_table.utf8_decode);
+			store_next(result, type);
+			const Location next = result + get_element_offset(type, 0);
+			copy(next + SLICE_ARRAY, slice + SLICE_ARRAY, 4);
+			copy(next + SLICE_END, slice + SLICE_END, 4);
+			assembler.MOV(ECX, (slice + SLICE_START).get_ptr());
+			assembler.ADD(ECX, EDX);
+			assembler.MOV((next + SLICE_START).get_ptr(), ECX);
+			return result;
+		}
+		else if (intrinsic.name_equals("sliceToArray")) {
+			// the slice owns its array, so the range can be moved to the front of it
+			const Type* slice_type = arguments[0]->get_type();
+			const Type* array_type = get_array_type(slice_type);
+			const std::uint32_t element_size = get_element_size(slice_type);
+			const Location slice = expression_table[arguments[0]];
+			const Location result = allocate(4);
+			copy(result, slice + SLICE_ARRAY, 4);
+			if (has_heap(get_element_type(slice_type))) {
+				const std::size_t free_elements = function_table.look_up(TypeFunction::FREE_ELEMENTS, array_type);
+				start_call();
+				load(ECX, result);
+				assembler.MOV(EAX, PTR(ECX));
+				assembler.SUB(EAX, (slice + SLICE_END).get_ptr());
+				assembler.PUSH(EAX);
+				push(slice + SLICE_END);
+				assembler.PUSH(ECX);
+				call(free_elements);
+				start_call();
+				push(slice + SLICE_START);
+				assembler.PUSH(0);
+				push(result);
+				call(free_elements);
+			}
+			assembler.MOV(EAX, (slice + SLICE_START).get_ptr());
+			assembler.CMP(EAX, 0);
+			const Jump jump_length = assembler.JE();
+			start_call();
+			assembler.MOV(EAX, (slice + SLICE_END).get_ptr());
+			assembler.SUB(EAX, (slice + SLICE_START).get_ptr());
+			assembler.IMUL(EAX, EAX, element_size);
+			assembler.PUSH(EAX);
+			assembler.MOV(EAX, (slice + SLICE_START).get_ptr());
+			element_address(result, element_size);
+			assembler.LEA(EAX, PTR(ECX, ARRAY_HEADER));
+			assembler.PUSH(EAX);
+			load(EAX, result);
+			assembler.ADD(EAX, ARRAY_HEADER);
+			assembler.PUSH(EAX);
+			call(function_table.memmove);
+			jump_length.set_target(assembler, assembler.get_position());
+			assembler.MOV(EAX, (slice + SLICE_END).get_ptr());
+			assembler.SUB(EAX, (slice + SLICE_START).get_ptr());
+			load(ECX, result);
+			assembler.MOV(PTR(ECX), EAX);
+			return result;
+		}
+		else if (intrinsic.name_equals("parallelMap") || intrinsic.name_equals("parallelReduce")) {
+			// the calls run one after the other, each of them gets its own copies of the environment and the element
+			const bool reduce = intrinsic.name_equals("parallelReduce");
+			const Function* function = intrinsic.get_function();
+			const std::vector<const Type*>& argument_types = function->get_argument_types();
+			const std::size_t first_argument = reduce ? 2 : 1;
+			const Type* return_type = function->get_return_type();
+			const std::uint32_t return_size = get_type_size(return_type);
+			const Type* element_type = argument_types.back();
+			const std::uint32_t element_size = get_element_size(arguments[0]->get_type());
+			const Location array = expression_table[arguments[0]];
+			const Location result = allocate_result(&intrinsic);
+			const Location accumulator = reduce ? allocate(return_size) : result;
+			const Location index = allocate(4);
+			if (reduce) {
+				copy_value(return_type, accumulator, expression_table[arguments[1]]);
+			}
+			else {
+				start_call();
+				assembler.PUSH(return_size);
+				load(ECX, array);
+				assembler.PUSH(PTR(ECX));
+				call(function_table.array_new);
+				store(result, EAX);
+			}
+			assembler.MOV(index.get_ptr(), 0);
+			const std::size_t loop = assembler.get_position();
+			assembler.MOV(EAX, index.get_ptr());
+			load(ECX, array);
+			assembler.CMP(EAX, PTR(ECX));
+			const Jump jump_end = assembler.JGE();
+			const std::uint32_t variable = context.variable;
+			for (std::size_t i = first_argument; i < arguments.size(); ++i) {
+				const Type* type = arguments[i]->get_type();
+				copy_value(type, allocate(get_type_size(type)), expression_table[arguments[i]]);
+			}
+			if (reduce) {
+				copy(allocate(return_size), accumulator, return_size);
+			}
+			const Location element = allocate(get_type_size(element_type));
+			assembler.MOV(EAX, index.get_ptr());
+			element_address(array, element_size);
+			if (element_size == 1) {
+				assembler.MOVZX(EAX, PTR(ECX, ARRAY_HEADER));
+				store(element, EAX);
+			}
+			else if (has_heap(element_type)) {
+				start_call();
+				push_address(element);
+				assembler.LEA(EAX, PTR(ECX, ARRAY_HEADER));
+				assembler.PUSH(EAX);
+				call(function_table.look_up(TypeFunction::COPY, element_type));
+			}
+			else {
+				load(element, PTR(ECX, ARRAY_HEADER), element_size);
+			}
+			const Location value = call_function(function);
+			if (reduce) {
+				copy(accumulator, value, return_size);
+			}
+			else {
+				assembler.MOV(EAX, index.get_ptr());
+				element_address(result, return_size);
+				store(PTR(ECX, ARRAY_HEADER), value, return_size);
+			}
+			context.variable = variable;
+			assembler.MOV(EAX, index.get_ptr());
+			assembler.ADD(EAX, 1);
+			assembler.MOV(index.get_ptr(), EAX);
+			assembler.JMP().set_target(assembler, loop);
+			jump_end.set_target(assembler, assembler.get_position());
+			copy(result, accumulator, return_size);
+			return result;
+		}
+		else if (intrinsic.name_equals("reference")) {
+			const Location value = expression_table[arguments[0]];
+			const std::uint32_t size = get_type_size(arguments[0]->get_type());
+			const Location result = allocate(4);
+			start_call();
+			assembler.PUSH(size);
+			call(function_table.malloc);
+			store(result, EAX);
+			assembler.MOV(ECX, EAX);
+			store(PTR(ECX), value, size);
+			return result;
+		}
+		else if (intrinsic.name_equals("copy")) {
+			const Type* type = intrinsic.get_type();
+			const Location result = allocate(get_type_size(type));
+			copy_value(type, result, expression_table[arguments[0]]);
+			return result;
+		}
+		else if (intrinsic.name_equals("free")) {
+			free_value(arguments[0]->get_type(), expression_table[arguments[0]]);
+			return allocate(0);
+		}
+		else if (intrinsic.name_equals("profileCounter")) {
 			return allocate(0);
 		}
+		else {
+			unsupported(intrinsic.get_name());
+		}
 	}
-	std::uint32_t visit_bind(const Bind& bind) override {
+	Location visit_void_literal(const VoidLiteral& void_literal) override {
 		return allocate(0);
 	}
-	std::uint32_t visit_return(const Return& return_) override {
-		assembler.comment("return");
-		const std::uint32_t size = get_type_size(return_.get_expression()->get_type());
-		memcopy(result, expression_table[return_.get_expression()], size);
+	Location visit_bind(const Bind& bind) override {
+		return expression_table[bind.get_right()];
+	}
+	Location visit_return(const Return& return_) override {
+		const Expression* expression = return_.get_expression();
+		if (!context.tail_call_data.is_tail_call(expression)) {
+			assembler.comment("return");
+			copy(result, expression_table[expression], get_type_size(expression->get_type()));
+		}
 		return allocate(0);
 	}
-	static void codegen(const Program& program, const char* source_path, const TailCallData& tail_call_data) {
-		std::vector<DeferredCall> deferred_calls;
-		std::map<const Function*, std::size_t> function_locations;
+	// copies the value ESI points to to EDI
+	static void generate_copy_value(A& assembler, FunctionTable& function_table, const Type* type) {
+		if (has_heap(type)) {
+			assembler.PUSH(EDI);
+			assembler.PUSH(ESI);
+			call_routine(assembler, function_table, function_table.look_up(TypeFunction::COPY, type), 2);
+		}
+		else {
+			copy_memory(assembler, PTR(EDI), PTR(ESI), get_type_size(type));
+		}
+	}
+	// copies the [EDI] elements after ESI + ARRAY_HEADER to the array EDI
+	static void generate_copy_elements(A& assembler, FunctionTable& function_table, const Type* type) {
+		const Type* element_type = get_element_type(type);
+		const std::uint32_t element_size = get_element_size(type);
+		if (has_heap(element_type)) {
+			assembler.MOV(EBX, 0);
+			generate_loop(assembler, EBX, PTR(EDI), [&]() {
+				assembler.IMUL(EAX, EBX, element_size);
+				assembler.LEA(ECX, PTR(EAX, ARRAY_HEADER));
+				assembler.ADD(ECX, EDI);
+				assembler.PUSH(ECX);
+				assembler.LEA(ECX, PTR(EAX, ARRAY_HEADER));
+				assembler.ADD(ECX, ESI);
+				assembler.PUSH(ECX);
+				call_routine(assembler, function_table, function_table.look_up(TypeFunction::COPY, element_type), 2);
+			});
+		}
+		else {
+			assembler.MOV(EAX, PTR(EDI));
+			assembler.IMUL(EAX, EAX, element_size);
+			assembler.PUSH(EAX);
+			assembler.LEA(EAX, PTR(ESI, ARRAY_HEADER));
+			assembler.PUSH(EAX);
+			assembler.LEA(EAX, PTR(EDI, ARRAY_HEADER));
+			assembler.PUSH(EAX);
+			call_routine(assembler, function_table, function_table.memmove, 3);
+		}
+	}
+	static void generate_copy_function(A& assembler, FunctionTable& function_table, const Type* type, std::size_t routine) {
+		function_table.define(assembler, routine);
+		enter_routine(assembler);
+		assembler.MOV(ESI, get_routine_argument(0));
+		assembler.MOV(EDI, get_routine_argument(1));
+		switch (type->get_id()) {
+		case TypeId::ARRAY:
+		case TypeId::STRING:
+			assembler.MOV(ESI, PTR(ESI));
+			assembler.PUSH(get_element_size(type));
+			assembler.PUSH(PTR(ESI));
+			call_routine(assembler, function_table, function_table.array_new, 2);
+			assembler.MOV(PTR(EDI), EAX);
+			assembler.MOV(EDI, EAX);
+			generate_copy_elements(assembler, function_table, type);
+			break;
+		case TypeId::SLICE:
+			// only the elements in the range of the slice are copied into a new array
+			assembler.MOV(EAX, PTR(ESI, SLICE_END));
+			assembler.SUB(EAX, PTR(ESI, SLICE_START));
+			assembler.MOV(PTR(EDI, SLICE_END), EAX);
+			assembler.MOV(PTR(EDI, SLICE_START), 0);
+			assembler.PUSH(get_element_size(type));
+			assembler.PUSH(EAX);
+			call_routine(assembler, function_table, function_table.array_new, 2);
+			assembler.MOV(PTR(EDI, SLICE_ARRAY), EAX);
+			assembler.MOV(EDI, EAX);
+			assembler.MOV(EAX, PTR(ESI, SLICE_START));
+			assembler.IMUL(EAX, EAX, get_element_size(type));
+			assembler.ADD(EAX, PTR(ESI, SLICE_ARRAY));
+			assembler.MOV(ESI, EAX);
+			generate_copy_elements(assembler, function_table, type);
+			break;
+		case TypeId::STRING_ITERATOR:
+			copy_memory(assembler, PTR(EDI, ITERATOR_POSITION), PTR(ESI, ITERATOR_POSITION), 4);
+			assembler.LEA(ESI, PTR(ESI, ITERATOR_STRING));
+			assembler.LEA(EDI, PTR(EDI, ITERATOR_STRING));
+			generate_copy_value(assembler, function_table, TypeInterner::get_string_type());
+			break;
+		case TypeId::REFERENCE:
+			{
+				// a copy allocates a new block and copies the value
+				const Type* value_type = static_cast<const ReferenceType*>(type)->get_type();
+				assembler.PUSH(get_type_size(value_type));
+				call_routine(assembler, function_table, function_table.malloc, 1);
+				assembler.MOV(PTR(EDI), EAX);
+				assembler.MOV(ESI, PTR(ESI));
+				assembler.MOV(EDI, EAX);
+				generate_copy_value(assembler, function_table, value_type);
+				break;
+			}
+		case TypeId::TUPLE:
+		case TypeId::STRUCT:
+			copy_memory(assembler, PTR(EDI), PTR(ESI), get_type_size(type));
+			for (const auto& member: get_members(type)) {
+				if (has_heap(member.first)) {
+					assembler.LEA(EAX, PTR(EDI, member.second));
+					assembler.PUSH(EAX);
+					assembler.LEA(EAX, PTR(ESI, member.second));
+					assembler.PUSH(EAX);
+					call_routine(assembler, function_table, function_table.look_up(TypeFunction::COPY, member.first), 2);
+				}
+			}
+			break;
+		case TypeId::ENUM:
+			{
+				copy_memory(assembler, PTR(EDI), PTR(ESI), get_type_size(type));
+				const auto& cases = static_cast<const EnumType*>(type)->get_cases();
+				for (std::size_t i = 0; i < cases.size(); ++i) {
+					if (has_heap(cases[i].second)) {
+						assembler.MOV(EAX, PTR(ESI));
+						assembler.CMP(EAX, i);
+						const Jump jump_next = assembler.JNE();
+						assembler.LEA(EAX, PTR(EDI, 4));
+						assembler.PUSH(EAX);
+						assembler.LEA(EAX, PTR(ESI, 4));
+						assembler.PUSH(EAX);
+						call_routine(assembler, function_table, function_table.look_up(TypeFunction::COPY, cases[i].second), 2);
+						jump_next.set_target(assembler, assembler.get_position());
+					}
+				}
+				break;
+			}
+		default:
+			break;
+		}
+		leave_routine(assembler);
+	}
+	static void generate_free_function(A& assembler, FunctionTable& function_table, const Type* type, std::size_t routine) {
+		function_table.define(assembler, routine);
+		enter_routine(assembler);
+		assembler.MOV(ESI, get_routine_argument(0));
+		auto free_member = [&](const Type* member_type, std::uint32_t offset) {
+			if (has_heap(member_type)) {
+				assembler.LEA(EAX, PTR(ESI, offset));
+				assembler.PUSH(EAX);
+				call_routine(assembler, function_table, function_table.look_up(TypeFunction::FREE, member_type), 1);
+			}
+		};
+		switch (type->get_id()) {
+		case TypeId::ARRAY:
+		case TypeId::STRING:
+			assembler.MOV(ESI, PTR(ESI));
+			if (has_heap(get_element_type(type))) {
+				assembler.PUSH(PTR(ESI));
+				assembler.PUSH(0);
+				assembler.PUSH(ESI);
+				call_routine(assembler, function_table, function_table.look_up(TypeFunction::FREE_ELEMENTS, type), 3);
+			}
+			assembler.PUSH(ESI);
+			call_routine(assembler, function_table, function_table.free, 1);
+			break;
+		case TypeId::SLICE:
+			free_member(get_array_type(type), SLICE_ARRAY);
+			break;
+		case TypeId::STRING_ITERATOR:
+			free_member(TypeInterner::get_string_type(), ITERATOR_STRING);
+			break;
+		case TypeId::REFERENCE:
+			assembler.MOV(ESI, PTR(ESI));
+			free_member(static_cast<const ReferenceType*>(type)->get_type(), 0);
+			assembler.PUSH(ESI);
+			call_routine(assembler, function_table, function_table.free, 1);
+			break;
+		case TypeId::TUPLE:
+		case TypeId::STRUCT:
+			for (const auto& member: get_members(type)) {
+				free_member(member.first, member.second);
+			}
+			break;
+		case TypeId::ENUM:
+			{
+				const auto& cases = static_cast<const EnumType*>(type)->get_cases();
+				for (std::size_t i = 0; i < cases.size(); ++i) {
+					if (has_heap(cases[i].second)) {
+						assembler.MOV(EAX, PTR(ESI));
+						assembler.CMP(EAX, i);
+						const Jump jump_next = assembler.JNE();
+						free_member(cases[i].second, 4);
+						jump_next.set_target(assembler, assembler.get_position());
+					}
+				}
+				break;
+			}
+		default:
+			break;
+		}
+		leave_routine(assembler);
+	}
+	// free_elements(array, index, count)
+	static void generate_free_elements_function(A& assembler, FunctionTable& function_table, const Type* type, std::size_t routine) {
+		const Type* element_type = get_element_type(type);
+		const std::uint32_t element_size = get_element_size(type);
+		function_table.define(assembler, routine);
+		enter_routine(assembler);
+		assembler.MOV(ESI, get_routine_argument(0));
+		assembler.MOV(EBX, get_routine_argument(1));
+		assembler.MOV(EDI, EBX);
+		assembler.ADD(EDI, get_routine_argument(2));
+		generate_loop(assembler, EBX, EDI, [&]() {
+			assembler.IMUL(EAX, EBX, element_size);
+			assembler.ADD(EAX, ESI);
+			assembler.ADD(EAX, ARRAY_HEADER);
+			assembler.PUSH(EAX);
+			call_routine(assembler, function_table, function_table.look_up(TypeFunction::FREE, element_type), 1);
+		});
+		leave_routine(assembler);
+	}
+	// malloc(size)
+	// a block of size class c holds 2^c bytes including the word before it that stores c
+	static void generate_malloc(A& assembler, FunctionTable& function_table) {
+		function_table.define(assembler, function_table.malloc);
+		enter_routine(assembler);
+		assembler.MOV(EAX, get_routine_argument(0));
+		assembler.ADD(EAX, 3);
+		assembler.BSR(ECX, EAX);
+		assembler.ADD(ECX, 1);
+		assembler.CMP(ECX, 3);
+		const Jump jump_minimum = assembler.JGE();
+		assembler.MOV(ECX, 3);
+		jump_minimum.set_target(assembler, assembler.get_position());
+		// reuse the first block of the free list
+		assembler.MOV(EDX, ECX);
+		assembler.SHL(EDX, 2);
+		assembler.ADD(EDX, function_table.free_lists);
+		assembler.MOV(EAX, PTR(EDX));
+		assembler.CMP(EAX, 0);
+		const Jump jump_allocate = assembler.JE();
+		assembler.MOV(EBX, PTR(EAX));
+		assembler.MOV(PTR(EDX), EBX);
+		const Jump jump_end = assembler.JMP();
+		jump_allocate.set_target(assembler, assembler.get_position());
+		// the heap starts at the initial program break
+		assembler.MOV(ESI, ECX);
+		assembler.MOV(EDX, function_table.heap_top);
+		assembler.MOV(EAX, PTR(EDX));
+		assembler.CMP(EAX, 0);
+		const Jump jump_initialized = assembler.JNE();
+		assembler.MOV(EAX, 0x2D); // brk
+		assembler.MOV(EBX, 0);
+		assembler.INT(0x80);
+		assembler.MOV(EDX, function_table.heap_end);
+		assembler.MOV(PTR(EDX), EAX);
+		assembler.MOV(EDX, function_table.heap_top);
+		assembler.MOV(PTR(EDX), EAX);
+		jump_initialized.set_target(assembler, assembler.get_position());
+		assembler.MOV(ECX, ESI);
+		assembler.MOV(EBX, 1);
+		assembler.SHL(EBX);
+		assembler.ADD(EBX, EAX);
+		assembler.MOV(PTR(EDX), EBX);
+		assembler.MOV(EDX, function_table.heap_end);
+		assembler.CMP(EBX, PTR(EDX));
+		const Jump jump_available = assembler.JBE();
+		// the program break grows in steps of 1 MiB
+		assembler.MOV(EDI, EAX);
+		assembler.ADD(EBX, 0xFFFFF);
+		assembler.AND(EBX, 0xFFF00000);
+		assembler.MOV(EAX, 0x2D); // brk
+		assembler.INT(0x80);
+		assembler.CMP(EAX, EBX);
+		const Jump jump_grown = assembler.JAE();
+		const std::string message = "out of memory\n";
+		function_table.load_string(assembler, ECX, message);
+		assembler.MOV(EAX, 0x04); // write
+		assembler.MOV(EBX, 2); // stderr
+		assembler.MOV(EDX, message.size());
+		assembler.INT(0x80);
+		assembler.MOV(EAX, 0x01); // exit
+		assembler.MOV(EBX, 1);
+		assembler.INT(0x80);
+		jump_grown.set_target(assembler, assembler.get_position());
+		assembler.MOV(EDX, function_table.heap_end);
+		assembler.MOV(PTR(EDX), EBX);
+		assembler.MOV(EAX, EDI);
+		assembler.MOV(ECX, ESI);
+		jump_available.set_target(assembler, assembler.get_position());
+		jump_end.set_target(assembler, assembler.get_position());
+		assembler.MOV(PTR(EAX), ECX);
+		assembler.ADD(EAX, 4);
+		leave_routine(assembler);
+	}
+	// free(pointer)
+	static void generate_free(A& assembler, FunctionTable& function_table) {
+		function_table.define(assembler, function_table.free);
+		assembler.MOV(EAX, PTR(ESP, 4));
+		assembler.SUB(EAX, 4);
+		assembler.MOV(ECX, PTR(EAX));
+		assembler.SHL(ECX, 2);
+		assembler.ADD(ECX, function_table.free_lists);
+		assembler.MOV(EDX, PTR(ECX));
+		assembler.MOV(PTR(EAX), EDX);
+		assembler.MOV(PTR(ECX), EAX);
+		assembler.RET();
+	}
+	// memmove(destination, source, size)
+	static void generate_memmove(A& assembler, FunctionTable& function_table) {
+		function_table.define(assembler, function_table.memmove);
+		enter_routine(assembler);
+		assembler.MOV(EDI, get_routine_argument(0));
+		assembler.MOV(ESI, get_routine_argument(1));
+		assembler.MOV(ECX, get_routine_argument(2));
+		assembler.CMP(EDI, ESI);
+		const Jump jump_forward = assembler.JBE();
+		// copy backwards since the destination may overlap the end of the source
+		assembler.ADD(ESI, ECX);
+		assembler.SUB(ESI, 1);
+		assembler.ADD(EDI, ECX);
+		assembler.SUB(EDI, 1);
+		assembler.STD();
+		assembler.REP_MOVSB();
+		assembler.CLD();
+		leave_routine(assembler);
+		jump_forward.set_target(assembler, assembler.get_position());
+		assembler.REP_MOVSB();
+		leave_routine(assembler);
+	}
+	// array_new(length, element_size)
+	static void generate_array_new(A& assembler, FunctionTable& function_table) {
+		function_table.define(assembler, function_table.array_new);
+		enter_routine(assembler);
+		assembler.MOV(EAX, get_routine_argument(0));
+		assembler.MOV(ECX, get_routine_argument(1));
+		assembler.IMUL(ECX);
+		assembler.ADD(EAX, ARRAY_HEADER);
+		assembler.PUSH(EAX);
+		call_routine(assembler, function_table, function_table.malloc, 1);
+		assembler.MOV(ECX, get_routine_argument(0));
+		assembler.MOV(PTR(EAX), ECX);
+		assembler.MOV(PTR(EAX, 4), ECX);
+		leave_routine(assembler);
+	}
+	// array_resize(array, index, remove, insert, element_size)
+	// replaces remove elements at index with room for insert elements and returns the array, which may have moved
+	static void generate_array_resize(A& assembler, FunctionTable& function_table) {
+		const Ptr array = get_routine_argument(0);
+		const Ptr index = get_routine_argument(1);
+		const Ptr remove = get_routine_argument(2);
+		const Ptr insert = get_routine_argument(3);
+		const Ptr element_size = get_routine_argument(4);
+		// moves the elements after the removed ones from ESI to their place in destination
+		auto move_tail = [&](Register destination) {
+			assembler.MOV(EAX, PTR(ESI));
+			assembler.SUB(EAX, index);
+			assembler.SUB(EAX, remove);
+			assembler.MOV(ECX, element_size);
+			assembler.IMUL(ECX);
+			assembler.PUSH(EAX);
+			assembler.MOV(EAX, index);
+			assembler.ADD(EAX, remove);
+			assembler.MOV(ECX, element_size);
+			assembler.IMUL(ECX);
+			assembler.ADD(EAX, ESI);
+			assembler.ADD(EAX, ARRAY_HEADER);
+			assembler.PUSH(EAX);
+			assembler.MOV(EAX, index);
+			assembler.ADD(EAX, insert);
+			assembler.MOV(ECX, element_size);
+			assembler.IMUL(ECX);
+			assembler.ADD(EAX, destination);
+			assembler.ADD(EAX, ARRAY_HEADER);
+			assembler.PUSH(EAX);
+			call_routine(assembler, function_table, function_table.memmove, 3);
+		};
+		function_table.define(assembler, function_table.array_resize);
+		enter_routine(assembler);
+		assembler.MOV(ESI, array);
+		assembler.MOV(EBX, PTR(ESI));
+		assembler.SUB(EBX, remove);
+		assembler.ADD(EBX, insert);
+		assembler.CMP(EBX, PTR(ESI, 4));
+		const Jump jump_in_place = assembler.JBE();
+		// the capacity at least doubles
+		assembler.MOV(EDI, PTR(ESI, 4));
+		assembler.ADD(EDI, EDI);
+		assembler.CMP(EDI, EBX);
+		const Jump jump_capacity = assembler.JAE();
+		assembler.MOV(EDI, EBX);
+		jump_capacity.set_target(assembler, assembler.get_position());
+		assembler.MOV(EAX, EDI);
+		assembler.MOV(ECX, element_size);
+		assembler.IMUL(ECX);
+		assembler.ADD(EAX, ARRAY_HEADER);
+		assembler.PUSH(EAX);
+		call_routine(assembler, function_table, function_table.malloc, 1);
+		assembler.MOV(PTR(EAX, 4), EDI);
+		assembler.MOV(EDI, EAX);
+		assembler.MOV(EAX, index);
+		assembler.MOV(ECX, element_size);
+		assembler.IMUL(ECX);
+		assembler.PUSH(EAX);
+		assembler.LEA(EAX, PTR(ESI, ARRAY_HEADER));
+		assembler.PUSH(EAX);
+		assembler.LEA(EAX, PTR(EDI, ARRAY_HEADER));
+		assembler.PUSH(EAX);
+		call_routine(assembler, function_table, function_table.memmove, 3);
+		move_tail(EDI);
+		assembler.PUSH(ESI);
+		call_routine(assembler, function_table, function_table.free, 1);
+		assembler.MOV(ESI, EDI);
+		const Jump jump_end = assembler.JMP();
+		jump_in_place.set_target(assembler, assembler.get_position());
+		assembler.MOV(EAX, remove);
+		assembler.CMP(EAX, insert);
+		const Jump jump_unmoved = assembler.JE();
+		move_tail(ESI);
+		jump_unmoved.set_target(assembler, assembler.get_position());
+		jump_end.set_target(assembler, assembler.get_position());
+		assembler.MOV(PTR(ESI), EBX);
+		assembler.MOV(EAX, ESI);
+		leave_routine(assembler);
+	}
+	// string_push_codepoint(string, codepoint)
+	static void generate_string_push_codepoint(A& assembler, FunctionTable& function_table) {
+		function_table.define(assembler, function_table.string_push_codepoint);
+		enter_routine(assembler);
+		assembler.MOV(EDI, get_routine_argument(1));
+		// EBX = the length of the UTF-8 encoding
+		std::vector<Jump> jumps_length;
+		assembler.MOV(EBX, 1);
+		assembler.CMP(EDI, 0x80);
+		jumps_length.push_back(assembler.JB());
+		assembler.MOV(EBX, 2);
+		assembler.CMP(EDI, 0x800);
+		jumps_length.push_back(assembler.JB());
+		assembler.MOV(EBX, 3);
+		assembler.CMP(EDI, 0x10000);
+		jumps_length.push_back(assembler.JB());
+		assembler.MOV(EBX, 4);
+		for (const Jump& jump_length: jumps_length) {
+			jump_length.set_target(assembler, assembler.get_position());
+		}
+		assembler.MOV(ESI, get_routine_argument(0));
+		assembler.PUSH(1);
+		assembler.PUSH(EBX);
+		assembler.PUSH(0);
+		assembler.PUSH(PTR(ESI));
+		assembler.PUSH(ESI);
+		call_routine(assembler, function_table, function_table.array_resize, 5);
+		assembler.MOV(ESI, EAX);
+		// ECX = the address of the new bytes minus ARRAY_HEADER
+		assembler.MOV(ECX, ESI);
+		assembler.ADD(ECX, PTR(ESI));
+		assembler.SUB(ECX, EBX);
+		std::vector<Jump> jumps_end;
+		for (std::uint32_t length = 1; length <= 4; ++length) {
+			std::vector<Jump> jumps_next;
+			if (length < 4) {
+				assembler.CMP(EBX, length);
+				jumps_next.push_back(assembler.JNE());
+			}
+			for (std::uint32_t i = 0; i < length; ++i) {
+				assembler.MOV(EAX, EDI);
+				const std::uint32_t shift = 6 * (length - 1 - i);
+				if (shift > 0) {
+					assembler.SHR(EAX, shift);
+				}
+				if (i == 0) {
+					if (length > 1) {
+						assembler.OR(EAX, 0xFF00 >> length & 0xFF);
+					}
+				}
+				else {
+					assembler.AND(EAX, 0x3F);
+					assembler.OR(EAX, 0x80);
+				}
+				assembler.MOV8(PTR(ECX, ARRAY_HEADER + i), EAX);
+			}
+			jumps_end.push_back(assembler.JMP());
+			for (const Jump& jump_next: jumps_next) {
+				jump_next.set_target(assembler, assembler.get_position());
+			}
+		}
+		for (const Jump& jump_end: jumps_end) {
+			jump_end.set_target(assembler, assembler.get_position());
+		}
+		assembler.MOV(EAX, ESI);
+		leave_routine(assembler);
+	}
+	// utf8_decode(bytes, size)
+	// returns the codepoint in EAX and the number of bytes in EDX, which is 0 at the end or at an invalid byte
+	static void generate_utf8_decode(A& assembler, FunctionTable& function_table) {
+		function_table.define(assembler, function_table.utf8_decode);
+		enter_routine(assembler);
+		assembler.MOV(ECX, get_routine_argument(0));
+		assembler.MOV(EBX, get_routine_argument(1));
+		std::vector<Jump> jumps_none;
+		assembler.CMP(EBX, 1);
+		jumps_none.push_back(assembler.JL());
+		assembler.MOVZX(ESI, PTR(ECX));
+		std::vector<Jump> jumps_end;
+		for (std::uint32_t length = 1; length <= 4; ++length) {
+			// the mask and the prefix of the first byte
+			const std::uint32_t mask = length == 1 ? 0x80 : 0xFF80 >> length & 0xFF;
+			const std::uint32_t prefix = mask << 1 & 0xFF;
+			assembler.CMP(EBX, length);
+			jumps_none.push_back(assembler.JL());
+			assembler.MOV(EAX, ESI);
+			assembler.AND(EAX, mask);
+			assembler.CMP(EAX, prefix);
+			const Jump jump_next = assembler.JNE();
+			assembler.MOV(EAX, ESI);
+			assembler.AND(EAX, ~mask & 0xFF);
+			for (std::uint32_t i = 1; i < length; ++i) {
+				assembler.SHL(EAX, 6);
+				assembler.MOVZX(EDI, PTR(ECX, i));
+				assembler.AND(EDI, 0x3F);
+				assembler.OR(EAX, EDI);
+			}
+			assembler.MOV(EDX, length);
+			jumps_end.push_back(assembler.JMP());
+			jump_next.set_target(assembler, assembler.get_position());
+		}
+		for (const Jump& jump_none: jumps_none) {
+			jump_none.set_target(assembler, assembler.get_position());
+		}
+		assembler.MOV(EAX, 0);
+		assembler.MOV(EDX, 0);
+		for (const Jump& jump_end: jumps_end) {
+			jump_end.set_target(assembler, assembler.get_position());
+		}
+		leave_routine(assembler);
+	}
+	// write(bytes, size)
+	static void generate_write(A& assembler, FunctionTable& function_table) {
+		function_table.define(assembler, function_table.write);
+		enter_routine(assembler);
+		assembler.MOV(ECX, get_routine_argument(0));
+		assembler.MOV(EDX, get_routine_argument(1));
+		assembler.MOV(EBX, 1); // stdout
+		// the system call may write fewer bytes than requested
+		const std::size_t loop = assembler.get_position();
+		assembler.CMP(EDX, 0);
+		const Jump jump_done = assembler.JLE();
+		assembler.MOV(EAX, 0x04); // write
+		assembler.INT(0x80);
+		assembler.CMP(EAX, 0);
+		const Jump jump_error = assembler.JLE();
+		assembler.ADD(ECX, EAX);
+		assembler.SUB(EDX, EAX);
+		assembler.JMP().set_target(assembler, loop);
+		jump_done.set_target(assembler, assembler.get_position());
+		jump_error.set_target(assembler, assembler.get_position());
+		leave_routine(assembler);
+	}
+	// read_all()
+	static void generate_read_all(A& assembler, FunctionTable& function_table) {
+		constexpr std::uint32_t BUFFER_SIZE = 4096;
+		function_table.define(assembler, function_table.read_all);
+		enter_routine(assembler);
+		assembler.PUSH(1);
+		assembler.PUSH(0);
+		call_routine(assembler, function_table, function_table.array_new, 2);
+		assembler.MOV(ESI, EAX);
+		// EDI = the number of bytes read so far
+		assembler.MOV(EDI, 0);
+		const std::size_t loop = assembler.get_position();
+		assembler.MOV(PTR(ESI), EDI);
+		assembler.PUSH(1);
+		assembler.PUSH(BUFFER_SIZE);
+		assembler.PUSH(0);
+		assembler.PUSH(EDI);
+		assembler.PUSH(ESI);
+		call_routine(assembler, function_table, function_table.array_resize, 5);
+		assembler.MOV(ESI, EAX);
+		assembler.MOV(EAX, 0x03); // read
+		assembler.MOV(EBX, 0); // stdin
+		assembler.LEA(ECX, PTR(ESI, ARRAY_HEADER));
+		assembler.ADD(ECX, EDI);
+		assembler.MOV(EDX, BUFFER_SIZE);
+		assembler.INT(0x80);
+		assembler.CMP(EAX, 0);
+		const Jump jump_end = assembler.JLE();
+		assembler.ADD(EDI, EAX);
+		assembler.JMP().set_target(assembler, loop);
+		jump_end.set_target(assembler, assembler.get_position());
+		assembler.MOV(PTR(ESI), EDI);
+		assembler.MOV(EAX, ESI);
+		leave_routine(assembler);
+	}
+	static void codegen(const Program& program, const char* source_path, const TailCallData& tail_call_data, const CodegenOptions& options) {
 		A assembler;
 		assembler.write_headers();
-		{
-			Jump jump = assembler.CALL();
-			deferred_calls.emplace_back(jump, program.get_main_function());
-			assembler.comment("exit");
-			assembler.MOV(EAX, 0x01);
-			assembler.MOV(EBX, 0);
-			assembler.INT(0x80);
+		FunctionTable function_table(assembler);
+		for (const Function* function: program) {
+			function_table.declare(function);
 		}
+		function_table.call(assembler, function_table.look_up(program.get_main_function()));
+		assembler.comment("exit");
+		assembler.MOV(EAX, 0x01);
+		assembler.MOV(EBX, 0);
+		assembler.INT(0x80);
 		for (const Function* function: program) {
+			Context context(function_table, function, assembler, tail_call_data);
+			std::vector<Register> used_registers;
+			RegisterAllocation::run(function, tail_call_data, context.register_table, used_registers);
 			assembler.comment("function");
-			function_locations[function] = assembler.get_position();
+			function_table.define(assembler, function_table.look_up(function));
 			assembler.PUSH(EBP);
 			assembler.MOV(EBP, ESP);
+			for (Register r: used_registers) {
+				assembler.PUSH(r);
+			}
+			context.variable -= 4 * used_registers.size();
+			context.body_position = assembler.get_position();
 			assembler.comment("--");
 			const std::uint32_t output_size = get_output_size(function);
 			const std::uint32_t size = std::max(get_input_size(function), output_size);
-			CodegenX86::evaluate(deferred_calls, function, assembler, 8 + size - output_size, function->get_block());
+			CodegenX86::evaluate(context, Location(), Location(8 + size - output_size), function->get_block());
 			assembler.comment("--");
+			for (std::uint32_t i = 0; i < used_registers.size(); ++i) {
+				assembler.MOV(used_registers[i], PTR(EBP, 0 - 4 * (i + 1)));
+			}
 			assembler.MOV(ESP, EBP);
 			assembler.POP(EBP);
 			assembler.RET();
 		}
-		for (const DeferredCall& deferred_call: deferred_calls) {
-			const std::size_t target = function_locations[deferred_call.function];
-			deferred_call.jump.set_target(assembler, target);
+		generate_malloc(assembler, function_table);
+		generate_free(assembler, function_table);
+		generate_memmove(assembler, function_table);
+		generate_array_new(assembler, function_table);
+		generate_array_resize(assembler, function_table);
+		generate_string_push_codepoint(assembler, function_table);
+		generate_utf8_decode(assembler, function_table);
+		generate_write(assembler, function_table);
+		generate_read_all(assembler, function_table);
+		std::pair<TypeFunction, const Type*> type_function;
+		while (function_table.get_next_type_function(type_function)) {
+			const std::size_t routine = function_table.look_up(type_function.first, type_function.second);
+			switch (type_function.first) {
+			case TypeFunction::COPY:
+				generate_copy_function(assembler, function_table, type_function.second, routine);
+				break;
+			case TypeFunction::FREE:
+				generate_free_function(assembler, function_table, type_function.second, routine);
+				break;
+			case TypeFunction::FREE_ELEMENTS:
+				generate_free_elements_function(assembler, function_table, type_function.second, routine);
+				break;
+			}
 		}
+		function_table.write_data(assembler);
 		std::string path = std::string(source_path) + ".exe";
 		assembler.write_file(path.c_str());
 		Printer status_printer(std::cerr);
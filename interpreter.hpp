@@ -0,0 +1,505 @@
+#pragma once
+
+#include "ast.hpp"
+#include <memory>
+#include <unordered_map>
+
+// evaluates calls to pure functions at compile time
+class Interpreter {
+public:
+	// numbers, strings, string iterators, string builders, and aggregates share one representation
+	// enums keep their case index in number and their value in elements
+	class Value {
+	public:
+		std::int32_t number = 0;
+		std::shared_ptr<const std::string> string;
+		std::shared_ptr<const std::vector<Value>> elements;
+		bool operator ==(const Value& rhs) const {
+			if (number != rhs.number) {
+				return false;
+			}
+			if (string != rhs.string && !(string && rhs.string && *string == *rhs.string)) {
+				return false;
+			}
+			if (elements != rhs.elements && !(elements && rhs.elements && *elements == *rhs.elements)) {
+				return false;
+			}
+			return true;
+		}
+		std::size_t get_hash() const {
+			std::size_t hash = hash_combine(0, static_cast<std::uint32_t>(number));
+			if (string) {
+				hash = hash_combine(hash, std::hash<std::string>()(*string));
+			}
+			if (elements) {
+				for (const Value& element: *elements) {
+					hash = hash_combine(hash, element.get_hash());
+				}
+				hash = hash_combine(hash, elements->size());
+			}
+			return hash;
+		}
+	};
+	// converts a literal into a value and fails for everything else
+	static bool get_value(const Expression* expression, Value& value) {
+		GetValue visitor(value);
+		return visit(visitor, expression);
+	}
+	// evaluates a call to function, fails if it is impure or runs out of fuel
+	static bool run(const Function* function, const std::vector<Value>& arguments, Value& result) {
+		Interpreter interpreter;
+		return interpreter.call(function, arguments, result);
+	}
+private:
+	// steps a single call may take and steps all calls of a compilation may take
+	static constexpr std::size_t FUEL = 1 << 20;
+	static inline std::size_t total_fuel = 1 << 24;
+	static constexpr std::size_t MAX_DEPTH = 1000;
+	class GetValue: public Visitor<bool> {
+		Value& value;
+		static std::shared_ptr<const std::vector<Value>> get_values(const std::vector<const Expression*>& expressions) {
+			std::vector<Value> values(expressions.size());
+			for (std::size_t i = 0; i < expressions.size(); ++i) {
+				if (!get_value(expressions[i], values[i])) {
+					return nullptr;
+				}
+			}
+			return std::make_shared<const std::vector<Value>>(std::move(values));
+		}
+	public:
+		GetValue(Value& value): value(value) {}
+		bool visit_int_literal(const IntLiteral& int_literal) override {
+			value.number = int_literal.get_value();
+			return true;
+		}
+		bool visit_array_literal(const ArrayLiteral& array_literal) override {
+			value.elements = get_values(array_literal.get_elements());
+			return value.elements != nullptr;
+		}
+		bool visit_string_literal(const StringLiteral& string_literal) override {
+			value.string = std::make_shared<const std::string>(string_literal.get_value());
+			return true;
+		}
+		bool visit_tuple_literal(const TupleLiteral& tuple_literal) override {
+			value.elements = get_values(tuple_literal.get_elements());
+			return value.elements != nullptr;
+		}
+		bool visit_struct_literal(const StructLiteral& struct_literal) override {
+			std::vector<const Expression*> fields;
+			for (const auto& field: struct_literal.get_fields()) {
+				fields.push_back(field.second);
+			}
+			value.elements = get_values(fields);
+			return value.elements != nullptr;
+		}
+		bool visit_enum_literal(const EnumLiteral& enum_literal) override {
+			value.number = enum_literal.get_index();
+			value.elements = get_values({enum_literal.get_expression()});
+			return value.elements != nullptr;
+		}
+		bool visit_void_literal(const VoidLiteral&) override {
+			return true;
+		}
+	};
+	struct CallKey {
+		const Function* function;
+		std::vector<Value> arguments;
+		std::size_t hash;
+		CallKey(const Function* function, const std::vector<Value>& arguments): function(function), arguments(arguments), hash(hash_pointer(function)) {
+			for (const Value& argument: arguments) {
+				hash = hash_combine(hash, argument.get_hash());
+			}
+		}
+		bool operator ==(const CallKey& rhs) const {
+			return hash == rhs.hash && function == rhs.function && arguments == rhs.arguments;
+		}
+	};
+	struct CallKeyHash {
+		std::size_t operator ()(const CallKey& key) const {
+			return key.hash;
+		}
+	};
+	class Frame: public Visitor<bool> {
+		Interpreter& interpreter;
+		const std::vector<Value>& arguments;
+		IndexTable<Expression, Value> values;
+		const Value* case_value = nullptr;
+		static bool execute_binary_operation(BinaryOperation operation, std::int32_t left, std::int32_t right, std::int32_t& result) {
+			// wrap around like the generated code instead of overflowing
+			const std::uint32_t unsigned_left = left;
+			const std::uint32_t unsigned_right = right;
+			switch (operation) {
+			case BinaryOperation::ADD:
+				result = unsigned_left + unsigned_right;
+				return true;
+			case BinaryOperation::SUB:
+				result = unsigned_left - unsigned_right;
+				return true;
+			case BinaryOperation::MUL:
+				result = unsigned_left * unsigned_right;
+				return true;
+			case BinaryOperation::DIV:
+				if (right == 0 || (left == INT32_MIN && right == -1)) {
+					return false;
+				}
+				result = left / right;
+				return true;
+			case BinaryOperation::REM:
+				if (right == 0 || (left == INT32_MIN && right == -1)) {
+					return false;
+				}
+				result = left % right;
+				return true;
+			case BinaryOperation::EQ:
+				result = left == right;
+				return true;
+			case BinaryOperation::NE:
+				result = left != right;
+				return true;
+			case BinaryOperation::LT:
+				result = left < right;
+				return true;
+			case BinaryOperation::LE:
+				result = left <= right;
+				return true;
+			case BinaryOperation::GT:
+				result = left > right;
+				return true;
+			case BinaryOperation::GE:
+				result = left >= right;
+				return true;
+			default:
+				return false;
+			}
+		}
+		Value get(const Expression* expression) const {
+			return values.get(expression);
+		}
+		// the value behind a reference or the value itself
+		Value get_dereferenced(const Expression* expression) const {
+			const Value value = get(expression);
+			if (expression->get_type_id() == TypeId::REFERENCE) {
+				return (*value.elements)[0];
+			}
+			return value;
+		}
+		bool set_elements(const Expression& expression, const std::vector<const Expression*>& expressions) {
+			if (!interpreter.consume(expressions.size())) {
+				return false;
+			}
+			std::vector<Value> elements;
+			elements.reserve(expressions.size());
+			for (const Expression* element: expressions) {
+				elements.push_back(get(element));
+			}
+			set(expression).elements = std::make_shared<const std::vector<Value>>(std::move(elements));
+			return true;
+		}
+		bool evaluate(const Block& block, Value& result) {
+			if (block.get_last() == nullptr) {
+				return false;
+			}
+			for (const Expression* expression: block) {
+				if (!interpreter.consume(1) || !visit(*this, expression)) {
+					return false;
+				}
+			}
+			result = get(block.get_last());
+			return true;
+		}
+		Value& set(const Expression& expression) {
+			return values[&expression];
+		}
+	public:
+		Frame(Interpreter& interpreter, const std::vector<Value>& arguments): interpreter(interpreter), arguments(arguments) {}
+		bool evaluate(const Function* function, Value& result) {
+			return evaluate(function->get_block(), result);
+		}
+		bool visit_int_literal(const IntLiteral& int_literal) override {
+			set(int_literal).number = int_literal.get_value();
+			return true;
+		}
+		bool visit_binary_expression(const BinaryExpression& binary_expression) override {
+			const std::int32_t left = get(binary_expression.get_left()).number;
+			const std::int32_t right = get(binary_expression.get_right()).number;
+			std::int32_t result;
+			if (!execute_binary_operation(binary_expression.get_operation(), left, right, result)) {
+				return false;
+			}
+			set(binary_expression).number = result;
+			return true;
+		}
+		bool visit_array_literal(const ArrayLiteral& array_literal) override {
+			return set_elements(array_literal, array_literal.get_elements());
+		}
+		bool visit_string_literal(const StringLiteral& string_literal) override {
+			set(string_literal).string = std::make_shared<const std::string>(string_literal.get_value());
+			return true;
+		}
+		bool visit_if(const If& if_) override {
+			const Block& block = get(if_.get_condition()).number ? if_.get_then_block() : if_.get_else_block();
+			Value result;
+			if (!evaluate(block, result)) {
+				return false;
+			}
+			set(if_) = std::move(result);
+			return true;
+		}
+		bool visit_tuple_literal(const TupleLiteral& tuple_literal) override {
+			return set_elements(tuple_literal, tuple_literal.get_elements());
+		}
+		bool visit_tuple_access(const TupleAccess& tuple_access) override {
+			const Value tuple = get(tuple_access.get_tuple());
+			set(tuple_access) = (*tuple.elements)[tuple_access.get_index()];
+			return true;
+		}
+		bool visit_struct_literal(const StructLiteral& struct_literal) override {
+			std::vector<const Expression*> fields;
+			for (const auto& field: struct_literal.get_fields()) {
+				fields.push_back(field.second);
+			}
+			return set_elements(struct_literal, fields);
+		}
+		bool visit_struct_access(const StructAccess& struct_access) override {
+			const Expression* struct_ = struct_access.get_struct();
+			const Type* type = struct_->get_type();
+			if (type->get_id() == TypeId::REFERENCE) {
+				type = static_cast<const ReferenceType*>(type)->get_type();
+			}
+			const std::size_t index = static_cast<const StructType*>(type)->get_index(struct_access.get_field_name());
+			const Value value = get_dereferenced(struct_);
+			set(struct_access) = (*value.elements)[index];
+			return true;
+		}
+		bool visit_enum_literal(const EnumLiteral& enum_literal) override {
+			Value value;
+			value.number = enum_literal.get_index();
+			value.elements = std::make_shared<const std::vector<Value>>(1, get(enum_literal.get_expression()));
+			set(enum_literal) = std::move(value);
+			return true;
+		}
+		bool visit_switch(const Switch& switch_) override {
+			const Value enum_ = get_dereferenced(switch_.get_enum());
+			const Block& block = switch_.get_cases()[enum_.number].second;
+			const Value* previous_case_value = std::exchange(case_value, &(*enum_.elements)[0]);
+			Value result;
+			const bool success = evaluate(block, result);
+			case_value = previous_case_value;
+			if (!success) {
+				return false;
+			}
+			set(switch_) = std::move(result);
+			return true;
+		}
+		bool visit_case_variable(const CaseVariable& case_variable) override {
+			if (case_value == nullptr) {
+				return false;
+			}
+			set(case_variable) = *case_value;
+			return true;
+		}
+		bool visit_argument(const Argument& argument) override {
+			set(argument) = arguments[argument.get_index()];
+			return true;
+		}
+		bool visit_function_call(const FunctionCall& call) override {
+			std::vector<Value> call_arguments;
+			call_arguments.reserve(call.get_arguments().size());
+			for (const Expression* argument: call.get_arguments()) {
+				call_arguments.push_back(get(argument));
+			}
+			Value result;
+			if (!interpreter.call(call.get_function(), call_arguments, result)) {
+				return false;
+			}
+			set(call) = std::move(result);
+			return true;
+		}
+		bool visit_intrinsic(const Intrinsic& intrinsic) override {
+			const std::vector<const Expression*>& intrinsic_arguments = intrinsic.get_arguments();
+			if (intrinsic.name_equals("arrayGet")) {
+				const Value array = get(intrinsic_arguments[0]);
+				const std::int32_t index = get(intrinsic_arguments[1]).number;
+				if (index < 0 || static_cast<std::size_t>(index) >= array.elements->size()) {
+					return false;
+				}
+				set(intrinsic) = (*array.elements)[index];
+				return true;
+			}
+			else if (intrinsic.name_equals("arrayLength")) {
+				const Value array = get(intrinsic_arguments[0]);
+				set(intrinsic).number = array.elements->size();
+				return true;
+			}
+			else if (intrinsic.name_equals("arraySplice")) {
+				const Value array = get(intrinsic_arguments[0]);
+				const std::int32_t index = get(intrinsic_arguments[1]).number;
+				const std::int32_t remove = get(intrinsic_arguments[2]).number;
+				if (index < 0 || remove < 0 || static_cast<std::size_t>(index) + static_cast<std::size_t>(remove) > array.elements->size()) {
+					return false;
+				}
+				std::vector<Value> elements(array.elements->begin(), array.elements->begin() + index);
+				if (intrinsic_arguments.size() == 4 && intrinsic_arguments[3]->get_type() == intrinsic.get_type()) {
+					const Value insert = get(intrinsic_arguments[3]);
+					elements.insert(elements.end(), insert.elements->begin(), insert.elements->end());
+				}
+				else for (std::size_t i = 3; i < intrinsic_arguments.size(); ++i) {
+					elements.push_back(get(intrinsic_arguments[i]));
+				}
+				elements.insert(elements.end(), array.elements->begin() + index + remove, array.elements->end());
+				if (!interpreter.consume(elements.size())) {
+					return false;
+				}
+				set(intrinsic).elements = std::make_shared<const std::vector<Value>>(std::move(elements));
+				return true;
+			}
+			else if (intrinsic.name_equals("stringBuilder")) {
+				// a string builder is represented by the string it has built so far
+				set(intrinsic).string = std::make_shared<const std::string>();
+				return true;
+			}
+			else if (intrinsic.name_equals("stringBuilderToString")) {
+				set(intrinsic) = get(intrinsic_arguments[0]);
+				return true;
+			}
+			else if (intrinsic.name_equals("stringPush") || intrinsic.name_equals("stringBuilderPush")) {
+				std::string string = *get(intrinsic_arguments[0]).string;
+				const Value argument = get(intrinsic_arguments[1]);
+				if (intrinsic_arguments[1]->get_type_id() == TypeId::STRING) {
+					string += *argument.string;
+				}
+				else {
+					if (argument.number < 0 || argument.number > 0x10FFFF) {
+						return false;
+					}
+					string += from_codepoint(argument.number);
+				}
+				if (!interpreter.consume(string.size())) {
+					return false;
+				}
+				set(intrinsic).string = std::make_shared<const std::string>(std::move(string));
+				return true;
+			}
+			else if (intrinsic.name_equals("stringIterator")) {
+				// the position in bytes is kept in number
+				const Value string = get(intrinsic_arguments[0]);
+				set(intrinsic).string = string.string;
+				return true;
+			}
+			else if (intrinsic.name_equals("stringIteratorGetNext")) {
+				Value iterator = get(intrinsic_arguments[0]);
+				StringView s = StringView(iterator.string->data(), iterator.string->size()).substr(iterator.number);
+				const std::size_t size = s.size();
+				Value found;
+				Value codepoint;
+				if (size > 0) {
+					codepoint.number = next_codepoint(s);
+					if (s.size() == size) {
+						// invalid UTF-8 is handled differently by every backend
+						return false;
+					}
+					found.number = 1;
+					iterator.number += size - s.size();
+				}
+				set(intrinsic).elements = std::make_shared<const std::vector<Value>>(std::vector<Value>{iterator, found, codepoint});
+				return true;
+			}
+			else if (intrinsic.name_equals("reference")) {
+				const Value value = get(intrinsic_arguments[0]);
+				set(intrinsic).elements = std::make_shared<const std::vector<Value>>(1, value);
+				return true;
+			}
+			else if (intrinsic.name_equals("parallelMap") || intrinsic.name_equals("parallelReduce")) {
+				// evaluated sequentially, the function receives its environment followed by the accumulator and the element
+				const bool reduce = intrinsic.name_equals("parallelReduce");
+				const Value array = get(intrinsic_arguments[0]);
+				std::vector<Value> call_arguments;
+				for (std::size_t i = reduce ? 2 : 1; i < intrinsic_arguments.size(); ++i) {
+					call_arguments.push_back(get(intrinsic_arguments[i]));
+				}
+				const std::size_t environment = call_arguments.size();
+				Value accumulator;
+				if (reduce) {
+					accumulator = get(intrinsic_arguments[1]);
+					call_arguments.push_back(Value());
+				}
+				call_arguments.push_back(Value());
+				std::vector<Value> elements;
+				for (const Value& element: *array.elements) {
+					if (reduce) {
+						call_arguments[environment] = accumulator;
+					}
+					call_arguments.back() = element;
+					Value result;
+					if (!interpreter.call(intrinsic.get_function(), call_arguments, result)) {
+						return false;
+					}
+					if (reduce) {
+						accumulator = std::move(result);
+					}
+					else {
+						elements.push_back(std::move(result));
+					}
+				}
+				if (reduce) {
+					set(intrinsic) = std::move(accumulator);
+				}
+				else {
+					set(intrinsic).elements = std::make_shared<const std::vector<Value>>(std::move(elements));
+				}
+				return true;
+			}
+			else {
+				// input, output, and profile counters
+				return false;
+			}
+		}
+		bool visit_void_literal(const VoidLiteral& void_literal) override {
+			set(void_literal);
+			return true;
+		}
+		bool visit_bind(const Bind& bind) override {
+			const Value value = get(bind.get_right());
+			set(bind) = value;
+			return true;
+		}
+		bool visit_return(const Return& return_) override {
+			const Value value = get(return_.get_expression());
+			set(return_) = value;
+			return true;
+		}
+	};
+	std::size_t fuel = FUEL;
+	std::size_t depth = 0;
+	std::unordered_map<CallKey, Value, CallKeyHash> results;
+	bool consume(std::size_t steps) {
+		if (steps > fuel || steps > total_fuel) {
+			fuel = 0;
+			return false;
+		}
+		fuel -= steps;
+		total_fuel -= steps;
+		return true;
+	}
+	bool call(const Function* function, const std::vector<Value>& arguments, Value& result) {
+		// pure functions are memoized, which makes naive recursion linear
+		CallKey key(function, arguments);
+		auto iterator = results.find(key);
+		if (iterator != results.end()) {
+			result = iterator->second;
+			return true;
+		}
+		if (depth >= MAX_DEPTH) {
+			return false;
+		}
+		depth += 1;
+		Frame frame(*this, arguments);
+		const bool success = frame.evaluate(function, result);
+		depth -= 1;
+		if (!success) {
+			return false;
+		}
+		results.emplace(std::move(key), result);
+		return true;
+	}
+};
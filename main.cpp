@@ -1,18 +1,64 @@
 #include "parser.hpp"
+#include "cache.hpp"
 #include "passes.hpp"
 #include "codegen_x86.hpp"
 #include "codegen_c.hpp"
 #include "codegen_js.hpp"
+#include "codegen_wasm.hpp"
 #include <string>
+#include <cstdlib>
+#include <new>
+
+// every allocation of the compiler is counted for --time-passes
+void* operator new(std::size_t size) {
+	Statistics::allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* pointer = std::malloc(size > 0 ? size : 1)) {
+		return pointer;
+	}
+	throw std::bad_alloc();
+}
+// not inlined so that the compiler does not match the free against the new at the call sites
+[[gnu::noinline]] void operator delete(void* pointer) noexcept {
+	std::free(pointer);
+}
+[[gnu::noinline]] void operator delete(void* pointer, std::size_t) noexcept {
+	std::free(pointer);
+}
 
 class Arguments {
 public:
 	const char* source_path = nullptr;
-	void (*codegen)(const Program& program, const char* source_path, const TailCallData& tail_call_data) = CodegenC::codegen;
+	bool print_statistics = false;
+	// where the JSON report of --time-passes is written, null for standard error
+	const char* time_passes_path = nullptr;
+	unsigned int optimization_level = 1;
+	const char* profile_use_path = nullptr;
+	CodegenOptions codegen_options;
+	void (*codegen)(const Program& program, const char* source_path, const TailCallData& tail_call_data, const CodegenOptions& options) = CodegenC::codegen;
 	void parse(int argc, char** argv) {
 		for (int i = 1; i < argc; ++i) {
 			if (StringView(argv[i]) == "-c") codegen = CodegenC::codegen;
 			else if (StringView(argv[i]) == "-js") codegen = CodegenJS::codegen;
+			else if (StringView(argv[i]) == "-x86") codegen = CodegenX86::codegen;
+			else if (StringView(argv[i]) == "-wasm") codegen = CodegenWasm::codegen;
+			else if (StringView(argv[i]) == "--stats") print_statistics = true;
+			else if (StringView(argv[i]) == "--time-passes") Statistics::time_phases = true;
+			else if (StringView(argv[i]).substr(0, 14) == "--time-passes=") {
+				Statistics::time_phases = true;
+				time_passes_path = argv[i] + 14;
+			}
+			else if (StringView(argv[i]) == "-O0") optimization_level = 0;
+			else if (StringView(argv[i]) == "-O1") optimization_level = 1;
+			else if (StringView(argv[i]) == "-cache" && i + 1 < argc) ParseCache::directory = argv[++i];
+			else if (StringView(argv[i]) == "-rc") codegen_options.reference_counting = true;
+			else if (StringView(argv[i]) == "-pool") codegen_options.pool_allocation = true;
+			else if (StringView(argv[i]) == "-profile") codegen_options.runtime_profile = true;
+			else if (StringView(argv[i]) == "-line-directives") codegen_options.line_directives = true;
+			else if (StringView(argv[i]).substr(0, 18) == "-profile-generate=") codegen_options.profile_path = argv[i] + 18;
+			else if (StringView(argv[i]).substr(0, 13) == "-profile-use=") profile_use_path = argv[i] + 13;
+			else if (StringView(argv[i]) == "-split" && i + 1 < argc) codegen_options.shards = std::strtoul(argv[++i], nullptr, 10);
+			else if (StringView(argv[i]) == "-j") codegen_options.jobs = std::thread::hardware_concurrency();
+			else if (StringView(argv[i]).substr(0, 2) == "-j") codegen_options.jobs = std::strtoul(argv[i] + 2, nullptr, 10);
 			else source_path = argv[i];
 		}
 	}
@@ -23,17 +69,31 @@ int main(int argc, char** argv) {
 	arguments.parse(argc, argv);
 	if (arguments.source_path == nullptr) {
 		print_error(Printer(std::cerr), "no input file");
+		Printer(std::cerr).print("usage: moebc [-c | -js | -wasm | -x86] [options] file.moeb\n");
 		return EXIT_FAILURE;
 	}
-	Program program = Pass1::run(arguments.source_path);
-	program = Lowering::run(program);
-	program = Pass3::run(program);
-	program = DeadCodeElimination::run(program);
-	program = Inlining::run(program);
-	program = Pass1::run(program);
-	program = DeadCodeElimination::run(program);
-	program = MemoryManagement::run(program);
+	Profile profile;
+	if (arguments.profile_use_path) {
+		profile = Profile::read(arguments.profile_use_path);
+	}
+	Program program = PassManager::run(arguments.source_path, arguments.optimization_level, arguments.profile_use_path ? &profile : nullptr, arguments.codegen_options.profile_path != nullptr);
 	TailCallData tail_call_data;
-	Pass5::run(program, tail_call_data);
-	arguments.codegen(program, arguments.source_path, tail_call_data);
+	Statistics::time("Pass5", [&]() {
+		Pass5::run(program, tail_call_data);
+	});
+	Statistics::time("codegen", [&]() {
+		arguments.codegen(program, arguments.source_path, tail_call_data, arguments.codegen_options);
+	});
+	if (arguments.print_statistics) {
+		Statistics::print(Printer(std::cerr));
+	}
+	if (Statistics::time_phases) {
+		if (arguments.time_passes_path) {
+			std::ofstream file(arguments.time_passes_path);
+			Statistics::print_json(Printer(file));
+		}
+		else {
+			Statistics::print_json(Printer(std::cerr));
+		}
+	}
 }
@@ -0,0 +1,19 @@
+#pragma once
+
+class CodegenOptions {
+public:
+	// number of threads generating function bodies, 1 generates them serially
+	unsigned int jobs = 1;
+	// number of C files the output is split into, 1 generates a single file
+	unsigned int shards = 1;
+	// share arrays and strings between copies and copy them on write
+	bool reference_counting = false;
+	// allocate small blocks from per-thread free lists instead of calling malloc and free
+	bool pool_allocation = false;
+	// file the executable writes its profile counters to, null for no counters
+	const char* profile_path = nullptr;
+	// count the calls and cycles of every function and the allocations of every type and write them to <source>.profile
+	bool runtime_profile = false;
+	// mark every function with a #line directive pointing to its source
+	bool line_directives = false;
+};
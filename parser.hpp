@@ -3,11 +3,12 @@
 #include "printer.hpp"
 #include "ast.hpp"
 #include <map>
+#include <array>
 #include <cstdlib>
 
 struct BinaryOperator {
 	const char* string;
-	using Create = Expression* (*)(const Expression* left, const Expression* right);
+	using Create = Expression* (*)(Program* program, const Expression* left, const Expression* right);
 	Create create;
 	constexpr BinaryOperator(const char* string, Create create): string(string), create(create) {}
 };
@@ -41,7 +42,7 @@ constexpr std::initializer_list<OperatorLevel> operators = {
 
 struct UnaryOperator {
 	const char* string;
-	using Create = Expression* (*)(const Expression* expression);
+	using Create = Expression* (*)(Program* program, const Expression* expression);
 	Create create;
 	constexpr UnaryOperator(const char* string, Create create): string(string), create(create) {}
 };
@@ -52,35 +53,122 @@ constexpr const char* intrinsics[] = {
 	"putChar",
 	"putStr",
 	"getChar",
+	"readAll",
+	"writeAll",
 	"arrayGet",
 	"arrayLength",
 	"arraySplice",
 	"stringPush",
 	"stringIterator",
 	"stringIteratorGetNext",
+	"stringBuilder",
+	"stringBuilderPush",
+	"stringBuilderToString",
+	"slice",
+	"sliceGetNext",
+	"sliceToArray",
+	"parallelMap",
+	"parallelReduce",
 	"reference",
 	"typeOf",
 	"arrayType",
+	"sliceType",
 	"tupleType",
 	"referenceType",
 	"error",
 	"import"
 };
 
+enum class Keyword {
+	NONE,
+	LET,
+	RETURN,
+	FUNC,
+	STRUCT,
+	ENUM,
+	IF,
+	ELSE,
+	SWITCH,
+	FALSE,
+	TRUE,
+	VOID,
+	INT_TYPE,
+	STRING_TYPE,
+	STRING_ITERATOR_TYPE,
+	STRING_BUILDER_TYPE,
+	VOID_TYPE
+};
+
+struct KeywordEntry {
+	StringView string;
+	Keyword keyword = Keyword::NONE;
+};
+
+constexpr KeywordEntry keywords[] = {
+	{"let", Keyword::LET},
+	{"return", Keyword::RETURN},
+	{"func", Keyword::FUNC},
+	{"struct", Keyword::STRUCT},
+	{"enum", Keyword::ENUM},
+	{"if", Keyword::IF},
+	{"else", Keyword::ELSE},
+	{"switch", Keyword::SWITCH},
+	{"false", Keyword::FALSE},
+	{"true", Keyword::TRUE},
+	{"void", Keyword::VOID},
+	{"Int", Keyword::INT_TYPE},
+	{"String", Keyword::STRING_TYPE},
+	{"StringIterator", Keyword::STRING_ITERATOR_TYPE},
+	{"StringBuilder", Keyword::STRING_BUILDER_TYPE},
+	{"Void", Keyword::VOID_TYPE}
+};
+
+// a perfect hash of the keywords, so that every identifier is compared with at most one keyword
+class KeywordTable {
+	static constexpr std::size_t size = 64;
+	std::array<KeywordEntry, size> table;
+	static constexpr std::size_t hash(const StringView& s) {
+		return (s.size() + static_cast<unsigned char>(s[0]) + 3 * static_cast<unsigned char>(s[s.size() - 1])) % size;
+	}
+public:
+	bool is_perfect = true;
+	constexpr KeywordTable(): table() {
+		for (const KeywordEntry& entry: keywords) {
+			if (table[hash(entry.string)].keyword != Keyword::NONE) {
+				is_perfect = false;
+			}
+			table[hash(entry.string)] = entry;
+		}
+	}
+	constexpr Keyword look_up(const StringView& s) const {
+		if (s.empty()) {
+			return Keyword::NONE;
+		}
+		const KeywordEntry& entry = table[hash(s)];
+		return entry.string == s ? entry.keyword : Keyword::NONE;
+	}
+};
+
+constexpr KeywordTable keyword_table;
+static_assert(keyword_table.is_perfect, "keyword hash collision");
+
 class Scope {
 	Scope*& current_scope;
 	Scope* parent;
+	Program* program;
 	std::map<StringView, const Expression*> variables;
 	Closure* closure;
 	const Expression* self = nullptr;
 	Block* block;
 public:
-	Scope(Scope*& current_scope, Closure* closure, Block* block): current_scope(current_scope), closure(closure), block(block) {
+	Scope(Scope*& current_scope, Program* program, Closure* closure, Block* block): current_scope(current_scope), program(program), closure(closure), block(block) {
 		parent = current_scope;
 		current_scope = this;
 	}
-	Scope(Scope*& current_scope, Block* block): Scope(current_scope, nullptr, block) {}
-	Scope(Scope*& current_scope): Scope(current_scope, nullptr, nullptr) {}
+	Scope(Scope*& current_scope, Program* program, Block* block): Scope(current_scope, program, nullptr, block) {}
+	Scope(Scope*& current_scope, Closure* closure, Block* block): Scope(current_scope, current_scope->program, closure, block) {}
+	Scope(Scope*& current_scope, Block* block): Scope(current_scope, current_scope->program, nullptr, block) {}
+	Scope(Scope*& current_scope): Scope(current_scope, current_scope->program, nullptr, nullptr) {}
 	~Scope() {
 		current_scope = parent;
 	}
@@ -119,7 +207,7 @@ public:
 		}
 	}
 	template <class T, class... A> T* create(A&&... arguments) {
-		T* expression = new T(std::forward<A>(arguments)...);
+		T* expression = program->create<T>(std::forward<A>(arguments)...);
 		add_expression(expression);
 		return expression;
 	}
@@ -337,6 +425,16 @@ public:
 			return StringView();
 		}
 	}
+	// what p would parse without consuming it
+	template <class P> StringView lookahead(P p) const {
+		Cursor copy = cursor;
+		if (get_parser(p).parse(copy)) {
+			return copy - cursor;
+		}
+		else {
+			return StringView();
+		}
+	}
 	Parser(const SourceFile* file): cursor(file) {}
 	Parser(const Cursor& cursor): cursor(cursor) {}
 	const char* get_path() const {
@@ -371,6 +469,17 @@ class MoebiusParser: private Parser {
 			error(format("expected \"%\"", s));
 		}
 	}
+	// the keyword at the current position without consuming it
+	Keyword peek_keyword() const {
+		return keyword_table.look_up(lookahead(zero_or_more(alphanumeric)));
+	}
+	bool parse_keyword(Keyword next_keyword, Keyword expected) {
+		if (next_keyword != expected) {
+			return false;
+		}
+		parse(zero_or_more(alphanumeric));
+		return true;
+	}
 	bool parse_comment() {
 		if (parse("//")) {
 			parse(zero_or_more(sequence(not_("\n"), any_char)));
@@ -462,10 +571,18 @@ class MoebiusParser: private Parser {
 		}
 		return parse(zero_or_more(alphanumeric));
 	}
-	const BinaryOperator* parse_binary_operator(const OperatorLevel* level) {
-		for (const BinaryOperator& op: *level) {
-			if (parse(sequence(op.string, not_(operator_char)))) {
-				return &op;
+	// the binary operator at the current position and its level, without consuming it
+	// the whole run of operator characters has to match, so that "<=" is never read as "<"
+	const BinaryOperator* peek_binary_operator(std::size_t& level) const {
+		const StringView s = lookahead(zero_or_more(operator_char));
+		if (s.empty()) {
+			return nullptr;
+		}
+		for (level = 0; level < operators.size(); ++level) {
+			for (const BinaryOperator& op: operators.begin()[level]) {
+				if (s == op.string) {
+					return &op;
+				}
 			}
 		}
 		return nullptr;
@@ -489,9 +606,11 @@ class MoebiusParser: private Parser {
 	}
 	const Expression* parse_expression_last() {
 		const SourcePosition position = get_position();
+		const Keyword next_keyword = peek_keyword();
 		if (parse("{")) {
 			parse_white_space();
-			if (parse(peek(keyword("let"))) || parse(peek(keyword("return"))) || parse(peek(keyword("func"))) || parse(peek(keyword("struct"))) || parse(peek(keyword("enum")))) {
+			const Keyword statement_keyword = peek_keyword();
+			if (statement_keyword == Keyword::LET || statement_keyword == Keyword::RETURN || statement_keyword == Keyword::FUNC || statement_keyword == Keyword::STRUCT || statement_keyword == Keyword::ENUM) {
 				const Expression* expression = parse_scope();
 				parse_white_space();
 				expect("}");
@@ -499,8 +618,8 @@ class MoebiusParser: private Parser {
 			}
 			else {
 				StructTypeDeclaration* struct_type_declaration = current_scope->create<StructTypeDeclaration>();
-				StructTypeDefinition* struct_type_definition = new StructTypeDefinition(struct_type_declaration);
-				StructLiteral* struct_literal = new StructLiteral(struct_type_definition);
+				StructTypeDefinition* struct_type_definition = program->create<StructTypeDefinition>(struct_type_declaration);
+				StructLiteral* struct_literal = program->create<StructLiteral>(struct_type_definition);
 				struct_type_definition->set_position(position);
 				struct_literal->set_position(position);
 				while (parse(not_("}"))) {
@@ -557,7 +676,7 @@ class MoebiusParser: private Parser {
 				return tuple;
 			}
 		}
-		else if (parse(keyword("if"))) {
+		else if (parse_keyword(next_keyword, Keyword::IF)) {
 			parse_white_space();
 			expect("(");
 			parse_white_space();
@@ -565,7 +684,7 @@ class MoebiusParser: private Parser {
 			parse_white_space();
 			expect(")");
 			parse_white_space();
-			If* if_ = new If(condition);
+			If* if_ = program->create<If>(condition);
 			if_->set_position(position);
 			{
 				Scope scope(current_scope, if_->get_then_block());
@@ -583,7 +702,7 @@ class MoebiusParser: private Parser {
 			current_scope->add_expression(if_);
 			return if_;
 		}
-		else if (parse(keyword("switch"))) {
+		else if (parse_keyword(next_keyword, Keyword::SWITCH)) {
 			parse_white_space();
 			expect("(");
 			parse_white_space();
@@ -593,7 +712,7 @@ class MoebiusParser: private Parser {
 			parse_white_space();
 			expect("{");
 			parse_white_space();
-			Switch* switch_ = new Switch(enum_);
+			Switch* switch_ = program->create<Switch>(enum_);
 			switch_->set_position(position);
 			while (parse(not_("}"))) {
 				const StringView case_name = parse_identifier();
@@ -614,14 +733,14 @@ class MoebiusParser: private Parser {
 			current_scope->add_expression(switch_);
 			return switch_;
 		}
-		else if (parse(keyword("func"))) {
+		else if (parse_keyword(next_keyword, Keyword::FUNC)) {
 			parse_white_space();
 			expect("(");
 			parse_white_space();
-			Function* function = new Function();
+			Function* function = program->create_function();
 			function->set_path(get_path());
-			program->add_function(function);
-			Closure* closure = new Closure(function);
+			function->set_position(position);
+			Closure* closure = program->create<Closure>(function);
 			closure->set_position(position);
 			{
 				Scope scope(current_scope, closure, function->get_block());
@@ -658,12 +777,12 @@ class MoebiusParser: private Parser {
 			current_scope->add_expression(closure);
 			return closure;
 		}
-		else if (parse(keyword("struct"))) {
+		else if (parse_keyword(next_keyword, Keyword::STRUCT)) {
 			parse_white_space();
 			expect("{");
 			parse_white_space();
 			StructTypeDeclaration* struct_type_declaration = current_scope->create<StructTypeDeclaration>();
-			StructTypeDefinition* struct_type_definition = new StructTypeDefinition(struct_type_declaration);
+			StructTypeDefinition* struct_type_definition = program->create<StructTypeDefinition>(struct_type_declaration);
 			struct_type_definition->set_position(position);
 			while (parse(not_("}"))) {
 				const StringView field_name = parse_identifier();
@@ -682,12 +801,12 @@ class MoebiusParser: private Parser {
 			current_scope->add_expression(struct_type_definition);
 			return struct_type_definition;
 		}
-		else if (parse(keyword("enum"))) {
+		else if (parse_keyword(next_keyword, Keyword::ENUM)) {
 			parse_white_space();
 			expect("{");
 			parse_white_space();
 			EnumTypeDeclaration* enum_type_declaration = current_scope->create<EnumTypeDeclaration>();
-			EnumTypeDefinition* enum_type_definition = new EnumTypeDefinition(enum_type_declaration);
+			EnumTypeDefinition* enum_type_definition = program->create<EnumTypeDefinition>(enum_type_declaration);
 			enum_type_definition->set_position(position);
 			while (parse(not_("}"))) {
 				const StringView case_name = parse_identifier();
@@ -731,7 +850,7 @@ class MoebiusParser: private Parser {
 		}
 		else if (parse("[")) {
 			parse_white_space();
-			ArrayLiteral* array_literal = new ArrayLiteral();
+			ArrayLiteral* array_literal = program->create<ArrayLiteral>();
 			array_literal->set_position(position);
 			while (parse(not_("]"))) {
 				array_literal->add_element(parse_expression());
@@ -745,37 +864,42 @@ class MoebiusParser: private Parser {
 			current_scope->add_expression(array_literal);
 			return array_literal;
 		}
-		else if (parse(keyword("false"))) {
+		else if (parse_keyword(next_keyword, Keyword::FALSE)) {
 			Expression* expression = current_scope->create<IntLiteral>(0);
 			expression->set_position(position);
 			return expression;
 		}
-		else if (parse(keyword("true"))) {
+		else if (parse_keyword(next_keyword, Keyword::TRUE)) {
 			Expression* expression = current_scope->create<IntLiteral>(1);
 			expression->set_position(position);
 			return expression;
 		}
-		else if (parse(keyword("void"))) {
+		else if (parse_keyword(next_keyword, Keyword::VOID)) {
 			Expression* expression = current_scope->create<VoidLiteral>();
 			expression->set_position(position);
 			return expression;
 		}
-		else if (parse(keyword("Int"))) {
+		else if (parse_keyword(next_keyword, Keyword::INT_TYPE)) {
 			Expression* expression = current_scope->create<TypeLiteral>(TypeInterner::get_int_type());
 			expression->set_position(position);
 			return expression;
 		}
-		else if (parse(keyword("String"))) {
+		else if (parse_keyword(next_keyword, Keyword::STRING_TYPE)) {
 			Expression* expression = current_scope->create<TypeLiteral>(TypeInterner::get_string_type());
 			expression->set_position(position);
 			return expression;
 		}
-		else if (parse(keyword("StringIterator"))) {
+		else if (parse_keyword(next_keyword, Keyword::STRING_ITERATOR_TYPE)) {
 			Expression* expression = current_scope->create<TypeLiteral>(TypeInterner::get_string_iterator_type());
 			expression->set_position(position);
 			return expression;
 		}
-		else if (parse(keyword("Void"))) {
+		else if (parse_keyword(next_keyword, Keyword::STRING_BUILDER_TYPE)) {
+			Expression* expression = current_scope->create<TypeLiteral>(TypeInterner::get_string_builder_type());
+			expression->set_position(position);
+			return expression;
+		}
+		else if (parse_keyword(next_keyword, Keyword::VOID_TYPE)) {
 			Expression* expression = current_scope->create<TypeLiteral>(TypeInterner::get_void_type());
 			expression->set_position(position);
 			return expression;
@@ -803,7 +927,7 @@ class MoebiusParser: private Parser {
 			parse_white_space();
 			expect("(");
 			parse_white_space();
-			Intrinsic* intrinsic = new Intrinsic(name);
+			Intrinsic* intrinsic = program->create<Intrinsic>(name);
 			intrinsic->set_position(position);
 			while (parse(not_(")"))) {
 				intrinsic->add_argument(parse_expression());
@@ -821,24 +945,46 @@ class MoebiusParser: private Parser {
 			error("expected an expression");
 		}
 	}
-	const Expression* parse_expression(const OperatorLevel* level = operators.begin()) {
-		if (level == operators.end()) {
+	const Expression* parse_unary_expression() {
+		const SourcePosition position = get_position();
+		if (const UnaryOperator* op = parse_unary_operator()) {
+			parse_white_space();
+			Expression* expression = op->create(program, parse_unary_expression());
+			expression->set_position(position);
+			current_scope->add_expression(expression);
+			return expression;
+		}
+		const Expression* expression = parse_expression_last();
+		parse_white_space();
+		while (true) {
 			const SourcePosition position = get_position();
-			if (const UnaryOperator* op = parse_unary_operator()) {
+			if (parse("(")) {
+				parse_white_space();
+				ClosureCall* call = program->create<ClosureCall>(expression);
+				call->set_position(position);
+				while (parse(not_(")"))) {
+					call->add_argument(parse_expression());
+					parse_white_space();
+					if (!parse(",")) {
+						break;
+					}
+					parse_white_space();
+				}
+				expect(")");
+				current_scope->add_expression(call);
+				expression = call;
 				parse_white_space();
-				Expression* expression = op->create(parse_expression(level));
-				expression->set_position(position);
-				current_scope->add_expression(expression);
-				return expression;
 			}
-			const Expression* expression = parse_expression_last();
-			parse_white_space();
-			while (true) {
-				const SourcePosition position = get_position();
+			else if (parse(".")) {
+				parse_white_space();
+				StringView name = parse_identifier();
+				parse_white_space();
+				const SourcePosition method_call_position = get_position();
 				if (parse("(")) {
 					parse_white_space();
-					ClosureCall* call = new ClosureCall(expression);
-					call->set_position(position);
+					const Expression* method = current_scope->look_up(name);
+					MethodCall* call = program->create<MethodCall>(expression, name, method);
+					call->set_position(method_call_position);
 					while (parse(not_(")"))) {
 						call->add_argument(parse_expression());
 						parse_white_space();
@@ -852,80 +998,64 @@ class MoebiusParser: private Parser {
 					expression = call;
 					parse_white_space();
 				}
-				else if (parse(".")) {
-					parse_white_space();
-					StringView name = parse_identifier();
+				else {
+					StructAccess* struct_access = current_scope->create<StructAccess>(expression, name);
+					struct_access->set_position(position);
+					expression = struct_access;
+				}
+			}
+			else if (parse("{")) {
+				parse_white_space();
+				StructLiteral* struct_literal = program->create<StructLiteral>(expression);
+				struct_literal->set_position(position);
+				while (parse(not_("}"))) {
+					const StringView field_name = parse_identifier();
 					parse_white_space();
-					const SourcePosition method_call_position = get_position();
-					if (parse("(")) {
+					const Expression* field;
+					if (parse(":")) {
 						parse_white_space();
-						const Expression* method = current_scope->look_up(name);
-						MethodCall* call = new MethodCall(expression, name, method);
-						call->set_position(method_call_position);
-						while (parse(not_(")"))) {
-							call->add_argument(parse_expression());
-							parse_white_space();
-							if (!parse(",")) {
-								break;
-							}
-							parse_white_space();
-						}
-						expect(")");
-						current_scope->add_expression(call);
-						expression = call;
+						field = parse_expression();
 						parse_white_space();
 					}
 					else {
-						StructAccess* struct_access = current_scope->create<StructAccess>(expression, name);
-						struct_access->set_position(position);
-						expression = struct_access;
-					}
-				}
-				else if (parse("{")) {
-					parse_white_space();
-					StructLiteral* struct_literal = new StructLiteral(expression);
-					struct_literal->set_position(position);
-					while (parse(not_("}"))) {
-						const StringView field_name = parse_identifier();
-						parse_white_space();
-						const Expression* field;
-						if (parse(":")) {
-							parse_white_space();
-							field = parse_expression();
-							parse_white_space();
-						}
-						else {
-							field = current_scope->look_up(field_name);
-							if (field == nullptr) {
-								error(format("undefined variable \"%\"", field_name));
-							}
-						}
-						struct_literal->add_field(field_name, field);
-						if (!parse(",")) {
-							break;
+						field = current_scope->look_up(field_name);
+						if (field == nullptr) {
+							error(format("undefined variable \"%\"", field_name));
 						}
-						parse_white_space();
 					}
-					expect("}");
-					current_scope->add_expression(struct_literal);
-					TypeAssert* type_assert = current_scope->create<TypeAssert>(struct_literal, expression);
-					type_assert->set_position(position);
-					expression = struct_literal;
+					struct_literal->add_field(field_name, field);
+					if (!parse(",")) {
+						break;
+					}
 					parse_white_space();
 				}
-				else {
-					break;
-				}
+				expect("}");
+				current_scope->add_expression(struct_literal);
+				TypeAssert* type_assert = current_scope->create<TypeAssert>(struct_literal, expression);
+				type_assert->set_position(position);
+				expression = struct_literal;
+				parse_white_space();
+			}
+			else {
+				break;
 			}
-			return expression;
 		}
-		const Expression* left = parse_expression(level + 1);
+		return expression;
+	}
+	// precedence climbing, the operators of a level are left associative
+	const Expression* parse_expression(std::size_t min_level = 0) {
+		const Expression* left = parse_unary_expression();
 		parse_white_space();
 		SourcePosition position = get_position();
-		while (const BinaryOperator* op = parse_binary_operator(level)) {
+		std::size_t level;
+		while (const BinaryOperator* op = peek_binary_operator(level)) {
+			if (level < min_level) {
+				break;
+			}
+			parse(op->string);
 			parse_white_space();
 			const Expression* right = parse_expression(level + 1);
-			Expression* expression = op->create(left, right);
+			Expression* expression = op->create(program, left, right);
 			expression->set_position(position);
 			current_scope->add_expression(expression);
 			left = expression;
@@ -951,7 +1081,8 @@ class MoebiusParser: private Parser {
 		Scope scope(current_scope);
 		while (true) {
 			const SourcePosition position = get_position();
-			if (parse(keyword("let"))) {
+			const Keyword next_keyword = peek_keyword();
+			if (parse_keyword(next_keyword, Keyword::LET)) {
 				parse_white_space();
 				std::vector<std::tuple<StringView, SourcePosition, const Expression*>> element_names;
 				if (parse("(")) {
@@ -993,16 +1124,17 @@ class MoebiusParser: private Parser {
 				}
 				parse_white_space();
 			}
-			else if (parse(keyword("func"))) {
+			else if (parse_keyword(next_keyword, Keyword::FUNC)) {
 				parse_white_space();
 				const StringView name = parse_identifier();
 				parse_white_space();
 				expect("(");
 				parse_white_space();
-				Function* function = new Function();
+				Function* function = program->create_function();
 				function->set_path(get_path());
-				program->add_function(function);
-				Closure* closure = new Closure(function);
+				function->set_position(position);
+				function->set_name(std::string(name.begin(), name.end()));
+				Closure* closure = program->create<Closure>(function);
 				closure->set_position(position);
 				{
 					Scope scope(current_scope, closure, function->get_block());
@@ -1042,7 +1174,7 @@ class MoebiusParser: private Parser {
 				current_scope->add_variable(name, closure);
 				parse_white_space();
 			}
-			else if (parse(keyword("struct"))) {
+			else if (parse_keyword(next_keyword, Keyword::STRUCT)) {
 				parse_white_space();
 				const StringView name = parse_identifier();
 				parse_white_space();
@@ -1050,7 +1182,7 @@ class MoebiusParser: private Parser {
 				parse_white_space();
 				StructTypeDeclaration* struct_type_declaration = current_scope->create<StructTypeDeclaration>();
 				current_scope->add_variable(name, struct_type_declaration);
-				StructTypeDefinition* struct_type_definition = new StructTypeDefinition(struct_type_declaration);
+				StructTypeDefinition* struct_type_definition = program->create<StructTypeDefinition>(struct_type_declaration);
 				struct_type_definition->set_position(position);
 				while (parse(not_("}"))) {
 					const StringView field_name = parse_identifier();
@@ -1069,7 +1201,7 @@ class MoebiusParser: private Parser {
 				parse_white_space();
 				current_scope->add_expression(struct_type_definition);
 			}
-			else if (parse(keyword("enum"))) {
+			else if (parse_keyword(next_keyword, Keyword::ENUM)) {
 				parse_white_space();
 				const StringView name = parse_identifier();
 				parse_white_space();
@@ -1077,7 +1209,7 @@ class MoebiusParser: private Parser {
 				parse_white_space();
 				EnumTypeDeclaration* enum_type_declaration = current_scope->create<EnumTypeDeclaration>();
 				current_scope->add_variable(name, enum_type_declaration);
-				EnumTypeDefinition* enum_type_definition = new EnumTypeDefinition(enum_type_declaration);
+				EnumTypeDefinition* enum_type_definition = program->create<EnumTypeDefinition>(enum_type_declaration);
 				enum_type_definition->set_position(position);
 				while (parse(not_("}"))) {
 					const StringView case_name = parse_identifier();
@@ -1113,10 +1245,9 @@ public:
 	MoebiusParser(const SourceFile* file, Program* program): Parser(file), program(program) {}
 	const Function* parse_program() {
 		parse_white_space();
-		Function* main_function = new Function();
+		Function* main_function = program->create_function();
 		main_function->set_path(get_path());
-		program->add_function(main_function);
-		Scope scope(current_scope, main_function->get_block());
+		Scope scope(current_scope, program, main_function->get_block());
 		const Expression* expression = parse_scope();
 		current_scope->create<Return>(expression);
 		parse_white_space();
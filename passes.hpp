@@ -1,7 +1,11 @@
 #pragma once
 
 #include "ast.hpp"
+#include "statistics.hpp"
+#include "profile.hpp"
+#include "interpreter.hpp"
 #include <filesystem>
+#include <unordered_map>
 
 // type checking, monomorphization, and constant propagation
 class Pass1: public Visitor<const Expression*> {
@@ -36,13 +40,18 @@ class Pass1: public Visitor<const Expression*> {
 	struct FunctionTableKey {
 		const Function* old_function;
 		std::vector<const Type*> argument_types;
-		FunctionTableKey(const Function* old_function): old_function(old_function) {}
-		FunctionTableKey() {}
-		bool operator <(const FunctionTableKey& rhs) const {
-			return std::make_pair(old_function, std::ref(argument_types)) < std::make_pair(rhs.old_function, std::ref(rhs.argument_types));
+		std::size_t hash;
+		FunctionTableKey(const Function* old_function, std::vector<const Type*>&& argument_types = {}): old_function(old_function), argument_types(std::move(argument_types)), hash(hash_combine(hash_pointer(old_function), this->argument_types)) {}
+		bool operator ==(const FunctionTableKey& rhs) const {
+			return hash == rhs.hash && old_function == rhs.old_function && argument_types == rhs.argument_types;
 		}
 	};
-	using FunctionTable = std::map<FunctionTableKey, Function*>;
+	struct FunctionTableKeyHash {
+		std::size_t operator ()(const FunctionTableKey& key) const {
+			return key.hash;
+		}
+	};
+	using FunctionTable = std::unordered_map<FunctionTableKey, Function*, FunctionTableKeyHash>;
 	using FileTable = std::map<std::string, const Function*>;
 	Program* old_program;
 	Program* program;
@@ -51,7 +60,9 @@ class Pass1: public Visitor<const Expression*> {
 	const FunctionTableKey& key;
 	const Type* case_type;
 	const Expression* case_variable;
-	using ExpressionTable = std::map<const Expression*, const Expression*>;
+	using ExpressionTable = IndexTable<Expression, const Expression*>;
+	// results of evaluated calls that need more literals are not inlined
+	static constexpr std::size_t MAX_LITERAL_SIZE = 1 << 16;
 	ExpressionTable& expression_table;
 	Block* destination_block;
 	bool omit_return;
@@ -85,7 +96,7 @@ class Pass1: public Visitor<const Expression*> {
 		std::exit(EXIT_FAILURE);
 	}
 	template <class T, class... A> T* create(A&&... arguments) {
-		T* expression = new T(std::forward<A>(arguments)...);
+		T* expression = program->create<T>(std::forward<A>(arguments)...);
 		destination_block->add_expression(expression);
 		return expression;
 	}
@@ -373,55 +384,60 @@ public:
 	}
 	const Expression* visit_call(const Expression& call, const Function* function, const Expression* closure, const Expression* object, const std::vector<const Expression*>& arguments) {
 		FunctionCall* new_call = create<FunctionCall>();
-		FunctionTableKey new_key;
+		std::vector<const Type*> argument_types;
 		if (closure) {
 			if (closure->get_type_id() != TypeId::CLOSURE) {
 				error(call, "call to a value that is not a function");
 			}
-			new_key.old_function = static_cast<const ClosureType*>(closure->get_type())->get_function();
+			function = static_cast<const ClosureType*>(closure->get_type())->get_function();
 			new_call->add_argument(closure);
-			new_key.argument_types.push_back(closure->get_type());
-		}
-		else {
-			new_key.old_function = function;
+			argument_types.push_back(closure->get_type());
 		}
 		if (object) {
 			const Expression* new_argument = expression_table[object];
 			new_call->add_argument(new_argument);
-			new_key.argument_types.push_back(new_argument->get_type());
+			argument_types.push_back(new_argument->get_type());
 		}
 		for (const Expression* argument: arguments) {
 			const Expression* new_argument = expression_table[argument];
 			new_call->add_argument(new_argument);
-			new_key.argument_types.push_back(new_argument->get_type());
+			argument_types.push_back(new_argument->get_type());
 		}
-		if (new_key.argument_types.size() != new_key.old_function->get_arguments()) {
-			std::size_t expected_arguments = new_key.old_function->get_arguments() - 1;
+		if (argument_types.size() != function->get_arguments()) {
+			std::size_t expected_arguments = function->get_arguments() - 1;
 			if (object) {
 				expected_arguments -= 1;
 			}
 			error(call, format("call with % to a function that accepts %", print_plural("argument", arguments.size()), print_plural("argument", expected_arguments)));
 		}
 
-		if (function_table[new_key] == nullptr) {
-			Function* new_function = new Function(new_key.argument_types, new_key.old_function->get_return_type());
-			program->add_function(new_function);
-			function_table[new_key] = new_function;
-			const Expression* new_expression = evaluate(new_key, new_function->get_block(), new_key.old_function->get_block());
+		const Function* new_function = get_specialization(call, function, std::move(argument_types));
+		new_call->set_type(new_function->get_return_type());
+		new_call->set_function(new_function);
+		return new_call;
+	}
+	// the specialization of function for the argument types, which is created on first use
+	const Function* get_specialization(const Expression& call, const Function* function, std::vector<const Type*>&& argument_types) {
+		const FunctionTableKey new_key(function, std::move(argument_types));
+		Function*& new_function = function_table[new_key];
+		if (new_function == nullptr) {
+			Statistics::specializations += 1;
+			new_function = program->create_function(new_key.argument_types, function->get_return_type());
+			new_function->set_source(function);
+			const Expression* new_expression = evaluate(new_key, new_function->get_block(), function->get_block());
 			if (new_function->get_return_type() && new_function->get_return_type() != new_expression->get_type()) {
 				error(call, format("function does not return the declared return type %", print_type(new_function->get_return_type())));
 			}
 			new_function->set_return_type(new_expression->get_type());
 		}
 		else {
+			Statistics::specialization_cache_hits += 1;
 			// detect recursion
-			if (function_table[new_key]->get_return_type() == nullptr) {
+			if (new_function->get_return_type() == nullptr) {
 				error(call, "cannot determine return type of recursive call");
 			}
 		}
-		new_call->set_type(function_table[new_key]->get_return_type());
-		new_call->set_function(function_table[new_key]);
-		return new_call;
+		return new_function;
 	}
 	const Expression* visit_closure_call(const ClosureCall& call) override {
 		const Expression* closure = expression_table[call.get_closure()];
@@ -470,7 +486,155 @@ public:
 		}
 		error(call, "invalid method call");
 	}
+	// the number of literals needed to represent value, or 0 if it cannot be represented
+	static std::size_t get_literal_size(const Interpreter::Value& value, const Type* type) {
+		switch (type->get_id()) {
+		case TypeId::INT:
+		case TypeId::STRING:
+		case TypeId::VOID:
+			return 1;
+		case TypeId::ARRAY:
+		{
+			if (value.elements->empty()) {
+				return 0;
+			}
+			const Type* element_type = static_cast<const ArrayType*>(type)->get_element_type();
+			std::size_t size = 1;
+			for (const Interpreter::Value& element: *value.elements) {
+				const std::size_t element_size = get_literal_size(element, element_type);
+				if (element_size == 0) {
+					return 0;
+				}
+				size += element_size;
+			}
+			return size;
+		}
+		case TypeId::TUPLE:
+		{
+			const std::vector<const Type*>& element_types = static_cast<const TupleType*>(type)->get_element_types();
+			std::size_t size = 1;
+			for (std::size_t i = 0; i < element_types.size(); ++i) {
+				const std::size_t element_size = get_literal_size((*value.elements)[i], element_types[i]);
+				if (element_size == 0) {
+					return 0;
+				}
+				size += element_size;
+			}
+			return size;
+		}
+		case TypeId::STRUCT:
+		{
+			const auto& fields = static_cast<const StructType*>(type)->get_fields();
+			std::size_t size = 1;
+			for (std::size_t i = 0; i < fields.size(); ++i) {
+				const std::size_t field_size = get_literal_size((*value.elements)[i], fields[i].second);
+				if (field_size == 0) {
+					return 0;
+				}
+				size += field_size;
+			}
+			return size;
+		}
+		case TypeId::ENUM:
+		{
+			const Type* case_type = static_cast<const EnumType*>(type)->get_cases()[value.number].second;
+			const std::size_t case_size = get_literal_size((*value.elements)[0], case_type);
+			return case_size == 0 ? 0 : case_size + 1;
+		}
+		case TypeId::REFERENCE:
+		{
+			const std::size_t reference_size = get_literal_size((*value.elements)[0], static_cast<const ReferenceType*>(type)->get_type());
+			return reference_size == 0 ? 0 : reference_size + 1;
+		}
+		default:
+			return 0;
+		}
+	}
+	const Expression* create_literal(const Interpreter::Value& value, const Type* type) {
+		switch (type->get_id()) {
+		case TypeId::INT:
+			return create<IntLiteral>(value.number);
+		case TypeId::STRING:
+			return create<StringLiteral>(*value.string);
+		case TypeId::ARRAY:
+		{
+			const Type* element_type = static_cast<const ArrayType*>(type)->get_element_type();
+			std::vector<const Expression*> elements;
+			for (const Interpreter::Value& element: *value.elements) {
+				elements.push_back(create_literal(element, element_type));
+			}
+			ArrayLiteral* array_literal = create<ArrayLiteral>(type);
+			for (const Expression* element: elements) {
+				array_literal->add_element(element);
+			}
+			return array_literal;
+		}
+		case TypeId::TUPLE:
+		{
+			const std::vector<const Type*>& element_types = static_cast<const TupleType*>(type)->get_element_types();
+			std::vector<const Expression*> elements;
+			for (std::size_t i = 0; i < element_types.size(); ++i) {
+				elements.push_back(create_literal((*value.elements)[i], element_types[i]));
+			}
+			TupleLiteral* tuple_literal = create<TupleLiteral>(type);
+			for (const Expression* element: elements) {
+				tuple_literal->add_element(element);
+			}
+			return tuple_literal;
+		}
+		case TypeId::STRUCT:
+		{
+			const auto& fields = static_cast<const StructType*>(type)->get_fields();
+			std::vector<const Expression*> elements;
+			for (std::size_t i = 0; i < fields.size(); ++i) {
+				elements.push_back(create_literal((*value.elements)[i], fields[i].second));
+			}
+			StructLiteral* struct_literal = create<StructLiteral>(type);
+			for (std::size_t i = 0; i < fields.size(); ++i) {
+				struct_literal->add_field(fields[i].first, elements[i]);
+			}
+			return struct_literal;
+		}
+		case TypeId::ENUM:
+		{
+			const Type* case_type = static_cast<const EnumType*>(type)->get_cases()[value.number].second;
+			const Expression* expression = create_literal((*value.elements)[0], case_type);
+			return create<EnumLiteral>(expression, value.number, type);
+		}
+		case TypeId::REFERENCE:
+		{
+			const Expression* expression = create_literal((*value.elements)[0], static_cast<const ReferenceType*>(type)->get_type());
+			Intrinsic* reference = create<Intrinsic>("reference", type);
+			reference->add_argument(expression);
+			return reference;
+		}
+		default:
+			return create<VoidLiteral>();
+		}
+	}
+	// evaluate calls with constant arguments at compile time
+	const Expression* evaluate_call(const FunctionCall& call) {
+		std::vector<Interpreter::Value> arguments(call.get_arguments().size());
+		for (std::size_t i = 0; i < arguments.size(); ++i) {
+			if (!Interpreter::get_value(expression_table[call.get_arguments()[i]], arguments[i])) {
+				return nullptr;
+			}
+		}
+		Interpreter::Value result;
+		if (!Interpreter::run(call.get_function(), arguments, result)) {
+			return nullptr;
+		}
+		const std::size_t size = get_literal_size(result, call.get_type());
+		if (size == 0 || size > MAX_LITERAL_SIZE) {
+			return nullptr;
+		}
+		Statistics::evaluated_calls += 1;
+		return create_literal(result, call.get_type());
+	}
 	const Expression* visit_function_call(const FunctionCall& call) override {
+		if (const Expression* result = evaluate_call(call)) {
+			return result;
+		}
 		return visit_call(call, call.get_function(), nullptr, nullptr, call.get_arguments());
 	}
 	void ensure_argument_count(const Intrinsic& intrinsic, std::size_t argument_count) {
@@ -497,6 +661,40 @@ public:
 			error(intrinsic, format("first argument of % must be an array", intrinsic.get_name()));
 		}
 	}
+	// the array or string a slice is a view of
+	const Type* get_sliced_type(const Intrinsic& intrinsic, const Type* type) {
+		if (type->get_id() == TypeId::SLICE) {
+			return static_cast<const SliceType*>(type)->get_array_type();
+		}
+		else if (type->get_id() == TypeId::ARRAY || type->get_id() == TypeId::STRING) {
+			return type;
+		}
+		else {
+			error(intrinsic, format("first argument of % must be an array, a string, or a slice", intrinsic.get_name()));
+		}
+	}
+	// the function a parallel intrinsic calls with its arguments from first_argument on followed by element_types
+	// before lowering these arguments are a single closure, afterwards they are the environment of the closure
+	const Function* get_parallel_function(const Intrinsic& intrinsic, std::size_t first_argument, std::vector<const Type*>&& element_types) {
+		const Function* function = intrinsic.get_function();
+		std::vector<const Type*> argument_types;
+		if (function == nullptr) {
+			const Expression* closure = expression_table[intrinsic.get_arguments()[first_argument]];
+			if (closure->get_type_id() != TypeId::CLOSURE) {
+				error(intrinsic, format("last argument of % must be a function", intrinsic.get_name()));
+			}
+			function = static_cast<const ClosureType*>(closure->get_type())->get_function();
+			argument_types.push_back(closure->get_type());
+		}
+		else for (std::size_t i = first_argument; i < intrinsic.get_arguments().size(); ++i) {
+			argument_types.push_back(expression_table[intrinsic.get_arguments()[i]]->get_type());
+		}
+		argument_types.insert(argument_types.end(), element_types.begin(), element_types.end());
+		if (argument_types.size() != function->get_arguments()) {
+			error(intrinsic, format("the function of % must accept %", intrinsic.get_name(), print_plural("argument", element_types.size())));
+		}
+		return get_specialization(intrinsic, function, std::move(argument_types));
+	}
 	Intrinsic* create_intrinsic(const Intrinsic& intrinsic, const Type* type = nullptr) {
 		Intrinsic* new_intrinsic = create<Intrinsic>(intrinsic.get_name(), type);
 		for (const Expression* argument: intrinsic.get_arguments()) {
@@ -525,6 +723,14 @@ public:
 			ensure_argument_types(intrinsic, {});
 			return create_intrinsic(intrinsic, TypeInterner::get_int_type());
 		}
+		else if (intrinsic.name_equals("readAll")) {
+			ensure_argument_types(intrinsic, {});
+			return create_intrinsic(intrinsic, TypeInterner::get_string_type());
+		}
+		else if (intrinsic.name_equals("writeAll")) {
+			ensure_argument_types(intrinsic, {TypeInterner::get_string_type()});
+			return create_intrinsic(intrinsic, TypeInterner::get_void_type());
+		}
 		else if (intrinsic.name_equals("arrayGet")) {
 			ensure_argument_count(intrinsic, 2);
 			const Expression* array = expression_table[intrinsic.get_arguments()[0]];
@@ -537,7 +743,11 @@ public:
 					return array_literal->get_elements()[index_literal->get_value()];
 				}
 			}
-			const Type* element_type = get_element_type(intrinsic, array->get_type());
+			const Type* array_type = array->get_type();
+			if (array_type->get_id() == TypeId::SLICE) {
+				array_type = static_cast<const SliceType*>(array_type)->get_array_type();
+			}
+			const Type* element_type = get_element_type(intrinsic, array_type);
 			if (index->get_type() != TypeInterner::get_int_type()) {
 				error(intrinsic, "second argument of arrayGet must be a number");
 			}
@@ -549,7 +759,10 @@ public:
 			if (const ArrayLiteral* array_literal = get_array_literal(array)) {
 				return create<IntLiteral>(array_literal->get_elements().size());
 			}
-			get_element_type(intrinsic, array->get_type());
+			// the length of a string slice is measured in the code units of the backend
+			if (array->get_type_id() != TypeId::SLICE) {
+				get_element_type(intrinsic, array->get_type());
+			}
 			return create_intrinsic(intrinsic, TypeInterner::get_int_type());
 		}
 		else if (intrinsic.name_equals("arraySplice")) {
@@ -613,6 +826,84 @@ public:
 			type.add_element_type(TypeInterner::get_int_type());
 			return create_intrinsic(intrinsic, TypeInterner::intern(&type));
 		}
+		else if (intrinsic.name_equals("stringBuilder")) {
+			ensure_argument_types(intrinsic, {});
+			return create_intrinsic(intrinsic, TypeInterner::get_string_builder_type());
+		}
+		else if (intrinsic.name_equals("stringBuilderPush")) {
+			ensure_argument_count(intrinsic, 2);
+			if (expression_table[intrinsic.get_arguments()[0]]->get_type() != TypeInterner::get_string_builder_type()) {
+				error(intrinsic, "first argument of stringBuilderPush must be a string builder");
+			}
+			const Type* argument_type = expression_table[intrinsic.get_arguments()[1]]->get_type();
+			if (!(argument_type == TypeInterner::get_int_type() || argument_type == TypeInterner::get_string_type())) {
+				error(intrinsic, "second argument of stringBuilderPush must be a number or a string");
+			}
+			return create_intrinsic(intrinsic, TypeInterner::get_string_builder_type());
+		}
+		else if (intrinsic.name_equals("stringBuilderToString")) {
+			ensure_argument_types(intrinsic, {TypeInterner::get_string_builder_type()});
+			return create_intrinsic(intrinsic, TypeInterner::get_string_type());
+		}
+		else if (intrinsic.name_equals("slice")) {
+			// slice(array) views the whole array, slice(array, start, end) a range of it
+			if (!(intrinsic.get_arguments().size() == 1 || intrinsic.get_arguments().size() == 3)) {
+				error(intrinsic, "slice takes 1 or 3 arguments");
+			}
+			const Type* array_type = get_sliced_type(intrinsic, expression_table[intrinsic.get_arguments()[0]]->get_type());
+			for (std::size_t i = 1; i < intrinsic.get_arguments().size(); ++i) {
+				if (expression_table[intrinsic.get_arguments()[i]]->get_type() != TypeInterner::get_int_type()) {
+					error(intrinsic, format("argument % of slice must be a number", print_number(i + 1)));
+				}
+			}
+			return create_intrinsic(intrinsic, TypeInterner::get_slice_type(array_type));
+		}
+		else if (intrinsic.name_equals("sliceGetNext")) {
+			const Type* slice_type = TypeInterner::get_slice_type(TypeInterner::get_string_type());
+			ensure_argument_types(intrinsic, {slice_type});
+			TupleType type;
+			type.add_element_type(slice_type);
+			type.add_element_type(TypeInterner::get_int_type());
+			type.add_element_type(TypeInterner::get_int_type());
+			return create_intrinsic(intrinsic, TypeInterner::intern(&type));
+		}
+		else if (intrinsic.name_equals("sliceToArray")) {
+			ensure_argument_count(intrinsic, 1);
+			const Type* slice_type = expression_table[intrinsic.get_arguments()[0]]->get_type();
+			if (slice_type->get_id() != TypeId::SLICE) {
+				error(intrinsic, "argument of sliceToArray must be a slice");
+			}
+			return create_intrinsic(intrinsic, static_cast<const SliceType*>(slice_type)->get_array_type());
+		}
+		else if (intrinsic.name_equals("parallelMap")) {
+			// parallelMap(array, f) is the array of f(element), the elements may be mapped on several threads
+			if (intrinsic.get_function() == nullptr) {
+				ensure_argument_count(intrinsic, 2);
+			}
+			const Type* element_type = get_element_type(intrinsic, expression_table[intrinsic.get_arguments()[0]]->get_type());
+			const Function* function = get_parallel_function(intrinsic, 1, {element_type});
+			Intrinsic* new_intrinsic = create_intrinsic(intrinsic, TypeInterner::get_array_type(function->get_return_type()));
+			new_intrinsic->set_function(function);
+			return new_intrinsic;
+		}
+		else if (intrinsic.name_equals("parallelReduce")) {
+			// parallelReduce(array, initial, f) combines initial and the elements with f
+			// ranges of the array may be combined on several threads, so f has to be associative and initial its identity
+			if (intrinsic.get_function() == nullptr) {
+				ensure_argument_count(intrinsic, 3);
+			}
+			const Type* element_type = get_element_type(intrinsic, expression_table[intrinsic.get_arguments()[0]]->get_type());
+			if (expression_table[intrinsic.get_arguments()[1]]->get_type() != element_type) {
+				error(intrinsic, format("argument 2 of parallelReduce must have type %", print_type(element_type)));
+			}
+			const Function* function = get_parallel_function(intrinsic, 2, {element_type, element_type});
+			if (function->get_return_type() != element_type) {
+				error(intrinsic, format("the function of parallelReduce must return %", print_type(element_type)));
+			}
+			Intrinsic* new_intrinsic = create_intrinsic(intrinsic, element_type);
+			new_intrinsic->set_function(function);
+			return new_intrinsic;
+		}
 		else if (intrinsic.name_equals("reference")) {
 			ensure_argument_count(intrinsic, 1);
 			const Type* type = expression_table[intrinsic.get_arguments()[0]]->get_type();
@@ -635,6 +926,18 @@ public:
 			const Type* element_type = static_cast<const TypeType*>(element_type_expression->get_type())->get_type();
 			return create<TypeLiteral>(TypeInterner::get_array_type(element_type));
 		}
+		else if (intrinsic.name_equals("sliceType")) {
+			ensure_argument_count(intrinsic, 1);
+			const Expression* array_type_expression = expression_table[intrinsic.get_arguments()[0]];
+			if (array_type_expression->get_type_id() != TypeId::TYPE) {
+				error(intrinsic, "argument of sliceType must be a type");
+			}
+			const Type* array_type = static_cast<const TypeType*>(array_type_expression->get_type())->get_type();
+			if (!(array_type->get_id() == TypeId::ARRAY || array_type->get_id() == TypeId::STRING)) {
+				error(intrinsic, "argument of sliceType must be an array type or String");
+			}
+			return create<TypeLiteral>(TypeInterner::get_slice_type(array_type));
+		}
 		else if (intrinsic.name_equals("tupleType")) {
 			ensure_argument_count(intrinsic, 1);
 			const Expression* tuple_type_expression = expression_table[intrinsic.get_arguments()[0]];
@@ -677,25 +980,27 @@ public:
 			}
 			const std::string path = get_import_path(key.old_function->get_path(), path_literal->get_value()).lexically_normal().string();
 			if (file_table[path] == nullptr) {
-				file_table[path] = MoebiusParser::parse_program(path.c_str(), old_program);
+				file_table[path] = ParseCache::parse_program(path.c_str(), old_program);
 			}
 			FunctionCall* new_call = create<FunctionCall>();
-			FunctionTableKey new_key(file_table[path]);
-			if (function_table[new_key] == nullptr) {
-				Function* new_function = new Function(nullptr);
-				program->add_function(new_function);
-				function_table[new_key] = new_function;
+			const FunctionTableKey new_key(file_table[path]);
+			Function*& new_function = function_table[new_key];
+			if (new_function == nullptr) {
+				Statistics::specializations += 1;
+				new_function = program->create_function(nullptr);
+				new_function->set_source(new_key.old_function);
 				const Expression* new_expression = evaluate(new_key, new_function->get_block(), new_key.old_function->get_block());
 				new_function->set_return_type(new_expression->get_type());
 			}
 			else {
+				Statistics::specialization_cache_hits += 1;
 				// detect recursion
-				if (function_table[new_key]->get_return_type() == nullptr) {
+				if (new_function->get_return_type() == nullptr) {
 					error(intrinsic, "cannot determine return type of recursive import");
 				}
 			}
-			new_call->set_type(function_table[new_key]->get_return_type());
-			new_call->set_function(function_table[new_key]);
+			new_call->set_type(new_function->get_return_type());
+			new_call->set_function(new_function);
 			return new_call;
 		}
 		else if (intrinsic.name_equals("copy")) {
@@ -797,12 +1102,12 @@ public:
 		Program old_program;
 		FileTable file_table;
 		const std::string path = std::filesystem::path(file_name).lexically_normal().string();
-		file_table[path] = MoebiusParser::parse_program(path.c_str(), &old_program);
+		file_table[path] = ParseCache::parse_program(path.c_str(), &old_program);
 		Program new_program;
 		FunctionTable function_table;
 		FunctionTableKey new_key(file_table[path]);
-		Function* new_function = new Function(TypeInterner::get_void_type());
-		new_program.add_function(new_function);
+		Function* new_function = new_program.create_function(TypeInterner::get_void_type());
+		new_function->set_source(new_key.old_function);
 		function_table[new_key] = new_function;
 		evaluate(&old_program, &new_program, file_table, function_table, new_key, new_function->get_block(), new_key.old_function->get_block());
 		return new_program;
@@ -813,8 +1118,8 @@ public:
 		FileTable file_table;
 		FunctionTable function_table;
 		FunctionTableKey new_key(main_function);
-		Function* new_function = new Function(main_function->get_return_type());
-		new_program.add_function(new_function);
+		Function* new_function = new_program.create_function(main_function->get_return_type());
+		new_function->set_source(main_function);
 		function_table[new_key] = new_function;
 		evaluate(&program, &new_program, file_table, function_table, new_key, new_function->get_block(), new_key.old_function->get_block());
 		return new_program;
@@ -822,16 +1127,21 @@ public:
 };
 
 // lower closures to tuples
+// the callee of every closure is known after monomorphization, so closure arguments are defunctionalized:
+// their environment is passed as separate arguments and accesses to it become direct uses of these arguments
 class Lowering: public Visitor<const Expression*> {
+	Program* program;
 	using TypeTable = std::map<const Type*, const Type*>;
 	TypeTable& type_table;
-	using FunctionTable = std::map<const Function*, Function*>;
+	using FunctionTable = IndexTable<Function, Function*>;
 	FunctionTable& function_table;
-	using ExpressionTable = std::map<const Expression*, const Expression*>;
+	using ExpressionTable = IndexTable<Expression, const Expression*>;
 	ExpressionTable& expression_table;
+	// the new index of the first argument of every argument of the current function
+	const std::vector<std::size_t>& argument_indices;
 	Block* destination_block;
 	template <class T, class... A> T* create(A&&... arguments) {
-		T* expression = new T(std::forward<A>(arguments)...);
+		T* expression = program->create<T>(std::forward<A>(arguments)...);
 		destination_block->add_expression(expression);
 		return expression;
 	}
@@ -883,10 +1193,24 @@ class Lowering: public Visitor<const Expression*> {
 	const Type* transform_type(const Type* type) {
 		return transform_type(type_table, type);
 	}
+	static bool is_closure(const Type* type) {
+		return type->get_id() == TypeId::CLOSURE;
+	}
+	static const std::vector<const Type*>& get_environment_types(const Type* type) {
+		return static_cast<const ClosureType*>(type)->get_environment_types();
+	}
+	// the elements of a lowered closure, taken directly from its tuple literal if possible
+	const Expression* get_environment_expression(const Expression* tuple, std::size_t index, const Type* type) {
+		GetTupleElement get_tuple_element(index);
+		if (const Expression* element = visit(get_tuple_element, tuple)) {
+			return element;
+		}
+		return create<TupleAccess>(tuple, index, type);
+	}
 public:
-	Lowering(TypeTable& type_table, FunctionTable& function_table, ExpressionTable& expression_table, Block* destination_block): type_table(type_table), function_table(function_table), expression_table(expression_table), destination_block(destination_block) {}
-	static void evaluate(TypeTable& type_table, FunctionTable& function_table, ExpressionTable& expression_table, Block* destination_block, const Block& source_block) {
-		Lowering lowering(type_table, function_table, expression_table, destination_block);
+	Lowering(Program* program, TypeTable& type_table, FunctionTable& function_table, ExpressionTable& expression_table, const std::vector<std::size_t>& argument_indices, Block* destination_block): program(program), type_table(type_table), function_table(function_table), expression_table(expression_table), argument_indices(argument_indices), destination_block(destination_block) {}
+	static void evaluate(Program* program, TypeTable& type_table, FunctionTable& function_table, ExpressionTable& expression_table, const std::vector<std::size_t>& argument_indices, Block* destination_block, const Block& source_block) {
+		Lowering lowering(program, type_table, function_table, expression_table, argument_indices, destination_block);
 		for (const Expression* expression: source_block) {
 			const Expression* new_expression = visit(lowering, expression);
 			if (new_expression) {
@@ -894,12 +1218,12 @@ public:
 			}
 		}
 	}
-	static void evaluate(TypeTable& type_table, FunctionTable& function_table, Block* destination_block, const Block& source_block) {
+	static void evaluate(Program* program, TypeTable& type_table, FunctionTable& function_table, const std::vector<std::size_t>& argument_indices, Block* destination_block, const Block& source_block) {
 		ExpressionTable expression_table;
-		evaluate(type_table, function_table, expression_table, destination_block, source_block);
+		evaluate(program, type_table, function_table, expression_table, argument_indices, destination_block, source_block);
 	}
 	void evaluate(Block* destination_block, const Block& source_block) {
-		evaluate(type_table, function_table, expression_table, destination_block, source_block);
+		evaluate(program, type_table, function_table, expression_table, argument_indices, destination_block, source_block);
 	}
 	const Expression* visit_int_literal(const IntLiteral& int_literal) override {
 		return create<IntLiteral>(int_literal.get_value());
@@ -972,24 +1296,60 @@ public:
 	}
 	const Expression* visit_closure_access(const ClosureAccess& closure_access) override {
 		const Expression* tuple = expression_table[closure_access.get_closure()];
-		return create<TupleAccess>(tuple, closure_access.get_index(), transform_type(closure_access.get_type()));
+		return get_environment_expression(tuple, closure_access.get_index(), transform_type(closure_access.get_type()));
 	}
-	Expression* visit_argument(const Argument& argument) override {
-		return create<Argument>(argument.get_index(), transform_type(argument.get_type()));
+	const Expression* visit_argument(const Argument& argument) override {
+		const std::size_t index = argument_indices[argument.get_index()];
+		if (is_closure(argument.get_type())) {
+			// the tuple is only kept if the closure is used as a whole
+			// the elements are added to the block before the tuple that uses them
+			const std::vector<const Type*>& environment_types = get_environment_types(argument.get_type());
+			TupleLiteral* tuple_literal = program->create<TupleLiteral>(transform_type(argument.get_type()));
+			for (std::size_t i = 0; i < environment_types.size(); ++i) {
+				tuple_literal->add_element(create<Argument>(index + i, transform_type(environment_types[i])));
+			}
+			destination_block->add_expression(tuple_literal);
+			return tuple_literal;
+		}
+		return create<Argument>(index, transform_type(argument.get_type()));
+	}
+	// adds the elements of the environment of a closure as separate arguments
+	template <class T> void add_environment_arguments(T* call, const Expression* closure) {
+		const Expression* tuple = expression_table[closure];
+		const std::vector<const Type*>& environment_types = get_environment_types(closure->get_type());
+		for (std::size_t i = 0; i < environment_types.size(); ++i) {
+			call->add_argument(get_environment_expression(tuple, i, transform_type(environment_types[i])));
+		}
 	}
 	const Expression* visit_function_call(const FunctionCall& call) override {
-		FunctionCall* new_call = create<FunctionCall>(transform_type(call.get_type()));
+		FunctionCall* new_call = program->create<FunctionCall>(transform_type(call.get_type()));
 		for (const Expression* argument: call.get_arguments()) {
-			new_call->add_argument(expression_table[argument]);
+			if (is_closure(argument->get_type())) {
+				add_environment_arguments(new_call, argument);
+			}
+			else {
+				new_call->add_argument(expression_table[argument]);
+			}
 		}
+		destination_block->add_expression(new_call);
 		new_call->set_function(function_table[call.get_function()]);
 		return new_call;
 	}
 	const Expression* visit_intrinsic(const Intrinsic& intrinsic) override {
-		Intrinsic* new_intrinsic = create<Intrinsic>(intrinsic.get_name(), transform_type(intrinsic.get_type()));
-		for (const Expression* argument: intrinsic.get_arguments()) {
+		Intrinsic* new_intrinsic = program->create<Intrinsic>(intrinsic.get_name(), transform_type(intrinsic.get_type()));
+		const std::vector<const Expression*>& arguments = intrinsic.get_arguments();
+		if (intrinsic.get_function()) {
+			// the last argument of a parallel intrinsic is the closure it calls
+			for (std::size_t i = 0; i + 1 < arguments.size(); ++i) {
+				new_intrinsic->add_argument(expression_table[arguments[i]]);
+			}
+			add_environment_arguments(new_intrinsic, arguments.back());
+			new_intrinsic->set_function(function_table[intrinsic.get_function()]);
+		}
+		else for (const Expression* argument: arguments) {
 			new_intrinsic->add_argument(expression_table[argument]);
 		}
+		destination_block->add_expression(new_intrinsic);
 		return new_intrinsic;
 	}
 	const Expression* visit_void_literal(const VoidLiteral&) override {
@@ -1018,18 +1378,28 @@ public:
 		Program new_program;
 		TypeTable type_table;
 		FunctionTable function_table;
+		IndexTable<Function, std::vector<std::size_t>> argument_table;
 		for (const Function* function: program) {
 			std::vector<const Type*> argument_types;
+			std::vector<std::size_t>& argument_indices = argument_table[function];
 			for (const Type* type: function->get_argument_types()) {
-				argument_types.push_back(transform_type(type_table, type));
+				argument_indices.push_back(argument_types.size());
+				if (is_closure(type)) {
+					for (const Type* environment_type: get_environment_types(type)) {
+						argument_types.push_back(transform_type(type_table, environment_type));
+					}
+				}
+				else {
+					argument_types.push_back(transform_type(type_table, type));
+				}
 			}
-			Function* new_function = new Function(argument_types, transform_type(type_table, function->get_return_type()));
-			new_program.add_function(new_function);
+			Function* new_function = new_program.create_function(argument_types, transform_type(type_table, function->get_return_type()));
+			new_function->set_source(function);
 			function_table[function] = new_function;
 		}
 		for (const Function* function: program) {
 			Function* new_function = function_table[function];
-			evaluate(type_table, function_table, new_function->get_block(), function->get_block());
+			evaluate(&new_program, type_table, function_table, argument_table[function], new_function->get_block(), function->get_block());
 		}
 		return new_program;
 	}
@@ -1037,9 +1407,9 @@ public:
 
 // dead expression elimination
 class DeadCodeElimination {
-	using FunctionTable = std::map<const Function*, Function*>;
-	using ExpressionTable = std::map<const Expression*, const Expression*>;
-	using UsageTable = std::map<const Expression*, bool>;
+	using FunctionTable = IndexTable<Function, Function*>;
+	using ExpressionTable = IndexTable<Expression, const Expression*>;
+	using UsageTable = IndexTable<Expression, bool>;
 	// TODO: remove unused arguments
 	class IsArgument: public Visitor<bool> {
 	public:
@@ -1053,7 +1423,7 @@ class DeadCodeElimination {
 	class Mark: public Visitor<void> {
 		UsageTable& usage_table;
 		void mark(const Expression* expression) {
-			if (usage_table.count(expression) > 0) {
+			if (usage_table.get(expression)) {
 				return;
 			}
 			usage_table[expression] = true;
@@ -1122,33 +1492,50 @@ class DeadCodeElimination {
 			mark(return_.get_expression());
 		}
 	};
+public:
+	// the live expressions of a whole program
+	// passes that copy the program can skip the dead ones instead of running a separate sweep
+	class Liveness {
+		UsageTable usage_table;
+	public:
+		Liveness(const Program& program) {
+			for (const Function* function: program) {
+				Mark::evaluate(usage_table, function->get_block());
+			}
+		}
+		bool is_live(const Expression* expression) const {
+			IsArgument is_argument;
+			return usage_table.get(expression) || visit(is_argument, expression);
+		}
+	};
+private:
 	class Sweep: public Visitor<const Expression*> {
+		Program* program;
 		FunctionTable& function_table;
-		const UsageTable& usage_table;
+		const Liveness& liveness;
 		ExpressionTable& expression_table;
 		Block* destination_block;
 		template <class T, class... A> T* create(A&&... arguments) {
-			T* expression = new T(std::forward<A>(arguments)...);
+			T* expression = program->create<T>(std::forward<A>(arguments)...);
 			destination_block->add_expression(expression);
 			return expression;
 		}
 	public:
-		Sweep(FunctionTable& function_table, const UsageTable& usage_table, ExpressionTable& expression_table, Block* destination_block): function_table(function_table), usage_table(usage_table), expression_table(expression_table), destination_block(destination_block) {}
-		static void evaluate(FunctionTable& function_table, const UsageTable& usage_table, ExpressionTable& expression_table, Block* destination_block, const Block& source_block) {
-			IsArgument is_argument;
-			Sweep sweep(function_table, usage_table, expression_table, destination_block);
+		Sweep(Program* program, FunctionTable& function_table, const Liveness& liveness, ExpressionTable& expression_table, Block* destination_block): program(program), function_table(function_table), liveness(liveness), expression_table(expression_table), destination_block(destination_block) {}
+		static void evaluate(Program* program, FunctionTable& function_table, const Liveness& liveness, ExpressionTable& expression_table, Block* destination_block, const Block& source_block) {
+			Sweep sweep(program, function_table, liveness, expression_table, destination_block);
 			for (const Expression* expression: source_block) {
-				if (usage_table.count(expression) > 0 || visit(is_argument, expression)) {
+				if (liveness.is_live(expression)) {
 					expression_table[expression] = visit(sweep, expression);
 				}
 			}
 		}
-		static void evaluate(FunctionTable& function_table, const UsageTable& usage_table, Block* destination_block, const Block& source_block) {
+		static void evaluate(Program* program, FunctionTable& function_table, const Liveness& liveness, Block* destination_block, const Block& source_block) {
 			ExpressionTable expression_table;
-			evaluate(function_table, usage_table, expression_table, destination_block, source_block);
+			evaluate(program, function_table, liveness, expression_table, destination_block, source_block);
 		}
 		void evaluate(Block* destination_block, const Block& source_block) {
-			evaluate(function_table, usage_table, expression_table, destination_block, source_block);
+			evaluate(program, function_table, liveness, expression_table, destination_block, source_block);
 		}
 		const Expression* visit_int_literal(const IntLiteral& int_literal) override {
 			return create<IntLiteral>(int_literal.get_value());
@@ -1228,6 +1615,9 @@ class DeadCodeElimination {
 			for (const Expression* argument: intrinsic.get_arguments()) {
 				new_intrinsic->add_argument(expression_table[argument]);
 			}
+			if (intrinsic.get_function()) {
+				new_intrinsic->set_function(function_table[intrinsic.get_function()]);
+			}
 			return new_intrinsic;
 		}
 		const Expression* visit_void_literal(const VoidLiteral&) override {
@@ -1248,15 +1638,14 @@ public:
 		Program new_program;
 		FunctionTable function_table;
 		for (const Function* function: program) {
-			Function* new_function = new Function(function->get_argument_types(), function->get_return_type());
-			new_program.add_function(new_function);
+			Function* new_function = new_program.create_function(function->get_argument_types(), function->get_return_type());
+			new_function->set_source(function);
 			function_table[function] = new_function;
 		}
+		const Liveness liveness(program);
 		for (const Function* function: program) {
 			Function* new_function = function_table[function];
-			UsageTable usage_table;
-			Mark::evaluate(usage_table, function->get_block());
-			Sweep::evaluate(function_table, usage_table, new_function->get_block(), function->get_block());
+			Sweep::evaluate(&new_program, function_table, liveness, new_function->get_block(), function->get_block());
 		}
 		return new_program;
 	}
@@ -1271,22 +1660,35 @@ class Inlining {
 		std::size_t callers = 0;
 		bool evaluating = false;
 		bool recursive = false;
+		bool hot = false;
+		bool cold = false;
+		bool instrument = false;
+		// called by a parallel intrinsic, which needs a function to call
+		bool parallel = false;
 		bool should_inline() const {
 			if (recursive) return false;
 			if (callers == 0) return false; // the main function
+			if (parallel) return false;
+			if (cold) return expressions <= 5 && calls == 0; // keep rarely executed code out of its callers
+			if (hot) return callers == 1 || expressions <= 40;
 			if (callers == 1) return true;
 			return expressions <= 5 && calls == 0;
 		}
 	};
-	using FunctionTable = std::map<const Function*, FunctionTableEntry>;
-	using ExpressionTable = std::map<const Expression*, const Expression*>;
+	using FunctionTable = IndexTable<Function, FunctionTableEntry>;
+	using ExpressionTable = IndexTable<Expression, const Expression*>;
+	using Liveness = DeadCodeElimination::Liveness;
 	class Analyze: public Visitor<void> {
 		FunctionTable& function_table;
+		const Liveness& liveness;
 		const Function* function;
 	public:
-		Analyze(FunctionTable& function_table, const Function* function): function_table(function_table), function(function) {}
+		Analyze(FunctionTable& function_table, const Liveness& liveness, const Function* function): function_table(function_table), liveness(liveness), function(function) {}
 		void evaluate(const Block& block) {
 			for (const Expression* expression: block) {
+				if (!liveness.is_live(expression)) {
+					continue;
+				}
 				visit(*this, expression);
 				function_table[function].expressions += 1;
 			}
@@ -1300,42 +1702,56 @@ class Inlining {
 				evaluate(case_.second);
 			}
 		}
-		void visit_function_call(const FunctionCall& call) override {
-			if (function_table[call.get_function()].callers == 0) {
-				function_table[call.get_function()].callers += 1;
-				function_table[call.get_function()].evaluating = true;
-				Analyze analyze(function_table, call.get_function());
-				analyze.evaluate(call.get_function()->get_block());
-				function_table[call.get_function()].evaluating = false;
+		void add_call(const Function* callee) {
+			if (function_table[callee].callers == 0) {
+				function_table[callee].callers += 1;
+				function_table[callee].evaluating = true;
+				Analyze analyze(function_table, liveness, callee);
+				analyze.evaluate(callee->get_block());
+				function_table[callee].evaluating = false;
 			}
 			else {
-				function_table[call.get_function()].callers += 1;
-				if (function_table[call.get_function()].evaluating) {
-					function_table[call.get_function()].recursive = true;
+				function_table[callee].callers += 1;
+				if (function_table[callee].evaluating) {
+					function_table[callee].recursive = true;
 				}
 			}
 			function_table[function].calls += 1;
 		}
+		void visit_function_call(const FunctionCall& call) override {
+			add_call(call.get_function());
+		}
+		void visit_intrinsic(const Intrinsic& intrinsic) override {
+			if (intrinsic.get_function()) {
+				function_table[intrinsic.get_function()].parallel = true;
+				add_call(intrinsic.get_function());
+			}
+		}
 	};
 	class Replace: public Visitor<const Expression*> {
 		Program* program;
 		FunctionTable& function_table;
+		const Liveness& liveness;
 		const Function* function;
 		const std::vector<const Expression*>& arguments;
 		ExpressionTable& expression_table;
 		Block* destination_block;
 		bool omit_return;
+		const Expression* counter;
 		const Expression* result = nullptr;
 		template <class T, class... A> T* create(A&&... arguments) {
-			T* expression = new T(std::forward<A>(arguments)...);
+			T* expression = program->create<T>(std::forward<A>(arguments)...);
 			destination_block->add_expression(expression);
 			return expression;
 		}
 	public:
-		Replace(Program* program, FunctionTable& function_table, const Function* function, const std::vector<const Expression*>& arguments, ExpressionTable& expression_table, Block* destination_block, bool omit_return): program(program), function_table(function_table), function(function), arguments(arguments), expression_table(expression_table), destination_block(destination_block), omit_return(omit_return) {}
-		static const Expression* evaluate(Program* program, FunctionTable& function_table, const Function* function, const std::vector<const Expression*>& arguments, ExpressionTable& expression_table, Block* destination_block, const Block& source_block, bool omit_return) {
-			Replace replace(program, function_table, function, arguments, expression_table, destination_block, omit_return);
+		Replace(Program* program, FunctionTable& function_table, const Liveness& liveness, const Function* function, const std::vector<const Expression*>& arguments, ExpressionTable& expression_table, Block* destination_block, bool omit_return, const Expression* counter): program(program), function_table(function_table), liveness(liveness), function(function), arguments(arguments), expression_table(expression_table), destination_block(destination_block), omit_return(omit_return), counter(counter) {}
+		static const Expression* evaluate(Program* program, FunctionTable& function_table, const Liveness& liveness, const Function* function, const std::vector<const Expression*>& arguments, ExpressionTable& expression_table, Block* destination_block, const Block& source_block, bool omit_return, const Expression* counter = nullptr) {
+			Replace replace(program, function_table, liveness, function, arguments, expression_table, destination_block, omit_return, counter);
 			for (const Expression* expression: source_block) {
+				if (!liveness.is_live(expression)) {
+					continue;
+				}
 				const Expression* new_expression = visit(replace, expression);
 				if (new_expression) {
 					expression_table[expression] = new_expression;
@@ -1343,26 +1759,41 @@ class Inlining {
 			}
 			return replace.result;
 		}
+		// counts the executions of the body of the original function, the result is bound to it to keep it alive
+		static const Expression* create_counter(Program* program, FunctionTable& function_table, const Function* function, Block* destination_block) {
+			if (!function_table[function].instrument) {
+				return nullptr;
+			}
+			IntLiteral* index = program->create<IntLiteral>(function->get_index());
+			destination_block->add_expression(index);
+			Intrinsic* counter = program->create<Intrinsic>("profileCounter", TypeInterner::get_void_type());
+			counter->add_argument(index);
+			destination_block->add_expression(counter);
+			return counter;
+		}
 		// main function
-		static const Expression* evaluate(Program* program, FunctionTable& function_table, const Function* function, Block* destination_block, const Block& source_block) {
+		static const Expression* evaluate(Program* program, FunctionTable& function_table, const Liveness& liveness, const Function* function, Block* destination_block, const Block& source_block) {
 			std::vector<const Expression*> arguments;
 			ExpressionTable expression_table;
-			return evaluate(program, function_table, function, arguments, expression_table, destination_block, source_block, false);
+			const Expression* counter = create_counter(program, function_table, function, destination_block);
+			return evaluate(program, function_table, liveness, function, arguments, expression_table, destination_block, source_block, false, counter);
 		}
 		// inlined functions
 		const Expression* evaluate(const Function* function, const std::vector<const Expression*>& arguments, Block* destination_block, const Block& source_block) {
 			ExpressionTable expression_table;
-			return evaluate(program, function_table, function, arguments, expression_table, destination_block, source_block, true);
+			const Expression* counter = create_counter(program, function_table, function, destination_block);
+			return evaluate(program, function_table, liveness, function, arguments, expression_table, destination_block, source_block, true, counter);
 		}
 		// non-inlined functions
 		const Expression* evaluate(const Function* function, Block* destination_block, const Block& source_block) {
 			std::vector<const Expression*> arguments;
 			ExpressionTable expression_table;
-			return evaluate(program, function_table, function, arguments, expression_table, destination_block, source_block, false);
+			const Expression* counter = create_counter(program, function_table, function, destination_block);
+			return evaluate(program, function_table, liveness, function, arguments, expression_table, destination_block, source_block, false, counter);
 		}
 		// if blocks
 		const Expression* evaluate(Block* destination_block, const Block& source_block) {
-			return evaluate(program, function_table, function, arguments, expression_table, destination_block, source_block, false);
+			return evaluate(program, function_table, liveness, function, arguments, expression_table, destination_block, source_block, false);
 		}
 		const Expression* visit_int_literal(const IntLiteral& int_literal) override {
 			return create<IntLiteral>(int_literal.get_value());
@@ -1447,21 +1878,28 @@ class Inlining {
 				for (const Expression* argument: call.get_arguments()) {
 					new_call->add_argument(expression_table[argument]);
 				}
-				if (function_table[call.get_function()].new_function == nullptr) {
-					Function* new_function = new Function(call.get_function()->get_argument_types(), call.get_function()->get_return_type());
-					program->add_function(new_function);
-					function_table[call.get_function()].new_function = new_function;
-					evaluate(call.get_function(), new_function->get_block(), call.get_function()->get_block());
-				}
-				new_call->set_function(function_table[call.get_function()].new_function);
+				new_call->set_function(get_new_function(call.get_function()));
 				return new_call;
 			}
 		}
+		// the copy of a function that is not inlined
+		const Function* get_new_function(const Function* function) {
+			if (function_table[function].new_function == nullptr) {
+				Function* new_function = program->create_function(function->get_argument_types(), function->get_return_type());
+				new_function->set_source(function);
+				function_table[function].new_function = new_function;
+				evaluate(function, new_function->get_block(), function->get_block());
+			}
+			return function_table[function].new_function;
+		}
 		const Expression* visit_intrinsic(const Intrinsic& intrinsic) override {
 			Intrinsic* new_intrinsic = create<Intrinsic>(intrinsic.get_name(), intrinsic.get_type());
 			for (const Expression* argument: intrinsic.get_arguments()) {
 				new_intrinsic->add_argument(expression_table[argument]);
 			}
+			if (intrinsic.get_function()) {
+				new_intrinsic->set_function(get_new_function(intrinsic.get_function()));
+			}
 			return new_intrinsic;
 		}
 		const Expression* visit_void_literal(const VoidLiteral&) override {
@@ -1474,6 +1912,9 @@ class Inlining {
 		}
 		const Expression* visit_return(const Return& return_) override {
 			result = expression_table[return_.get_expression()];
+			if (counter) {
+				result = create<Bind>(counter, result, result->get_type());
+			}
 			if (omit_return) {
 				return result;
 			}
@@ -1488,32 +1929,43 @@ class Inlining {
 	};
 public:
 	Inlining() = delete;
-	static Program run(const Program& program) {
+	// dead code is skipped while copying, so no separate DeadCodeElimination run is needed before this pass
+	// with instrument every function counts its executions, with a profile those counts guide the decisions
+	static Program run(const Program& program, const Profile* profile = nullptr, bool instrument = false) {
 		const Function* main_function = program.get_main_function();
+		const Liveness liveness(program);
 		Program new_program;
 		FunctionTable function_table;
-		Analyze analyze(function_table, main_function);
+		for (const Function* function: program) {
+			function_table[function].instrument = instrument;
+			if (profile) {
+				function_table[function].hot = profile->is_hot(function->get_index());
+				function_table[function].cold = profile->is_cold(function->get_index());
+			}
+		}
+		Analyze analyze(function_table, liveness, main_function);
 		analyze.evaluate(main_function->get_block());
-		Function* new_function = new Function(main_function->get_return_type());
-		new_program.add_function(new_function);
+		Function* new_function = new_program.create_function(main_function->get_return_type());
+		new_function->set_source(main_function);
 		function_table[main_function].new_function = new_function;
-		Replace::evaluate(&new_program, function_table, main_function, new_function->get_block(), main_function->get_block());
+		Replace::evaluate(&new_program, function_table, liveness, main_function, new_function->get_block(), main_function->get_block());
 		return new_program;
 	}
 };
 
 // remove empty tuples
 class Pass3: public Visitor<const Expression*> {
+	Program* program;
 	using TypeTable = std::map<const Type*, const Type*>;
 	TypeTable& type_table;
-	using FunctionTable = std::map<const Function*, Function*>;
+	using FunctionTable = IndexTable<Function, Function*>;
 	FunctionTable& function_table;
 	const Function* function;
-	using ExpressionTable = std::map<const Expression*, const Expression*>;
+	using ExpressionTable = IndexTable<Expression, const Expression*>;
 	ExpressionTable& expression_table;
 	Block* destination_block;
 	template <class T, class... A> T* create(A&&... arguments) {
-		T* expression = new T(std::forward<A>(arguments)...);
+		T* expression = program->create<T>(std::forward<A>(arguments)...);
 		destination_block->add_expression(expression);
 		return expression;
 	}
@@ -1596,21 +2048,21 @@ class Pass3: public Visitor<const Expression*> {
 		return transform_type(type_table, type);
 	}
 public:
-	Pass3(TypeTable& type_table, FunctionTable& function_table, const Function* function, ExpressionTable& expression_table, Block* destination_block): type_table(type_table), function_table(function_table), function(function), expression_table(expression_table), destination_block(destination_block) {}
-	static void evaluate(TypeTable& type_table, FunctionTable& function_table, const Function* function, ExpressionTable& expression_table, Block* destination_block, const Block& source_block) {
-		Pass3 pass3(type_table, function_table, function, expression_table, destination_block);
+	Pass3(Program* program, TypeTable& type_table, FunctionTable& function_table, const Function* function, ExpressionTable& expression_table, Block* destination_block): program(program), type_table(type_table), function_table(function_table), function(function), expression_table(expression_table), destination_block(destination_block) {}
+	static void evaluate(Program* program, TypeTable& type_table, FunctionTable& function_table, const Function* function, ExpressionTable& expression_table, Block* destination_block, const Block& source_block) {
+		Pass3 pass3(program, type_table, function_table, function, expression_table, destination_block);
 		for (const Expression* expression: source_block) {
 			if (!is_empty_tuple(expression)) {
 				expression_table[expression] = visit(pass3, expression);
 			}
 		}
 	}
-	static void evaluate(TypeTable& type_table, FunctionTable& function_table, const Function* function, Block* destination_block, const Block& source_block) {
+	static void evaluate(Program* program, TypeTable& type_table, FunctionTable& function_table, const Function* function, Block* destination_block, const Block& source_block) {
 		ExpressionTable expression_table;
-		evaluate(type_table, function_table, function, expression_table, destination_block, source_block);
+		evaluate(program, type_table, function_table, function, expression_table, destination_block, source_block);
 	}
 	void evaluate(Block* destination_block, const Block& source_block) {
-		evaluate(type_table, function_table, function, expression_table, destination_block, source_block);
+		evaluate(program, type_table, function_table, function, expression_table, destination_block, source_block);
 	}
 	const Expression* visit_int_literal(const IntLiteral& int_literal) override {
 		return create<IntLiteral>(int_literal.get_value());
@@ -1697,7 +2149,13 @@ public:
 	const Expression* visit_intrinsic(const Intrinsic& intrinsic) override {
 		Intrinsic* new_intrinsic = create<Intrinsic>(intrinsic.get_name(), transform_type(intrinsic.get_type()));
 		for (const Expression* argument: intrinsic.get_arguments()) {
-			new_intrinsic->add_argument(expression_table[argument]);
+			// the arguments a parallel intrinsic passes to its function are removed like the arguments of a call
+			if (!(intrinsic.get_function() && is_empty_tuple(argument))) {
+				new_intrinsic->add_argument(expression_table[argument]);
+			}
+		}
+		if (intrinsic.get_function()) {
+			new_intrinsic->set_function(function_table[intrinsic.get_function()]);
 		}
 		return new_intrinsic;
 	}
@@ -1727,8 +2185,8 @@ public:
 					argument_types.push_back(transform_type(type_table, type));
 				}
 			}
-			Function* new_function = new Function(argument_types, transform_type(type_table, function->get_return_type()));
-			new_program.add_function(new_function);
+			Function* new_function = new_program.create_function(argument_types, transform_type(type_table, function->get_return_type()));
+			new_function->set_source(function);
 			function_table[function] = new_function;
 		}
 		for (const Function* function: program) {
@@ -1736,7 +2194,226 @@ public:
 				continue;
 			}
 			Function* new_function = function_table[function];
-			evaluate(type_table, function_table, function, new_function->get_block(), function->get_block());
+			evaluate(&new_program, type_table, function_table, function, new_function->get_block(), function->get_block());
+		}
+		return new_program;
+	}
+};
+
+// common subexpression elimination
+// pure expressions are numbered by their operation and operands, a block sees the values of the blocks that dominate it
+class CommonSubexpressionElimination: public Visitor<const Expression*> {
+	using FunctionTable = IndexTable<Function, Function*>;
+	using ExpressionTable = IndexTable<Expression, const Expression*>;
+	enum class ValueKind {
+		INT_LITERAL,
+		BINARY_EXPRESSION,
+		TUPLE_ACCESS,
+		STRUCT_ACCESS,
+		INTRINSIC
+	};
+	struct ValueKey {
+		ValueKind kind;
+		std::size_t value;
+		std::string name;
+		std::vector<const Expression*> operands;
+		std::size_t hash;
+		ValueKey(ValueKind kind, std::size_t value, std::string&& name, std::vector<const Expression*>&& operands): kind(kind), value(value), name(std::move(name)), operands(std::move(operands)), hash(hash_combine(hash_combine(hash_combine(static_cast<std::size_t>(kind), value), std::hash<std::string>()(this->name)), this->operands)) {}
+		bool operator ==(const ValueKey& rhs) const {
+			return hash == rhs.hash && kind == rhs.kind && value == rhs.value && name == rhs.name && operands == rhs.operands;
+		}
+	};
+	struct ValueKeyHash {
+		std::size_t operator ()(const ValueKey& key) const {
+			return key.hash;
+		}
+	};
+	using ValueTable = std::unordered_map<ValueKey, const Expression*, ValueKeyHash>;
+	// the values a block adds are removed again when the block ends
+	class Scope {
+		ValueTable& value_table;
+		std::vector<const ValueKey*>& undo_log;
+		std::size_t size;
+	public:
+		Scope(ValueTable& value_table, std::vector<const ValueKey*>& undo_log): value_table(value_table), undo_log(undo_log), size(undo_log.size()) {}
+		Scope(const Scope&) = delete;
+		Scope& operator =(const Scope&) = delete;
+		~Scope() {
+			while (undo_log.size() > size) {
+				value_table.erase(value_table.find(*undo_log.back()));
+				undo_log.pop_back();
+			}
+		}
+	};
+	Program* program;
+	FunctionTable& function_table;
+	const DeadCodeElimination::Liveness& liveness;
+	ValueTable& value_table;
+	std::vector<const ValueKey*>& undo_log;
+	ExpressionTable& expression_table;
+	Block* destination_block;
+	template <class T, class... A> T* create(A&&... arguments) {
+		T* expression = program->create<T>(std::forward<A>(arguments)...);
+		destination_block->add_expression(expression);
+		return expression;
+	}
+	// returns the expression that already computes the value or creates a new one
+	template <class F> const Expression* look_up(ValueKey&& key, F&& f) {
+		auto iterator = value_table.find(key);
+		if (iterator != value_table.end()) {
+			++Statistics::common_subexpressions;
+			return iterator->second;
+		}
+		const Expression* expression = f();
+		iterator = value_table.emplace(std::move(key), expression).first;
+		undo_log.push_back(&iterator->first);
+		return expression;
+	}
+	static bool is_pure(const Intrinsic& intrinsic) {
+		return intrinsic.name_equals("arrayGet") || intrinsic.name_equals("arrayLength");
+	}
+public:
+	CommonSubexpressionElimination(Program* program, FunctionTable& function_table, const DeadCodeElimination::Liveness& liveness, ValueTable& value_table, std::vector<const ValueKey*>& undo_log, ExpressionTable& expression_table, Block* destination_block): program(program), function_table(function_table), liveness(liveness), value_table(value_table), undo_log(undo_log), expression_table(expression_table), destination_block(destination_block) {}
+	static void evaluate(Program* program, FunctionTable& function_table, const DeadCodeElimination::Liveness& liveness, ValueTable& value_table, std::vector<const ValueKey*>& undo_log, ExpressionTable& expression_table, Block* destination_block, const Block& source_block) {
+		Scope scope(value_table, undo_log);
+		CommonSubexpressionElimination pass(program, function_table, liveness, value_table, undo_log, expression_table, destination_block);
+		for (const Expression* expression: source_block) {
+			if (liveness.is_live(expression)) {
+				expression_table[expression] = visit(pass, expression);
+			}
+		}
+	}
+	void evaluate(Block* destination_block, const Block& source_block) {
+		evaluate(program, function_table, liveness, value_table, undo_log, expression_table, destination_block, source_block);
+	}
+	const Expression* visit_int_literal(const IntLiteral& int_literal) override {
+		return look_up(ValueKey(ValueKind::INT_LITERAL, int_literal.get_value(), std::string(), {}), [&]() {
+			return create<IntLiteral>(int_literal.get_value());
+		});
+	}
+	const Expression* visit_binary_expression(const BinaryExpression& binary_expression) override {
+		const Expression* left = expression_table[binary_expression.get_left()];
+		const Expression* right = expression_table[binary_expression.get_right()];
+		return look_up(ValueKey(ValueKind::BINARY_EXPRESSION, static_cast<std::size_t>(binary_expression.get_operation()), std::string(), {left, right}), [&]() {
+			return create<BinaryExpression>(binary_expression.get_operation(), left, right);
+		});
+	}
+	const Expression* visit_array_literal(const ArrayLiteral& array_literal) override {
+		ArrayLiteral* new_array_literal = create<ArrayLiteral>(array_literal.get_type());
+		for (const Expression* element: array_literal.get_elements()) {
+			new_array_literal->add_element(expression_table[element]);
+		}
+		return new_array_literal;
+	}
+	const Expression* visit_string_literal(const StringLiteral& string_literal) override {
+		return create<StringLiteral>(string_literal.get_value());
+	}
+	const Expression* visit_if(const If& if_) override {
+		const Expression* condition = expression_table[if_.get_condition()];
+		If* new_if = create<If>(condition, if_.get_type());
+		evaluate(new_if->get_then_block(), if_.get_then_block());
+		evaluate(new_if->get_else_block(), if_.get_else_block());
+		return new_if;
+	}
+	const Expression* visit_tuple_literal(const TupleLiteral& tuple_literal) override {
+		TupleLiteral* new_tuple_literal = create<TupleLiteral>(tuple_literal.get_type());
+		for (const Expression* element: tuple_literal.get_elements()) {
+			new_tuple_literal->add_element(expression_table[element]);
+		}
+		return new_tuple_literal;
+	}
+	const Expression* visit_tuple_access(const TupleAccess& tuple_access) override {
+		const Expression* tuple = expression_table[tuple_access.get_tuple()];
+		return look_up(ValueKey(ValueKind::TUPLE_ACCESS, tuple_access.get_index(), std::string(), {tuple}), [&]() {
+			return create<TupleAccess>(tuple, tuple_access.get_index(), tuple_access.get_type());
+		});
+	}
+	const Expression* visit_struct_literal(const StructLiteral& struct_literal) override {
+		StructLiteral* new_struct_literal = create<StructLiteral>(struct_literal.get_type());
+		for (const auto& field: struct_literal.get_fields()) {
+			new_struct_literal->add_field(field.first, expression_table[field.second]);
+		}
+		return new_struct_literal;
+	}
+	const Expression* visit_struct_access(const StructAccess& struct_access) override {
+		const Expression* struct_ = expression_table[struct_access.get_struct()];
+		return look_up(ValueKey(ValueKind::STRUCT_ACCESS, 0, std::string(struct_access.get_field_name()), {struct_}), [&]() {
+			return create<StructAccess>(struct_, struct_access.get_field_name(), struct_access.get_type());
+		});
+	}
+	const Expression* visit_enum_literal(const EnumLiteral& enum_literal) override {
+		const Expression* expression = expression_table[enum_literal.get_expression()];
+		return create<EnumLiteral>(expression, enum_literal.get_index(), enum_literal.get_type());
+	}
+	const Expression* visit_switch(const Switch& switch_) override {
+		const Expression* enum_ = expression_table[switch_.get_enum()];
+		Switch* new_switch = create<Switch>(enum_, switch_.get_type());
+		for (const auto& case_: switch_.get_cases()) {
+			evaluate(new_switch->add_case(case_.first), case_.second);
+		}
+		return new_switch;
+	}
+	const Expression* visit_case_variable(const CaseVariable& case_variable) override {
+		return create<CaseVariable>(case_variable.get_type());
+	}
+	const Expression* visit_argument(const Argument& argument) override {
+		return create<Argument>(argument.get_index(), argument.get_type());
+	}
+	const Expression* visit_function_call(const FunctionCall& call) override {
+		FunctionCall* new_call = create<FunctionCall>(call.get_type());
+		for (const Expression* argument: call.get_arguments()) {
+			new_call->add_argument(expression_table[argument]);
+		}
+		new_call->set_function(function_table[call.get_function()]);
+		return new_call;
+	}
+	const Expression* visit_intrinsic(const Intrinsic& intrinsic) override {
+		std::vector<const Expression*> arguments;
+		for (const Expression* argument: intrinsic.get_arguments()) {
+			arguments.push_back(expression_table[argument]);
+		}
+		auto create_intrinsic = [&]() {
+			Intrinsic* new_intrinsic = create<Intrinsic>(intrinsic.get_name(), intrinsic.get_type());
+			for (const Expression* argument: arguments) {
+				new_intrinsic->add_argument(argument);
+			}
+			if (intrinsic.get_function()) {
+				new_intrinsic->set_function(function_table[intrinsic.get_function()]);
+			}
+			return new_intrinsic;
+		};
+		if (is_pure(intrinsic)) {
+			return look_up(ValueKey(ValueKind::INTRINSIC, 0, std::string(intrinsic.get_name()), std::vector<const Expression*>(arguments)), create_intrinsic);
+		}
+		return create_intrinsic();
+	}
+	const Expression* visit_void_literal(const VoidLiteral&) override {
+		return create<VoidLiteral>();
+	}
+	const Expression* visit_bind(const Bind& bind) override {
+		const Expression* left = expression_table[bind.get_left()];
+		const Expression* right = expression_table[bind.get_right()];
+		return create<Bind>(left, right, bind.get_type());
+	}
+	const Expression* visit_return(const Return& return_) override {
+		const Expression* expression = expression_table[return_.get_expression()];
+		return create<Return>(expression);
+	}
+	static Program run(const Program& program) {
+		Program new_program;
+		FunctionTable function_table;
+		for (const Function* function: program) {
+			Function* new_function = new_program.create_function(function->get_argument_types(), function->get_return_type());
+			new_function->set_source(function);
+			function_table[function] = new_function;
+		}
+		const DeadCodeElimination::Liveness liveness(program);
+		for (const Function* function: program) {
+			Function* new_function = function_table[function];
+			ValueTable value_table;
+			std::vector<const ValueKey*> undo_log;
+			ExpressionTable expression_table;
+			evaluate(&new_program, function_table, liveness, value_table, undo_log, expression_table, new_function->get_block(), function->get_block());
 		}
 		return new_program;
 	}
@@ -1744,37 +2421,58 @@ public:
 
 // memory management
 class MemoryManagement: public Visitor<const Expression*> {
+	struct Usage {
+		const Expression* resource = nullptr;
+		const Expression* consumer = nullptr;
+		std::size_t argument_index = 0;
+		bool is(const Expression* consumer, std::size_t argument_index) const {
+			return this->consumer == consumer && this->argument_index == argument_index;
+		}
+	};
+	using Usages = IndexTable<Expression, Usage>;
 	struct UsageTable {
-		std::map<const Block*, std::map<const Expression*, std::pair<const Expression*, std::size_t>>> usages;
+		const DeadCodeElimination::Liveness& liveness;
+		std::map<const Block*, Usages> usages;
 		std::map<const Block*, std::vector<const Expression*>> frees;
-		std::map<const Expression*, std::size_t> levels;
+		IndexTable<Expression, std::size_t> levels;
+		// the last access of every element of a tuple
+		IndexTable<Expression, std::vector<const Expression*>> element_accesses;
+		// tuples that are used as a whole and not only taken apart by accesses in their own block
+		IndexTable<Expression, bool> whole_uses;
+		UsageTable(const DeadCodeElimination::Liveness& liveness): liveness(liveness) {}
 	};
+	static bool is_managed(const Type* type) {
+		const TypeId type_id = type->get_id();
+		return type_id == TypeId::STRUCT || type_id == TypeId::ENUM || type_id == TypeId::TUPLE || type_id == TypeId::ARRAY || type_id == TypeId::STRING || type_id == TypeId::STRING_ITERATOR || type_id == TypeId::STRING_BUILDER || type_id == TypeId::SLICE || type_id == TypeId::REFERENCE;
+	}
 	static bool is_managed(const Expression* expression) {
-		const TypeId type_id = expression->get_type_id();
-		return type_id == TypeId::STRUCT || type_id == TypeId::ENUM || type_id == TypeId::TUPLE || type_id == TypeId::ARRAY || type_id == TypeId::STRING || type_id == TypeId::STRING_ITERATOR || type_id == TypeId::REFERENCE;
+		return is_managed(expression->get_type());
 	}
 	class UsageAnalysis1: public Visitor<void> {
 		UsageTable& usage_table;
-		const Block* block;
+		Usages& usages;
 		std::size_t level;
 	public:
-		UsageAnalysis1(UsageTable& usage_table, const Block* block, std::size_t level): usage_table(usage_table), block(block), level(level) {}
+		UsageAnalysis1(UsageTable& usage_table, const Block* block, std::size_t level): usage_table(usage_table), usages(usage_table.usages[block]), level(level) {}
 		void add_usage(const Expression* resource, const Expression* consumer, std::size_t argument_index) {
 			if (is_managed(resource)) {
-				usage_table.usages[block][resource] = std::make_pair(consumer, argument_index);
+				usages[resource] = Usage {resource, consumer, argument_index};
+				usage_table.whole_uses[resource] = true;
 			}
 		}
 		void propagate_usages(const Block* block, const Expression* consumer) {
-			for (auto& entry: usage_table.usages[block]) {
-				const Expression* resource = entry.first;
-				if (usage_table.levels[resource] <= level) {
-					add_usage(resource, consumer, 0);
+			for (const Usage& usage: usage_table.usages[block]) {
+				if (usage.resource && usage_table.levels[usage.resource] <= level) {
+					add_usage(usage.resource, consumer, 0);
 				}
 			}
 		}
 		static void evaluate(UsageTable& usage_table, const Block& block, std::size_t level = 1) {
 			UsageAnalysis1 usage_analysis1(usage_table, &block, level);
 			for (const Expression* expression: block) {
+				if (!usage_table.liveness.is_live(expression)) {
+					continue;
+				}
 				if (is_managed(expression)) {
 					usage_table.levels[expression] = level;
 				}
@@ -1803,7 +2501,13 @@ class MemoryManagement: public Visitor<const Expression*> {
 			}
 		}
 		void visit_tuple_access(const TupleAccess& tuple_access) override {
-			add_usage(tuple_access.get_tuple(), &tuple_access, 0);
+			const Expression* tuple = tuple_access.get_tuple();
+			usages[tuple] = Usage {tuple, &tuple_access, 0};
+			std::vector<const Expression*>& element_accesses = usage_table.element_accesses[tuple];
+			if (element_accesses.size() <= tuple_access.get_index()) {
+				element_accesses.resize(tuple_access.get_index() + 1);
+			}
+			element_accesses[tuple_access.get_index()] = &tuple_access;
 		}
 		void visit_struct_literal(const StructLiteral& struct_literal) override {
 			for (std::size_t i = 0; i < struct_literal.get_fields().size(); ++i) {
@@ -1844,52 +2548,52 @@ class MemoryManagement: public Visitor<const Expression*> {
 	};
 	class UsageAnalysis2: public Visitor<void> {
 		UsageTable& usage_table;
-		const Block* block;
+		const Usages& usages;
 		std::size_t level;
 	public:
-		UsageAnalysis2(UsageTable& usage_table, const Block* block, std::size_t level): usage_table(usage_table), block(block), level(level) {}
+		UsageAnalysis2(UsageTable& usage_table, const Block* block, std::size_t level): usage_table(usage_table), usages(usage_table.usages[block]), level(level) {}
 		bool is_last_use(const Expression* resource, const Expression* consumer, std::size_t argument_index) {
-			return usage_table.usages[block][resource] == std::make_pair(consumer, argument_index);
+			return usages.get(resource).is(consumer, argument_index);
 		}
 		void remove_invalid_usages(const Block* block, const Expression* consumer) {
-			auto iterator = usage_table.usages[block].begin();
-			while (iterator != usage_table.usages[block].end()) {
-				const Expression* resource = iterator->first;
-				if (usage_table.levels[resource] <= level && !is_last_use(resource, consumer, 0)) {
-					iterator = usage_table.usages[block].erase(iterator);
-				}
-				else {
-					++iterator;
+			Usages& block_usages = usage_table.usages[block];
+			for (const Usage& usage: block_usages) {
+				if (usage.resource && usage_table.levels[usage.resource] <= level && !is_last_use(usage.resource, consumer, 0)) {
+					block_usages[usage.resource] = Usage();
 				}
 			}
 		}
 		void ensure_frees(const std::vector<std::pair<std::string, Block>>& cases) {
 			for (const auto& source_case: cases) {
 				const Block* source_block = &source_case.second;
-				for (auto& entry: usage_table.usages[source_block]) {
-					const Expression* resource = entry.first;
+				for (const Usage& usage: usage_table.usages[source_block]) {
+					if (usage.resource == nullptr) {
+						continue;
+					}
 					for (const auto& target_case: cases) {
 						const Block* target_block = &target_case.second;
-						if (usage_table.usages[target_block].count(resource) == 0 && usage_table.levels[resource] < level + 1) {
+						if (usage_table.usages[target_block].get(usage.resource).resource == nullptr && usage_table.levels[usage.resource] < level + 1) {
 							// if a resource from the source block has no usage in the target block, add it to the free list
-							usage_table.frees[target_block].push_back(resource);
+							usage_table.frees[target_block].push_back(usage.resource);
 						}
 					}
 				}
 			}
 		}
 		void ensure_frees(const Block* source_block, const Block* target_block) {
-			for (auto& entry: usage_table.usages[source_block]) {
-				const Expression* resource = entry.first;
-				if (usage_table.usages[target_block].count(resource) == 0 && usage_table.levels[resource] < level + 1) {
+			for (const Usage& usage: usage_table.usages[source_block]) {
+				if (usage.resource && usage_table.usages[target_block].get(usage.resource).resource == nullptr && usage_table.levels[usage.resource] < level + 1) {
 					// if a resource from the source block has no usage in the target block, add it to the free list
-					usage_table.frees[target_block].push_back(resource);
+					usage_table.frees[target_block].push_back(usage.resource);
 				}
 			}
 		}
 		static void evaluate(UsageTable& usage_table, const Block& block, std::size_t level = 1) {
 			UsageAnalysis2 usage_analysis2(usage_table, &block, level);
 			for (const Expression* expression: block) {
+				if (!usage_table.liveness.is_live(expression)) {
+					continue;
+				}
 				visit(usage_analysis2, expression);
 			}
 		}
@@ -1914,26 +2618,37 @@ class MemoryManagement: public Visitor<const Expression*> {
 			}
 		}
 	};
-	using FunctionTable = std::map<const Function*, Function*>;
+	Program* program;
+	using FunctionTable = IndexTable<Function, Function*>;
 	FunctionTable& function_table;
 	UsageTable& usage_table;
-	using ExpressionTable = std::map<const Expression*, const Expression*>;
+	using ExpressionTable = IndexTable<Expression, const Expression*>;
 	ExpressionTable& expression_table;
 	Block* destination_block;
 	const Block* source_block;
+	const Usages& usages;
 	template <class T, class... A> T* create(A&&... arguments) {
-		T* expression = new T(std::forward<A>(arguments)...);
+		T* expression = program->create<T>(std::forward<A>(arguments)...);
 		destination_block->add_expression(expression);
 		return expression;
 	}
 	bool is_last_use(const Expression* resource, const Expression* consumer, std::size_t argument_index) {
-		return usage_table.usages[source_block][resource] == std::make_pair(consumer, argument_index);
+		return usages.get(resource).is(consumer, argument_index);
 	}
 	bool is_unused(const Expression* resource) {
-		return usage_table.usages[source_block].count(resource) == 0;
+		return usages.get(resource).resource == nullptr;
+	}
+	// a tuple that is only taken apart can move each element out at its last access
+	bool is_destructured(const Expression* tuple) {
+		return !usage_table.whole_uses.get(tuple);
 	}
+	bool is_last_access(const TupleAccess& tuple_access) {
+		const std::vector<const Expression*> element_accesses = usage_table.element_accesses.get(tuple_access.get_tuple());
+		return element_accesses[tuple_access.get_index()] == &tuple_access;
+	}
+	// the parallel intrinsics pass copies of their arguments to their function
 	bool is_borrowed(const Intrinsic& intrinsic) {
-		return intrinsic.name_equals("putStr") || intrinsic.name_equals("arrayGet") || intrinsic.name_equals("arrayLength");
+		return intrinsic.name_equals("putStr") || intrinsic.name_equals("writeAll") || intrinsic.name_equals("arrayGet") || intrinsic.name_equals("arrayLength") || intrinsic.name_equals("parallelMap") || intrinsic.name_equals("parallelReduce");
 	}
 	const Expression* copy(const Expression* resource) {
 		Intrinsic* copy_intrinsic = create<Intrinsic>("copy", resource->get_type());
@@ -1945,22 +2660,24 @@ class MemoryManagement: public Visitor<const Expression*> {
 		free_intrinsic->add_argument(resource);
 	}
 public:
-	MemoryManagement(FunctionTable& function_table, UsageTable& usage_table, ExpressionTable& expression_table, Block* destination_block, const Block* source_block): function_table(function_table), usage_table(usage_table), expression_table(expression_table), destination_block(destination_block), source_block(source_block) {}
-	static void evaluate(FunctionTable& function_table, UsageTable& usage_table, ExpressionTable& expression_table, Block* destination_block, const Block& source_block) {
-		MemoryManagement pass4(function_table, usage_table, expression_table, destination_block, &source_block);
+	MemoryManagement(Program* program, FunctionTable& function_table, UsageTable& usage_table, ExpressionTable& expression_table, Block* destination_block, const Block* source_block): program(program), function_table(function_table), usage_table(usage_table), expression_table(expression_table), destination_block(destination_block), source_block(source_block), usages(usage_table.usages[source_block]) {}
+	static void evaluate(Program* program, FunctionTable& function_table, UsageTable& usage_table, ExpressionTable& expression_table, Block* destination_block, const Block& source_block) {
+		MemoryManagement pass4(program, function_table, usage_table, expression_table, destination_block, &source_block);
 		for (const Expression* expression: usage_table.frees[&source_block]) {
 			pass4.free(expression_table[expression]);
 		}
 		for (const Expression* expression: source_block) {
-			expression_table[expression] = visit(pass4, expression);
+			if (usage_table.liveness.is_live(expression)) {
+				expression_table[expression] = visit(pass4, expression);
+			}
 		}
 	}
-	static void evaluate(FunctionTable& function_table, UsageTable& usage_table, Block* destination_block, const Block& source_block) {
+	static void evaluate(Program* program, FunctionTable& function_table, UsageTable& usage_table, Block* destination_block, const Block& source_block) {
 		ExpressionTable expression_table;
-		evaluate(function_table, usage_table, expression_table, destination_block, source_block);
+		evaluate(program, function_table, usage_table, expression_table, destination_block, source_block);
 	}
 	void evaluate(Block* destination_block, const Block& source_block) {
-		evaluate(function_table, usage_table, expression_table, destination_block, source_block);
+		evaluate(program, function_table, usage_table, expression_table, destination_block, source_block);
 	}
 	const Expression* visit_int_literal(const IntLiteral& int_literal) override {
 		return create<IntLiteral>(int_literal.get_value());
@@ -1971,7 +2688,7 @@ public:
 		return create<BinaryExpression>(binary_expression.get_operation(), left, right);
 	}
 	const Expression* visit_array_literal(const ArrayLiteral& array_literal) override {
-		ArrayLiteral* new_array_literal = new ArrayLiteral(array_literal.get_type());
+		ArrayLiteral* new_array_literal = program->create<ArrayLiteral>(array_literal.get_type());
 		for (std::size_t i = 0; i < array_literal.get_elements().size(); ++i) {
 			const Expression* element = array_literal.get_elements()[i];
 			if (is_managed(element) && !is_last_use(element, &array_literal, i)) {
@@ -1995,7 +2712,7 @@ public:
 		return new_if;
 	}
 	const Expression* visit_tuple_literal(const TupleLiteral& tuple_literal) override {
-		TupleLiteral* new_tuple_literal = new TupleLiteral(tuple_literal.get_type());
+		TupleLiteral* new_tuple_literal = program->create<TupleLiteral>(tuple_literal.get_type());
 		for (std::size_t i = 0; i < tuple_literal.get_elements().size(); ++i) {
 			const Expression* element = tuple_literal.get_elements()[i];
 			if (is_managed(element) && !is_last_use(element, &tuple_literal, i)) {
@@ -2011,16 +2728,34 @@ public:
 	const Expression* visit_tuple_access(const TupleAccess& tuple_access) override {
 		const Expression* tuple = expression_table[tuple_access.get_tuple()];
 		const Expression* new_tuple_access = create<TupleAccess>(tuple, tuple_access.get_index(), tuple_access.get_type());
-		if (is_managed(&tuple_access)) {
-			new_tuple_access = copy(new_tuple_access);
+		if (is_destructured(tuple_access.get_tuple())) {
+			if (is_managed(&tuple_access) && !is_last_access(tuple_access)) {
+				new_tuple_access = copy(new_tuple_access);
+			}
+			if (is_last_use(tuple_access.get_tuple(), &tuple_access, 0)) {
+				// the elements that were never accessed are still owned by the tuple
+				const std::vector<const Expression*> element_accesses = usage_table.element_accesses.get(tuple_access.get_tuple());
+				const std::vector<const Type*>& element_types = static_cast<const TupleType*>(tuple->get_type())->get_element_types();
+				for (std::size_t i = 0; i < element_types.size(); ++i) {
+					const bool accessed = i < element_accesses.size() && element_accesses[i] != nullptr;
+					if (!accessed && is_managed(element_types[i])) {
+						free(create<TupleAccess>(tuple, i, element_types[i]));
+					}
+				}
+			}
 		}
-		if (is_last_use(tuple_access.get_tuple(), &tuple_access, 0)) {
-			free(tuple);
+		else {
+			if (is_managed(&tuple_access)) {
+				new_tuple_access = copy(new_tuple_access);
+			}
+			if (is_last_use(tuple_access.get_tuple(), &tuple_access, 0)) {
+				free(tuple);
+			}
 		}
 		return new_tuple_access;
 	}
 	const Expression* visit_struct_literal(const StructLiteral& struct_literal) override {
-		StructLiteral* new_struct_literal = new StructLiteral(struct_literal.get_type());
+		StructLiteral* new_struct_literal = program->create<StructLiteral>(struct_literal.get_type());
 		for (std::size_t i = 0; i < struct_literal.get_fields().size(); ++i) {
 			const auto& field = struct_literal.get_fields()[i];
 			if (is_managed(field.second) && !is_last_use(field.second, &struct_literal, i)) {
@@ -2082,7 +2817,7 @@ public:
 		return new_argument;
 	}
 	const Expression* visit_function_call(const FunctionCall& call) override {
-		FunctionCall* new_call = new FunctionCall(call.get_type());
+		FunctionCall* new_call = program->create<FunctionCall>(call.get_type());
 		for (std::size_t i = 0; i < call.get_arguments().size(); ++i) {
 			const Expression* argument = call.get_arguments()[i];
 			if (is_managed(argument) && !is_last_use(argument, &call, i)) {
@@ -2096,17 +2831,46 @@ public:
 		new_call->set_function(function_table[call.get_function()]);
 		return new_call;
 	}
+	// splicing an array that is still used afterwards copies it into the result instead of copying it first
+	// the remaining splices own their array and can update it in place
+	// slicing an array that is still used afterwards only copies the range of the slice
+	static const char* get_copying_splice(const Intrinsic& intrinsic) {
+		if (intrinsic.name_equals("arraySplice")) {
+			return "arraySpliceCopy";
+		}
+		if (intrinsic.name_equals("stringPush")) {
+			return "stringPushCopy";
+		}
+		if (intrinsic.name_equals("slice")) {
+			return "sliceCopy";
+		}
+		return nullptr;
+	}
 	const Expression* visit_intrinsic(const Intrinsic& intrinsic) override {
-		Intrinsic* new_intrinsic = new Intrinsic(intrinsic.get_name(), intrinsic.get_type());
+		const char* name = intrinsic.get_name();
+		bool copying_splice = false;
+		if (const char* copying_name = get_copying_splice(intrinsic)) {
+			if (!is_last_use(intrinsic.get_arguments()[0], &intrinsic, 0)) {
+				name = copying_name;
+				copying_splice = true;
+			}
+		}
+		Intrinsic* new_intrinsic = program->create<Intrinsic>(name, intrinsic.get_type());
 		for (std::size_t i = 0; i < intrinsic.get_arguments().size(); ++i) {
 			const Expression* argument = intrinsic.get_arguments()[i];
-			if (is_managed(argument) && !is_borrowed(intrinsic) && !is_last_use(argument, &intrinsic, i)) {
+			if (i == 0 && copying_splice) {
+				new_intrinsic->add_argument(expression_table[argument]);
+			}
+			else if (is_managed(argument) && !is_borrowed(intrinsic) && !is_last_use(argument, &intrinsic, i)) {
 				new_intrinsic->add_argument(copy(expression_table[argument]));
 			}
 			else {
 				new_intrinsic->add_argument(expression_table[argument]);
 			}
 		}
+		if (intrinsic.get_function()) {
+			new_intrinsic->set_function(function_table[intrinsic.get_function()]);
+		}
 		destination_block->add_expression(new_intrinsic);
 		const Expression* result = new_intrinsic;
 		if (is_managed(&intrinsic) && intrinsic.name_equals("arrayGet")) {
@@ -2137,43 +2901,294 @@ public:
 			return create<Return>(expression_table[expression]);
 		}
 	}
+	// dead code is skipped while copying, so no separate DeadCodeElimination run is needed before this pass
 	static Program run(const Program& program) {
+		const DeadCodeElimination::Liveness liveness(program);
 		Program new_program;
 		FunctionTable function_table;
 		for (const Function* function: program) {
-			Function* new_function = new Function(function->get_argument_types(), function->get_return_type());
-			new_program.add_function(new_function);
+			Function* new_function = new_program.create_function(function->get_argument_types(), function->get_return_type());
+			new_function->set_source(function);
 			function_table[function] = new_function;
 		}
 		for (const Function* function: program) {
 			Function* new_function = function_table[function];
-			UsageTable usage_table;
+			UsageTable usage_table(liveness);
 			UsageAnalysis1::evaluate(usage_table, function->get_block());
 			UsageAnalysis2::evaluate(usage_table, function->get_block());
-			evaluate(function_table, usage_table, new_function->get_block(), function->get_block());
+			evaluate(&new_program, function_table, usage_table, new_function->get_block(), function->get_block());
 		}
 		return new_program;
 	}
 };
 
+// escape analysis
+// finds the arrays, strings and references that are only borrowed and freed by the function that creates them
+// the memory management has made all consumptions explicit, so it runs on its output
+class EscapeAnalysis {
+	using UsageTable = IndexTable<Expression, bool>;
+	static bool is_managed(const Type* type) {
+		const TypeId type_id = type->get_id();
+		return type_id == TypeId::STRUCT || type_id == TypeId::ENUM || type_id == TypeId::TUPLE || type_id == TypeId::ARRAY || type_id == TypeId::STRING || type_id == TypeId::STRING_ITERATOR || type_id == TypeId::STRING_BUILDER || type_id == TypeId::SLICE || type_id == TypeId::REFERENCE;
+	}
+	class Mark: public Visitor<void> {
+		UsageTable& allocations;
+		UsageTable& escaping;
+		void escape(const Expression* expression) {
+			escaping[expression] = true;
+		}
+	public:
+		Mark(UsageTable& allocations, UsageTable& escaping): allocations(allocations), escaping(escaping) {}
+		static void evaluate(UsageTable& allocations, UsageTable& escaping, const Block& block) {
+			Mark mark(allocations, escaping);
+			for (const Expression* expression: block) {
+				visit(mark, expression);
+			}
+		}
+		void evaluate(const Block& block) {
+			evaluate(allocations, escaping, block);
+		}
+		void visit_binary_expression(const BinaryExpression& binary_expression) override {
+			escape(binary_expression.get_left());
+			escape(binary_expression.get_right());
+		}
+		void visit_array_literal(const ArrayLiteral& array_literal) override {
+			// freeing an array with managed elements frees the elements as well
+			if (!is_managed(static_cast<const ArrayType*>(array_literal.get_type())->get_element_type())) {
+				allocations[&array_literal] = true;
+			}
+			for (const Expression* element: array_literal.get_elements()) {
+				escape(element);
+			}
+		}
+		void visit_string_literal(const StringLiteral& string_literal) override {
+			allocations[&string_literal] = true;
+		}
+		void visit_if(const If& if_) override {
+			escape(if_.get_condition());
+			evaluate(if_.get_then_block());
+			evaluate(if_.get_else_block());
+		}
+		void visit_tuple_literal(const TupleLiteral& tuple_literal) override {
+			for (const Expression* element: tuple_literal.get_elements()) {
+				escape(element);
+			}
+		}
+		void visit_tuple_access(const TupleAccess& tuple_access) override {
+			escape(tuple_access.get_tuple());
+		}
+		void visit_struct_literal(const StructLiteral& struct_literal) override {
+			for (const auto& field: struct_literal.get_fields()) {
+				escape(field.second);
+			}
+		}
+		void visit_struct_access(const StructAccess& struct_access) override {
+			// accessing a field of a reference only reads it
+			if (struct_access.get_struct()->get_type_id() != TypeId::REFERENCE) {
+				escape(struct_access.get_struct());
+			}
+		}
+		void visit_enum_literal(const EnumLiteral& enum_literal) override {
+			escape(enum_literal.get_expression());
+		}
+		void visit_switch(const Switch& switch_) override {
+			if (switch_.get_enum()->get_type_id() != TypeId::REFERENCE) {
+				escape(switch_.get_enum());
+			}
+			for (const auto& case_: switch_.get_cases()) {
+				evaluate(case_.second);
+			}
+		}
+		void visit_function_call(const FunctionCall& call) override {
+			for (const Expression* argument: call.get_arguments()) {
+				escape(argument);
+			}
+		}
+		void visit_intrinsic(const Intrinsic& intrinsic) override {
+			if (intrinsic.name_equals("reference")) {
+				allocations[&intrinsic] = true;
+			}
+			const bool borrowed = intrinsic.name_equals("putStr") || intrinsic.name_equals("writeAll") || intrinsic.name_equals("arrayGet") || intrinsic.name_equals("arrayLength") || intrinsic.name_equals("parallelMap") || intrinsic.name_equals("parallelReduce") || intrinsic.name_equals("free");
+			for (std::size_t i = 0; i < intrinsic.get_arguments().size(); ++i) {
+				if (!(borrowed && i == 0)) {
+					escape(intrinsic.get_arguments()[i]);
+				}
+			}
+		}
+		void visit_bind(const Bind& bind) override {
+			escape(bind.get_left());
+			escape(bind.get_right());
+		}
+		void visit_return(const Return& return_) override {
+			escape(return_.get_expression());
+		}
+	};
+	UsageTable allocations;
+	UsageTable escaping;
+public:
+	EscapeAnalysis(const Program& program) {
+		for (const Function* function: program) {
+			Mark::evaluate(allocations, escaping, function->get_block());
+		}
+	}
+	// whether the expression allocates memory that can live in the stack frame of its function
+	bool is_stack_allocated(const Expression* expression) const {
+		return allocations.get(expression) && !escaping.get(expression);
+	}
+};
+
+// the functions called by parallelMap and parallelReduce and whether they perform input or output
+// a function that performs input or output, directly or through the functions it calls, has to run sequentially
+class ParallelAnalysis {
+	using FunctionTable = IndexTable<Function, std::vector<const Function*>>;
+	class Mark: public Visitor<void> {
+		std::vector<const Function*>& callees;
+		bool& input_output;
+		std::vector<const Function*>& parallel_functions;
+	public:
+		Mark(std::vector<const Function*>& callees, bool& input_output, std::vector<const Function*>& parallel_functions): callees(callees), input_output(input_output), parallel_functions(parallel_functions) {}
+		void evaluate(const Block& block) {
+			for (const Expression* expression: block) {
+				visit(*this, expression);
+			}
+		}
+		void visit_if(const If& if_) override {
+			evaluate(if_.get_then_block());
+			evaluate(if_.get_else_block());
+		}
+		void visit_switch(const Switch& switch_) override {
+			for (const auto& case_: switch_.get_cases()) {
+				evaluate(case_.second);
+			}
+		}
+		void visit_function_call(const FunctionCall& call) override {
+			callees.push_back(call.get_function());
+		}
+		void visit_intrinsic(const Intrinsic& intrinsic) override {
+			if (intrinsic.get_function()) {
+				callees.push_back(intrinsic.get_function());
+				parallel_functions.push_back(intrinsic.get_function());
+			}
+			if (intrinsic.name_equals("putChar") || intrinsic.name_equals("putStr") || intrinsic.name_equals("getChar") || intrinsic.name_equals("readAll") || intrinsic.name_equals("writeAll") || intrinsic.name_equals("profileCounter")) {
+				input_output = true;
+			}
+		}
+	};
+	IndexTable<Function, bool> input_output;
+	std::vector<const Function*> parallel_functions;
+public:
+	ParallelAnalysis(const Program& program) {
+		FunctionTable callers;
+		std::vector<const Function*> worklist;
+		for (const Function* function: program) {
+			std::vector<const Function*> callees;
+			bool function_input_output = false;
+			Mark mark(callees, function_input_output, parallel_functions);
+			mark.evaluate(function->get_block());
+			for (const Function* callee: callees) {
+				callers[callee].push_back(function);
+			}
+			if (function_input_output) {
+				input_output[function] = true;
+				worklist.push_back(function);
+			}
+		}
+		// propagate input and output to the callers
+		while (!worklist.empty()) {
+			const Function* function = worklist.back();
+			worklist.pop_back();
+			for (const Function* caller: callers[function]) {
+				if (!input_output.get(caller)) {
+					input_output[caller] = true;
+					worklist.push_back(caller);
+				}
+			}
+		}
+	}
+	bool has_input_output(const Function* function) const {
+		return input_output.get(function);
+	}
+	const std::vector<const Function*>& get_parallel_functions() const {
+		return parallel_functions;
+	}
+};
+
 class TailCallData {
 public:
-	std::map<const Expression*, bool> tail_call_expressions;
-	std::map<const Function*, bool> tail_call_functions;
+	IndexTable<Expression, bool> tail_call_expressions;
+	IndexTable<Function, bool> tail_call_functions;
+	// mutually tail recursive functions that are merged into a single loop
+	std::vector<std::vector<const Function*>> groups;
+	IndexTable<Function, std::size_t> function_groups;
+	IndexTable<Expression, bool> group_tail_call_expressions;
 	bool is_tail_call(const Expression* expression) const {
-		return tail_call_expressions.count(expression) > 0;
+		return tail_call_expressions.get(expression);
 	}
 	bool has_tail_call(const Function* function) const {
-		return tail_call_functions.count(function) > 0;
+		return tail_call_functions.get(function);
+	}
+	bool is_group_tail_call(const Expression* expression) const {
+		return group_tail_call_expressions.get(expression);
+	}
+	bool has_group(const Function* function) const {
+		return function_groups.get(function) > 0;
+	}
+	std::size_t get_group(const Function* function) const {
+		return function_groups.get(function) - 1;
 	}
 };
 
 // tail call optimization
+// calls to the function itself become loops and strongly connected components of tail calls become groups
 class Pass5: public Visitor<void> {
-	const Function* function;
-	TailCallData& data;
+	struct FunctionTableEntry {
+		std::vector<const FunctionCall*> tail_calls;
+		std::size_t index = 0;
+		std::size_t low_link = 0;
+		std::size_t component = 0;
+		bool on_stack = false;
+	};
+	using FunctionTable = IndexTable<Function, FunctionTableEntry>;
+	class StronglyConnectedComponents {
+		FunctionTable& function_table;
+		std::vector<const Function*> stack;
+		std::size_t next_index = 1;
+	public:
+		std::vector<std::vector<const Function*>> components;
+		StronglyConnectedComponents(FunctionTable& function_table): function_table(function_table) {}
+		void evaluate(const Function* function) {
+			function_table[function].index = next_index;
+			function_table[function].low_link = next_index;
+			++next_index;
+			stack.push_back(function);
+			function_table[function].on_stack = true;
+			for (const FunctionCall* call: function_table[function].tail_calls) {
+				const Function* callee = call->get_function();
+				if (function_table[callee].index == 0) {
+					evaluate(callee);
+					function_table[function].low_link = std::min(function_table[function].low_link, function_table[callee].low_link);
+				}
+				else if (function_table[callee].on_stack) {
+					function_table[function].low_link = std::min(function_table[function].low_link, function_table[callee].index);
+				}
+			}
+			if (function_table[function].low_link == function_table[function].index) {
+				std::vector<const Function*> component;
+				const Function* member;
+				do {
+					member = stack.back();
+					stack.pop_back();
+					function_table[member].on_stack = false;
+					function_table[member].component = components.size();
+					component.push_back(member);
+				} while (member != function);
+				components.push_back(std::move(component));
+			}
+		}
+	};
+	std::vector<const FunctionCall*>& tail_calls;
 public:
-	Pass5(const Function* function, TailCallData& data): function(function), data(data) {}
+	Pass5(std::vector<const FunctionCall*>& tail_calls): tail_calls(tail_calls) {}
 	void evaluate(const Block& block) {
 		visit(*this, block.get_last());
 	}
@@ -2187,10 +3202,7 @@ public:
 		}
 	}
 	void visit_function_call(const FunctionCall& call) override {
-		if (call.get_function() == function) {
-			data.tail_call_expressions[&call] = true;
-			data.tail_call_functions[function] = true;
-		}
+		tail_calls.push_back(&call);
 	}
 	void visit_bind(const Bind& bind) override {
 		const Expression* right = bind.get_right();
@@ -2205,9 +3217,96 @@ public:
 		}
 	}
 	static void run(const Program& program, TailCallData& data) {
+		FunctionTable function_table;
 		for (const Function* function: program) {
-			Pass5 pass5(function, data);
+			Pass5 pass5(function_table[function].tail_calls);
 			pass5.evaluate(function->get_block());
 		}
+		StronglyConnectedComponents scc(function_table);
+		for (const Function* function: program) {
+			if (function_table[function].index == 0) {
+				scc.evaluate(function);
+			}
+		}
+		for (const Function* function: program) {
+			for (const FunctionCall* call: function_table[function].tail_calls) {
+				if (call->get_function() == function) {
+					data.tail_call_expressions[call] = true;
+					data.tail_call_functions[function] = true;
+				}
+			}
+		}
+		for (std::vector<const Function*>& component: scc.components) {
+			if (component.size() < 2) {
+				continue;
+			}
+			for (const Function* function: component) {
+				data.function_groups[function] = data.groups.size() + 1;
+				for (const FunctionCall* call: function_table[function].tail_calls) {
+					if (function_table[call->get_function()].component == function_table[function].component) {
+						data.group_tail_call_expressions[call] = true;
+					}
+				}
+			}
+			data.groups.push_back(std::move(component));
+		}
+	}
+};
+
+// runs the passes selected by the optimization level
+// dead code elimination is fused into the passes that copy the program
+class PassManager {
+	static Statistics::ProgramSize get_size(const Program* program) {
+		Statistics::ProgramSize size;
+		if (program) {
+			size.functions = program->get_functions();
+			size.expressions = program->get_expressions();
+		}
+		size.types = TypeInterner::get_type_count();
+		return size;
+	}
+	// records the cost of the pass and the size of the program before and after it with --time-passes
+	template <class F> static Program run_pass(const char* name, const Program* program, F&& pass) {
+		if (!Statistics::time_phases) {
+			return pass();
+		}
+		const Statistics::ProgramSize before = get_size(program);
+		Statistics::Timer timer;
+		Program result = pass();
+		Statistics::Phase phase = timer.stop(name);
+		phase.has_sizes = true;
+		phase.before = before;
+		phase.after = get_size(&result);
+		Statistics::phases.push_back(phase);
+		return result;
+	}
+public:
+	PassManager() = delete;
+	static Program run(const char* path, unsigned int optimization_level, const Profile* profile = nullptr, bool instrument = false) {
+		// the first pass parses the source, so there is no program before it
+		Program program = run_pass("Pass1", nullptr, [&]() {
+			return Pass1::run(path);
+		});
+		program = run_pass("Lowering", &program, [&]() {
+			return Lowering::run(program);
+		});
+		program = run_pass("Pass3", &program, [&]() {
+			return Pass3::run(program);
+		});
+		if (optimization_level >= 1) {
+			program = run_pass("Inlining", &program, [&]() {
+				return Inlining::run(program, profile, instrument);
+			});
+			program = run_pass("Pass1", &program, [&]() {
+				return Pass1::run(program);
+			});
+			program = run_pass("CommonSubexpressionElimination", &program, [&]() {
+				return CommonSubexpressionElimination::run(program);
+			});
+		}
+		program = run_pass("MemoryManagement", &program, [&]() {
+			return MemoryManagement::run(program);
+		});
+		return program;
 	}
 };
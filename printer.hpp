@@ -5,6 +5,14 @@
 #include <vector>
 #include <fstream>
 #include <iterator>
+#include <algorithm>
+#include <cerrno>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 class StringView {
 	const char* string;
@@ -344,22 +352,102 @@ public:
 	}
 };
 
+// regular files are mapped into memory, everything else is read in chunks
 class SourceFile {
+	static constexpr std::size_t chunk_size = 64 * 1024;
 	const char* path;
+	const char* data = nullptr;
+	std::size_t size = 0;
+	bool is_mapped = false;
 	std::vector<char> content;
+	template <class F> void read_chunks(F read) {
+		std::size_t length = 0;
+		while (true) {
+			if (content.size() - length < chunk_size) {
+				content.resize(std::max(content.size() * 2, length + chunk_size));
+			}
+			const std::size_t count = read(content.data() + length, content.size() - length);
+			if (count == 0) {
+				break;
+			}
+			length += count;
+		}
+		content.resize(length);
+		data = content.data();
+		size = content.size();
+	}
 public:
 	SourceFile(const char* path): path(path) {
-		std::ifstream file(path);
-		content.insert(content.end(), std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+#if defined(__unix__) || defined(__APPLE__)
+		const int fd = open(path, O_RDONLY);
+		if (fd == -1) {
+			return;
+		}
+		struct stat file_status;
+		if (fstat(fd, &file_status) == 0 && S_ISREG(file_status.st_mode) && file_status.st_size > 0) {
+			void* address = mmap(nullptr, file_status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (address != MAP_FAILED) {
+				data = static_cast<const char*>(address);
+				size = file_status.st_size;
+				is_mapped = true;
+				close(fd);
+				return;
+			}
+		}
+		read_chunks([&](char* buffer, std::size_t count) -> std::size_t {
+			ssize_t result;
+			do {
+				result = ::read(fd, buffer, count);
+			} while (result == -1 && errno == EINTR);
+			return result > 0 ? result : 0;
+		});
+		close(fd);
+#else
+		std::ifstream file(path, std::ios::binary);
+		read_chunks([&](char* buffer, std::size_t count) -> std::size_t {
+			file.read(buffer, count);
+			return file.gcount();
+		});
+#endif
+	}
+	SourceFile(const SourceFile&) = delete;
+	SourceFile& operator =(const SourceFile&) = delete;
+	~SourceFile() {
+#if defined(__unix__) || defined(__APPLE__)
+		if (is_mapped) {
+			munmap(const_cast<char*>(data), size);
+		}
+#endif
 	}
 	const char* get_path() const {
 		return path;
 	}
 	const char* begin() const {
-		return content.data();
+		return data;
 	}
 	const char* end() const {
-		return content.data() + content.size();
+		return data + size;
+	}
+};
+
+// the start of every line of a source file, to look up the lines of many positions
+class LineTable {
+	std::vector<std::size_t> line_starts;
+public:
+	LineTable(const char* path) {
+		SourceFile file(path);
+		line_starts.push_back(0);
+		for (const char* c = file.begin(); c < file.end(); ++c) {
+			if (*c == '\n') {
+				line_starts.push_back(c + 1 - file.begin());
+			}
+		}
+	}
+	std::size_t get_line(std::size_t position) const {
+		return std::upper_bound(line_starts.begin(), line_starts.end(), position) - line_starts.begin();
+	}
+	std::size_t get_column(std::size_t position) const {
+		return 1 + position - line_starts[get_line(position) - 1];
 	}
 };
 
@@ -421,7 +509,7 @@ class Variable {
 	std::size_t index;
 public:
 	constexpr Variable(std::size_t index): index(index) {}
-	Variable() {}
+	Variable(): index(0) {}
 	void print(const Printer& printer) const {
 		printer.print(format("v%", print_number(index)));
 	}
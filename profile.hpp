@@ -0,0 +1,44 @@
+#pragma once
+
+#include "printer.hpp"
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <vector>
+
+// call counts written by an executable built with -profile-generate
+// every line holds the index of a function before inlining and the number of times its body was entered
+class Profile {
+	std::vector<std::uint64_t> counts;
+	std::uint64_t max_count = 0;
+public:
+	static Profile read(const char* path) {
+		std::ifstream file(path);
+		if (!file) {
+			print_error(Printer(std::cerr), format("cannot read profile \"%\"", path));
+			std::exit(EXIT_FAILURE);
+		}
+		Profile profile;
+		std::size_t index;
+		std::uint64_t count;
+		while (file >> index >> count) {
+			if (index >= profile.counts.size()) {
+				profile.counts.resize(index + 1);
+			}
+			profile.counts[index] = count;
+			profile.max_count = std::max(profile.max_count, count);
+		}
+		return profile;
+	}
+	std::uint64_t get_count(std::size_t index) const {
+		return index < counts.size() ? counts[index] : 0;
+	}
+	// at least 1/64 of the calls of the most frequently called function
+	bool is_hot(std::size_t index) const {
+		return get_count(index) > 0 && get_count(index) * 64 >= max_count;
+	}
+	// less than 1/4096 of the calls of the most frequently called function
+	bool is_cold(std::size_t index) const {
+		return get_count(index) * 4096 < max_count;
+	}
+};
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "printer.hpp"
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <type_traits>
+#include <sys/resource.h>
+
+// counters that are reported with --stats
+class Statistics {
+public:
+	static inline std::size_t specializations = 0;
+	static inline std::size_t specialization_cache_hits = 0;
+	static inline std::size_t parse_cache_hits = 0;
+	static inline std::size_t parse_cache_misses = 0;
+	static inline std::size_t common_subexpressions = 0;
+	static inline std::size_t evaluated_calls = 0;
+	// counted by the global operator new
+	static inline std::atomic<std::size_t> allocations{0};
+	class ProgramSize {
+	public:
+		std::size_t functions = 0;
+		std::size_t expressions = 0;
+		std::size_t types = 0;
+	};
+	// a pass or another phase of the compiler that is reported with --time-passes
+	class Phase {
+	public:
+		const char* name;
+		std::uint64_t microseconds = 0;
+		std::size_t allocations = 0;
+		// the peak resident set size of the compiler at the end of the phase
+		std::size_t peak_kilobytes = 0;
+		// only passes that produce a program record its size
+		bool has_sizes = false;
+		ProgramSize before;
+		ProgramSize after;
+	};
+	static inline bool time_phases = false;
+	static inline std::vector<Phase> phases;
+	static std::size_t get_peak_kilobytes() {
+		struct rusage usage;
+		if (getrusage(RUSAGE_SELF, &usage) != 0) {
+			return 0;
+		}
+		return usage.ru_maxrss;
+	}
+	class Timer {
+		std::chrono::steady_clock::time_point start;
+		std::size_t start_allocations;
+	public:
+		Timer(): start(std::chrono::steady_clock::now()), start_allocations(allocations.load(std::memory_order_relaxed)) {}
+		Phase stop(const char* name) const {
+			Phase phase;
+			phase.name = name;
+			phase.microseconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+			phase.allocations = allocations.load(std::memory_order_relaxed) - start_allocations;
+			phase.peak_kilobytes = get_peak_kilobytes();
+			return phase;
+		}
+	};
+	// runs f and records its cost as a phase if --time-passes is given
+	template <class F> static auto time(const char* name, F&& f) {
+		if (!time_phases) {
+			return f();
+		}
+		Timer timer;
+		if constexpr (std::is_void_v<decltype(f())>) {
+			f();
+			phases.push_back(timer.stop(name));
+		}
+		else {
+			auto result = f();
+			phases.push_back(timer.stop(name));
+			return result;
+		}
+	}
+	static void print(const Printer& printer) {
+		printer.print(format("specializations created: %\n", print_number(specializations)));
+		printer.print(format("specialization cache hits: %\n", print_number(specialization_cache_hits)));
+		printer.print(format("parse cache hits: %\n", print_number(parse_cache_hits)));
+		printer.print(format("parse cache misses: %\n", print_number(parse_cache_misses)));
+		printer.print(format("common subexpressions eliminated: %\n", print_number(common_subexpressions)));
+		printer.print(format("calls evaluated at compile time: %\n", print_number(evaluated_calls)));
+	}
+	static void print_size(const Printer& printer, const ProgramSize& size) {
+		printer.print(format("{\"functions\": %, \"expressions\": %, \"types\": %}", print_number(size.functions), print_number(size.expressions), print_number(size.types)));
+	}
+	// one JSON object with the counters and the phases in the order in which they ran
+	// the codegen phase includes the time of the C compiler, which is also reported as cc
+	static void print_json(const Printer& printer) {
+		printer.print("{\n");
+		printer.print("\t\"counters\": {\n");
+		printer.print(format("\t\t\"specializations\": %,\n", print_number(specializations)));
+		printer.print(format("\t\t\"specialization_cache_hits\": %,\n", print_number(specialization_cache_hits)));
+		printer.print(format("\t\t\"parse_cache_hits\": %,\n", print_number(parse_cache_hits)));
+		printer.print(format("\t\t\"parse_cache_misses\": %,\n", print_number(parse_cache_misses)));
+		printer.print(format("\t\t\"common_subexpressions\": %,\n", print_number(common_subexpressions)));
+		printer.print(format("\t\t\"evaluated_calls\": %\n", print_number(evaluated_calls)));
+		printer.print("\t},\n");
+		printer.print("\t\"phases\": [");
+		for (std::size_t i = 0; i < phases.size(); ++i) {
+			const Phase& phase = phases[i];
+			printer.print(i > 0 ? ",\n" : "\n");
+			printer.print(format("\t\t{\"name\": \"%\", \"microseconds\": %, \"allocations\": %, \"peak_rss_kilobytes\": %", phase.name, print_number(phase.microseconds), print_number(phase.allocations), print_number(phase.peak_kilobytes)));
+			if (phase.has_sizes) {
+				printer.print(", \"before\": ");
+				print_size(printer, phase.before);
+				printer.print(", \"after\": ");
+				print_size(printer, phase.after);
+			}
+			printer.print("}");
+		}
+		printer.print("\n\t]\n");
+		printer.print("}\n");
+	}
+};